@@ -692,6 +692,79 @@ dax_tag_mask(dax_state *ds, tag_handle handle, void *data, void *mask)
 }
 
 
+/*!
+ * Writes the data for several tag handles as a single operation.  This is
+ * the typed version of dax_multi_write().  Data formatting and BOOL bit
+ * offsets are handled the same way as dax_tag_write().  All of the data has
+ * to fit in a single message.
+ *
+ * @param ds Pointer to dax state object
+ * @param handles Array of handles that describe the data that we wish to write
+ * @param data Array of pointers to the data for each handle
+ * @param count Number of handles
+ * @returns Zero on success or an error code otherwise
+ */
+int
+dax_tag_multi_write(dax_state *ds, tag_handle *handles, void **data, int count)
+{
+    dax_write_item *items;
+    uint8_t *scratch, *newdata, *mask;
+    int i, n, j, result = 0, size, used = 0;
+
+    items = malloc(sizeof(dax_write_item) * count);
+    if(items == NULL) return ERR_ALLOC;
+    /* BOOL data that doesn't line up with a byte is turned into masked data
+     * in this scratch area.  If it won't fit here it won't fit in the message */
+    scratch = malloc(MSG_DATA_SIZE);
+    if(scratch == NULL) {
+        free(items);
+        return ERR_ALLOC;
+    }
+    for(j = 0; j < count; j++) {
+        items[j].idx = handles[j].index;
+        items[j].offset = handles[j].byte;
+        if(handles[j].type == DAX_BOOL && (handles[j].bit > 0 || handles[j].count % 8 )) {
+            size = handles[j].size;
+            if(handles[j].bit && !(handles[j].count % 8)) {
+                size++;
+            }
+            if(used + size * 2 > MSG_DATA_SIZE) {
+                result = ERR_2BIG;
+                break;
+            }
+            newdata = &scratch[used];
+            mask = &scratch[used + size];
+            used += size * 2;
+            bzero(newdata, size * 2);
+            i = handles[j].bit % 8;
+            for(n = 0; n < handles[j].count; n++) {
+                if( (0x01 << (n % 8)) & ((uint8_t *)data[j])[n / 8] ) {
+                    newdata[i / 8] |= (1 << (i % 8));
+                }
+                mask[i / 8] |= (1 << (i % 8));
+                i++;
+            }
+            items[j].size = size;
+            items[j].data = newdata;
+            items[j].mask = mask;
+        } else {
+            pthread_mutex_lock(&ds->lock);
+            result =  _write_format(ds, handles[j].type, handles[j].count, data[j], 0);
+            pthread_mutex_unlock(&ds->lock);
+            if(result) break;
+            items[j].size = handles[j].size;
+            items[j].data = data[j];
+            items[j].mask = NULL;
+        }
+    }
+    if(result == 0) {
+        result = dax_multi_write(ds, items, count);
+    }
+    free(scratch);
+    free(items);
+    return result;
+}
+
 /* These two functions walk through the given data using the handles in the group id
  * to send each element of the group the the formatting routines so that they can be
  * reformatted if need be to match the server.
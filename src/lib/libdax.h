@@ -83,6 +83,7 @@ struct tag_group_id {
     int count;           /* Number of tag handles in the group */
     int size;            /* Total size of the group's data in bytes */
     uint8_t options;    /* Not implemented yet */
+    uint8_t subscribed; /* Non-zero if the server is pushing this group to us */
     tag_handle *handles; /* Array of tag handles that describes the group */
 };
 
@@ -92,6 +93,7 @@ typedef struct tag_group_id tag_group_id;
 typedef struct event_db {
     uint32_t idx;  /* Tag index of the event */
     uint32_t id;   /* Individual id of the event */
+    uint32_t options; /* Last options sent to the server for this event */
     void *udata;    /* The user data to be sent with callback() */
     void (*callback)(dax_state *ds, void *udata);  /* Callback function */
     void (*free_callback)(void *udata); /* Callback to free userdata */
@@ -125,6 +127,7 @@ struct dax_state {
     int event_count;       /* Total number of events stored in the array */
     int event_data_size;   /* Size of the event data that is stored here */
     char *event_data;      /* Pointer to the event data that was returned */
+    char *event_stamp;     /* Pointer to the write stamp of the event, NULL if none */
     dax_message **emsg_queue; /* Event Message FIFO Queue */
     int emsg_queue_size;     /* Total size of the Event Message Queue */
     int emsg_queue_count;    /* number of entries in the event message queue */
@@ -109,6 +109,7 @@ add_event(dax_state *ds, dax_id id, void *udata, void (*callback)(dax_state *ds,
     /* TODO: Sort this array and add binary search to event_dispatch() */
     ds->events[ds->event_count].idx = id.index;
     ds->events[ds->event_count].id = id.id;
+    ds->events[ds->event_count].options = 0;
     ds->events[ds->event_count].udata = udata;
     ds->events[ds->event_count].callback = callback;
     ds->events[ds->event_count].free_callback = free_callback;
@@ -156,8 +157,15 @@ dispatch_event(dax_state *ds, dax_message *msg, dax_id *id)
     eid =      ntohl(*(uint32_t *)(&msg->data[4]));
     /* we just store the pointer to the message data in case the callback needs it
      * This data can be retrieved in the callback by dax_event_get_data() */
-    ds->event_data = &msg->data[8];
-    ds->event_data_size = msg->size-8;
+    if(msg->msg_type & MSG_EVENT_STAMP && msg->size >= 8 + EVENT_STAMP_SIZE) {
+        ds->event_stamp = &msg->data[8];
+        ds->event_data = &msg->data[8 + EVENT_STAMP_SIZE];
+        ds->event_data_size = msg->size - 8 - EVENT_STAMP_SIZE;
+    } else {
+        ds->event_stamp = NULL;
+        ds->event_data = &msg->data[8];
+        ds->event_data_size = msg->size-8;
+    }
     for(n = 0; n < ds->event_count; n ++) {
         if(ds->events[n].idx == idx && ds->events[n].id == eid) {
             if(ds->events[n].callback != NULL) {
@@ -168,10 +176,12 @@ dispatch_event(dax_state *ds, dax_message *msg, dax_id *id)
                 id->index = idx;
             }
             ds->event_data = NULL; /* This indicates that the data is out of scope now */
+            ds->event_stamp = NULL;
             return 0;
         }
     }
     ds->event_data = NULL; /* This indicates that the data is out of scope now */
+    ds->event_stamp = NULL;
     dax_log(DAX_LOG_ERROR, "dax_event_dispatch() received an event that does not exist in database");
     return ERR_GENERIC;
 }
@@ -295,3 +305,26 @@ dax_event_get_data(dax_state *ds, void* buff, int len) {
     memcpy(buff, ds->event_data, size);
     return size;
 }
+
+/*!
+ * Retrieves the time and writer of the write that caused the event.  The
+ * server only sends these if the EVENT_OPT_SEND_TIME option has been set
+ * on the event with dax_event_options().  Like dax_event_get_data() this
+ * is only valid inside the callback function.
+ *
+ * @param ds    Pointer to the dax state object
+ * @param stamp Pointer to the structure that will be filled in
+ * @returns     Zero on success, ERR_EMPTY if the event has no stamp or
+ *              ERR_DELETED if called outside the callback
+ */
+int
+dax_event_get_stamp(dax_state *ds, dax_stamp *stamp) {
+    if(ds->event_data == NULL) return ERR_DELETED;
+    if(ds->event_stamp == NULL) return ERR_EMPTY;
+    if(stamp == NULL) return ERR_ARG;
+
+    stamp->time = stom_lint(*((dax_lint *)&ds->event_stamp[0]));
+    stamp->mono = stom_ulint(*((dax_ulint *)&ds->event_stamp[8]));
+    stamp->writer = stom_dint(*((dax_dint *)&ds->event_stamp[16]));
+    return 0;
+}
@@ -71,6 +71,8 @@ dax_init(const char *name)
     ds->last_msg = NULL;
     ds->event_size = 1;
     ds->event_count = 0;
+    ds->event_data = NULL;
+    ds->event_stamp = NULL;
     /* Event Message FIFO Queue */
     ds->emsg_queue = malloc(sizeof(dax_message *)*EVENT_QUEUE_SIZE);
     ds->emsg_queue_size = EVENT_QUEUE_SIZE;     /* Total size of the Event Message Queue */
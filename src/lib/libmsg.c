@@ -524,6 +524,89 @@ dax_tag_add(dax_state *ds, tag_handle *h, char *name, tag_type type, int count,
     return result;
 }
 
+/*!
+ * Add a list of tags to the server.  The tags are sent to the server
+ * in as few messages as possible so this is much faster than calling
+ * dax_tag_add() for each tag when a module has a lot of tags to create.
+ * Each tag is added on it's own so some may fail while others succeed.
+ *
+ * @param ds Pointer to the dax state object
+ * @param h Pointer to an array of handles that will be filled in for
+ *          each tag that is added.  May be NULL.
+ * @param tags Array of tag definitions.  The name, type, count and attr
+ *             members are used to create the tag and the idx member is
+ *             set to the new tag's index or the error code for that tag.
+ * @param count Number of tags in the array
+ *
+ * @returns Zero if all of the tags were added, the error code of the
+ *          first tag that failed or an error code if the messages could
+ *          not be sent.
+ */
+int
+dax_tag_add_bulk(dax_state *ds, tag_handle *h, dax_tag *tags, int count)
+{
+    int result, first = 0, n, start, i;
+    size_t size, len;
+    uint16_t sent;
+    char buff[MSG_DATA_SIZE];
+
+    for(n = 0; n < count; n++) {
+        if(tags[n].count == 0) return ERR_ARG;
+        if((len = strlen(tags[n].name)) > DAX_TAGNAME_SIZE) return ERR_2BIG;
+        if(len == 0) return ERR_TAG_BAD;
+    }
+    pthread_mutex_lock(&ds->lock);
+    for(start = 0; start < count; start += sent) {
+        size = 2;
+        for(sent = 0; start + sent < count && sent < TAG_BULK_MAX; sent++) {
+            n = start + sent;
+            len = strlen(tags[n].name) + 1;
+            if(size + 12 + len > MSG_DATA_SIZE) break;
+            *((uint32_t *)&buff[size]) = mtos_udint(tags[n].type);
+            *((uint32_t *)&buff[size + 4]) = mtos_udint(tags[n].count);
+            *((uint32_t *)&buff[size + 8]) = mtos_udint(tags[n].attr);
+            memcpy(&buff[size + 12], tags[n].name, len);
+            size += 12 + len;
+        }
+        *((uint16_t *)&buff[0]) = mtos_uint(sent);
+        result = _message_send(ds, MSG_TAG_ADD_BULK, buff, size);
+        if(result) {
+            pthread_mutex_unlock(&ds->lock);
+            return result;
+        }
+        size = sent * sizeof(int32_t);
+        result = _message_recv(ds, MSG_TAG_ADD_BULK, buff, &size, 1);
+        if(result) {
+            pthread_mutex_unlock(&ds->lock);
+            return result;
+        }
+        for(i = 0; i < sent; i++) {
+            n = start + i;
+            tags[n].idx = stom_dint(*((int32_t *)&buff[i * sizeof(int32_t)]));
+            if(tags[n].idx < 0) {
+                if(first == 0) first = tags[n].idx;
+                continue;
+            }
+            if(h != NULL) {
+                h[n].index = tags[n].idx;
+                h[n].byte = 0;
+                h[n].bit = 0;
+                h[n].type = tags[n].type;
+                h[n].count = tags[n].count;
+                if(tags[n].type == DAX_BOOL) {
+                    h[n].size = (tags[n].count - 1)/8 +1;
+                } else {
+                    h[n].size = tags[n].count * dax_get_typesize(ds, tags[n].type);
+                }
+            }
+            cache_tag_del(ds, tags[n].idx);
+            cache_tag_add(ds, &tags[n]);
+        }
+    }
+    pthread_mutex_unlock(&ds->lock);
+    return first;
+}
+
 /*!
  * Delete a tag from the tagserver.
  *
@@ -659,6 +742,247 @@ dax_tag_byindex(dax_state *ds, dax_tag *tag, tag_index idx)
     return 0;
 }
 
+/*!
+ * Retrieve a list of tags by name.  Tags that are already in the
+ * tag cache are not requested from the server and the rest are retrieved
+ * in as few messages as possible.
+ *
+ * @param ds Pointer to the dax state object
+ * @param tags Array of structures that this function will fill with
+ *             each tag's information.  If a tag is not found the idx
+ *             member is set to the error code.
+ * @param names Array of the names of the tags that we are requesting
+ * @param count Number of tags in the arrays
+ *
+ * @returns Zero if all of the tags were found, the error code of the
+ *          first tag that was not found or an error code if the messages
+ *          could not be sent.
+ */
+int
+dax_tag_get_bulk(dax_state *ds, dax_tag *tags, char **names, int count)
+{
+    int result, first = 0, n, i, start;
+    int pos[TAG_BULK_MAX];
+    size_t size, len;
+    uint16_t sent;
+    char buff[MSG_DATA_SIZE];
+
+    if(names == NULL || tags == NULL) return ERR_ARG;
+
+    pthread_mutex_lock(&ds->lock);
+    for(start = 0; start < count; start = n) {
+        size = 2;
+        sent = 0;
+        for(n = start; n < count && sent < TAG_BULK_MAX; n++) {
+            len = strlen(names[n]);
+            if(len > DAX_TAGNAME_SIZE || len == 0) {
+                tags[n].idx = len ? ERR_2BIG : ERR_NOTFOUND;
+                if(first == 0) first = tags[n].idx;
+                continue;
+            }
+            if(check_cache_name(ds, names[n], &tags[n]) == 0) continue;
+            if(size + len + 1 > MSG_DATA_SIZE) break;
+            memcpy(&buff[size], names[n], len + 1);
+            size += len + 1;
+            pos[sent++] = n;
+        }
+        if(sent == 0) continue;
+        *((uint16_t *)&buff[0]) = mtos_uint(sent);
+        result = _message_send(ds, MSG_TAG_GET_BULK, buff, size);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Can't send MSG_TAG_GET_BULK message");
+            pthread_mutex_unlock(&ds->lock);
+            return result;
+        }
+        size = sent * TAG_BULK_SIZE;
+        result = _message_recv(ds, MSG_TAG_GET_BULK, buff, &size, 1);
+        if(result) {
+            pthread_mutex_unlock(&ds->lock);
+            return result;
+        }
+        for(i = 0; i < sent; i++) {
+            dax_tag *tag = &tags[pos[i]];
+
+            tag->idx = stom_dint(*((int32_t *)&buff[i * TAG_BULK_SIZE]));
+            if(tag->idx < 0) {
+                if(first == 0) first = tag->idx;
+                continue;
+            }
+            tag->type = stom_udint(*((uint32_t *)&buff[i * TAG_BULK_SIZE + 4]));
+            tag->count = stom_udint(*((uint32_t *)&buff[i * TAG_BULK_SIZE + 8]));
+            tag->attr = stom_uint(*((uint16_t *)&buff[i * TAG_BULK_SIZE + 12]));
+            strcpy(tag->name, names[pos[i]]);
+            cache_tag_add(ds, tag);
+        }
+    }
+    pthread_mutex_unlock(&ds->lock);
+    return first;
+}
+
+/*!
+ * Retrieve one page of the tag list from the server.  The server returns as
+ * many tags as will fit in a single message starting at the index given by
+ * start.  Deleted tags and tags that do not match the filter are skipped.
+ *
+ * @param ds Pointer to the dax state object
+ * @param start Pointer to the index to start the list at.  This is set
+ *              to the index where the next page starts or TAG_LIST_DONE
+ *              (-1) if there are no more tags.
+ * @param filter Shell style wildcard pattern (e.g. "Motor*") that the tag
+ *               names have to match.  NULL or empty lists all tags.
+ * @param tags Array of structures that will be filled with the tags
+ * @param count Pointer to the size of the tags array.  It is set to the
+ *              number of tags that were returned.
+ *
+ * @returns Zero on success or an error code otherwise
+ */
+int
+dax_tag_list(dax_state *ds, tag_index *start, char *filter, dax_tag *tags, int *count)
+{
+    int result, n;
+    size_t size, offset;
+    char buff[MSG_DATA_SIZE];
+
+    if(start == NULL || tags == NULL || count == NULL) return ERR_ARG;
+    *((tag_index *)&buff[0]) = mtos_dint(*start);
+    *((uint16_t *)&buff[4]) = mtos_uint(*count > 0xFFFF ? 0xFFFF : *count);
+    size = 6;
+    if(filter != NULL) {
+        if(strlen(filter) + 7 > MSG_DATA_SIZE) return ERR_2BIG;
+        strcpy(&buff[6], filter);
+        size += strlen(filter) + 1;
+    }
+
+    pthread_mutex_lock(&ds->lock);
+    result = _message_send(ds, MSG_TAG_LIST, buff, size);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+    size = MSG_DATA_SIZE;
+    result = _message_recv(ds, MSG_TAG_LIST, buff, &size, 1);
+    pthread_mutex_unlock(&ds->lock);
+    if(result) return result;
+
+    *start = stom_dint(*((tag_index *)&buff[0]));
+    *count = stom_uint(*((uint16_t *)&buff[4]));
+    offset = 6;
+    for(n = 0; n < *count; n++) {
+        if(offset + 15 > size) return ERR_MSG_BAD;
+        tags[n].idx = stom_dint(*((int32_t *)&buff[offset]));
+        tags[n].type = stom_udint(*((uint32_t *)&buff[offset + 4]));
+        tags[n].count = stom_udint(*((uint32_t *)&buff[offset + 8]));
+        tags[n].attr = stom_uint(*((uint16_t *)&buff[offset + 12]));
+        strncpy(tags[n].name, &buff[offset + 14], DAX_TAGNAME_SIZE);
+        tags[n].name[DAX_TAGNAME_SIZE] = '\0';
+        offset += 15 + strlen(&buff[offset + 14]);
+    }
+    return 0;
+}
+
+/*!
+ * Iterate through all of the tags in the server that match the filter.  The
+ * tags are retrieved a page at a time with dax_tag_list() and the callback
+ * function is called once for each tag.
+ *
+ * @param ds Pointer to the dax state object
+ * @param filter Shell style wildcard pattern that the tag names have to
+ *               match.  NULL or empty lists all tags.
+ * @param udata User data that will be passed to the callback function
+ * @param callback Function that will be called for each tag
+ *
+ * @returns Zero on success or an error code otherwise
+ */
+int
+dax_tag_iter(dax_state *ds, char *filter, void *udata, void (*callback)(dax_tag *tag, void *udata))
+{
+    dax_tag tags[MSG_DATA_SIZE / 15];
+    tag_index start = 0;
+    int result, count, n;
+
+    if(callback == NULL) return ERR_ARG;
+    while(start != TAG_LIST_DONE) {
+        count = MSG_DATA_SIZE / 15;
+        result = dax_tag_list(ds, &start, filter, tags, &count);
+        if(result) return result;
+        for(n = 0; n < count; n++) {
+            callback(&tags[n], udata);
+        }
+    }
+    return 0;
+}
+
+/*!
+ * Retrieve the list of tag changes that have happened since the given
+ * journal sequence number.  The server keeps a limited number of changes
+ * so a module that has been gone for too long is told to resync.  Modules
+ * that want to resync efficiently after a reconnect should call this once
+ * with a sequence number of zero when they start to get the current
+ * sequence number, read what they need, and then keep the sequence
+ * number up to date by calling this function periodically or after a
+ * reconnect.
+ *
+ * @param ds Pointer to the dax state object
+ * @param seq Pointer to the sequence number of the last change that the
+ *            module has seen.  It is updated to the sequence number of the
+ *            last change that was returned.
+ * @param changes Array that will be filled with the changes
+ * @param count Pointer to the size of the changes array.  It is set to
+ *              the number of changes that were returned.  If it comes back
+ *              equal to the size of the array there may be more changes.
+ *
+ * @returns Zero on success, ERR_OVERFLOW if the server no longer has all
+ *          of the changes since seq or tags have been added or deleted
+ *          since then, or an error code otherwise.  When
+ *          ERR_OVERFLOW is returned seq is set to the server's current
+ *          sequence number and the module should read all of its tags.
+ */
+int
+dax_changes_since(dax_state *ds, uint64_t *seq, dax_change *changes, int *count)
+{
+    int result, n, max, got, total = 0;
+    size_t size;
+    char buff[MSG_DATA_SIZE];
+
+    if(seq == NULL || changes == NULL || count == NULL || *count < 0) return ERR_ARG;
+    /* We keep asking until the array is full or the server runs out */
+    do {
+        max = MIN(*count - total, CHANGES_MAX);
+        *((uint64_t *)&buff[0]) = mtos_ulint(*seq);
+        *((uint16_t *)&buff[8]) = mtos_uint(max);
+
+        pthread_mutex_lock(&ds->lock);
+        result = _message_send(ds, MSG_CHANGES_SINCE, buff, 10);
+        if(result) {
+            pthread_mutex_unlock(&ds->lock);
+            return result;
+        }
+        size = MSG_DATA_SIZE;
+        result = _message_recv(ds, MSG_CHANGES_SINCE, buff, &size, 1);
+        pthread_mutex_unlock(&ds->lock);
+        if(result) return result;
+        if(size < CHANGES_HEADER_SIZE) return ERR_MSG_BAD;
+
+        result = stom_dint(*((int32_t *)&buff[0]));
+        *seq = stom_ulint(*((uint64_t *)&buff[4]));
+        got = stom_uint(*((uint16_t *)&buff[12]));
+        if(result) {
+            *count = 0;
+            return result;
+        }
+        if(got > max || CHANGES_HEADER_SIZE + got * CHANGES_ENTRY_SIZE > size) return ERR_MSG_BAD;
+        for(n = 0; n < got; n++) {
+            char *p = &buff[CHANGES_HEADER_SIZE + n * CHANGES_ENTRY_SIZE];
+            changes[total + n].idx = stom_dint(*((int32_t *)&p[0]));
+            changes[total + n].byte = stom_udint(*((uint32_t *)&p[4]));
+            changes[total + n].size = stom_udint(*((uint32_t *)&p[8]));
+        }
+        total += got;
+    } while(got == max && total < *count);
+    *count = total;
+    return 0;
+}
+
 /*!
  * Raw low level database read.  The data will be retrieved exactly
  * like it appears in the server.  It is up to the module to convert
@@ -819,6 +1143,149 @@ dax_mask(dax_state *ds, tag_index idx, uint32_t offset, void *data, void *mask,
     return 0;
 }
 
+/*!
+ * Writes several pieces of raw data to the server in a single message.  The
+ * server writes all of the data before any events are sent or mappings are
+ * followed so other modules never see only part of the data changed.  If any
+ * item is bad nothing is written.  Like dax_write() the data is assumed to
+ * already be in the server's number format.
+ *
+ * @param ds Pointer to the dax state object.
+ * @param items Array of items that describe the data to write
+ * @param count Number of items in the array
+ *
+ * @returns Zero upon success or an error code otherwise
+ */
+int
+dax_multi_write(dax_state *ds, dax_write_item *items, int count)
+{
+    size_t sendsize;
+    uint8_t buff[MSG_DATA_SIZE];
+    int n, result;
+
+    if(count > 0xFFFF) return ERR_2BIG;
+    *((uint16_t *)&buff[0]) = mtos_uint(count);
+    sendsize = 2;
+    for(n = 0; n < count; n++) {
+        if(sendsize + 13 + items[n].size * (items[n].mask ? 2 : 1) > MSG_DATA_SIZE) {
+            return ERR_2BIG;
+        }
+        *((tag_index *)&buff[sendsize]) = mtos_dint(items[n].idx);
+        *((uint32_t *)&buff[sendsize + 4]) = mtos_udint(items[n].offset);
+        *((uint32_t *)&buff[sendsize + 8]) = mtos_udint(items[n].size);
+        buff[sendsize + 12] = items[n].mask ? MULTI_WRITE_MASK : 0x00;
+        sendsize += 13;
+        memcpy(&buff[sendsize], items[n].data, items[n].size);
+        sendsize += items[n].size;
+        if(items[n].mask) {
+            memcpy(&buff[sendsize], items[n].mask, items[n].size);
+            sendsize += items[n].size;
+        }
+    }
+
+    pthread_mutex_lock(&ds->lock);
+    result = _message_send(ds, MSG_TAG_MULTI_WRITE, buff, sendsize);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+    result = _message_recv(ds, MSG_TAG_MULTI_WRITE, buff, 0, 1);
+    pthread_mutex_unlock(&ds->lock);
+    return result;
+}
+
+/*!
+ * Adds several items to a queue tag.  As many items as will fit are sent
+ * in each message and each message is added to the queue as a single
+ * operation.  Modules that have a write event on the queue only get one
+ * event for each message so they should read until the queue is empty.
+ * Like dax_write() the data is assumed to already be in the server's
+ * number format.
+ *
+ * @param ds Pointer to the dax state object.
+ * @param h Handle of the queue tag
+ * @param data Pointer to 'count' items back to back
+ * @param count Number of items to add
+ *
+ * @returns Zero upon success or an error code otherwise
+ */
+int
+dax_queue_write(dax_state *ds, tag_handle h, void *data, int count)
+{
+    uint8_t buff[MSG_DATA_SIZE];
+    int result, chunk, max, n = 0;
+
+    if(h.size == 0 || count <= 0) return ERR_ARG;
+    max = MIN((MSG_DATA_SIZE - 6) / h.size, 0xFFFF);
+    if(max == 0) return ERR_2BIG;
+
+    while(n < count) {
+        chunk = MIN(count - n, max);
+        *((tag_index *)&buff[0]) = mtos_dint(h.index);
+        *((uint16_t *)&buff[4]) = mtos_uint(chunk);
+        memcpy(&buff[6], &((uint8_t *)data)[n * h.size], chunk * h.size);
+
+        pthread_mutex_lock(&ds->lock);
+        result = _message_send(ds, MSG_QUEUE_WRITE, buff, 6 + chunk * h.size);
+        if(result == 0) {
+            result = _message_recv(ds, MSG_QUEUE_WRITE, buff, 0, 1);
+        }
+        pthread_mutex_unlock(&ds->lock);
+        if(result) return result;
+        n += chunk;
+    }
+    return 0;
+}
+
+/*!
+ * Removes up to *count items from a queue tag.  The server sends as many
+ * items as will fit in each message so this is much faster than reading
+ * one item at a time with dax_read_tag() when the queue is busy.
+ *
+ * @param ds Pointer to the dax state object.
+ * @param h Handle of the queue tag
+ * @param data Pointer to a buffer that can hold *count items
+ * @param count Pointer to the maximum number of items to read.  It is set
+ *              to the number of items that were actually read.
+ *
+ * @returns Zero upon success, ERR_EMPTY if the queue was empty or an
+ *          error code otherwise
+ */
+int
+dax_queue_read(dax_state *ds, tag_handle h, void *data, int *count)
+{
+    uint8_t buff[MSG_DATA_SIZE];
+    int result, chunk, got, max, n = 0;
+    size_t size;
+
+    if(h.size == 0 || count == NULL || *count <= 0) return ERR_ARG;
+    max = MIN((MSG_DATA_SIZE - 2) / h.size, 0xFFFF);
+    if(max == 0) return ERR_2BIG;
+
+    while(n < *count) {
+        chunk = MIN(*count - n, max);
+        *((tag_index *)&buff[0]) = mtos_dint(h.index);
+        *((uint16_t *)&buff[4]) = mtos_uint(chunk);
+
+        pthread_mutex_lock(&ds->lock);
+        result = _message_send(ds, MSG_QUEUE_READ, buff, 6);
+        if(result == 0) {
+            size = MSG_DATA_SIZE;
+            result = _message_recv(ds, MSG_QUEUE_READ, buff, &size, 1);
+        }
+        pthread_mutex_unlock(&ds->lock);
+        if(result == ERR_EMPTY) break;
+        if(result) return result;
+        got = stom_uint(*((uint16_t *)&buff[0]));
+        if(got > chunk || 2 + got * h.size > size) return ERR_MSG_BAD;
+        memcpy(&((uint8_t *)data)[n * h.size], &buff[2], got * h.size);
+        n += got;
+        if(got < chunk) break; /* The queue is empty now */
+    }
+    *count = n;
+    return n ? 0 : ERR_EMPTY;
+}
+
 /*!
  * Used to add an override to the given tag
  * @param ds Pointer to the dax state object.
@@ -1131,6 +1598,191 @@ dax_atomic_op(dax_state *ds, tag_handle h, void *data, uint16_t operation) {
     return 0;
 }
 
+/* Returns the size of the old data that the server sends back for a
+ * fetch or compare and swap operation */
+static int
+_atomic_fetch_size(tag_handle h) {
+    if(h.type == DAX_BOOL) return (h.count - 1)/8 + 1;
+    return h.size;
+}
+
+/* Compare and swap always returns the old data */
+static int
+_atomic_is_fetch(uint16_t operation) {
+    return (operation & ATOMIC_OP_FETCH) || ((operation & ~ATOMIC_OP_FETCH) == ATOMIC_OP_CAS);
+}
+
+/*!
+ * Same as dax_atomic_op() except that the data as it was just before the
+ * operation was applied is returned.  This makes it possible to implement
+ * things like shared counters without another read round trip.
+ *
+ * @param ds Pointer to the dax state object
+ * @param h  Handle that represents the data to apply the operation to.
+ * @param data Any data that may be required by this operation.
+ * @param operation Number representing the operation that we wish to perform.
+ *                  ATOMIC_OP_FETCH is added automatically.
+ * @param old Pointer to a buffer that will receive the old data.  BOOL data
+ *            is returned starting at bit zero of the first byte.
+ *
+ * @returns Zero on success or an error code otherwise.
+ */
+int
+dax_atomic_fetch_op(dax_state *ds, tag_handle h, void *data, uint16_t operation, void *old) {
+    size_t sendsize, size;
+    int result;
+    uint8_t buff[MSG_DATA_SIZE];
+
+    operation |= ATOMIC_OP_FETCH;
+    /* Compare and swap sends twice the data */
+    if((operation & ~ATOMIC_OP_FETCH) == ATOMIC_OP_CAS) {
+        sendsize = h.size * 2 + 21;
+    } else {
+        sendsize = h.size + 21;
+    }
+    if(sendsize > MSG_DATA_SIZE) {
+        return ERR_2BIG;
+    }
+    if(IS_CUSTOM(h.type)) {
+        return ERR_ILLEGAL;
+    }
+    *(dax_dint *)buff = mtos_dint(h.index);       /* Index */
+    *(dax_dint *)&buff[4] = mtos_dint(h.byte);    /* Byte offset */
+    *(dax_dint *)&buff[8] = mtos_dint(h.count);   /* Tag Count */
+    *(dax_dint *)&buff[12] = mtos_dint(h.type);   /* Data Type */
+    buff[16]=h.bit;                               /* Bit offset */
+    *(dax_uint *)&buff[17] = mtos_uint(operation);/* Operation */
+
+    if(data != NULL) {
+        memcpy(&buff[21], data, sendsize - 21);
+    } else {
+        bzero(&buff[21], sendsize - 21);
+    }
+
+    pthread_mutex_lock(&ds->lock);
+    result = _message_send(ds, MSG_ATOMIC_OP, buff, sendsize);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+    size = MSG_DATA_SIZE;
+    result = _message_recv(ds, MSG_ATOMIC_OP, buff, &size, 1);
+    pthread_mutex_unlock(&ds->lock);
+    if(result) {
+        if(result == ERR_DELETED) {
+            cache_tag_del(ds, h.index);
+        }
+        return result;
+    }
+    if(size < _atomic_fetch_size(h) + 4) return ERR_MSG_BAD;
+    if(old != NULL) memcpy(old, &buff[4], _atomic_fetch_size(h));
+    /* A non-zero result means a compare and swap did not match */
+    if(stom_dint(*(dax_dint *)buff)) return ERR_INUSE;
+    return 0;
+}
+
+/*!
+ * Compare and swap.  If the data that the handle points to is equal to
+ * 'expected' then it is replaced with 'newdata'.  The comparison is done
+ * bitwise so REAL values must match exactly.
+ *
+ * @param ds Pointer to the dax state object
+ * @param h  Handle that represents the data to compare and swap
+ * @param expected The data that we expect to be in the tag
+ * @param newdata  The data that will be written if the expected data matches
+ * @param old Pointer to a buffer that will receive the data that was in the
+ *            tag before the operation.  Can be NULL.
+ *
+ * @returns Zero if the data was swapped, ERR_INUSE if the data did not
+ *          match or an error code otherwise.
+ */
+int
+dax_atomic_cas(dax_state *ds, tag_handle h, void *expected, void *newdata, void *old) {
+    uint8_t buff[MSG_DATA_SIZE];
+
+    if(h.size * 2 > MSG_DATA_SIZE) return ERR_2BIG;
+    memcpy(buff, expected, h.size);
+    memcpy(&buff[h.size], newdata, h.size);
+    return dax_atomic_fetch_op(ds, h, buff, ATOMIC_OP_CAS, old);
+}
+
+/*!
+ * Apply a list of atomic operations in a single message.  The server
+ * applies them in order during one dispatch so no other module can see or
+ * change the data in between.  A failure in one operation does not stop
+ * the others.  The result of each operation is stored in the 'result' member
+ * of the operation.  For compare and swap operations the result is ERR_INUSE
+ * if the data did not match.
+ *
+ * @param ds Pointer to the dax state object
+ * @param ops Array of operations
+ * @param count Number of operations in the array
+ *
+ * @returns Zero if the message was handled or an error code otherwise.  The
+ *          individual operations may still have failed.
+ */
+int
+dax_atomic_batch(dax_state *ds, dax_atomic *ops, int count) {
+    int n, offset, datasize, result;
+    size_t size;
+    tag_handle h;
+    uint8_t buff[MSG_DATA_SIZE];
+
+    if(count > 0xFFFF) return ERR_2BIG;
+    *(uint16_t *)buff = mtos_uint(count);
+    offset = 2;
+    for(n = 0; n < count; n++) {
+        h = ops[n].h;
+        if(IS_CUSTOM(h.type)) return ERR_ILLEGAL;
+        if((ops[n].operation & ~ATOMIC_OP_FETCH) == ATOMIC_OP_CAS) {
+            datasize = h.size * 2;
+        } else {
+            datasize = h.size;
+        }
+        if(offset + 25 + datasize > MSG_DATA_SIZE) return ERR_2BIG;
+        *(dax_dint *)&buff[offset] = mtos_dint(h.index);
+        *(dax_dint *)&buff[offset + 4] = mtos_dint(h.byte);
+        *(dax_dint *)&buff[offset + 8] = mtos_dint(h.count);
+        *(dax_dint *)&buff[offset + 12] = mtos_dint(h.type);
+        buff[offset + 16] = h.bit;
+        *(dax_uint *)&buff[offset + 17] = mtos_uint(ops[n].operation);
+        *(dax_dint *)&buff[offset + 21] = mtos_dint(datasize);
+        offset += 25;
+        if(ops[n].data != NULL) {
+            memcpy(&buff[offset], ops[n].data, datasize);
+        } else {
+            bzero(&buff[offset], datasize);
+        }
+        offset += datasize;
+    }
+
+    pthread_mutex_lock(&ds->lock);
+    result = _message_send(ds, MSG_ATOMIC_BATCH, buff, offset);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+    size = MSG_DATA_SIZE;
+    result = _message_recv(ds, MSG_ATOMIC_BATCH, buff, &size, 1);
+    pthread_mutex_unlock(&ds->lock);
+    if(result) return result;
+
+    offset = 0;
+    for(n = 0; n < count; n++) {
+        if(offset + 4 > size) return ERR_MSG_BAD;
+        ops[n].result = stom_dint(*(dax_dint *)&buff[offset]);
+        offset += 4;
+        if(ops[n].result >= 0 && _atomic_is_fetch(ops[n].operation)) {
+            datasize = _atomic_fetch_size(ops[n].h);
+            if(offset + datasize > size) return ERR_MSG_BAD;
+            if(ops[n].old != NULL) memcpy(ops[n].old, &buff[offset], datasize);
+            offset += datasize;
+        }
+        if(ops[n].result > 0) ops[n].result = ERR_INUSE;
+    }
+    return 0;
+}
+
 /*!
  * Add an event to the tag server.  An event is triggered when the conditions
  * given become true.
@@ -1286,7 +1938,7 @@ dax_event_get(dax_state *ds, dax_id id)
 int
 dax_event_options(dax_state *ds, dax_id id, uint32_t options)
 {
-    int test;
+    int test, n;
     size_t size;
     dax_dint result;
     dax_dint temp;
@@ -1307,6 +1959,14 @@ dax_event_options(dax_state *ds, dax_id id, uint32_t options)
         return result;
     } else {
         test = _message_recv(ds, MSG_EVNT_OPT, &result, &size, 1);
+        if(test == 0) {
+            /* Keep track of these for dax_event_interval() */
+            for(n = 0; n < ds->event_count; n++) {
+                if(ds->events[n].idx == id.index && ds->events[n].id == id.id) {
+                    ds->events[n].options = options;
+                }
+            }
+        }
         pthread_mutex_unlock(&ds->lock);
         return test;
     }
@@ -1314,6 +1974,61 @@ dax_event_options(dax_state *ds, dax_id id, uint32_t options)
     return 0;
 }
 
+/*!
+ * Set the minimum interval between events.  Events that hit inside the
+ * interval are dropped unless the EVENT_OPT_COALESCE option has been set
+ * with dax_event_options(), in which case a single event carrying the
+ * latest data is sent when the interval expires.  This is only allowed
+ * for EVENT_WRITE and EVENT_CHANGE events.
+ *
+ * @param ds Pointer to the dax state object.
+ * @param id The identifier of the event.
+ * @param interval Minimum time between events in milliseconds.  Zero
+ *                 removes the limit.
+ *
+ * @returns Zero on success or an error code otherwise
+ */
+int
+dax_event_interval(dax_state *ds, dax_id id, uint32_t interval)
+{
+    int test;
+    size_t size;
+    dax_dint result;
+    dax_dint temp;
+    dax_udint u_temp;
+    char buff[MSG_DATA_SIZE];
+    int n;
+
+    /* The server sets the options and the interval in the same message
+     * so we have to send the options that are already there. */
+    pthread_mutex_lock(&ds->lock);
+    for(n = 0; n < ds->event_count; n++) {
+        if(ds->events[n].idx == id.index && ds->events[n].id == id.id) break;
+    }
+    if(n == ds->event_count) {
+        pthread_mutex_unlock(&ds->lock);
+        return ERR_NOTFOUND;
+    }
+    temp = mtos_dint(id.index);      /* Tag Index */
+    memcpy(buff, &temp, 4);
+    temp = mtos_dint(id.id);         /* Event ID */
+    memcpy(&buff[4], &temp, 4);
+    temp = mtos_dint(ds->events[n].options); /* Options */
+    memcpy(&buff[8], &temp, 4);
+    u_temp = mtos_udint(interval);   /* Interval */
+    memcpy(&buff[12], &u_temp, 4);
+    size = 16;
+
+    result = _message_send(ds, MSG_EVNT_OPT, buff, size);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+    test = _message_recv(ds, MSG_EVNT_OPT, &result, &size, 1);
+    pthread_mutex_unlock(&ds->lock);
+    return test;
+}
+
 /*!
  * Write the compound datatype to the server and free the memory
  * associated with it.  This is the last function to be called during
@@ -1696,6 +2411,7 @@ dax_group_add(dax_state *ds, int *result, tag_handle *h, int count, uint8_t opti
         id->index = *(uint32_t *)buff;
         id->count = count;
         id->options = options;
+        id->subscribed = 0;
         id->size = group_size;
     }
     pthread_mutex_unlock(&ds->lock);
@@ -1787,6 +2503,17 @@ dax_group_write(dax_state *ds, tag_group_id *id, void *data) {
     return result;
 }
 
+/* Removes the local event entry for a group subscription */
+static void
+_group_event_del(dax_state *ds, tag_group_id *id) {
+    dax_id eid;
+
+    eid.index = id->index;
+    eid.id = GROUP_EVENT_ID;
+    del_event(ds, eid);
+    id->subscribed = 0;
+}
+
 /*!
  * Deletes a tag data group from the server.
  *
@@ -1813,6 +2540,8 @@ dax_group_del(dax_state *ds, tag_group_id *id) {
 
      result = _message_recv(ds, MSG_GRP_DEL, NULL, 0, 1);
      if(result == 0) {
+         /* The server drops the subscription with the group */
+         if(id->subscribed) _group_event_del(ds, id);
          free(id->handles);
          free(id);
      }
@@ -1820,3 +2549,113 @@ dax_group_del(dax_state *ds, tag_group_id *id) {
      return result;
 }
 
+/*!
+ * Subscribe to a tag data group.  Whenever any member of the group is
+ * written the server will push the entire group data to us as a single
+ * event instead of having to add events to every member and then read the
+ * group.  The callback is dispatched the same way as other events with
+ * dax_event_wait() or dax_event_poll() and the data can be retrieved inside
+ * the callback with dax_group_get_data().  Calling this function on a group
+ * that is already subscribed will just change the interval.
+ *
+ * @param ds       Pointer to the dax state object
+ * @param id       Pointer to the tag group id returned by dax_group_add()
+ * @param interval Minimum time in milliseconds between pushes.  Writes that
+ *                 happen inside the interval are coalesced into one push
+ *                 with the latest data.  Zero pushes on every write.
+ * @param callback Function that will be called when the group is pushed
+ * @param udata    Pointer to user data that will be passed to the callback
+ * @param free_callback Function that will be called to free udata when the
+ *                 subscription is removed.  Can be NULL.
+ * @returns        0 on success an error code otherwise
+ */
+int
+dax_group_subscribe(dax_state *ds, tag_group_id *id, uint32_t interval,
+                    void (*callback)(dax_state *ds, void *udata),
+                    void *udata, void (*free_callback)(void *udata)) {
+    int result;
+    uint32_t u_temp;
+    char buff[9];
+    dax_id eid;
+
+    u_temp = mtos_udint(id->index);
+    memcpy(buff, &u_temp, 4);
+    buff[4] = GRP_SUB_ENABLE;
+    u_temp = mtos_udint(interval);
+    memcpy(&buff[5], &u_temp, 4);
+
+    pthread_mutex_lock(&ds->lock);
+    result = _message_send(ds, MSG_GRP_SUB, buff, 9);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+
+    result = _message_recv(ds, MSG_GRP_SUB, NULL, 0, 1);
+    if(result == 0) {
+        if(id->subscribed) _group_event_del(ds, id);
+        eid.index = id->index;
+        eid.id = GROUP_EVENT_ID;
+        result = add_event(ds, eid, udata, callback, free_callback);
+        if(result == 0) id->subscribed = 1;
+    }
+    pthread_mutex_unlock(&ds->lock);
+    return result;
+}
+
+/*!
+ * Stop the server from pushing the tag data group.
+ *
+ * @param ds      Pointer to the dax state object
+ * @param id      Pointer to the tag group id returned by dax_group_add()
+ * @returns       0 on success an error code otherwise
+ */
+int
+dax_group_unsubscribe(dax_state *ds, tag_group_id *id) {
+    int result;
+    uint32_t u_temp;
+    char buff[9];
+
+    if(! id->subscribed) return ERR_NOTFOUND;
+    u_temp = mtos_udint(id->index);
+    memcpy(buff, &u_temp, 4);
+    buff[4] = 0x00;
+    memset(&buff[5], 0, 4);
+
+    pthread_mutex_lock(&ds->lock);
+    result = _message_send(ds, MSG_GRP_SUB, buff, 9);
+    if(result) {
+        pthread_mutex_unlock(&ds->lock);
+        return result;
+    }
+
+    result = _message_recv(ds, MSG_GRP_SUB, NULL, 0, 1);
+    if(result == 0) {
+        _group_event_del(ds, id);
+    }
+    pthread_mutex_unlock(&ds->lock);
+    return result;
+}
+
+/*!
+ * Retrieves the group data that was pushed by the server for a subscribed
+ * group.  Like dax_event_get_data() this is meant to be called from inside
+ * the callback function and the data goes out of scope when the callback
+ * returns.  The data is converted to the module's format.
+ *
+ * @param ds      Pointer to the dax state object
+ * @param id      Pointer to the tag group id returned by dax_group_add()
+ * @param buff    Pointer to a buffer that will receive the data
+ * @param size    Size of the above buffer
+ * @returns       0 on success an error code otherwise
+ */
+int
+dax_group_get_data(dax_state *ds, tag_group_id *id, void *buff, size_t size) {
+    int result;
+
+    if(size < id->size) return ERR_ARG;
+    result = dax_event_get_data(ds, buff, id->size);
+    if(result < 0) return result;
+    if(result != id->size) return ERR_GENERIC;
+    return group_read_format(ds, id, buff);
+}
@@ -53,14 +53,23 @@
 #define MSG_DEL_OVRD    0x0019 /* Delete override */
 #define MSG_GET_OVRD    0x001A /* Read the current override mask and raw value for the given tag */
 #define MSG_SET_OVRD    0x001B /* Set or clear tag override flag */
+#define MSG_GRP_SUB     0x001C /* Subscribe / unsubscribe to pushed tag group data */
+#define MSG_ATOMIC_BATCH 0x001D /* Perform a list of atomic operations in one message */
+#define MSG_TAG_MULTI_WRITE 0x001E /* Write data to several tags as a single operation */
+#define MSG_TAG_ADD_BULK 0x001F /* Add a list of tags in one message */
+#define MSG_TAG_GET_BULK 0x0020 /* Retrieve the definitions of a list of tags by name */
+#define MSG_CHANGES_SINCE 0x0021 /* Retrieve the tag changes since a journal sequence number */
+#define MSG_QUEUE_WRITE 0x0022 /* Add a list of items to a queue tag */
+#define MSG_QUEUE_READ  0x0023 /* Remove up to a given number of items from a queue tag */
 
 /* More to come */
 
-#define NUM_COMMANDS 27
+#define NUM_COMMANDS 35
 
 #define MSG_RESPONSE  0x01000000LL /* Flag for defining a response message */
 #define MSG_ERROR     0x02000000LL /* Flag for defining an error message */
 #define MSG_EVENT     0x80000000LL /* Flag for defining an event message */
+#define MSG_EVENT_STAMP 0x40000000LL /* Event message has the write stamp before the data */
 
 /* These are flags for the registration command */
 #define CONNECT_SYNC  0x01 /* Used to identify the synchronous socket during registration */
@@ -83,6 +92,31 @@
 #define TAG_GET_NAME    0x01 /* Retrieve the tag by name */
 #define TAG_GET_INDEX   0x02 /* Retrieve the tag by it's index */
 
+/* Largest number of tags that can be sent in a single MSG_TAG_ADD_BULK or
+ * MSG_TAG_GET_BULK message.  This keeps the response inside one message. */
+#define TAG_BULK_MAX    256
+/* Size of each tag definition in the MSG_TAG_GET_BULK response */
+#define TAG_BULK_SIZE   14
+
+/* The MSG_CHANGES_SINCE response has a 14 byte header (result, sequence
+ * number and count) followed by 12 bytes (index, byte, size) per change */
+#define CHANGES_HEADER_SIZE 14
+#define CHANGES_ENTRY_SIZE  12
+#define CHANGES_MAX ((MSG_DATA_SIZE - CHANGES_HEADER_SIZE) / CHANGES_ENTRY_SIZE)
+
+/* Size of the write stamp in event messages.  Time (8), mono (8), writer (4) */
+#define EVENT_STAMP_SIZE 20
+
+/* Flags for each item in the MSG_TAG_MULTI_WRITE command */
+#define MULTI_WRITE_MASK 0x01 /* Item has a mask following the data */
+
+/* Flags for the MSG_GRP_SUB command */
+#define GRP_SUB_ENABLE  0x01 /* Start pushing the group data, clear to stop */
+
+/* Event id that the server uses for tag group subscription pushes.  The
+ * tag index field of the event carries the group index instead. */
+#define GROUP_EVENT_ID  0xFFFFFFFF
+
 /* Subcommands for the MSG_CDT_GET command */
 #define CDT_GET_NAME    0x01 /* Retrieve the type by name */
 #define CDT_GET_TYPE    0x02 /* Retrieve the type by it's type */
@@ -101,6 +135,8 @@
 #define MSG_DATA_SIZE (DAX_MSGMAX - MSG_HDR_SIZE)
 #define MSG_TAG_DATA_SIZE (MSG_DATA_SIZE - sizeof(tag_idx_t))
 #define MSG_TAG_GROUP_DATA_SIZE (MSG_DATA_SIZE - sizeof(uint32_t))
+/* Subscription pushes carry the group index and the event id as well */
+#define MSG_GROUP_EVENT_DATA_SIZE (MSG_DATA_SIZE - 2 * sizeof(uint32_t))
 
 /* This is the initial size of the group array that will be allocated
  * for each module the first time a group is added to that module */
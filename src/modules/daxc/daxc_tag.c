@@ -159,10 +159,16 @@ tag_del(char **tokens)
 }
 
 
+static void
+_show_tag_callback(dax_tag *tag, void *udata)
+{
+    show_tag(tag->idx, *tag);
+}
+
 /* TAG LIST command function
  * If we have no arguments then we list all the tags
- * If we have a single argument then we see if it's a tagname
- * or a number.  If a tagname then we list that tag if it's a number
+ * If we have a single argument then we see if it's a tagname, a
+ * wildcard pattern or a number.  If a tagname then we list that tag if it's a number
  * then we check for a second argument.  If we have two numbers then
  * we list from the first to the first + second if not then we list
  * the next X tags and increment nextindex. */
@@ -193,7 +199,14 @@ list_tags(char **tokens)
     if(arg[0]) {
         start = strtol(arg[0], &end_ptr, 0);
         /* If arg[0] is text then it's a tagname instead of an index */
-        if(end_ptr == arg[0]) {
+        if(end_ptr == arg[0] && strpbrk(arg[0], "*?[")) {
+            /* Wildcards are matched by the server */
+            result = dax_tag_iter(ds, arg[0], NULL, _show_tag_callback);
+            if(result) {
+                printf("Error: %d\n", result);
+                return result;
+            }
+        } else if(end_ptr == arg[0]) {
             if( dax_tag_byname(ds, &temp_tag, arg[0]) ) {
                 fprintf(stderr, "ERROR: Unknown Tagname %s\n", arg[0]);
                 return 1;
@@ -240,17 +253,10 @@ list_tags(char **tokens)
         }
     } else {
         /* List all tags */
-        for(n=0; n<=lastindex; n++) {
-            result = dax_tag_byindex(ds, &temp_tag, n);
-            if(result == ERR_DELETED) {
-                ; /* do nothing */
-            } else if(result) {
-                printf("Error: %d\n", result);
-                return result;
-            } else {
-                /* Otherwise show it */
-                show_tag(n, temp_tag);
-            }
+        result = dax_tag_iter(ds, NULL, NULL, _show_tag_callback);
+        if(result) {
+            printf("Error: %d\n", result);
+            return result;
         }
         nextindex = 0; /* Reset this static variable so other tag lists start at the beginning */
     }
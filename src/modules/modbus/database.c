@@ -21,51 +21,412 @@
 
 extern dax_state *ds;
 
+/* The slave and server ports answer requests out of a local image of each
+ * of their register tags instead of asking the tag server every time.  The
+ * images are kept current by change events that carry the new data.
+ *
+ * Writes from the Modbus clients go into the image right away and are
+ * handed to the flush thread which sends everything that has been written
+ * since its last pass in a single multiple write message.  The request
+ * waits until the batch that holds its write has been sent so the data is
+ * in the tag server before the client gets its response, but any number of
+ * connections and ports share each trip to the server.  The bits that have
+ * been written but not sent yet are set in the image's mask so that an
+ * event with older data can't overwrite them. */
 
-void
-slave_write_database(tag_index idx, int reg, int offset, int count, uint16_t *data)
-{
-    int result;
-    tag_handle h;
+typedef struct mb_image {
+    tag_index idx;
+    tag_type type;
+    uint32_t size;      /* Size of the tag data in bytes */
+    uint32_t lo, hi;    /* Byte range that has bits set in the mask */
+    uint32_t slo, shi;  /* Byte range that the flush is sending */
+    uint8_t *data;      /* Our copy of the tag data */
+    uint8_t *mask;      /* Bits written locally that haven't been sent */
+    uint8_t *sent;      /* Data that the flush is sending */
+    uint8_t *sentmask;  /* ...and the mask that goes with it */
+} mb_image;
 
-    /* We're going to cheat and build our own tag_handle */
-    /* We're assuming that the server loop won't call this function
-     * with bad data. */
+/* Userdata for the change events.  Each one covers part of an image */
+typedef struct image_chunk {
+    mb_image *image;
+    uint32_t offset;
+    uint32_t size;
+} image_chunk;
+
+/* Largest number of items that we put into one multiple write */
+#define MAX_WRITE_ITEMS 32
+
+static mb_image **_images;
+static int _image_count;
+static pthread_mutex_t _image_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t _flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _done_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t _write_gen;   /* Incremented for every write into an image */
+static uint64_t _flushed_gen; /* Last write that has been sent to the server */
+static pthread_t _flush_thread;
+static int _flush_running;
+
+/* We're going to cheat and build our own tag_handle */
+/* We're assuming that the server loop won't call this function
+ * with bad data. */
+static void
+_make_handle(tag_handle *h, tag_index idx, int reg, int offset, int count)
+{
+    h->index = idx;
+    h->count = count;
     switch(reg) {
         case MB_REG_HOLDING: /* These are the 16 bit registers */
-            h.index = idx;
-            h.byte = offset * 2;
-            h.bit = 0;
-            h.count = count;
-            h.size = count * 2;
-            h.type = DAX_UINT;
-            break;
         case MB_REG_INPUT:
-            h.index = idx;
-            h.byte = offset * 2;
-            h.bit = 0;
-            h.count = count;
-            h.size = count * 2;
-            h.type = DAX_UINT;
+            h->byte = offset * 2;
+            h->bit = 0;
+            h->size = count * 2;
+            h->type = DAX_UINT;
             break;
         case MB_REG_COIL:
-            h.index = idx;
-            h.byte = offset / 8;
-            h.bit = offset % 8;
-            h.count = count;
-            h.size = (h.bit + count - 1) / 8 - (h.bit / 8) + 1;
-            h.type = DAX_BOOL;
-            break;
         case MB_REG_DISC:
-            h.index = idx;
-            h.byte = offset / 8;
-            h.bit = offset % 8;
-            h.count = count;
-            h.size = (h.bit + count - 1) / 8 - (h.bit / 8) + 1;
-            h.type = DAX_BOOL;
+            h->byte = offset / 8;
+            h->bit = offset % 8;
+            h->size = (h->bit + count - 1) / 8 - (h->bit / 8) + 1;
+            h->type = DAX_BOOL;
             break;
     }
+}
+
+/* This should be called with _image_lock held */
+static mb_image *
+_find_image(tag_index idx)
+{
+    for(int n = 0; n < _image_count; n++) {
+        if(_images[n]->idx == idx) return _images[n];
+    }
+    return NULL;
+}
+
+/* Returns true if the registers are all inside the image */
+static int
+_image_fits(mb_image *image, int reg, int offset, int count)
+{
+    if(reg == MB_REG_HOLDING || reg == MB_REG_INPUT) {
+        return (uint32_t)(offset + count) * 2 <= image->size;
+    } else {
+        return (uint32_t)(offset + count + 7) / 8 <= image->size;
+    }
+}
 
+/* Copies new data from the server into the part of the image that starts
+ * at 'offset'.  Bits that we have written but not sent are left alone. */
+static void
+_image_update(mb_image *image, uint32_t offset, uint8_t *buff, uint32_t size)
+{
+    uint8_t *data, *mask;
+
+    pthread_mutex_lock(&_image_lock);
+    data = &image->data[offset];
+    mask = &image->mask[offset];
+    for(uint32_t n = 0; n < size; n++) {
+        data[n] = (data[n] & mask[n]) | (buff[n] & ~mask[n]);
+    }
+    pthread_mutex_unlock(&_image_lock);
+}
+
+static void
+_image_callback(dax_state *_ds, void *ud)
+{
+    image_chunk *chunk = (image_chunk *)ud;
+    uint8_t buff[chunk->size];
+    int result;
+
+    result = dax_event_get_data(_ds, buff, chunk->size);
+    if(result < (int)chunk->size) {
+        /* The event didn't have the data so we'll go get it */
+        result = dax_read(_ds, chunk->image->idx, chunk->offset, buff, chunk->size);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to read tag data for register image");
+            return;
+        }
+    }
+    _image_update(chunk->image, chunk->offset, buff, chunk->size);
+}
+
+/* Sends the items and clears them out */
+static void
+_send_items(dax_write_item *items, int *count)
+{
+    int result;
+
+    if(*count == 0) return;
+    result = dax_multi_write(ds, items, *count);
+    if(result) {
+        dax_log(DAX_LOG_ERROR, "Unable to write tag data to server\n");
+    }
+    *count = 0;
+}
+
+/* Sends everything that has been written into the images to the server.  Only
+ * one flush runs at a time since they share the sent buffers in the images. */
+static void
+_flush(void)
+{
+    dax_write_item items[MAX_WRITE_ITEMS];
+    mb_image *image;
+    uint64_t gen;
+    uint32_t offset, size, lo, hi;
+    int n, count, msgsize;
+
+    pthread_mutex_lock(&_flush_lock);
+    pthread_mutex_lock(&_image_lock);
+    gen = _write_gen;
+    for(n = 0; n < _image_count; n++) {
+        image = _images[n];
+        image->slo = image->lo;
+        image->shi = image->hi;
+        if(image->lo < image->hi) {
+            memcpy(&image->sent[image->lo], &image->data[image->lo], image->hi - image->lo);
+            memcpy(&image->sentmask[image->lo], &image->mask[image->lo], image->hi - image->lo);
+        }
+    }
+    pthread_mutex_unlock(&_image_lock);
+
+    /* Nobody else touches the sent buffers or adds images while we hold
+     * the flush lock so we don't need the image lock to send them */
+    count = 0;
+    msgsize = 2;
+    for(n = 0; n < _image_count; n++) {
+        image = _images[n];
+        for(offset = image->slo; offset < image->shi; offset += size) {
+            size = MIN(image->shi - offset, MB_WRITE_CHUNK);
+            if(count == MAX_WRITE_ITEMS || msgsize + 13 + size * 2 > MB_WRITE_BATCH) {
+                _send_items(items, &count);
+                msgsize = 2;
+            }
+            items[count].idx = image->idx;
+            items[count].offset = offset;
+            items[count].size = size;
+            items[count].data = &image->sent[offset];
+            items[count].mask = &image->sentmask[offset];
+            msgsize += 13 + size * 2;
+            count++;
+        }
+    }
+    _send_items(items, &count);
+
+    /* Now we clear the mask bits that we sent unless they have been written
+     * again with different data while we were sending them */
+    pthread_mutex_lock(&_image_lock);
+    for(n = 0; n < _image_count; n++) {
+        image = _images[n];
+        lo = image->size;
+        hi = 0;
+        for(offset = image->lo; offset < image->hi; offset++) {
+            image->mask[offset] &= ~(image->sentmask[offset] & ~(image->data[offset] ^ image->sent[offset]));
+            image->sentmask[offset] = 0x00;
+            if(image->mask[offset]) {
+                if(offset < lo) lo = offset;
+                hi = offset + 1;
+            }
+        }
+        image->lo = lo;
+        image->hi = hi;
+    }
+    _flushed_gen = gen;
+    pthread_cond_broadcast(&_done_cond);
+    pthread_mutex_unlock(&_image_lock);
+    pthread_mutex_unlock(&_flush_lock);
+}
+
+static void *
+_flush_loop(void *arg)
+{
+    pthread_mutex_lock(&_image_lock);
+    while(1) {
+        while(_flushed_gen == _write_gen) {
+            pthread_cond_wait(&_flush_cond, &_image_lock);
+        }
+        pthread_mutex_unlock(&_image_lock);
+        _flush();
+        pthread_mutex_lock(&_image_lock);
+    }
+    return NULL;
+}
+
+/* Deletes the 'count' events in 'ids' that were added for the image and
+ * frees the image.  The chunks are freed along with their events. */
+static void
+_image_abort(mb_image *image, dax_id *ids, int count)
+{
+    int n;
+
+    for(n = 0; n < count; n++) {
+        dax_event_del(ds, ids[n]);
+    }
+    free(ids);
+    free(image->data);
+    free(image);
+}
+
+/* Creates a register image for the tag that 'h' points to.  The image is
+ * filled with the current data and events are added to keep it current.
+ * A tag that is used by more than one node or port only gets one image. */
+int
+slave_cache_tag(tag_handle h)
+{
+    mb_image *image, **list;
+    image_chunk *chunk;
+    tag_handle eh;
+    dax_id *ids;
+    uint32_t offset;
+    int result, count = 0;
+
+    pthread_mutex_lock(&_image_lock);
+    image = _find_image(h.index);
+    pthread_mutex_unlock(&_image_lock);
+    if(image != NULL) {
+        /* Anything past the end of the image is read from the server */
+        if(image->size < h.size) {
+            dax_log(DAX_LOG_WARN, "Register image for tag %d is smaller than the tag", h.index);
+        }
+        return 0;
+    }
+
+    image = malloc(sizeof(mb_image));
+    if(image == NULL) return ERR_ALLOC;
+    image->idx = h.index;
+    image->type = h.type;
+    image->size = h.size;
+    image->lo = h.size;
+    image->hi = 0;
+    image->data = calloc(4, h.size);
+    if(image->data == NULL) {
+        free(image);
+        return ERR_ALLOC;
+    }
+    image->mask = &image->data[h.size];
+    image->sent = &image->data[h.size * 2];
+    image->sentmask = &image->data[h.size * 3];
+    /* We keep the event ids so that we can take them back out if we fail */
+    ids = malloc(sizeof(dax_id) * ((h.size + MB_IMAGE_CHUNK - 1) / MB_IMAGE_CHUNK));
+    if(ids == NULL) {
+        free(image->data);
+        free(image);
+        return ERR_ALLOC;
+    }
+
+    /* Each event has to fit in one message so big tags get more than one */
+    for(offset = 0; offset < h.size; offset += MB_IMAGE_CHUNK) {
+        chunk = malloc(sizeof(image_chunk));
+        if(chunk == NULL) {
+            _image_abort(image, ids, count);
+            return ERR_ALLOC;
+        }
+        chunk->image = image;
+        chunk->offset = offset;
+        chunk->size = MIN(h.size - offset, MB_IMAGE_CHUNK);
+        eh = h;
+        eh.byte = offset;
+        eh.bit = 0;
+        eh.size = chunk->size;
+        if(h.type == DAX_BOOL) {
+            eh.count = MIN(chunk->size * 8, h.count - offset * 8);
+        } else {
+            eh.count = chunk->size / 2;
+        }
+        result = dax_event_add(ds, &eh, EVENT_CHANGE, NULL, &ids[count], _image_callback, chunk, free);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to add event for register image");
+            free(chunk);
+            _image_abort(image, ids, count);
+            return result;
+        }
+        dax_event_options(ds, ids[count], EVENT_OPT_SEND_DATA);
+        count++;
+    }
+    /* The events are in place so we won't miss anything that happens after this */
+    result = dax_read_tag(ds, h, image->data);
+    if(result) {
+        dax_log(DAX_LOG_ERROR, "Unable to read tag data for register image");
+    }
+
+    /* The port threads may already be running */
+    pthread_mutex_lock(&_flush_lock);
+    pthread_mutex_lock(&_image_lock);
+    list = realloc(_images, sizeof(mb_image *) * (_image_count + 1));
+    if(list == NULL) {
+        pthread_mutex_unlock(&_image_lock);
+        pthread_mutex_unlock(&_flush_lock);
+        _image_abort(image, ids, count);
+        return ERR_ALLOC;
+    }
+    free(ids);
+    _images = list;
+    _images[_image_count++] = image;
+    pthread_mutex_unlock(&_image_lock);
+    pthread_mutex_unlock(&_flush_lock);
+
+    if(!_flush_running) {
+        if(pthread_create(&_flush_thread, NULL, _flush_loop, NULL)) {
+            dax_log(DAX_LOG_ERROR, "Unable to start register image flush thread");
+        } else {
+            pthread_detach(_flush_thread);
+            _flush_running = 1;
+        }
+    }
+    return 0;
+}
+
+void
+slave_write_database(tag_index idx, int reg, int offset, int count, uint16_t *data)
+{
+    int result;
+    tag_handle h;
+    mb_image *image;
+    uint8_t *src, mask;
+    uint32_t byte, lo, hi;
+    uint64_t gen;
+
+    pthread_mutex_lock(&_image_lock);
+    image = _find_image(idx);
+    if(image != NULL && _image_fits(image, reg, offset, count)) {
+        if(reg == MB_REG_HOLDING || reg == MB_REG_INPUT) {
+            lo = offset * 2;
+            hi = lo + count * 2;
+            memcpy(&image->data[lo], data, count * 2);
+            memset(&image->mask[lo], 0xFF, count * 2);
+        } else {
+            src = (uint8_t *)data;
+            lo = offset / 8;
+            hi = (offset + count + 7) / 8;
+            for(int n = 0; n < count; n++) {
+                byte = (offset + n) / 8;
+                mask = 0x01 << ((offset + n) % 8);
+                if(src[n / 8] & (0x01 << (n % 8))) {
+                    image->data[byte] |= mask;
+                } else {
+                    image->data[byte] &= ~mask;
+                }
+                image->mask[byte] |= mask;
+            }
+        }
+        if(lo < image->lo) image->lo = lo;
+        if(hi > image->hi) image->hi = hi;
+        gen = ++_write_gen;
+        if(!_flush_running) {
+            /* No flush thread so we'll have to send it ourselves */
+            pthread_mutex_unlock(&_image_lock);
+            _flush();
+            return;
+        }
+        pthread_cond_signal(&_flush_cond);
+        /* Wait for the flush thread to send a batch with our write in it */
+        while(_flushed_gen < gen) {
+            pthread_cond_wait(&_done_cond, &_image_lock);
+        }
+        pthread_mutex_unlock(&_image_lock);
+        return;
+    }
+    pthread_mutex_unlock(&_image_lock);
+
+    _make_handle(&h, idx, reg, offset, count);
     result = dax_write_tag(ds, h, data);
     if(result) {
         dax_log(DAX_LOG_ERROR, "Unable to write tag data to server\n");
@@ -77,47 +438,34 @@ void
 slave_read_database(tag_index idx, int reg, int offset, int count, uint16_t *data) {
     int result;
     tag_handle h;
+    mb_image *image;
+    uint8_t *dest;
+    uint32_t byte;
 
-    /* We're going to cheat and build our own tag_handle */
-    /* We're assuming that the server loop won't call this function
-     * with bad data. */
-    switch(reg) {
-        case MB_REG_HOLDING: /* These are the 16 bit registers */
-            h.index = idx;
-            h.byte = offset * 2;
-            h.bit = 0;
-            h.count = count;
-            h.size = count * 2;
-            h.type = DAX_UINT;
-            break;
-        case MB_REG_INPUT:
-            h.index = idx;
-            h.byte = offset * 2;
-            h.bit = 0;
-            h.count = count;
-            h.size = count * 2;
-            h.type = DAX_UINT;
-            break;
-        case MB_REG_COIL:
-            h.index = idx;
-            h.byte = offset / 8;
-            h.bit = offset % 8;
-            h.count = count;
-            h.size = (h.bit + count - 1) / 8 - (h.bit / 8) + 1;
-            h.type = DAX_BOOL;
-            break;
-        case MB_REG_DISC:
-            h.index = idx;
-            h.byte = offset / 8;
-            h.bit = offset % 8;
-            h.count = count;
-            h.size = (h.bit + count - 1) / 8 - (h.bit / 8) + 1;
-            h.type = DAX_BOOL;
-            break;
+    pthread_mutex_lock(&_image_lock);
+    image = _find_image(idx);
+    if(image != NULL && _image_fits(image, reg, offset, count)) {
+        if(reg == MB_REG_HOLDING || reg == MB_REG_INPUT) {
+            memcpy(data, &image->data[offset * 2], count * 2);
+        } else {
+            /* The bits are shifted down so that the first one is bit 0 of data */
+            dest = (uint8_t *)data;
+            memset(dest, 0, (count + 7) / 8);
+            for(int n = 0; n < count; n++) {
+                byte = (offset + n) / 8;
+                if(image->data[byte] & (0x01 << ((offset + n) % 8))) {
+                    dest[n / 8] |= 0x01 << (n % 8);
+                }
+            }
+        }
+        pthread_mutex_unlock(&_image_lock);
+        return;
     }
+    pthread_mutex_unlock(&_image_lock);
+
+    _make_handle(&h, idx, reg, offset, count);
     result = dax_read_tag(ds, h, data);
     if(result) {
         dax_log(DAX_LOG_ERROR, "Unable to write tag data to server\n");
     }
 }
-
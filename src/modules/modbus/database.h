@@ -26,6 +26,13 @@
 #include <modopt.h>
 #include <modbus.h>
 
+/* The change events for a register image and the writes that we send have
+ * to fit in a single message to the tag server */
+#define MB_IMAGE_CHUNK 2048
+#define MB_WRITE_CHUNK 1024
+#define MB_WRITE_BATCH 4000
+
+int slave_cache_tag(tag_handle h);
 void slave_write_database(tag_index idx, int reg, int offset, int count, uint16_t *data);
 void slave_read_database(tag_index idx, int reg, int offset, int count, uint16_t *data);
 
@@ -0,0 +1,230 @@
+/* mbbatch.c - Modbus (tm) Communications Library
+ * Copyright (C) 2024 Phil Birkelbach
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Source file for batching the tag server traffic of a master or client
+ * scan.  Reading each write command's data and writing each read command's
+ * data on its own costs a round trip to the tag server for every command,
+ * which adds up on ports with a lot of commands.
+ *
+ * When the port starts, the data tags of the continuous write commands are
+ * put in tag groups.  At the start of each scan the groups that have a
+ * command due are read, so all of the write data comes in with a message
+ * or two.  The data from the read commands is queued as the responses come
+ * in and is written with dax_tag_multi_write() at the end of the scan.
+ * Commands that are sent outside of the scan don't use any of this.
+ */
+
+#include "modbus.h"
+#include "database.h"
+
+extern dax_state *ds;
+
+/* Most commands that we will queue before we write them.  Each one takes at
+ * least 17 bytes of the message so we'll run out of room first anyway. */
+#define MB_BATCH_ITEMS 256
+/* Largest number of members the server allows in a tag group */
+#define MB_GROUP_MEMBERS 150
+
+/* Worst case number of bytes that the data for the handle takes in a multi
+ * write message.  BOOLs that don't line up with a byte are sent with a mask
+ * that might be one byte longer than the data. */
+static int
+_item_size(tag_handle *h)
+{
+    return 13 + (h->size + 1) * 2;
+}
+
+/* Adds a group for the commands in list to the port.  Returns 0 on success */
+static int
+_add_group(mb_port *mp, mb_cmd **list, int count, size_t size)
+{
+    mb_batch_group *group;
+    tag_handle h[count];
+    int n, result;
+
+    group = malloc(sizeof(mb_batch_group));
+    if(group == NULL) return MB_ERR_ALLOC;
+    group->cmds = malloc(sizeof(mb_cmd *) * count);
+    /* dax_group_read() puts the group index at the front of the buffer */
+    group->buff = malloc(size > 4 ? size : 4);
+    if(group->cmds == NULL || group->buff == NULL) {
+        if(group->cmds != NULL) free(group->cmds);
+        if(group->buff != NULL) free(group->buff);
+        free(group);
+        return MB_ERR_ALLOC;
+    }
+    for(n = 0; n < count; n++) {
+        h[n] = list[n]->data_h;
+    }
+    group->id = dax_group_add(ds, &result, h, count, 0);
+    if(group->id == NULL) {
+        dax_log(DAX_LOG_WARN, "Unable to add tag group for port %s - %d", mp->name, result);
+        free(group->cmds);
+        free(group->buff);
+        free(group);
+        return result ? result : MB_ERR_GENERIC;
+    }
+    memcpy(group->cmds, list, sizeof(mb_cmd *) * count);
+    group->count = count;
+    group->size = size;
+    group->next = mp->groups;
+    mp->groups = group;
+    return 0;
+}
+
+/* Allocates the queue for the read data and puts the data tags of the port's
+ * continuous write commands into tag groups.  Commands whose tags can't be
+ * found yet or that can't go in a group are read one at a time as before.
+ * Returns 0 on success or MB_ERR_ALLOC if the queue can't be allocated */
+int
+mb_batch_init(mb_port *mp)
+{
+    mb_cmd *mc;
+    mb_cmd *list[MB_GROUP_MEMBERS];
+    size_t size = 0;
+    int count = 0;
+
+    if(mp->batch_h == NULL) {
+        mp->batch_h = malloc(sizeof(tag_handle) * MB_BATCH_ITEMS);
+        mp->batch_data = malloc(sizeof(void *) * MB_BATCH_ITEMS);
+        if(mp->batch_h == NULL || mp->batch_data == NULL) return MB_ERR_ALLOC;
+    }
+    mp->batch_count = 0;
+    mp->batch_size = 2;
+    /* We only have to do this once, even if the port is restarted */
+    if(mp->groups != NULL) return 0;
+
+    for(mc = mp->scan; mc != NULL; mc = mc->snext) {
+        mc->prefetched = 0;
+        if(!(mc->mode & MB_CONTINUOUS) || !mb_is_write_cmd(mc)) continue;
+        if(mb_data_handle(mc)) continue;
+        /* The server hands us the whole bytes so BOOLs that don't start on a
+         * byte would have to be shifted.  dax_read_tag() already does that. */
+        if(mc->data_h.type == DAX_BOOL && mc->data_h.bit) continue;
+        if(count == MB_GROUP_MEMBERS || size + mc->data_h.size > MB_WRITE_BATCH) {
+            _add_group(mp, list, count, size);
+            count = 0;
+            size = 0;
+        }
+        list[count++] = mc;
+        size += mc->data_h.size;
+    }
+    if(count) _add_group(mp, list, count, size);
+    return 0;
+}
+
+/* Reads the tag groups that have write commands due in this scan and hands
+ * the data out to the commands. */
+void
+mb_batch_prefetch(mb_port *mp)
+{
+    mb_batch_group *group;
+    mb_cmd *mc;
+    tag_handle *h;
+    int n, due, result;
+    size_t offset;
+
+    for(group = mp->groups; group != NULL; group = group->next) {
+        due = 0;
+        for(n = 0; n < group->count; n++) {
+            if(group->cmds[n]->due && group->cmds[n]->enable) due = 1;
+        }
+        if(!due) continue;
+
+        result = dax_group_read(ds, group->id, group->buff, group->size > 4 ? group->size : 4);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to read tag group for port %s", mp->name);
+        }
+        offset = 0;
+        for(n = 0; n < group->count; n++) {
+            mc = group->cmds[n];
+            h = &mc->data_h;
+            /* If the read failed they'll each go get their own */
+            mc->prefetched = (result == 0 && mc->due);
+            if(mc->prefetched) {
+                memcpy(mc->data, &group->buff[offset], h->size);
+                /* Don't send the bits of whatever tag is after ours */
+                if(h->type == DAX_BOOL && h->count % 8) {
+                    mc->data[h->size - 1] &= (0x01 << (h->count % 8)) - 1;
+                }
+            }
+            offset += h->size;
+        }
+    }
+}
+
+/* Queues the data of the read command to be written at the end of the scan.
+ * The command's data buffer isn't touched again until its next response,
+ * which won't be until after the flush.  Returns 0 on success. */
+int
+mb_batch_queue(mb_port *mp, mb_cmd *mc)
+{
+    int size;
+
+    if(mp->batch_h == NULL) {
+        return dax_write_tag(ds, mc->data_h, mc->data);
+    }
+    size = _item_size(&mc->data_h);
+    if(mp->batch_count == MB_BATCH_ITEMS || mp->batch_size + size > MB_WRITE_BATCH) {
+        mb_batch_flush(mp);
+    }
+    mp->batch_h[mp->batch_count] = mc->data_h;
+    mp->batch_data[mp->batch_count] = mc->data;
+    mp->batch_count++;
+    mp->batch_size += size;
+    return 0;
+}
+
+/* Writes all of the queued read data to the tag server */
+void
+mb_batch_flush(mb_port *mp)
+{
+    int n, result;
+
+    if(mp->batch_count == 0) return;
+    result = dax_tag_multi_write(ds, mp->batch_h, mp->batch_data, mp->batch_count);
+    if(result) {
+        /* The server won't write any of it if one is bad so we don't lose
+         * all of them for one bad tag */
+        dax_log(DAX_LOG_ERROR, "Unable to write tag data for port %s - %d", mp->name, result);
+        for(n = 0; n < mp->batch_count; n++) {
+            dax_write_tag(ds, mp->batch_h[n], mp->batch_data[n]);
+        }
+    }
+    mp->batch_count = 0;
+    mp->batch_size = 2;
+}
+
+/* The tag server deletes the groups when we disconnect so we only have to
+ * free our side of them. */
+void
+mb_batch_free(mb_port *mp)
+{
+    mb_batch_group *group;
+
+    while(mp->groups != NULL) {
+        group = mp->groups;
+        mp->groups = group->next;
+        free(group->cmds);
+        free(group->buff);
+        free(group);
+    }
+    if(mp->batch_h != NULL) free(mp->batch_h);
+    if(mp->batch_data != NULL) free(mp->batch_data);
+    mp->batch_h = NULL;
+    mp->batch_data = NULL;
+}
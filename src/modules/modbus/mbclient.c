@@ -0,0 +1,469 @@
+/* mbclient.c - Modbus (tm) Communications Library
+ * Copyright (C) 2024 Phil Birkelbach
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Source file for the concurrent Modbus TCP client engine.  The normal
+ * client loop sends a command and waits for the response before it moves
+ * on to the next one, so the time to scan the port is the sum of all of
+ * the round trips.  Here the commands that are due are sorted into queues
+ * by the connection that they go to and every connection is sent its next
+ * request as soon as the last one is answered.  All of the sockets are
+ * waited on at once with epoll so the scan takes about as long as the
+ * slowest server takes to answer its own commands.
+ *
+ * Most servers and gateways will also accept more than one request at a
+ * time on a connection.  The port's window is the number of requests that
+ * we'll keep in flight on each connection.  The responses are matched up
+ * to the requests by the transaction ID in the MBAP header and every
+ * request gets its own timeout.
+ */
+
+#include "modbus.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <time.h>
+
+#define MAX_EVENTS 64
+
+static uint64_t
+_now_msec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Sets the events that we are waiting on for the connection at index n */
+static int
+_watch(mb_port *mp, int n, uint32_t events)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.u32 = n;
+    if(epoll_ctl(mp->client_fd, EPOLL_CTL_MOD, mp->connections[n].fd, &ev)) {
+        if(errno != ENOENT) return MB_ERR_GENERIC;
+        if(epoll_ctl(mp->client_fd, EPOLL_CTL_ADD, mp->connections[n].fd, &ev)) {
+            return MB_ERR_GENERIC;
+        }
+    }
+    return 0;
+}
+
+/* Closes the connection at index n and throws away whatever is left in
+ * its queue for this scan.  The entry stays in the pool with an fd of -1
+ * so that we'll try to connect again on the next scan. */
+static void
+_drop(mb_port *mp, int n)
+{
+    tcp_connection *tc = &mp->connections[n];
+
+    dax_log(DAX_LOG_COMM, "Dropping connection to %s:%d", inet_ntoa(tc->addr), tc->port);
+    for(int i = 0; i < tc->pending; i++) {
+        tc->inflight[i].cmd->timeouts++;
+        tc->inflight[i].cmd->lasterror = ME_TIMEOUT;
+    }
+    if(tc->fd > 0) close(tc->fd); /* This also takes it out of the epoll set */
+    tc->fd = -1;
+    tc->state = MB_CONN_IDLE;
+    tc->head = tc->tail = NULL;
+    tc->pending = 0;
+    tc->rxlen = 0;
+}
+
+/* Builds and writes the request for the in flight slot.  Every time that
+ * it is sent it gets a new transaction ID so that a late response to an
+ * earlier try can't be mistaken for this one.  Returns the number of bytes
+ * written, 0 if the command doesn't need to be sent or a negative error code. */
+static int
+_send_request(mb_port *mp, tcp_connection *tc, mb_inflight *inf)
+{
+    uint8_t buff[MB_FRAME_LEN];
+    int length;
+
+    inf->tid = ++tc->tid;
+    length = mb_build_tcp_request(inf->cmd, buff, inf->tid);
+    if(length == 0) return 0;
+    inf->cmd->requests++;
+    if(mp->out_callback) {
+        mp->out_callback(mp, buff, length);
+    }
+    if(write(tc->fd, buff, length) != length) {
+        return MB_ERR_GENERIC;
+    }
+    inf->deadline = _now_msec() + mp->timeout;
+    return length;
+}
+
+/* Removes slot i from the in flight list */
+static inline void
+_release(tcp_connection *tc, int i)
+{
+    tc->pending--;
+    if(i != tc->pending) {
+        tc->inflight[i] = tc->inflight[tc->pending];
+    }
+}
+
+/* Sends commands off of the connection's queue until the window is full,
+ * the queue is empty or we have to wait out the intercommand delay. */
+static void
+_fill(mb_port *mp, int n)
+{
+    tcp_connection *tc = &mp->connections[n];
+    mb_inflight *inf;
+    int result;
+
+    if(tc->fd <= 0 || tc->state == MB_CONN_CONNECTING) return;
+    while(tc->head != NULL && tc->pending < mp->window) {
+        if(tc->hold && _now_msec() < tc->hold) return;
+        inf = &tc->inflight[tc->pending];
+        inf->cmd = tc->head;
+        inf->try = 1;
+        tc->head = inf->cmd->qnext;
+        if(mp->maxattempts) {
+            mp->attempt++;
+        }
+        if(mb_is_write_cmd(inf->cmd)) {
+            mb_get_write_data(mp, inf->cmd);
+        }
+        mb_sched_start(inf->cmd);
+        result = _send_request(mp, tc, inf);
+        if(result < 0) {
+            _drop(mp, n);
+            return;
+        }
+        if(result > 0) {
+            tc->pending++;
+            if(mp->delay > 0) tc->hold = _now_msec() + mp->delay;
+        }
+    }
+}
+
+/* Start a non-blocking connection to the server for entry n.  When it
+ * finishes epoll will tell us that the socket is writable. */
+static int
+_connect(mb_port *mp, int n)
+{
+    tcp_connection *tc = &mp->connections[n];
+    struct sockaddr_in addr;
+    int fd;
+
+    if(mp->socket == UDP_SOCK) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+    } else {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if(fd < 0) return MB_ERR_OPEN;
+    if(fcntl(fd, F_SETFL, O_NONBLOCK)) {
+        close(fd);
+        return MB_ERR_OPEN;
+    }
+    if(mp->socket != UDP_SOCK) {
+        /* Pipelined requests are small and we don't want them held back */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_addr = tc->addr;
+    addr.sin_port = htons(tc->port);
+
+    tc->fd = fd;
+    tc->rxlen = 0;
+    tc->pending = 0;
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        tc->state = MB_CONN_IDLE;
+        return _watch(mp, n, EPOLLIN);
+    }
+    if(errno != EINPROGRESS) {
+        close(fd);
+        tc->fd = -1;
+        return MB_ERR_OPEN;
+    }
+    tc->state = MB_CONN_CONNECTING;
+    tc->deadline = _now_msec() + mp->timeout;
+    return _watch(mp, n, EPOLLOUT);
+}
+
+/* epoll says that a non-blocking connect() has finished one way or another */
+static void
+_connected(mb_port *mp, int n)
+{
+    tcp_connection *tc = &mp->connections[n];
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    tc->state = MB_CONN_IDLE;
+    if(getsockopt(tc->fd, SOL_SOCKET, SO_ERROR, &err, &len) || err) {
+        dax_log(DAX_LOG_COMM, "Unable to connect to %s:%d - %s", inet_ntoa(tc->addr), tc->port, strerror(err));
+        _drop(mp, n);
+        return;
+    }
+    dax_log(DAX_LOG_COMM, "Connected to %s:%d", inet_ntoa(tc->addr), tc->port);
+    if(_watch(mp, n, EPOLLIN)) {
+        _drop(mp, n);
+        return;
+    }
+    _fill(mp, n);
+}
+
+/* Deals with a single complete MBAP frame that is at the beginning of the
+ * connection's receive buffer. */
+static void
+_handle_frame(mb_port *mp, int n, int length)
+{
+    tcp_connection *tc = &mp->connections[n];
+    mb_cmd *mc;
+    uint16_t tid;
+    int i, result;
+
+    if(mp->in_callback) {
+        mp->in_callback(mp, tc->rxbuff, length);
+    }
+    tid = (uint16_t)tc->rxbuff[0] << 8 | tc->rxbuff[1];
+    for(i = 0; i < tc->pending; i++) {
+        if(tc->inflight[i].tid == tid) break;
+    }
+    if(i == tc->pending) {
+        /* Probably the late answer to a request that already timed out */
+        dax_log(DAX_LOG_COMM, "Discarding response with transaction id %d from %s", tid, inet_ntoa(tc->addr));
+        return;
+    }
+    mc = tc->inflight[i].cmd;
+    _release(tc, i);
+    /* The PDU after the MBAP header looks just like an RTU message */
+    result = mb_handle_response(&tc->rxbuff[6], mc);
+    if(result > 0) {
+        mc->exceptions++;
+        mc->lasterror = result | ME_EXCEPTION;
+    } else {
+        mc->lasterror = 0;
+        if(mb_is_read_cmd(mc)) {
+            mb_send_read_data(mp, mc);
+        }
+    }
+    mp->attempt = 0;
+}
+
+/* Reads whatever is available on the connection and handles every
+ * complete frame that we have. */
+static void
+_read(mb_port *mp, int n)
+{
+    tcp_connection *tc = &mp->connections[n];
+    int result, length;
+
+    result = read(tc->fd, &tc->rxbuff[tc->rxlen], MB_FRAME_LEN - tc->rxlen);
+    if(result == 0 || (result < 0 && errno != EAGAIN && errno != EINTR)) {
+        _drop(mp, n);
+        return;
+    }
+    if(result < 0) return;
+    tc->rxlen += result;
+
+    while(tc->rxlen >= 6) {
+        length = ((int)tc->rxbuff[4] << 8 | tc->rxbuff[5]) + 6;
+        if(length < 8 || length > MB_FRAME_LEN) {
+            dax_log(DAX_LOG_ERROR, "Bad frame length %d from %s", length, inet_ntoa(tc->addr));
+            _drop(mp, n);
+            return;
+        }
+        if(tc->rxlen < length) break;
+        _handle_frame(mp, n, length);
+        tc->rxlen -= length;
+        memmove(tc->rxbuff, &tc->rxbuff[length], tc->rxlen);
+    }
+    _fill(mp, n);
+}
+
+/* Deals with anything on the connection whose deadline has passed */
+static void
+_expire(mb_port *mp, int n, uint64_t now)
+{
+    tcp_connection *tc = &mp->connections[n];
+    mb_inflight *inf;
+    int i, result;
+
+    if(tc->state == MB_CONN_CONNECTING) {
+        if(tc->deadline <= now) {
+            dax_log(DAX_LOG_COMM, "Timeout connecting to %s:%d", inet_ntoa(tc->addr), tc->port);
+            _drop(mp, n);
+        }
+        return;
+    }
+    for(i = 0; i < tc->pending; i++) {
+        inf = &tc->inflight[i];
+        if(inf->deadline > now) continue;
+        inf->cmd->timeouts++;
+        inf->cmd->lasterror = ME_TIMEOUT;
+        result = 0;
+        if(inf->try++ <= mp->retries) {
+            result = _send_request(mp, tc, inf);
+            if(result < 0) {
+                _drop(mp, n);
+                return;
+            }
+        }
+        if(result == 0) {
+            _release(tc, i);
+            i--; /* The last one was moved into this slot */
+        }
+    }
+    _fill(mp, n);
+}
+
+/* Returns the next time that something on the connection needs attention
+ * or 0 if the connection has nothing left to do during this scan. */
+static uint64_t
+_next_deadline(mb_port *mp, tcp_connection *tc)
+{
+    uint64_t next = UINT64_MAX;
+
+    if(tc->state == MB_CONN_CONNECTING) return tc->deadline;
+    if(tc->fd <= 0) return 0;
+    for(int i = 0; i < tc->pending; i++) {
+        if(tc->inflight[i].deadline < next) next = tc->inflight[i].deadline;
+    }
+    /* Only the intercommand delay can be holding up the queue here */
+    if(tc->head != NULL && tc->pending < mp->window && tc->hold && tc->hold < next) {
+        next = tc->hold;
+    }
+    return next == UINT64_MAX ? 0 : next;
+}
+
+/* Creates the epoll instance that the engine uses.  Returns 0 on success */
+int
+mb_client_init(mb_port *mp)
+{
+    if(mp->client_fd >= 0) return 0;
+    mp->client_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(mp->client_fd < 0) {
+        dax_log(DAX_LOG_ERROR, "Unable to create epoll instance - %s", strerror(errno));
+        return MB_ERR_GENERIC;
+    }
+    return 0;
+}
+
+/* Runs a single scan of the port.  All of the commands that are due are
+ * sent and this function returns once they have all been answered or have
+ * timed out.  We hold the send lock for the whole scan so that the
+ * asynchronous commands in mb_send_command() don't read our responses. */
+int
+mb_client_scan(mb_port *mp)
+{
+    struct epoll_event events[MAX_EVENTS];
+    tcp_connection *tc;
+    mb_cmd *mc;
+    uint64_t now, next, deadline;
+    int n, count, wait;
+
+    pthread_mutex_lock(&mp->send_lock);
+    /* Sort the commands that the scheduler marked into queues for each connection */
+    for(mc = mp->scan; mc != NULL; mc = mc->snext) {
+        if(mc->due) {
+            /* The jitter is measured when _fill() actually sends it */
+            mc->due = 0;
+            n = mb_find_connection(mp, mc->ip_address, mc->port);
+            if(n < 0) continue;
+            tc = &mp->connections[n];
+            mc->qnext = NULL;
+            if(tc->head == NULL) {
+                tc->head = mc;
+            } else {
+                tc->tail->qnext = mc;
+            }
+            tc->tail = mc;
+        }
+    }
+    /* Get everybody started */
+    for(n = 0; n < mp->connection_count; n++) {
+        tc = &mp->connections[n];
+        if(tc->head == NULL) continue;
+        tc->hold = 0;
+        if(tc->fd <= 0) {
+            if(_connect(mp, n)) {
+                dax_log(DAX_LOG_COMM, "Unable to connect to %s:%d", inet_ntoa(tc->addr), tc->port);
+                _drop(mp, n);
+                continue;
+            }
+        } else if(_watch(mp, n, EPOLLIN)) {
+            _drop(mp, n);
+            continue;
+        }
+        _fill(mp, n);
+    }
+
+    while(1) {
+        /* Find out who is still busy and when the next deadline is */
+        next = UINT64_MAX;
+        for(n = 0; n < mp->connection_count; n++) {
+            deadline = _next_deadline(mp, &mp->connections[n]);
+            if(deadline && deadline < next) next = deadline;
+        }
+        if(next == UINT64_MAX) break;
+        now = _now_msec();
+        wait = next > now ? (int)(next - now) : 0;
+
+        count = epoll_wait(mp->client_fd, events, MAX_EVENTS, wait);
+        if(count < 0 && errno != EINTR) {
+            dax_log(DAX_LOG_ERROR, "Client epoll error on port %s - %s", mp->name, strerror(errno));
+            break;
+        }
+        for(int i = 0; i < count; i++) {
+            n = events[i].data.u32;
+            tc = &mp->connections[n];
+            if(tc->fd <= 0) continue;
+            if(tc->state == MB_CONN_CONNECTING) {
+                _connected(mp, n);
+            } else if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                _read(mp, n);
+            }
+        }
+        now = _now_msec();
+        for(n = 0; n < mp->connection_count; n++) {
+            deadline = _next_deadline(mp, &mp->connections[n]);
+            if(deadline && deadline <= now) {
+                _expire(mp, n, now);
+            }
+        }
+    }
+    /* If we bailed out early make sure nothing is left for the next scan */
+    for(n = 0; n < mp->connection_count; n++) {
+        tc = &mp->connections[n];
+        if(tc->state == MB_CONN_CONNECTING || tc->pending) _drop(mp, n);
+        tc->head = tc->tail = NULL;
+    }
+    pthread_mutex_unlock(&mp->send_lock);
+    return 0;
+}
+
+#else
+
+int
+mb_client_init(mb_port *mp)
+{
+    return MB_ERR_GENERIC;
+}
+
+int
+mb_client_scan(mb_port *mp)
+{
+    return MB_ERR_GENERIC;
+}
+
+#endif
@@ -34,6 +34,13 @@ initcmd(struct mb_cmd *c)
     c->data = NULL;
     c->datasize = 0;
     c->interval = 0;
+    c->period = 0;
+    c->deadline = 0;
+    c->due_time = 0;
+    c->due = 0;
+    c->jitter = 0;
+    c->overruns = 0;
+    c->prefetched = 0;
 
     c->icount = 0;
     c->requests = 0;
@@ -46,6 +53,11 @@ initcmd(struct mb_cmd *c)
     c->firstrun = 0;
     bzero(&c->data_h, sizeof(tag_handle));
     c->next = NULL;
+    c->snext = NULL;
+    c->qnext = NULL;
+    c->merge = NULL;
+    c->members = NULL;
+    c->mnext = NULL;
 };
 
 /********************/
@@ -207,3 +219,162 @@ mb_is_write_cmd(mb_cmd *cmd)
     }
 
 }
+
+/* Returns true if the command is a candidate for being merged with others.
+ * Only reads that are sent every scan can be merged.  Anything that is
+ * triggered needs to stay on it's own. */
+static inline int
+_can_merge(mb_cmd *mc)
+{
+    return mb_is_read_cmd(mc) && mc->mode == MB_CONTINUOUS && mc->merge == NULL;
+}
+
+/* Returns true if a and b go to the same place and could be read together */
+static inline int
+_same_target(mb_cmd *a, mb_cmd *b)
+{
+    return a->ip_address.s_addr == b->ip_address.s_addr && a->port == b->port &&
+           a->node == b->node && a->function == b->function &&
+           a->interval == b->interval && a->period == b->period;
+}
+
+/* qsort() comparison function that puts commands for the same target
+ * together in register order */
+static int
+_merge_compare(const void *x, const void *y)
+{
+    mb_cmd *a = *(mb_cmd **)x;
+    mb_cmd *b = *(mb_cmd **)y;
+
+    if(a->ip_address.s_addr != b->ip_address.s_addr) return a->ip_address.s_addr < b->ip_address.s_addr ? -1 : 1;
+    if(a->port != b->port) return a->port < b->port ? -1 : 1;
+    if(a->node != b->node) return a->node < b->node ? -1 : 1;
+    if(a->function != b->function) return a->function < b->function ? -1 : 1;
+    if(a->interval != b->interval) return a->interval < b->interval ? -1 : 1;
+    if(a->period != b->period) return a->period < b->period ? -1 : 1;
+    if(a->m_register != b->m_register) return a->m_register < b->m_register ? -1 : 1;
+    return 0;
+}
+
+/* Creates the command that reads for the 'count' commands in list.  They
+ * are already sorted by register. */
+static int
+_merge_group(mb_port *port, mb_cmd **list, int count)
+{
+    mb_cmd *mc, *last;
+    unsigned int end = 0;
+    int n, result;
+
+    for(n = 0; n < count; n++) {
+        if(list[n]->m_register + list[n]->length > end) end = list[n]->m_register + list[n]->length;
+    }
+    mc = mb_new_cmd(NULL);
+    if(mc == NULL) return MB_ERR_ALLOC;
+    mc->ip_address = list[0]->ip_address;
+    mc->port = list[0]->port;
+    result = mb_set_command(mc, list[0]->node, list[0]->function, list[0]->m_register, end - list[0]->m_register);
+    if(result) {
+        mb_destroy_cmd(mc);
+        return result;
+    }
+    mc->mode = MB_CONTINUOUS;
+    mc->interval = list[0]->interval;
+    mc->period = list[0]->period;
+    last = NULL;
+    for(n = 0; n < count; n++) {
+        list[n]->merge = mc;
+        list[n]->mnext = NULL;
+        if(last == NULL) mc->members = list[n];
+        else             last->mnext = list[n];
+        last = list[n];
+    }
+    mc->next = port->merged;
+    port->merged = mc;
+    dax_log(DAX_LOG_MINOR, "Merged %d commands into node %d, function %d, register %d, length %d",
+            count, mc->node, mc->function, mc->m_register, mc->length);
+    return 0;
+}
+
+/* This is the optimizer pass for master and client ports.  Read commands that
+ * go to the same node and function code and that have registers that overlap,
+ * touch or are no more than port->gap registers apart are merged into as few
+ * requests as the protocol allows.  The original commands stay in the ports
+ * command list so that their enable bits still work, but the port's scan list
+ * is rebuilt with the merged command in place of the first member and
+ * without the rest.  When the response comes in mb_send_read_data() scatters
+ * the data back out to each member's tag.  Returns the number of merged
+ * commands that were created or a negative error code. */
+int
+mb_merge_commands(mb_port *port)
+{
+    mb_cmd **list, *mc, *last;
+    unsigned int start, end, limit;
+    int count = 0, groups = 0, first, n, result;
+
+    for(mc = port->commands; mc != NULL; mc = mc->next) {
+        if(_can_merge(mc)) count++;
+    }
+    if(count < 2) return 0;
+    list = malloc(sizeof(mb_cmd *) * count);
+    if(list == NULL) return MB_ERR_ALLOC;
+    count = 0;
+    for(mc = port->commands; mc != NULL; mc = mc->next) {
+        if(_can_merge(mc)) list[count++] = mc;
+    }
+    qsort(list, count, sizeof(mb_cmd *), _merge_compare);
+
+    first = 0;
+    while(first < count) {
+        limit = (list[first]->function == 1 || list[first]->function == 2) ? 2000 : 125;
+        start = list[first]->m_register;
+        end = start + list[first]->length;
+        for(n = first + 1; n < count; n++) {
+            if(!_same_target(list[first], list[n])) break;
+            if(list[n]->m_register > end + port->gap) break;
+            if(MAX(end, list[n]->m_register + list[n]->length) - start > limit) break;
+            end = MAX(end, list[n]->m_register + list[n]->length);
+        }
+        if(n - first > 1) {
+            result = _merge_group(port, &list[first], n - first);
+            if(result) {
+                free(list);
+                return result;
+            }
+            groups++;
+        }
+        first = n;
+    }
+    free(list);
+    if(groups == 0) return 0;
+
+    /* Rebuild the scan list in the original command order */
+    port->scan = last = NULL;
+    for(mc = port->commands; mc != NULL; mc = mc->next) {
+        if(mc->merge != NULL) {
+            if(mc->merge->members != mc) continue; /* Only the first member */
+            mc = mc->merge;
+        }
+        mc->snext = NULL;
+        if(last == NULL) port->scan = mc;
+        else             last->snext = mc;
+        last = mc;
+        if(mc->members != NULL) mc = mc->members; /* Back to where we were */
+    }
+    mb_update_merged(port);
+    return groups;
+}
+
+/* Merged commands are enabled if any of their members are.  This should be
+ * called whenever the enable bits of the commands change. */
+void
+mb_update_merged(mb_port *port)
+{
+    mb_cmd *mc, *member;
+
+    for(mc = port->merged; mc != NULL; mc = mc->next) {
+        mc->enable = 0;
+        for(member = mc->members; member != NULL; member = member->mnext) {
+            if(member->enable) mc->enable = 1;
+        }
+    }
+}
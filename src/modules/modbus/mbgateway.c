@@ -0,0 +1,355 @@
+/* mbgateway.c - Modbus (tm) Communications Library
+ * Copyright (C) 2024 Phil Birkelbach
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Source file for the Modbus TCP to RTU gateway.  A TCP server port can
+ * send the requests for some unit IDs to an RTU master port instead of
+ * answering them from its own registers.  The server thread puts these
+ * requests on the master port's queue and goes right back to its other
+ * connections.  The master port's thread owns the serial line, so it sends
+ * the queued requests between its own commands and while it waits for the
+ * next scan.  The responses are handed back to the server thread through a
+ * pipe that it waits on along with the sockets, so only the server thread
+ * ever writes to the client connections.
+ *
+ * If the server port has a ttl, read responses are kept for that many
+ * milliseconds.  Many clients polling the same registers then only cost
+ * one trip on the serial line.
+ */
+
+#include "modbus.h"
+#include <time.h>
+
+static uint64_t
+_now_msec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+_is_write(uint8_t function)
+{
+    switch(function) {
+        case 5:
+        case 6:
+        case 15:
+        case 16:
+        case 22:
+        case 23:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Finds the cache entry for the unit ID, function, address and count in key */
+static mb_gw_cache *
+_cache_entry(mb_port *port, uint8_t *key)
+{
+    uint32_t hash = 2166136261u;
+
+    for(int n = 0; n < 6; n++) {
+        hash = (hash ^ key[n]) * 16777619u;
+    }
+    return &port->gw_cache[hash % MB_GW_CACHE_SIZE];
+}
+
+/* Throws away everything in the cache for the given unit */
+static void
+_cache_invalidate(mb_port *port, uint8_t unit)
+{
+    for(int n = 0; n < MB_GW_CACHE_SIZE; n++) {
+        if(port->gw_cache[n].key[0] == unit) {
+            port->gw_cache[n].expires = 0;
+        }
+    }
+}
+
+/* Turns the request in the MBAP frame into an exception response.  Returns
+ * the new length of the frame */
+static int
+_exception(uint8_t *frame, uint8_t code)
+{
+    frame[4] = 0;
+    frame[5] = 3;
+    frame[7] |= ME_EXCEPTION;
+    frame[8] = code;
+    return 9;
+}
+
+static void
+_send_response(mb_port *port, int fd, uint8_t *frame, int length)
+{
+    if(port->out_callback) {
+        port->out_callback(port, frame, length);
+    }
+    write(fd, frame, length);
+}
+
+/* Sets up the pipe that the master ports use to wake up the server thread and
+ * the response cache.  Returns 0 on success or a negative error code */
+int
+mb_gateway_init(mb_port *port)
+{
+    if(pipe(port->gw_pipe)) {
+        dax_log(DAX_LOG_ERROR, "Unable to create gateway pipe for port %s - %s", port->name, strerror(errno));
+        port->gw_pipe[0] = port->gw_pipe[1] = -1;
+        return MB_ERR_GENERIC;
+    }
+    fcntl(port->gw_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(port->gw_pipe[1], F_SETFL, O_NONBLOCK);
+    if(port->ttl > 0 && port->gw_cache == NULL) {
+        port->gw_cache = calloc(MB_GW_CACHE_SIZE, sizeof(mb_gw_cache));
+        if(port->gw_cache == NULL) {
+            dax_log(DAX_LOG_ERROR, "Unable to allocate gateway cache for port %s", port->name);
+        }
+    }
+    return 0;
+}
+
+/* Called by the server thread with a complete MBAP request for a unit ID that
+ * is routed to a master port.  The response is sent right away if it is in
+ * the cache.  Otherwise the request goes on the master port's queue. */
+void
+mb_gateway_request(mb_port *port, client_buffer *cc, uint8_t *frame, int length)
+{
+    mb_port *mp;
+    mb_gw_request *req;
+    mb_gw_cache *entry;
+    uint16_t msgsize;
+    uint8_t cache;
+
+    /* Only plain reads can be cached */
+    cache = (port->gw_cache != NULL && length == 12 && frame[7] >= 1 && frame[7] <= 4);
+    if(cache) {
+        entry = _cache_entry(port, &frame[6]);
+        if(entry->expires > _now_msec() && memcmp(entry->key, &frame[6], 6) == 0) {
+            memcpy(&frame[6], entry->buff, entry->length);
+            msgsize = entry->length;
+            COPYWORD(&frame[4], &msgsize);
+            _send_response(port, cc->fd, frame, entry->length + 6);
+            return;
+        }
+    }
+    /* Nobody should get an old copy after they have written to the unit */
+    if(port->gw_cache != NULL && _is_write(frame[7])) {
+        _cache_invalidate(port, frame[6]);
+    }
+
+    mp = port->routes[frame[6]];
+    req = malloc(sizeof(mb_gw_request));
+    if(req == NULL) {
+        _send_response(port, cc->fd, frame, _exception(frame, ME_GW_PATH));
+        return;
+    }
+    req->server = port;
+    req->fd = cc->fd;
+    req->serial = cc->serial;
+    memcpy(req->key, &frame[6], 6);
+    req->cache = cache;
+    req->length = length;
+    memcpy(req->buff, frame, length);
+    req->next = NULL;
+
+    pthread_mutex_lock(&mp->gw_lock);
+    /* If the master isn't running or is too far behind there's no sense in
+     * letting the client wait for its own timeout */
+    if(!mp->running || mp->inhibit || mp->gw_count >= MB_GW_QUEUE_SIZE) {
+        pthread_mutex_unlock(&mp->gw_lock);
+        dax_log(DAX_LOG_COMM, "Gateway port %s is not available for unit %d", mp->name, frame[6]);
+        _send_response(port, cc->fd, frame, _exception(frame, ME_GW_PATH));
+        free(req);
+        return;
+    }
+    if(mp->gw_tail == NULL) {
+        mp->gw_head = req;
+    } else {
+        mp->gw_tail->next = req;
+    }
+    mp->gw_tail = req;
+    mp->gw_count++;
+    pthread_cond_signal(&mp->gw_cond);
+    pthread_mutex_unlock(&mp->gw_lock);
+}
+
+/* Called by the server thread when the gateway pipe is readable.  Sends all of
+ * the responses that the master ports have finished to the clients that are
+ * still connected */
+void
+mb_gateway_deliver(mb_port *port)
+{
+    char junk[64];
+    mb_gw_request *req, *next;
+    client_buffer *cc;
+    mb_gw_cache *entry;
+
+    while(read(port->gw_pipe[0], junk, sizeof(junk)) > 0);
+
+    pthread_mutex_lock(&port->gw_lock);
+    req = port->gw_head;
+    port->gw_head = port->gw_tail = NULL;
+    pthread_mutex_unlock(&port->gw_lock);
+
+    while(req != NULL) {
+        next = req->next;
+        if(req->cache && !(req->buff[7] & ME_EXCEPTION)) {
+            entry = _cache_entry(port, req->key);
+            memcpy(entry->key, req->key, 6);
+            entry->length = req->length - 6;
+            memcpy(entry->buff, &req->buff[6], entry->length);
+            entry->expires = _now_msec() + port->ttl;
+        } else if(port->gw_cache != NULL && _is_write(req->key[1])) {
+            /* A read may have been cached while the write was on the line */
+            _cache_invalidate(port, req->key[0]);
+        }
+        /* The client may have gone away and the fd been given to someone else */
+        if(req->fd < port->clients_size) {
+            cc = port->clients[req->fd];
+            if(cc != NULL && cc->serial == req->serial) {
+                _send_response(port, cc->fd, req->buff, req->length);
+            }
+        }
+        free(req);
+        req = next;
+    }
+}
+
+/* Sends the request on the master port's serial line and puts the response in
+ * its place.  If the unit doesn't answer an exception is put there instead. */
+static void
+_transact(mb_port *mp, mb_gw_request *req)
+{
+    uint8_t buff[MB_FRAME_LEN];
+    uint16_t crc, msgsize;
+    int length, result, try;
+
+    if(mp->fd <= 0 || mp->inhibit) {
+        req->length = _exception(req->buff, ME_GW_PATH);
+        return;
+    }
+    length = req->length - 6; /* The RTU frame is the unit ID and the PDU */
+    for(try = 0; try <= mp->retries; try++) {
+        memcpy(buff, &req->buff[6], length);
+        crc = crc16(buff, length);
+        COPYWORD(&buff[length], &crc);
+        tcflush(mp->fd, TCIOFLUSH);
+        if(mp->out_callback) {
+            mp->out_callback(mp, buff, length + 2);
+        }
+        if(write(mp->fd, buff, length + 2) < 0) {
+            dax_log(DAX_LOG_ERROR, "Unable to write to gateway port %s - %s", mp->name, strerror(errno));
+            break;
+        }
+        result = mb_rtu_read(mp, buff, MB_FRAME_LEN, mp->timeout, mb_rtu_response_length);
+        if(result > 0 && mp->in_callback) {
+            mp->in_callback(mp, buff, result);
+        }
+        if(result > 4 && result - 2 <= MB_TCP_ADU_SIZE - 6 &&
+           buff[0] == req->buff[6] && crc16check(buff, result)) {
+            result -= 2; /* We don't send the CRC */
+            memcpy(&req->buff[6], buff, result);
+            msgsize = result;
+            COPYWORD(&req->buff[4], &msgsize);
+            req->length = result + 6;
+            return;
+        }
+        if(result != 0) {
+            /* Garbage or someone else's frame.  Wait for the line to go quiet */
+            mb_rtu_drain(mp);
+        }
+        if(mp->delay > 0) usleep(mp->delay * 1000);
+    }
+    req->length = _exception(req->buff, ME_GW_TARGET);
+}
+
+/* Gives the finished request back to the server port that it came from */
+static void
+_finish(mb_gw_request *req)
+{
+    mb_port *port = req->server;
+
+    req->next = NULL;
+    pthread_mutex_lock(&port->gw_lock);
+    if(port->gw_tail == NULL) {
+        port->gw_head = req;
+    } else {
+        port->gw_tail->next = req;
+    }
+    port->gw_tail = req;
+    pthread_mutex_unlock(&port->gw_lock);
+    /* If the pipe is full the server already has a reason to wake up */
+    write(port->gw_pipe[1], "", 1);
+}
+
+/* Called by the master port's thread to send every request that is waiting
+ * on its gateway queue */
+void
+mb_gateway_service(mb_port *mp)
+{
+    mb_gw_request *req;
+    int opened = 0;
+
+    while(1) {
+        pthread_mutex_lock(&mp->gw_lock);
+        req = mp->gw_head;
+        if(req != NULL) {
+            mp->gw_head = req->next;
+            if(mp->gw_head == NULL) mp->gw_tail = NULL;
+            mp->gw_count--;
+        }
+        pthread_mutex_unlock(&mp->gw_lock);
+        if(req == NULL) break;
+
+        /* The send lock keeps us off of the line while event and trigger
+         * commands are being sent from the main thread */
+        pthread_mutex_lock(&mp->send_lock);
+        /* A port that doesn't persist is closed between scans so we open
+         * it for as long as there are requests waiting */
+        if(mp->fd <= 0 && !mp->persist && !mp->inhibit) {
+            if(mb_open_port(mp) == 0 && mp->fd > 0) opened = 1;
+        }
+        _transact(mp, req);
+        pthread_mutex_unlock(&mp->send_lock);
+        _finish(req);
+    }
+    if(opened) {
+        pthread_mutex_lock(&mp->send_lock);
+        mb_close_port(mp);
+        pthread_mutex_unlock(&mp->send_lock);
+    }
+}
+
+/* This is used by the master port in place of sleeping between scans.  It
+ * waits until the deadline on the monotonic clock and sends the gateway
+ * requests as they come in */
+void
+mb_gateway_wait(mb_port *mp, struct timespec *deadline)
+{
+    pthread_mutex_lock(&mp->gw_lock);
+    while(1) {
+        if(mp->gw_head != NULL) {
+            pthread_mutex_unlock(&mp->gw_lock);
+            mb_gateway_service(mp);
+            pthread_mutex_lock(&mp->gw_lock);
+            continue;
+        }
+        if(pthread_cond_timedwait(&mp->gw_cond, &mp->gw_lock, deadline) == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&mp->gw_lock);
+}
@@ -26,6 +26,8 @@ extern dax_state *ds;
 static void
 initport(mb_port *p)
 {
+    pthread_condattr_t attr;
+
     p->name = NULL;
     p->flags = 0x00;
     p->device = NULL;
@@ -38,19 +40,26 @@ initport(mb_port *p)
     p->databits = 8;
     p->stopbits = 1;
     p->timeout = 1000;
-    p->frame = 1000;
+    p->frame = 0;
+    p->silence = 3646; /* 3.5 characters at 9600 8N1 */
     p->delay = 0;
     p->retries = 3;
     p->parity = MB_NONE;
     p->bindport = 5001;
     p->scanrate = 1000;
     p->nodes = NULL;
-    p->buff_head = NULL;
+    p->clients = NULL;
+    p->clients_size = 0;
+    p->server_fd = -1;
     FD_ZERO(&(p->fdset));
     p->maxfd = 0;
     p->running = 0;
     p->inhibit = 0;
     p->commands = NULL;
+    p->scan = NULL;
+    p->merged = NULL;
+    p->coalesce = 0;
+    p->gap = 0;
     p->out_callback = NULL;
     p->in_callback = NULL;
     strcpy(p->ipaddress, "0.0.0.0");
@@ -58,7 +67,36 @@ initport(mb_port *p)
     p->connection_size = MB_INIT_CONNECTION_SIZE;
     p->connection_count = 0;
     p->persist = 1;
+    p->concurrent = 0;
+    p->window = 1;
+    p->tid = 0;
+    p->client_fd = -1;
+    p->heap = NULL;
+    p->heap_count = 0;
+    p->stats_time = 0;
+    bzero(&p->jitter_h, sizeof(tag_handle));
+    bzero(&p->overrun_h, sizeof(tag_handle));
+    p->cache = 1;
+    p->groups = NULL;
+    p->batch_h = NULL;
+    p->batch_data = NULL;
+    p->batch_count = 0;
+    p->batch_size = 0;
+    p->routes = NULL;
+    p->ttl = 0;
+    p->gw_cache = NULL;
+    p->gw_pipe[0] = p->gw_pipe[1] = -1;
+    p->serial = 0;
+    p->gateway = 0;
+    p->gw_head = p->gw_tail = NULL;
+    p->gw_count = 0;
     pthread_mutex_init(&p->send_lock, NULL);
+    pthread_mutex_init(&p->gw_lock, NULL);
+    /* mb_gateway_wait() figures its timeouts from the monotonic clock */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->gw_cond, &attr);
+    pthread_condattr_destroy(&attr);
 };
 
 static int
@@ -227,6 +265,8 @@ _free_cmd(mb_cmd *cmd)
 void
 mb_destroy_port(mb_port *port)
 {
+    mb_gw_request *req;
+
     mb_close_port(port);
 
     if(port->name != NULL) free(port->name);
@@ -234,6 +274,29 @@ mb_destroy_port(mb_port *port)
 
     /* destroys all of the commands */
     _free_cmd(port->commands);
+    _free_cmd(port->merged);
+
+    if(port->clients != NULL) {
+        for(int n = 0; n < port->clients_size; n++) {
+            if(port->clients[n] != NULL) {
+                close(port->clients[n]->fd);
+                free(port->clients[n]);
+            }
+        }
+        free(port->clients);
+    }
+    if(port->server_fd >= 0) close(port->server_fd);
+    if(port->gw_pipe[0] >= 0) close(port->gw_pipe[0]);
+    if(port->gw_pipe[1] >= 0) close(port->gw_pipe[1]);
+    if(port->routes != NULL) free(port->routes);
+    if(port->heap != NULL) free(port->heap);
+    mb_batch_free(port);
+    if(port->gw_cache != NULL) free(port->gw_cache);
+    while(port->gw_head != NULL) {
+        req = port->gw_head;
+        port->gw_head = req->next;
+        free(req);
+    }
 }
 
 /* This function sets the port up as a normal serial port. 'device' is the system device file that represents
@@ -242,6 +305,8 @@ mb_destroy_port(mb_port *port)
 int
 mb_set_serial_port(mb_port *port, const char *device, int baudrate, short databits, short parity, short stopbits)
 {
+    int bits;
+
     port->devtype = MB_SERIAL;
     port->device = strdup(device);
     if(port->device == NULL) {
@@ -266,6 +331,17 @@ mb_set_serial_port(mb_port *port, const char *device, int baudrate, short databi
         dax_log(DAX_LOG_ERROR, "Wrong number of stopbits passed");
         return MB_ERR_STOPBITS;
     }
+    port->parity = parity;
+    /* RTU frames are separated by 3.5 characters of silence.  Above 19200
+     * baud the spec fixes it at 1.75mSec so that it's not so short that
+     * the serial drivers can't keep up. */
+    if(baudrate > 19200) {
+        port->silence = 1750;
+    } else {
+        /* Start bit, data bits, parity bit and stop bits */
+        bits = 1 + databits + (parity == MB_NONE ? 0 : 1) + stopbits;
+        port->silence = (bits * 3500000 + baudrate - 1) / baudrate;
+    }
     return 0;
 }
 
@@ -341,14 +417,16 @@ mb_close_port(mb_port *port)
 
     if(port->devtype == MB_NETWORK) {
         for(int n=0; n<port->connection_count; n++) {
-            dax_log(DAX_LOG_COMM, "Closing Connection %d", port->connections[n].fd);
-            result = close(port->connections[n].fd);
+            if(port->connections[n].fd > 0) {
+                dax_log(DAX_LOG_COMM, "Closing Connection %d", port->connections[n].fd);
+                result = close(port->connections[n].fd);
+                if(result) {
+                    dax_log(DAX_LOG_ERROR, "Error closing network file descriptor %d", port->connections[n].fd);
+                }
+            }
             port->connections[n].addr.s_addr = 0x0000;
             port->connections[n].port = 0;
             port->connections[n].fd = 0;
-            if(result) {
-                dax_log(DAX_LOG_ERROR, "Error closing network file descriptor %d", port->connections[n].fd);
-            }
         }
         port->connection_count = 0;
     } else {
@@ -419,6 +497,20 @@ _get_unused_connection(mb_port *mp) {
     return mp->connection_count++;
 }
 
+/* Sets up the connection pool entry at index n */
+static inline void
+_init_connection(mb_port *mp, int n, struct in_addr address, uint16_t port, int fd) {
+    mp->connections[n].addr = address;
+    mp->connections[n].port = port;
+    mp->connections[n].fd = fd;
+    mp->connections[n].state = MB_CONN_IDLE;
+    mp->connections[n].head = NULL;
+    mp->connections[n].tail = NULL;
+    mp->connections[n].pending = 0;
+    mp->connections[n].hold = 0;
+    mp->connections[n].rxlen = 0;
+}
+
 /* This function retrieves a connection from the ports connection pool
  * if the conneciton does not exist then it attempts to make the connection
  * and stores that in the pool for later.  Returns the file descriptor
@@ -429,7 +521,11 @@ mb_get_connection(mb_port *mp, struct in_addr address, uint16_t port) {
 
     for(n=0;n<mp->connection_count;n++) {
         if(mp->connections[n].addr.s_addr == address.s_addr && mp->connections[n].port == port) {
-            /* We found one that matches */
+            /* We found one that matches.  The concurrent client engine leaves
+             * entries that lost their connection at -1 so we reconnect them */
+            if(mp->connections[n].fd < 0) {
+                mp->connections[n].fd = openIPport(mp, address, port);
+            }
             return mp->connections[n].fd;
         }
     }
@@ -437,13 +533,29 @@ mb_get_connection(mb_port *mp, struct in_addr address, uint16_t port) {
     fd = openIPport(mp, address, port);
     if(fd>=0) {
         n = _get_unused_connection(mp);
-        mp->connections[n].addr = address;
-        mp->connections[n].port = port;
-        mp->connections[n].fd = fd;
+        _init_connection(mp, n, address, port, fd);
     }
     return fd;
 }
 
+/* This function returns the index of the connection to the given address
+ * and port in the ports connection pool.  If there isn't one yet then a
+ * new entry is added with an fd of -1 and it's up to the caller to make
+ * the connection.  Returns a negative error code on failure. */
+int
+mb_find_connection(mb_port *mp, struct in_addr address, uint16_t port) {
+    int n;
+
+    for(n=0;n<mp->connection_count;n++) {
+        if(mp->connections[n].addr.s_addr == address.s_addr && mp->connections[n].port == port) {
+            return n;
+        }
+    }
+    n = _get_unused_connection(mp);
+    if(n < 0) return n;
+    _init_connection(mp, n, address, port, -1);
+    return n;
+}
 
 /* Adds a new command to the linked list of commands on port p
    This is the master port threads list of commands that it sends
@@ -459,12 +571,18 @@ add_cmd(mb_port *p, mb_cmd *mc)
 
     if(p->commands == NULL) {
         p->commands = mc;
+        p->scan = mc;
     } else {
         node = p->commands;
         while(node->next != NULL) {
             node = node->next;
         }
         node->next = mc;
+        node = p->scan;
+        while(node->snext != NULL) {
+            node = node->snext;
+        }
+        node->snext = mc;
     }
     return 0;
 }
@@ -510,13 +628,36 @@ mb_print_portconfig(FILE *fd, mb_port *mp)
     }
     fprintf(fd, "\n");
     fprintf(fd, "Intercommand delay: %d mSec\n", mp->delay);
-    fprintf(fd, "Interbyte Timeout: %d mSec\n", mp->frame);
+    if(mp->frame) {
+        fprintf(fd, "Interbyte Timeout: %d mSec\n", mp->frame);
+    } else {
+        fprintf(fd, "Interbyte Timeout: %d uSec\n", mp->silence);
+    }
     fprintf(fd, "Retries: %d\n", mp->retries);
     fprintf(fd, "Scan Rate: %d mSec\n", mp->scanrate);
     fprintf(fd, "Timeout: %d mSec\n", mp->timeout);
     fprintf(fd, "Max Failures: %d\n", mp->maxattempts);
     fprintf(fd, "Inhibit Time: %d Seconds\n", mp->inhibit_time);
     fprintf(fd, "Persist Connection: %s\n", mp->persist ? "Yes" : "No");
+    if(mp->coalesce) {
+        fprintf(fd, "Coalesce Reads: Yes, gap %d\n", mp->gap);
+    }
+    if(mp->type == MB_SLAVE) {
+        fprintf(fd, "Register Cache: %s\n", mp->cache ? "Yes" : "No");
+    }
+    if(mp->routes != NULL) {
+        fprintf(fd, "Gateway Cache: %d mSec\n", mp->ttl);
+        for(int n = 1; n < 256; n++) {
+            if(mp->routes[n] == NULL) continue;
+            i = n;
+            while(n < 255 && mp->routes[n + 1] == mp->routes[i]) n++;
+            fprintf(fd, "  units %d-%d forwarded to %s\n", i, n, mp->routes[i]->name);
+        }
+    }
+    if(mp->protocol == MB_TCP && mp->type == MB_CLIENT) {
+        fprintf(fd, "Concurrent Scanning: %s\n", mp->concurrent ? "Yes" : "No");
+        fprintf(fd, "Transaction Window: %d\n", mp->window);
+    }
 
     mc = mp->commands;
     if(mc == NULL) fprintf(fd, "No commands configured for this port\n");
@@ -0,0 +1,207 @@
+/* mbsched.c - Modbus (tm) Communications Library
+ * Copyright (C) 2024 Phil Birkelbach
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Source file for the master and client command scheduler.  Every
+ * continuous command has its own period and the time that it is due next
+ * on the monotonic clock.  The commands are kept in a heap ordered by
+ * that time.  When the port wakes up, every command that is due is marked
+ * and the next deadline is figured from the last one, not from when the
+ * command was actually sent, so the phase of a command doesn't drift no
+ * matter how long the other commands take.  The port then sleeps until the
+ * earliest deadline with an absolute clock_nanosleep().
+ *
+ * If a command is so late that its next deadline has already gone by, the
+ * periods that it missed are counted as overruns and it is put back on
+ * its own schedule rather than being sent several times in a row.
+ */
+
+#include "modbus.h"
+#include <time.h>
+
+extern dax_state *ds;
+
+/* How often the jitter and overrun tags are written, in nSec */
+#define STATS_INTERVAL 1000000000ULL
+
+uint64_t
+mb_sched_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+_to_timespec(uint64_t t, struct timespec *ts)
+{
+    ts->tv_sec = t / 1000000000ULL;
+    ts->tv_nsec = t % 1000000000ULL;
+}
+
+/* Moves the command at index n down the heap until it is in order */
+static void
+_sift_down(mb_port *mp, int n)
+{
+    mb_cmd *mc = mp->heap[n];
+    int child;
+
+    while((child = n * 2 + 1) < mp->heap_count) {
+        if(child + 1 < mp->heap_count &&
+           mp->heap[child + 1]->deadline < mp->heap[child]->deadline) {
+            child++;
+        }
+        if(mp->heap[child]->deadline >= mc->deadline) break;
+        mp->heap[n] = mp->heap[child];
+        n = child;
+    }
+    mp->heap[n] = mc;
+}
+
+/* Builds the heap from the continuous commands in the port's scan list.
+ * They are all due right away.  Returns 0 on success or an error code. */
+int
+mb_sched_init(mb_port *mp)
+{
+    mb_cmd *mc;
+    uint64_t now;
+    int count = 0;
+
+    for(mc = mp->scan; mc != NULL; mc = mc->snext) {
+        if(mc->mode & MB_CONTINUOUS) count++;
+    }
+    if(mp->heap != NULL) free(mp->heap);
+    mp->heap = NULL;
+    mp->heap_count = 0;
+    if(count == 0) return 0;
+
+    mp->heap = malloc(sizeof(mb_cmd *) * count);
+    if(mp->heap == NULL) return MB_ERR_ALLOC;
+    now = mb_sched_now();
+    for(mc = mp->scan; mc != NULL; mc = mc->snext) {
+        if(!(mc->mode & MB_CONTINUOUS)) continue;
+        if(mc->period == 0) {
+            /* The old way of figuring how often the command is sent */
+            mc->period = (mc->interval ? mc->interval : 1) * mp->scanrate;
+        }
+        mc->deadline = now;
+        mc->due = 0;
+        mp->heap[mp->heap_count++] = mc;
+    }
+    mp->stats_time = now + STATS_INTERVAL;
+    return 0;
+}
+
+/* Marks every command that is due now and moves its deadline on to the next
+ * period.  Returns the number of enabled commands that were marked. */
+int
+mb_sched_collect(mb_port *mp)
+{
+    mb_cmd *mc;
+    uint64_t now, period, missed;
+    int count = 0;
+
+    now = mb_sched_now();
+    while(mp->heap_count && mp->heap[0]->deadline <= now) {
+        mc = mp->heap[0];
+        period = (uint64_t)mc->period * 1000000;
+        if(mc->enable && mp->enable) {
+            mc->due = 1;
+            mc->due_time = mc->deadline;
+            count++;
+        }
+        mc->deadline += period;
+        if(mc->deadline <= now) {
+            missed = (now - mc->deadline) / period + 1;
+            if(mc->enable && mp->enable) mc->overruns += missed;
+            mc->deadline += missed * period;
+        }
+        _sift_down(mp, 0);
+    }
+    return count;
+}
+
+/* Called right before a marked command is sent.  Clears the mark and keeps
+ * track of how late the command is. */
+void
+mb_sched_start(mb_cmd *mc)
+{
+    int64_t late;
+
+    mc->due = 0;
+    late = (int64_t)(mb_sched_now() - mc->due_time) / 1000;
+    if(late > INT32_MAX) late = INT32_MAX;
+    if(late > mc->jitter) mc->jitter = late;
+}
+
+/* Returns the time (nSec monotonic) that the next command is due */
+uint64_t
+mb_sched_next(mb_port *mp)
+{
+    if(mp->heap_count == 0) {
+        return mb_sched_now() + (uint64_t)mp->scanrate * 1000000;
+    }
+    return mp->heap[0]->deadline;
+}
+
+/* Sleeps until the next command is due.  Gateway requests are still sent
+ * while we wait. */
+void
+mb_sched_sleep(mb_port *mp)
+{
+    struct timespec ts;
+
+    _to_timespec(mb_sched_next(mp), &ts);
+    if(mp->gateway) {
+        mb_gateway_wait(mp, &ts);
+    } else {
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    }
+}
+
+/* Writes the jitter and overrun tags for the port if it's time.  The jitter
+ * is the latest that each command was sent since the last time the tags were
+ * written, in uSec.  The tags are in the same order as the commands in the
+ * configuration, the same as the enable tag. */
+void
+mb_sched_stats(mb_port *mp)
+{
+    mb_cmd *mc, *src;
+    uint64_t now;
+    int n;
+
+    now = mb_sched_now();
+    if(now < mp->stats_time) return;
+    mp->stats_time = now + STATS_INTERVAL;
+    if(mp->jitter_h.index == 0 || mp->overrun_h.index == 0) return;
+
+    dax_dint jitter[mp->jitter_h.count];
+    dax_udint overruns[mp->overrun_h.count];
+
+    n = 0;
+    for(mc = mp->commands; mc != NULL && n < mp->jitter_h.count; mc = mc->next) {
+        /* Merged commands are sent for all of their members */
+        src = mc->merge ? mc->merge : mc;
+        jitter[n] = src->jitter;
+        overruns[n] = src->overruns;
+        n++;
+    }
+    for(mc = mp->commands; mc != NULL; mc = mc->next) mc->jitter = 0;
+    for(mc = mp->merged; mc != NULL; mc = mc->next) mc->jitter = 0;
+    dax_write_tag(ds, mp->jitter_h, jitter);
+    dax_write_tag(ds, mp->overrun_h, overruns);
+}
@@ -16,32 +16,66 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  *
  * Source file for TCP Server functionality
+ *
+ * Each client connection has its own frame buffer that is found directly
+ * from the file descriptor.  A read can end in the middle of a frame or it
+ * can contain more than one frame if the client pipelines its requests, so
+ * whatever is left over after all of the complete frames are handled is
+ * kept for the next read.  We wait on the sockets with epoll when we have
+ * it and fall back to select() when we don't.
+ *
+ * If the port is a gateway the requests for the routed unit IDs are handed
+ * to mbgateway.c and the responses come back through the gateway pipe.
  */
 
 #include "modbus.h"
+#include <netinet/tcp.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+
+#define MAX_EVENTS 64
+#endif
 
 extern dax_state *ds;
 extern pthread_barrier_t port_barrier;
 extern pthread_mutex_t port_lock;
 
 
-/* These two functions are wrappers to deal with adding and deleting
-   file descriptors to the global _fdset and dealing with _maxfd */
-static void
+/* These two functions add and remove file descriptors from whatever we
+ * are using to wait on the sockets. */
+static int
 _add_fd(mb_port *port, int fd)
 {
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if(epoll_ctl(port->server_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        return MB_ERR_GENERIC;
+    }
+#else
+    if(fd >= FD_SETSIZE) return MB_ERR_GENERIC;
     FD_SET(fd, &(port->fdset));
     if(fd > port->maxfd) port->maxfd = fd;
+#endif
+    return 0;
 }
 
 static void
 _del_fd(mb_port *port, int fd)
 {
+#ifdef HAVE_SYS_EPOLL_H
+    /* Closing the socket would take it out of the epoll set but not if
+     * the descriptor has been duplicated somewhere */
+    epoll_ctl(port->server_fd, EPOLL_CTL_DEL, fd, NULL);
+#else
     int n, tmpfd = 0;
 
     FD_CLR(fd, &(port->fdset));
 
-    /* If it's the largest one then we need to re-figure _maxfd */
+    /* If it's the largest one then we need to re-figure maxfd */
     if(fd == port->maxfd) {
         for(n = 0; n <= port->maxfd; n++) {
             if(FD_ISSET(n, &(port->fdset))) {
@@ -50,118 +84,108 @@ _del_fd(mb_port *port, int fd)
         }
         port->maxfd = tmpfd;
     }
+#endif
 }
 
 static int
 _add_connection(mb_port *port, int fd)
 {
-    struct client_buffer *new;
-
-    new = malloc(sizeof(struct client_buffer));
+    client_buffer *new, **list;
+    int size;
+
+    /* Make sure that the array is big enough to be indexed by this fd */
+    if(fd >= port->clients_size) {
+        size = port->clients_size ? port->clients_size : 16;
+        while(size <= fd) size *= 2;
+        list = realloc(port->clients, sizeof(client_buffer *) * size);
+        if(list == NULL) return MB_ERR_ALLOC;
+        memset(&list[port->clients_size], 0, sizeof(client_buffer *) * (size - port->clients_size));
+        port->clients = list;
+        port->clients_size = size;
+    }
+    new = malloc(sizeof(client_buffer));
     if(new == NULL) return MB_ERR_ALLOC;
 
     new->fd = fd;
+    new->serial = ++port->serial;
     new->buffindex = 0;
-
-    if(port->buff_head == NULL) {
-        /* If it's the first one just put it on top */
-        new->next = NULL;
-    } else {
-        /* Just jam the thing onto the top of the list */
-        new->next = port->buff_head;
-    }
-    port->buff_head = new;
-    _add_fd(port, fd);
-    return 0;
-}
-
-/* Loops through the client buffer linked list of the port and sets
- * the index to 0, effectively deleting the buffers. */
-static int
-_clear_buffers(mb_port *port)
-{
-    struct client_buffer *this;
-
-    this = port->buff_head;
-
-    while(this != NULL) {
-        this->buffindex = 0;
-        this = this->next;
+    if(_add_fd(port, fd)) {
+        free(new);
+        return MB_ERR_GENERIC;
     }
+    port->clients[fd] = new;
     return 0;
 }
 
 static int
 _del_connection(mb_port *port, int fd)
 {
-
-    close(fd);
     _del_fd(port, fd);
-    return 0;
-}
-
-static struct client_buffer *
-_get_buff_ptr(mb_port *port, int fd)
-{
-    struct client_buffer *this;
-
-    this = port->buff_head;
-    while(this != NULL) {
-        if(this->fd == fd) {
-            return this;
-        }
-        this = this->next;
+    close(fd);
+    if(fd < port->clients_size && port->clients[fd] != NULL) {
+        free(port->clients[fd]);
+        port->clients[fd] = NULL;
     }
-    return NULL;
+    return 0;
 }
 
+/* Reads whatever is available on the connection and answers every complete
+ * request that we have.  Anything left over is the beginning of the next
+ * request and is moved to the front of the buffer. */
 static int
-_mb_read(mb_port *port, int fd)
+_mb_read(mb_port *port, client_buffer *cc)
 {
-    int result, size;
-    unsigned char buff[100];
-    struct client_buffer *cc;
+    int result, length, offset;
+    uint8_t frame[MB_TCP_ADU_SIZE];
     uint16_t msgsize;
 
-    size = 100;
-    result = read(fd, buff, size);
+    result = read(cc->fd, &cc->buff[cc->buffindex], MB_TCP_ADU_SIZE - cc->buffindex);
     if(result < 0) {
+        if(errno == EAGAIN || errno == EINTR) return 0;
         return MB_ERR_RECV_FAIL;
     } if(result == 0) { /* EOF means the other guy is closed */
         return MB_ERR_NO_SOCKET;
     }
-
-    cc = _get_buff_ptr(port, fd);
-    assert(cc != NULL); /* If we get this far cc should exist in the port */
-
-    /* Check that we haven't received too big of a message */
-    if((result + cc->buffindex) > MB_BUFF_SIZE) {
-        return MB_ERR_OVERFLOW;
-    }
-    memcpy(&(cc->buff[cc->buffindex]), buff, result); /* Copy the new data to the buffer */
     cc->buffindex += result;
-    if(cc->buffindex > 5) {
-        COPYWORD(&msgsize, (uint16_t *)&cc->buff[4]); /* Get the Modbus Message size */
-        if(cc->buffindex >= (msgsize + 6)) {
-            if(port->in_callback) {
-                port->in_callback(port, cc->buff, cc->buffindex);
-            }
 
-            result = create_response(port, &(cc->buff[6]), MB_BUFF_SIZE - 6);
-            if(result > 0) { /* We have a response */
-                msgsize = result;
-                COPYWORD(&(cc->buff[4]), &msgsize);
-                if(port->out_callback) {
-                    port->out_callback(port, cc->buff, result + 6);
-                }
-                write(cc->fd, cc->buff, result + 6);
-                cc->buffindex = 0;
-            } else if(result < 0) {
-                dax_log(DAX_LOG_ERROR, "Error Code Returned %d", result);
-                return result;
+    offset = 0;
+    while(cc->buffindex - offset > 5) {
+        /* Get the Modbus Message size */
+        length = ((int)cc->buff[offset + 4] << 8 | cc->buff[offset + 5]) + 6;
+        /* The header is bad or the message won't fit in our buffer */
+        if(length < 8 || length > MB_TCP_ADU_SIZE) {
+            return MB_ERR_OVERFLOW;
+        }
+        if(cc->buffindex - offset < length) break; /* Wait for the rest */
+
+        /* The response is built in place and it may be longer than the request
+         * so we work on a copy to keep from writing over the next request. */
+        memcpy(frame, &cc->buff[offset], length);
+        offset += length;
+        if(port->in_callback) {
+            port->in_callback(port, frame, length);
+        }
+        if(port->routes != NULL && port->routes[frame[6]] != NULL) {
+            mb_gateway_request(port, cc, frame, length);
+            continue;
+        }
+
+        result = create_response(port, &frame[6], MB_TCP_ADU_SIZE - 6);
+        if(result > 0) { /* We have a response */
+            msgsize = result;
+            COPYWORD(&frame[4], &msgsize);
+            if(port->out_callback) {
+                port->out_callback(port, frame, result + 6);
             }
+            write(cc->fd, frame, result + 6);
+        } else if(result < 0) {
+            dax_log(DAX_LOG_ERROR, "Error Code Returned %d", result);
         }
     }
+    if(offset) {
+        cc->buffindex -= offset;
+        memmove(cc->buff, &cc->buff[offset], cc->buffindex);
+    }
     return 0;
 }
 
@@ -198,66 +222,122 @@ _server_listen(mb_port *port)
         close(fd);
         return -1;
     }
+#ifdef HAVE_SYS_EPOLL_H
+    port->server_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(port->server_fd < 0) {
+        dax_log(DAX_LOG_ERROR, "Unable to create epoll instance - %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+#endif
     /* We store this fd so that we know what socket we are listening on */
     port->fd = fd;
-    _add_fd(port, fd);
-
+    if(_add_fd(port, fd)) {
+        close(fd);
+        return -1;
+    }
+    if(port->routes != NULL) {
+        if(mb_gateway_init(port) || _add_fd(port, port->gw_pipe[0])) {
+            dax_log(DAX_LOG_ERROR, "Unable to start the gateway on port %s", port->name);
+            return -1;
+        }
+    }
     return 0;
 }
 
+static void
+_accept(mb_port *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd, one = 1;
+
+    fd = accept(port->fd, (struct sockaddr *)&addr, &len);
+    if(fd < 0) {
+        /* TODO: Need to handle these communication errors */
+        dax_log(DAX_LOG_ERROR, "Error Accepting socket: %s", strerror(errno));
+        return;
+    }
+    /* Responses are small and we don't want them to wait on Nagle */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if(_add_connection(port, fd)) {
+        dax_log(DAX_LOG_ERROR, "Unable to add connection from %s", inet_ntoa(addr.sin_addr));
+        close(fd);
+        return;
+    }
+    dax_log(DAX_LOG_MAJOR, "Accepted connection from %s on fd %d", inet_ntoa(addr.sin_addr), fd);
+}
+
+/* Handles the data that is waiting on the client socket 'fd' */
+static void
+_service(mb_port *port, int fd)
+{
+    int result;
+
+    if(fd >= port->clients_size || port->clients[fd] == NULL) return;
+    result = _mb_read(port, port->clients[fd]);
+    if(result == MB_ERR_NO_SOCKET) { /* This is the end of file */
+        dax_log(DAX_LOG_MAJOR, "Disconnected socket on fd %d", fd);
+        _del_connection(port, fd);
+    } else if(result == MB_ERR_OVERFLOW) {
+        /* We can't find the next frame in the stream after this */
+        dax_log(DAX_LOG_ERROR, "Bad frame received on fd %d, closing connection", fd);
+        _del_connection(port, fd);
+    } else if(result < 0) {
+        dax_log(DAX_LOG_ERROR, "Receive error on fd %d - %s", fd, strerror(errno));
+        _del_connection(port, fd);
+    }
+}
+
 /* This function blocks waiting for a message to be received.  Once a message
  * is retrieved from the system the proper handling function is called */
-int
+static int
 _receive(mb_port *port)
 {
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[MAX_EVENTS];
+    int count, n;
+
+    count = epoll_wait(port->server_fd, events, MAX_EVENTS, -1);
+    if(count < 0) {
+        /* Ignore interruption by signal */
+        if(errno == EINTR) return 0;
+        return MB_ERR_RECV_FAIL;
+    }
+    for(n = 0; n < count; n++) {
+        if(events[n].data.fd == port->fd) { /* This is the listening socket */
+            _accept(port);
+        } else if(events[n].data.fd == port->gw_pipe[0]) {
+            mb_gateway_deliver(port);
+        } else {
+            _service(port, events[n].data.fd);
+        }
+    }
+#else
     fd_set tmpset;
-    struct timeval tm;
-    struct sockaddr_in addr;
-    int result, fd, n;
-    socklen_t len = 0;
+    int result, n;
 
     FD_ZERO(&tmpset);
     FD_COPY(&(port->fdset), &tmpset);
-    tm.tv_sec = 1; /* TODO: this should be configuration */
-    tm.tv_usec = 0;
-
-    result = select(port->maxfd + 1, &tmpset, NULL, NULL, &tm);
 
+    result = select(port->maxfd + 1, &tmpset, NULL, NULL, NULL);
     if(result < 0) {
         /* Ignore interruption by signal */
-        if(errno == EINTR) {
-            ; /* TODO: check to see if we should die here */
-        } else {
-            /* TODO: Deal with these errors */
-            return MB_ERR_RECV_FAIL;
-        }
-    } else if(result == 0) { /* Timeout */
-        _clear_buffers(port); /* this erases all of the _buffer nodes */
-        return 0;
-    } else {
-        for(n = 0; n <= port->maxfd; n++) {
-            if(FD_ISSET(n, &tmpset)) {
-                if(n == port->fd) { /* This is a listening socket */
-                    fd = accept(n, (struct sockaddr *)&addr, &len);
-                    if(fd < 0) {
-                        /* TODO: Need to handle these communication errors */
-                        dax_log(DAX_LOG_ERROR, "Error Accepting socket: %s", strerror(errno));
-                    } else {
-                        dax_log(DAX_LOG_MAJOR, "Accepted socket on fd %d", n);
-                        _add_connection(port, fd);
-                    }
-                } else {
-                    result = _mb_read(port, n);
-                    if(result == MB_ERR_NO_SOCKET) { /* This is the end of file */
-                        dax_log(DAX_LOG_MAJOR, "Disconnected socket on fd %d", n);
-                        _del_connection(port, n);
-                    } else if(result < 0) {
-                        return result; /* Pass the error up */
-                    }
-                }
+        if(errno == EINTR) return 0;
+        return MB_ERR_RECV_FAIL;
+    }
+    for(n = 0; n <= port->maxfd; n++) {
+        if(FD_ISSET(n, &tmpset)) {
+            if(n == port->fd) { /* This is the listening socket */
+                _accept(port);
+            } else if(n == port->gw_pipe[0]) {
+                mb_gateway_deliver(port);
+            } else {
+                _service(port, n);
             }
         }
     }
+#endif
     return 0;
 }
 
@@ -277,13 +357,8 @@ server_loop(mb_port *port)
     while(1) {
         result = _receive(port);
         if(result) {
-            if(result == MB_ERR_OVERFLOW) {
-                dax_log(DAX_LOG_ERROR, "Buffer Overflow Attempt");
-            } else {
-                dax_log(DAX_LOG_ERROR, "Receive error - %s", strerror(result));
-            }
+            dax_log(DAX_LOG_ERROR, "Receive error - %s", strerror(errno));
         }
     }
     return -1; /* Can never get here */
 }
-
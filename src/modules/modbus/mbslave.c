@@ -19,83 +19,55 @@
  */
 
 #include "modbus.h"
-#include <sys/stat.h>
-#include <sys/select.h>
 
 extern dax_state *ds;
 
 static int
 _mb_read(mb_port *port, int fd)
 {
-    int result;
+    int result, length;
     unsigned char buff[MB_BUFF_SIZE];
-    int buffindex;
     uint16_t checksum;
-    struct stat staterr;
-    fd_set readfs, errfs;
-    struct timeval timeout;
-    int state=0; /* 0 = waiting */
-
-    buffindex = 0;
 
     /* Read a frame from the serial port */
-    while(1) {
-        if(state == 0) { /* Waiting */
-            timeout.tv_usec = (port->timeout % 1000) * 1000;
-            timeout.tv_sec = port->timeout / 1000;
-            FD_ZERO(&readfs);
-            FD_SET(fd, &readfs);
-            FD_ZERO(&errfs);
-            FD_SET(fd, &errfs);
-            result = select(fd+1, &readfs, NULL, &errfs, &timeout);
-            if(FD_ISSET(fd, &readfs)) {
-                state = 1; /* We have data to read */
-            }
-        } else if(state == 1) { /* reading frame */
-            result = read(fd, &buff[buffindex], MB_BUFF_SIZE-buffindex);
-            if(result < 0) {
-                dax_log(DAX_LOG_ERROR, "Error reading Serial port on fd = %d", fd);
-                return MB_ERR_RECV_FAIL;
-            } else if(result > 0) {
-                buffindex += result;
-                if(buffindex > MB_BUFF_SIZE) {
-                    return MB_ERR_OVERFLOW;
-                }
-            } else {
-                result = stat(port->device, &staterr);
-                if(result) {
-                    close(fd);
-                    port->fd = 0;
-                    return MB_ERR_PORTFAIL;
-                }
-                break; /* One way or another we are at the end of our frame */
-            }
-            // TODO: Need to calculate this based on serial parameters.
-            usleep(port->frame*1000); /* Inter byte timeout */
-        }
+    length = mb_rtu_read(port, buff, MB_BUFF_SIZE, port->timeout, mb_rtu_request_length);
+    if(length == 0) return 0; /* Nothing this time */
+    if(length == MB_ERR_PORTFAIL) {
+        close(fd);
+        port->fd = 0;
+        return length;
+    } else if(length == MB_ERR_OVERFLOW) {
+        mb_rtu_drain(port);
+        return 0;
+    } else if(length < 0) {
+        dax_log(DAX_LOG_ERROR, "Error reading Serial port on fd = %d", fd);
+        return length;
     }
-    if(buffindex > 0) {
-        if(port->in_callback) {
-            port->in_callback(port, buff, buffindex);
-        }
 
-        /* Check the checksum here. */
-        result = crc16check(buff, buffindex);
-        if(result) {
-            result = create_response(port, buff, MB_BUFF_SIZE);
-            if(result > 0) { /* We have a response */
-                checksum = crc16(buff, result);
-                COPYWORD(&(buff[result]), &checksum);
-                if(port->out_callback) {
-                    port->out_callback(port, buff, result+2);
-                }
-                write(fd, buff, result+2);
-                buffindex = 0;
-            } else if(result < 0) {
-                dax_log(DAX_LOG_ERROR, "Error reading serial port data %d\n", result);
-                return result;
+    if(port->in_callback) {
+        port->in_callback(port, buff, length);
+    }
+
+    /* Check the checksum here. */
+    result = crc16check(buff, length);
+    if(result) {
+        result = create_response(port, buff, MB_BUFF_SIZE - 2);
+        if(result > 0) { /* We have a response */
+            checksum = crc16(buff, result);
+            COPYWORD(&(buff[result]), &checksum);
+            if(port->out_callback) {
+                port->out_callback(port, buff, result+2);
             }
+            write(fd, buff, result+2);
+        } else if(result < 0) {
+            dax_log(DAX_LOG_ERROR, "Error reading serial port data %d\n", result);
+            return result;
         }
+    } else {
+        /* This might be part of a frame for another slave that we didn't
+         * find the end of.  Wait for the line to go quiet before we look
+         * for the next request. */
+        mb_rtu_drain(port);
     }
     return 0;
 }
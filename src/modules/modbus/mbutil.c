@@ -19,6 +19,16 @@
  */
 
 #include <modbus.h>
+#include <sys/select.h>
+#include <time.h>
+
+/* MB_CRC_SLICE is the number of bytes of the message that the CRC
+ * calculation handles in each step.  1 is the original algorithm from the
+ * Modbus spec.  The others use the slice-by-N method which needs a table
+ * for each byte of the slice but gets rid of most of the dependency between
+ * one byte and the next. */
+
+#if MB_CRC_SLICE == 1
 
 /* CRC table straight from the modbus spec */
 static unsigned char aCRCHi[] = {
@@ -82,6 +92,67 @@ crc16(unsigned char *msg, unsigned short length)
     return (CRCHi << 8 | CRCLo);
 };
 
+#elif MB_CRC_SLICE == 4 || MB_CRC_SLICE == 8
+
+/* _crc_table[0] is the normal table for the reflected 0xA001 polynomial.
+ * _crc_table[k][n] is the CRC of byte n followed by k zero bytes. */
+static uint16_t _crc_table[MB_CRC_SLICE][256];
+static pthread_once_t _crc_once = PTHREAD_ONCE_INIT;
+
+static void
+_crc_init(void)
+{
+    uint16_t crc;
+    int n, k;
+
+    for(n = 0; n < 256; n++) {
+        crc = n;
+        for(k = 0; k < 8; k++) {
+            crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+        _crc_table[0][n] = crc;
+    }
+    for(k = 1; k < MB_CRC_SLICE; k++) {
+        for(n = 0; n < 256; n++) {
+            crc = _crc_table[k - 1][n];
+            _crc_table[k][n] = (crc >> 8) ^ _crc_table[0][crc & 0xFF];
+        }
+    }
+}
+
+/* Modbus CRC16 checksum calculation.  The result is byte swapped the same way
+ * as the original table algorithm so that COPYWORD() puts it in the message
+ * in the right order. */
+uint16_t
+crc16(unsigned char *msg, unsigned short length)
+{
+    uint16_t crc = 0xFFFF;
+
+    pthread_once(&_crc_once, _crc_init);
+    while(length >= MB_CRC_SLICE) {
+        crc ^= msg[0] | (uint16_t)msg[1] << 8;
+#if MB_CRC_SLICE == 8
+        crc = _crc_table[7][crc & 0xFF] ^ _crc_table[6][crc >> 8] ^
+              _crc_table[5][msg[2]] ^ _crc_table[4][msg[3]] ^
+              _crc_table[3][msg[4]] ^ _crc_table[2][msg[5]] ^
+              _crc_table[1][msg[6]] ^ _crc_table[0][msg[7]];
+#else
+        crc = _crc_table[3][crc & 0xFF] ^ _crc_table[2][crc >> 8] ^
+              _crc_table[1][msg[2]] ^ _crc_table[0][msg[3]];
+#endif
+        msg += MB_CRC_SLICE;
+        length -= MB_CRC_SLICE;
+    }
+    while(length--) {
+        crc = (crc >> 8) ^ _crc_table[0][(crc ^ *msg++) & 0xFF];
+    }
+    return (crc << 8) | (crc >> 8);
+}
+
+#else
+#  error "MB_CRC_SLICE must be 1, 4 or 8"
+#endif
+
 /* Checks the checksum of the modbus message given by *buff 
  * length should be the length of the modbus data buffer INCLUDING the
  * two byte checksum.  Returns 1 if checksum matches */
@@ -96,3 +167,127 @@ crc16check(uint8_t *buff, int length)
     else return 0;
 };
 
+
+static long
+_usec_since(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/* Waits up to 'usec' for data on the port.  Returns 1 if there is data,
+ * 0 on timeout or a negative error */
+static int
+_rtu_wait(mb_port *mp, long usec)
+{
+    fd_set fds;
+    struct timeval tv;
+    int result;
+
+    FD_ZERO(&fds);
+    FD_SET(mp->fd, &fds);
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
+    result = select(mp->fd + 1, &fds, NULL, NULL, &tv);
+    if(result < 0) {
+        if(errno == EINTR) return 0;
+        return MB_ERR_RECV_FAIL;
+    }
+    return result;
+}
+
+/* Returns the length that the RTU request at the start of buff should be
+ * including the CRC.  Returns 0 if we need more of the frame to tell or
+ * -1 if we don't know the function code. */
+int
+mb_rtu_request_length(uint8_t *buff, int count)
+{
+    if(count < 2) return 0;
+    switch(buff[1]) {
+        case 1: case 2: case 3: case 4: case 5: case 6:
+            return 8;
+        case 15: case 16:
+            if(count < 7) return 0;
+            return buff[6] + 9;
+        default:
+            return -1;
+    }
+}
+
+/* Same as above for the responses that a master would receive */
+int
+mb_rtu_response_length(uint8_t *buff, int count)
+{
+    if(count < 2) return 0;
+    if(buff[1] & 0x80) return 5; /* Exception */
+    switch(buff[1]) {
+        case 1: case 2: case 3: case 4:
+            if(count < 3) return 0;
+            return buff[2] + 5;
+        case 5: case 6: case 15: case 16:
+            return 8;
+        default:
+            return -1;
+    }
+}
+
+/* Reads a single RTU frame from the serial port into buff.  We wait up to
+ * 'timeout' mSec for the frame to arrive.  The 'length' function tells us
+ * how long the frame should be from the first few bytes so we can return as
+ * soon as we have it all.  If it can't tell then the frame ends when the line
+ * has been silent for 3.5 characters.  Returns the number of bytes in the
+ * frame, 0 on timeout or a negative error code */
+int
+mb_rtu_read(mb_port *mp, uint8_t *buff, int size, int timeout, int (*length)(uint8_t *, int))
+{
+    struct timespec start;
+    long wait, gap;
+    int result, count = 0, expect = 0;
+
+    gap = mp->frame ? mp->frame * 1000L : mp->silence;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(1) {
+        if(expect < 0) {
+            wait = gap;
+        } else {
+            /* Until we have the whole frame we wait for the rest of the
+             * timeout.  USB adapters often deliver a frame in pieces with
+             * gaps that are longer than the silent interval. */
+            wait = timeout * 1000L - _usec_since(&start);
+            if(wait < 0) wait = 0;
+        }
+        result = _rtu_wait(mp, wait);
+        if(result < 0) return result;
+        if(result == 0) {
+            if(count || wait == 0) return count; /* Whatever we have is the frame */
+            continue; /* Interrupted */
+        }
+        result = read(mp->fd, &buff[count], size - count);
+        if(result < 0) {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            return MB_ERR_RECV_FAIL;
+        }
+        if(result == 0) return MB_ERR_PORTFAIL; /* Readable but no data means it's gone */
+        count += result;
+        if(expect == 0) expect = length(buff, count);
+        if(expect > 0 && count >= expect) return expect;
+        if(count >= size) return MB_ERR_OVERFLOW;
+    }
+}
+
+/* Throws away everything on the port until the line has been silent for the
+ * interframe time.  This gets us lined up with the start of the next frame
+ * after we receive garbage. */
+void
+mb_rtu_drain(mb_port *mp)
+{
+    uint8_t buff[64];
+    long gap;
+
+    gap = mp->frame ? mp->frame * 1000L : mp->silence;
+    while(_rtu_wait(mp, gap) > 0) {
+        if(read(mp->fd, buff, sizeof(buff)) <= 0) return;
+    }
+}
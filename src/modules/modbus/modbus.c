@@ -93,54 +93,61 @@ mb_run_port(struct mb_port *m_port)
 
 /* This is the primary event loop for a Modbus TCP client.  It calls the functions
    to send the request and receive the responses.  It also takes care of the
-   retries and the counters. */
+   retries and the counters.  The scheduler in mbsched.c decides which commands
+   are due each time we wake up. */
 int
 client_loop(mb_port *mp)
 {
-    long time_spent;
     struct mb_cmd *mc;
-    struct timeval start, end;
 
     mp->running = 1; /* Tells the world that we are going */
     mp->attempt = 0;
     mp->dienow = 0;
 
+    if(mp->concurrent && mb_client_init(mp)) {
+        dax_log(DAX_LOG_WARN, "Concurrent scanning is not available for port %s", mp->name);
+        mp->concurrent = 0;
+    }
+    if(mb_sched_init(mp)) {
+        dax_log(DAX_LOG_ERROR, "Unable to allocate the command schedule for port %s", mp->name);
+        mp->running = 0;
+        return MB_ERR_ALLOC;
+    }
+    /* Groups that fail just leave their commands to be read one at a time */
+    if(mb_batch_init(mp) == MB_ERR_ALLOC) {
+        dax_log(DAX_LOG_ERROR, "Unable to allocate the tag server batch for port %s", mp->name);
+        mp->running = 0;
+        return MB_ERR_ALLOC;
+    }
+
     while(1) {
-        gettimeofday(&start, NULL);
-        if(mp->enable) { /* If enable=0 then pause for the scanrate and try again. */
-            mc = mp->commands;
-
-            while(mc != NULL) {
-                /* Only if the command is enabled and the interval counter is over */
-                if(mc->enable && (mc->mode & MB_CONTINUOUS) && (++mc->icount >= mc->interval)) {
-                    mc->icount = 0;
+        if(mb_sched_collect(mp)) {
+            mb_batch_prefetch(mp);
+            if(mp->concurrent) {
+                mb_client_scan(mp);
+            } else {
+                for(mc = mp->scan; mc != NULL; mc = mc->snext) {
+                    if(!mc->due) continue;
+                    mb_sched_start(mc);
                     if(mp->maxattempts) {
                         mp->attempt++;
                     }
-                    if( mb_send_command(mp, mc) > 0 ) {
+                    if( mb_scan_command(mp, mc) > 0 ) {
                         mp->attempt = 0; /* Good response, reset counter */
                     }
-//                    if((mp->maxattempts && mp->attempt >= mp->maxattempts) || mp->dienow) {
-//                        mp->inhibit_temp = 0;
-//                        mp->inhibit = 1;
-//                    }
+                    if(mp->delay > 0) usleep(mp->delay * 1000);
                 }
-                if(mp->delay > 0) usleep(mp->delay * 1000);
-                mc = mc->next; /* get next command from the linked list */
-            } /* End of while for sending commands */
+            }
+            mb_batch_flush(mp);
         }
-        /* This calculates the length of time that it took to send the messages on this port
-           and then subtracts that time from the port's scanrate and calls usleep to hold
-           for the right amount of time.  */
-        gettimeofday(&end, NULL);
-        time_spent = (end.tv_sec-start.tv_sec)*1000 + (end.tv_usec/1000 - start.tv_usec/1000);
-        /* If it takes longer than the scanrate then just go again instead of sleeping */
-        if(time_spent < mp->scanrate) {
+        mb_sched_stats(mp);
+        /* If the next command isn't due yet we sleep until it is */
+        if(mb_sched_next(mp) > mb_sched_now()) {
             if(!mp->persist) {
                 mb_close_port(mp);
             }
             mp->scanning = 0; /* We're going to assume this is atomic for now */
-            usleep((mp->scanrate - time_spent) * 1000);
+            mb_sched_sleep(mp);
             mp->scanning = 1;
         }
     }
@@ -154,66 +161,78 @@ client_loop(mb_port *mp)
 
 /* This is the primary event loop for a Modbus master.  It calls the functions
    to send the request and receive the responses.  It also takes care of the
-   retries and the counters. */
+   retries and the counters.  The scheduler in mbsched.c decides which commands
+   are due each time we wake up. */
 int
 master_loop(mb_port *mp)
 {
-    long time_spent;
     int result;
     struct mb_cmd *mc;
-    struct timeval start, end;
-    unsigned char bail = 0;
 
     mp->running = 1; /* Tells the world that we are going */
     mp->attempt = 0;
     mp->dienow = 0;
 
+    if(mb_sched_init(mp)) {
+        dax_log(DAX_LOG_ERROR, "Unable to allocate the command schedule for port %s", mp->name);
+        mp->running = 0;
+        return MB_ERR_ALLOC;
+    }
+    /* Groups that fail just leave their commands to be read one at a time */
+    if(mb_batch_init(mp) == MB_ERR_ALLOC) {
+        dax_log(DAX_LOG_ERROR, "Unable to allocate the tag server batch for port %s", mp->name);
+        mp->running = 0;
+        return MB_ERR_ALLOC;
+    }
+
     while(1) {
-        gettimeofday(&start, NULL);
-        if(mp->enable && !mp->inhibit) { /* If enable=0 then pause for the scanrate and try again. */
-            mc = mp->commands;
-            while(mc != NULL && !bail) {
-                /* Only if the command is enabled and the interval counter is over */
-                if(mc->enable && (mc->mode & MB_CONTINUOUS) && (++mc->icount >= mc->interval)) {
-                    mc->icount = 0;
-                    if(mp->maxattempts) {
-                        mp->attempt++;
-                    }
-                    if( mb_send_command(mp, mc) > 0 ) {
-                        mp->attempt = 0; /* Good response, reset counter */
-                    }
-                    if((mp->maxattempts && mp->attempt >= mp->maxattempts) || mp->dienow) {
-                        bail = 1;
-                        mp->inhibit_temp = 0;
-                        mp->inhibit = 1;
-                    }
+        if(!mp->inhibit && mb_sched_collect(mp)) {
+            mb_batch_prefetch(mp);
+            for(mc = mp->scan; mc != NULL; mc = mc->snext) {
+                if(!mc->due) continue;
+                /* If we bail out in the middle these will be sent next time */
+                if(mp->inhibit) break;
+                mb_sched_start(mc);
+                if(mp->maxattempts) {
+                    mp->attempt++;
+                }
+                if( mb_scan_command(mp, mc) > 0 ) {
+                    mp->attempt = 0; /* Good response, reset counter */
+                }
+                if((mp->maxattempts && mp->attempt >= mp->maxattempts) || mp->dienow) {
+                    mp->inhibit_temp = 0;
+                    mp->inhibit = 1;
                 }
                 if(mp->delay > 0) usleep(mp->delay * 1000);
-                mc = mc->next; /* get next command from the linked list */
-            } /* End of while for sending commands */
+                /* Don't make gateway requests wait for the whole scan */
+                if(mp->gateway) mb_gateway_service(mp);
+            }
+            mb_batch_flush(mp);
         }
         if(mp->inhibit) {
-            bail = 0;
             mb_close_port(mp);
+            /* Answer whatever is waiting since we won't be back for a while */
+            if(mp->gateway) mb_gateway_service(mp);
             if(mp->inhibit_time) {
                 sleep(mp->inhibit_time);
                 result = mb_open_port(mp);
-                if(result == 0) mp->inhibit = 0;
+                if(result == 0) {
+                    mp->inhibit = 0;
+                    mp->attempt = 0;
+                    /* Start over instead of counting everything we missed */
+                    mb_sched_init(mp);
+                }
             } else {
                 return MB_ERR_PORTFAIL;
             }
         }
-        /* This calculates the length of time that it took to send the messages on this port
-           and then subtracts that time from the port's scanrate and calls usleep to hold
-           for the right amount of time.  */
-        gettimeofday(&end, NULL);
-        time_spent = (end.tv_sec-start.tv_sec)*1000 + (end.tv_usec/1000 - start.tv_usec/1000);
-        /* If it takes longer than the scanrate then just go again instead of sleeping */
-        if(time_spent < mp->scanrate) {
+        mb_sched_stats(mp);
+        /* If the next command isn't due yet we sleep until it is */
+        if(mb_sched_next(mp) > mb_sched_now()) {
             if(!mp->persist) {
                 mb_close_port(mp);
             }
-            usleep((mp->scanrate - time_spent) * 1000);
+            mb_sched_sleep(mp);
         }
     }
     /* Close the port */
@@ -331,13 +350,8 @@ sendRTUrequest(mb_port *mp, mb_cmd *cmd)
 }
 
 /*
- * This function waits for one interbyte timeout (wait) period and then
- * checks to see if there is data on the port.  If there is no data and
- * we still have not received any data then it compares the current time
- * against the time the loop was started to see about the timeout.  If there
- * is data then it is written into the buffer.  If there is no data on the
- * read() and we have received some data already then the full message should
- * have been received and the function exits.
+ * Reads the response from the serial port.  The frame is returned as soon
+ * as we have as many bytes as the function code says the response should be.
 
  * Returns 0 on timeout
  * Returns -1 on CRC fail
@@ -346,38 +360,25 @@ sendRTUrequest(mb_port *mp, mb_cmd *cmd)
 static int
 getRTUresponse(uint8_t *buff, mb_port *mp)
 {
-    unsigned int buffptr = 0;
-    struct timeval oldtime, thistime;
-    int result;
-
-    gettimeofday(&oldtime, NULL);
-
-    while(1) {
-        usleep(mp->frame * 1000);
-        result = read(mp->fd, &buff[buffptr], MB_FRAME_LEN);
-        if(result > 0) { /* Get some data */
-            buffptr += result; // TODO: WE NEED A BOUNDS CHECK HERE.  Seg Fault Commin'
-        } else { /* Message is finished, good or bad */
-            if(buffptr > 0) { /* Is there any data in buffer? */
-
-                if(mp->in_callback) {
-                    mp->in_callback(mp, buff, buffptr);
-                }
-                /* Check the checksum here. */
-                result = crc16check(buff, buffptr);
-
-                if(!result) return -1;
-                else return buffptr;
-
-            } else { /* No data in the buffer */
-                gettimeofday(&thistime,NULL);
-                if(timediff(oldtime, thistime) > mp->timeout) {
-                    return 0;
-                }
-            }
+    int result, length;
+
+    length = mb_rtu_read(mp, buff, MB_FRAME_LEN, mp->timeout, mb_rtu_response_length);
+    if(length == 0) return 0;
+    if(length < 0) {
+        if(length != MB_ERR_OVERFLOW) {
+            dax_log(DAX_LOG_ERROR, "Error reading serial port %s - %d", mp->name, length);
+            return 0;
         }
+        mb_rtu_drain(mp);
+        return -1;
     }
-    return 0; /* Should never get here */
+    if(mp->in_callback) {
+        mp->in_callback(mp, buff, length);
+    }
+    /* Check the checksum here. */
+    result = crc16check(buff, length);
+    if(!result) return -1;
+    return length;
 }
 
 /* We haven't implemented ASCII yet */
@@ -393,19 +394,18 @@ getASCIIresponse(uint8_t *buff, mb_port *mp)
     return 0;
 }
 
-static uint16_t _req_tid;
-
-/* This function formulates and sends the Modbus TCP client request */
-static int
-sendTCPrequest(mb_port *mp, mb_cmd *cmd)
+/* This function formulates the Modbus TCP client request for cmd in buff
+ * using the given transaction id.  Returns the total length of the frame
+ * or 0 if the command doesn't need to be sent this time. */
+int
+mb_build_tcp_request(mb_cmd *cmd, uint8_t *buff, uint16_t tid)
 {
-    uint8_t buff[MB_FRAME_LEN];
-    uint16_t crc, temp, length;
+    uint16_t crc, temp, length = 0;
 
     /* build the request message */
     /* MBAP Header minus the length.  We'll set it later */
-    buff[0] = _req_tid>>8;  /* Transaction ID */
-    buff[1] = _req_tid++;   /* Transaction ID */
+    buff[0] = tid>>8;  /* Transaction ID */
+    buff[1] = tid;     /* Transaction ID */
     buff[2] = 0x00;  /* Protocol ID */
     buff[3] = 0x00;  /* Protocol ID */
     /* Modbus RTU PDU */
@@ -427,7 +427,7 @@ sendTCPrequest(mb_port *mp, mb_cmd *cmd)
                 COPYWORD(&buff[8], &cmd->m_register);
                 if(temp) buff[10] = 0xff;
                 else     buff[10] = 0x00;
-                buff[5] = 0x00;
+                buff[11] = 0x00;
                 cmd->firstrun = 1;
                 cmd->lastcrc = temp;
                 length = 6;
@@ -464,7 +464,6 @@ sendTCPrequest(mb_port *mp, mb_cmd *cmd)
                 COPYWORD(&buff[8], &cmd->m_register);
                 COPYWORD(&buff[10], &cmd->length);
                 buff[12] = (cmd->length-1)/8 + 1;
-                printf("Bytes = %d\n", buff[12]);
                 for(int n = 0; n < buff[12]; n++) {
                     buff[13+n] = cmd->data[n];
                 }
@@ -493,23 +492,38 @@ sendTCPrequest(mb_port *mp, mb_cmd *cmd)
             }
         /* TODO: Add the rest of the function codes */
         default:
-            break;
+            return 0;
     }
     /* Go back and put the length in the MBAP Header */
     COPYWORD(&buff[4], &length);
+    return length + 6;
+}
+
+/* This function formulates and sends the Modbus TCP client request */
+static int
+sendTCPrequest(mb_port *mp, mb_cmd *cmd)
+{
+    uint8_t buff[MB_FRAME_LEN];
+    int length;
+
+    length = mb_build_tcp_request(cmd, buff, ++mp->tid);
+    if(length == 0) return 0;
     /* Send Request */
     cmd->requests++; /* Increment the request counter */
     tcflush(mp->fd, TCIOFLUSH);
     /* Send the buffer to the callback routine. */
     if(mp->out_callback) {
-        mp->out_callback(mp, buff, length + 6);
+        mp->out_callback(mp, buff, length);
     }
 
-    return write(mp->fd, buff, length + 6);
+    return write(mp->fd, buff, length);
 }
 
 /*
- * This function immediately tries to read data from the file handle.
+ * This function waits for the response to the last request that was sent.
+ * Anything that comes in with a different transaction ID is the late answer
+ * to a request that already timed out so it is thrown away and we keep
+ * waiting.
 
  * Returns 0 on timeout
  * Returns the length of the message on success
@@ -518,32 +532,42 @@ static int
 getTCPresponse(uint8_t *buff, mb_port *mp)
 {
     uint8_t tempbuff[MB_FRAME_LEN];
-    struct timeval timeout;
+    struct timeval timeout, start, now;
+    long remain;
     int result;
+    uint16_t tid;
     fd_set readfs, errfs;
 
-
-    timeout.tv_usec = (mp->timeout % 1000) * 1000;
-    timeout.tv_sec = mp->timeout / 1000;
-    FD_ZERO(&readfs);
-    FD_SET(mp->fd, &readfs);
-    FD_ZERO(&errfs);
-    FD_SET(mp->fd, &errfs);
-    result = select(mp->fd+1, &readfs, NULL, &errfs, &timeout);
-    if(FD_ISSET(mp->fd, &readfs)) {
-        /* TODO Can we really assume that we'll get the whole thing in one read() */
-        result = read(mp->fd, tempbuff, MB_BUFF_SIZE);
-    }
-    if(result > 0) { /* Is there any data in buffer? */
+    gettimeofday(&start, NULL);
+    while(1) {
+        gettimeofday(&now, NULL);
+        remain = mp->timeout - (long)timediff(start, now);
+        if(remain <= 0) return 0;
+        timeout.tv_usec = (remain % 1000) * 1000;
+        timeout.tv_sec = remain / 1000;
+        FD_ZERO(&readfs);
+        FD_SET(mp->fd, &readfs);
+        FD_ZERO(&errfs);
+        FD_SET(mp->fd, &errfs);
+        result = select(mp->fd+1, &readfs, NULL, &errfs, &timeout);
+        if(FD_ISSET(mp->fd, &readfs)) {
+            /* TODO Can we really assume that we'll get the whole thing in one read() */
+            result = read(mp->fd, tempbuff, MB_BUFF_SIZE);
+        }
+        if(result <= 0) return result;
         if(mp->in_callback) {
             mp->in_callback(mp, tempbuff, result);
         }
-        /* We have to convert the TCP message to it's RTU equivalent,
-         * because that is what the calling function is expecting. */
-        result -= 6;
-        memcpy(buff, &tempbuff[6], result);
+        tid = (uint16_t)tempbuff[0] << 8 | tempbuff[1];
+        if(result > 6 && tid == mp->tid) {
+            /* We have to convert the TCP message to it's RTU equivalent,
+             * because that is what the calling function is expecting. */
+            result -= 6;
+            memcpy(buff, &tempbuff[6], result);
+            return result;
+        }
+        dax_log(DAX_LOG_COMM, "Discarding response with transaction id %d on port %s", tid, mp->name);
     }
-    return result;
 }
 
 
@@ -559,8 +583,8 @@ getTCPresponse(uint8_t *buff, mb_port *mp)
  * the their responses into RTUish messages
  */
 /* TODO: There is all kinds of buffer overflow potential here.  It should all be checked */
-static int
-handleresponse(uint8_t *buff, mb_cmd *cmd)
+int
+mb_handle_response(uint8_t *buff, mb_cmd *cmd)
 {
     int n;
 
@@ -595,15 +619,12 @@ handleresponse(uint8_t *buff, mb_cmd *cmd)
     return 0;
 }
 
-/* This function is called before a write command request is sent.  It's purpose
- * is to read the data from the tagserver and put it in the command buffer.  First
- * it checks to see if we have already retrieved our handle from the
- * tag server.  If not then we attempt to retrieve it.  Then we make sure that
- * the sizes of the tag and the command buffer are the same and adjust if necessary.
- * If the handles has been retrieved then we simply read the data from the
- * tagserver and put it in the command data buffer so that it can be sent. */
-static int
-_get_write_data(mb_cmd *mc) {
+/* Checks to see if we have already retrieved the handle to the command's data
+ * tag from the tag server.  If not then we attempt to retrieve it.  Then we make
+ * sure that the sizes of the tag and the command buffer are the same and adjust
+ * if necessary.  Returns 0 if the handle is good or an error code. */
+int
+mb_data_handle(mb_cmd *mc) {
     int result;
 
     if(mc->data_h.index == 0) {
@@ -617,46 +638,84 @@ _get_write_data(mb_cmd *mc) {
             if(mc->datasize < mc->data_h.size) mc->data_h.size = mc->datasize;
         }
     }
-    /* If we get here we assume that we now have a valid tag handle */
+    return 0;
+}
+
+/* This function is called before a write command request is sent.  It's purpose
+ * is to read the data from the tagserver and put it in the command buffer.  If
+ * batch is the port that is scanning and the data was already read with the
+ * port's tag groups at the start of the scan there is nothing left to do. */
+int
+mb_get_write_data(mb_port *batch, mb_cmd *mc) {
+    int result;
+
+    if(batch != NULL && mc->prefetched) {
+        mc->prefetched = 0;
+        return 0;
+    }
+    result = mb_data_handle(mc);
+    if(result) return result;
     return dax_read_tag(ds, mc->data_h, mc->data);
 }
 
+/* Copies the part of the merged command's data that belongs to the
+ * member into the member's data buffer. */
+static void
+_scatter(mb_cmd *merged, mb_cmd *member)
+{
+    unsigned int offset, n, bit;
+
+    offset = member->m_register - merged->m_register;
+    if(member->function == 3 || member->function == 4) {
+        memcpy(member->data, &merged->data[offset * 2], member->length * 2);
+    } else { /* Bits have to be shifted into place */
+        bzero(member->data, member->datasize);
+        for(n = 0; n < member->length; n++) {
+            bit = offset + n;
+            if(merged->data[bit / 8] & (0x01 << (bit % 8))) {
+                member->data[n / 8] |= (0x01 << (n % 8));
+            }
+        }
+    }
+}
+
 /* This function is called after a command response has been received.  It's purpose
- * is to put the data into the tagserver.  It first checks to see if we have already
- * retrieved our handle from the tag server.  If not then we attempt to retrieve it.
- * Then we make sure that the sizes of the tag and the command buffer are the same
- * and adjust if necessary. If the handles has been retrieved then we simply write
- * the data from the command data buffer to the tagserver. */
-static int
-_send_read_data(mb_cmd *mc) {
+ * is to put the data into the tagserver.  If batch is not NULL the data is queued
+ * on that port and written along with the rest of the scan by mb_batch_flush(). */
+int
+mb_send_read_data(mb_port *batch, mb_cmd *mc) {
+    mb_cmd *member;
     int result;
 
-    if(mc->data_h.index == 0) {
-        result = dax_tag_handle(ds, &mc->data_h, mc->data_tag, mc->tagcount);
-        if(result) return result;
-        /* We need to check if the tag size and the data buffer size in the modbus command
-         * are the same.  If not then if the tag is smaller it's no big deal but if the command
-         * data size is smaller then we'll truncate the size in the tag handle. */
-        if(mc->data_h.size != mc->datasize) {
-            dax_log(DAX_LOG_ERROR, "Tag size and Modbus request size are different.  Data will be truncated");
-            if(mc->datasize < mc->data_h.size) mc->data_h.size = mc->datasize;
+    /* A merged command doesn't have a tag of it's own.  It hands its data
+     * out to each of the commands that it was made from. */
+    if(mc->members != NULL) {
+        for(member = mc->members; member != NULL; member = member->mnext) {
+            if(!member->enable) continue;
+            _scatter(mc, member);
+            member->responses++;
+            member->lasterror = 0;
+            mb_send_read_data(batch, member);
         }
+        return 0;
+    }
+
+    result = mb_data_handle(mc);
+    if(result) return result;
+    if(batch != NULL) {
+        return mb_batch_queue(batch, mc);
     }
-    /* If we get here we assume that we now have a valid tag handle */
     return dax_write_tag(ds, mc->data_h, mc->data);
 }
 
 
-/*!
- * External function to send a Modbus commaond (mc) to port (mp).  The function
- * sets some function pointers to the functions that handle the port protocol and
- * then uses those functions generically.  The retry loop tries the command for the
- * configured number of times and if successful returns 0.  If not, an error code
- * is returned. mb_buff should be at least MB_FRAME_LEN in length
- */
-
-int
-mb_send_command(mb_port *mp, mb_cmd *mc)
+/* Sends the command (mc) to port (mp).  The function sets some function pointers
+ * to the functions that handle the port protocol and then uses those functions
+ * generically.  The retry loop tries the command for the configured number of
+ * times and if successful returns 0.  If not, an error code is returned.  If
+ * batch is set the tag server data goes through the port's scan batch. */
+static int
+_send_command(mb_port *mp, mb_cmd *mc, int batch)
 {
     uint8_t buff[MB_FRAME_LEN]; /* Modbus Frame buffer */
     int try = 1;
@@ -693,7 +752,7 @@ mb_send_command(mb_port *mp, mb_cmd *mc)
     }
     /* Retrieve the data from the tag server */
     if(mb_is_write_cmd(mc)) {
-        result = _get_write_data(mc);
+        result = mb_get_write_data(batch ? mp : NULL, mc);
     }
     do { /* retry loop */
         result = sendrequest(mp, mc);
@@ -711,7 +770,7 @@ mb_send_command(mb_port *mp, mb_cmd *mc)
         }
 
         if(msglen > 0) {
-            result = handleresponse(buff, mc); /* Returns 0 on success + on failure */
+            result = mb_handle_response(buff, mc); /* Returns 0 on success + on failure */
             if(result > 0) {
                 mc->exceptions++;
                 mc->lasterror = result | ME_EXCEPTION;
@@ -719,7 +778,7 @@ mb_send_command(mb_port *mp, mb_cmd *mc)
                 mc->lasterror = 0;
                 /* Send the data to the tag server */
                 if(mb_is_read_cmd(mc)) {
-                    result = _send_read_data(mc);
+                    result = mb_send_read_data(batch ? mp : NULL, mc);
                 }
             }
             if(!mp->scanning && !mp->persist) close(mp->fd);
@@ -741,6 +800,25 @@ mb_send_command(mb_port *mp, mb_cmd *mc)
     return 0 - mc->lasterror;
 }
 
+/*!
+ * External function to send a Modbus command (mc) to port (mp) right now.  This
+ * is used for the commands that are sent outside of the port's scan.  The data
+ * is read from or written to the tag server before the function returns.
+ */
+int
+mb_send_command(mb_port *mp, mb_cmd *mc)
+{
+    return _send_command(mp, mc, 0);
+}
+
+/* Sends a command that the scheduler marked as part of the port's scan.  The
+ * read data is held until mb_batch_flush() is called at the end of the scan. */
+int
+mb_scan_command(mb_port *mp, mb_cmd *mc)
+{
+    return _send_command(mp, mc, 1);
+}
+
 static int
 _create_exception(unsigned char *buff, uint16_t exception)
 {
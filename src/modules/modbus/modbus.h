@@ -99,6 +99,8 @@
 #define ME_WRONG_DEVICE   3
 #define ME_CHECKSUM       4
 #define ME_TIMEOUT        8
+#define ME_GW_PATH        0x0A    /* Gateway path unavailable */
+#define ME_GW_TARGET      0x0B    /* Gateway target device failed to respond */
 
 /* Command Methods */
 #define MB_CONTINUOUS  0x01   /* Command is sent periodically */
@@ -154,22 +156,81 @@
 /* Maximum number of connections that can be in the pool */
 #define MB_MAX_CONNECTION_SIZE 2048
 
-/* This is used in the port for client connections for the TCP Server */
+/* Largest Modbus TCP frame.  7 byte MBAP header and a 253 byte PDU */
+#define MB_TCP_ADU_SIZE 260
+
+/* This is the frame buffer for each client connection to the TCP Server.  They
+ * are kept in the port's clients array which is indexed by the file descriptor */
 typedef struct client_buffer {
     int fd;                /* File descriptor of the socket */
+    unsigned int serial;   /* Tells this connection apart from a later one on the same fd */
     int buffindex;         /* index where the next character will be placed */
-    unsigned char buff[MB_BUFF_SIZE];   /* data buffer */
-    struct client_buffer *next;
+    unsigned char buff[MB_TCP_ADU_SIZE];   /* data buffer */
 } client_buffer;
 
+/* Largest number of requests that can wait on a gateway master port */
+#define MB_GW_QUEUE_SIZE 64
+/* Number of read responses that a gateway server port can cache */
+#define MB_GW_CACHE_SIZE 128
+
+/* A request that a TCP server port has forwarded to an RTU master port.  The
+ * master puts the response in buff in place of the request and gives it back
+ * to the server to send to the client. */
+typedef struct mb_gw_request {
+    struct mb_port *server;   /* Server port that the request came in on */
+    int fd;                   /* Client connection that it came in on */
+    unsigned int serial;      /* Serial number of that connection */
+    uint8_t key[6];           /* Unit ID, function code, address and count of the request */
+    uint8_t cache;            /* If true the response can be cached */
+    int length;               /* Length of the MBAP frame in buff */
+    uint8_t buff[MB_TCP_ADU_SIZE];
+    struct mb_gw_request *next;
+} mb_gw_request;
+
+/* A read response that a gateway server port has kept */
+typedef struct mb_gw_cache {
+    uint8_t key[6];           /* Same as the request key */
+    uint64_t expires;         /* Time (mSec monotonic) that the entry is no good */
+    int length;               /* Length of the response from the unit ID on */
+    uint8_t buff[MB_TCP_ADU_SIZE - 6];
+} mb_gw_cache;
+
+/* States of a connection in the concurrent client engine */
+#define MB_CONN_IDLE       0  /* Connected or not, but not waiting on connect() */
+#define MB_CONN_CONNECTING 1  /* Waiting for a non-blocking connect() */
+
+/* Largest number of requests that can be in flight on one connection */
+#define MB_MAX_WINDOW 16
+
+/* A request that has been sent and is waiting on the response */
+typedef struct mb_inflight {
+    struct mb_cmd *cmd;
+    uint16_t tid;             /* Transaction ID that we sent it with */
+    int try;                  /* Number of times it has been sent */
+    uint64_t deadline;        /* Time (mSec monotonic) that it times out */
+} mb_inflight;
+
 /* This structure represents a single connection to a TCP server.
  * There is a dynamic array of these in the port that are basically
  * used as a connection pool. If fd is not zero then we are connected.
+ * An fd of -1 is an entry that the concurrent client engine knows about
+ * but that is not connected right now.
  */
 typedef struct tcp_connection {
     struct in_addr addr;
     uint16_t port;
     int fd;
+    /* The rest is only used by the concurrent client engine in mbclient.c */
+    uint8_t state;            /* One of the MB_CONN_* states */
+    struct mb_cmd *head;      /* Commands still to be sent during this scan */
+    struct mb_cmd *tail;
+    mb_inflight inflight[MB_MAX_WINDOW];
+    int pending;              /* Number of requests in flight */
+    uint16_t tid;             /* Last transaction ID that was used */
+    uint64_t deadline;        /* Time (mSec monotonic) that a connect() times out */
+    uint64_t hold;            /* Don't send anything before this time (intercommand delay) */
+    int rxlen;                /* Number of bytes in rxbuff */
+    uint8_t rxbuff[MB_FRAME_LEN];
 } tcp_connection;
 
 
@@ -184,6 +245,13 @@ typedef struct mb_cmd {
     uint16_t length;         /* length of modbus data */
 
     unsigned int interval;   /* number of port scans between messages */
+    unsigned int period;     /* mSec between messages.  Zero uses interval times the scanrate */
+    uint64_t deadline;       /* Time (nSec monotonic) that the command is due next */
+    uint64_t due_time;       /* The deadline that the command was last marked for */
+    uint8_t due;             /* Set by the scheduler when the command should be sent */
+    int32_t jitter;          /* Latest that the command was sent in uSec since the stats were written */
+    uint32_t overruns;       /* Number of periods that were missed entirely */
+    uint8_t prefetched;      /* The write data was read with the port's tag groups this scan */
     uint8_t *data;           /* pointer to the actual modbus data that this command refers */
     int datasize;            /* size of the *data memory area */
     unsigned int icount;     /* number of intervals passed */
@@ -202,8 +270,24 @@ typedef struct mb_cmd {
     tag_handle data_h;       /* Handle to data tag */
 
     struct mb_cmd* next;
+    struct mb_cmd* snext;    /* Next command in the port's scan list */
+    struct mb_cmd* qnext;    /* Next command in a connection's send queue */
+    struct mb_cmd* merge;    /* The merged command that does the reading for this one */
+    struct mb_cmd* members;  /* For a merged command, the commands that it reads for */
+    struct mb_cmd* mnext;    /* Next member of the same merged command */
 } mb_cmd;
 
+/* A tag group that the data for a number of write commands is read with at
+ * the start of a scan */
+typedef struct mb_batch_group {
+    tag_group_id *id;
+    mb_cmd **cmds;           /* The commands in the same order as the group members */
+    int count;
+    uint8_t *buff;           /* Buffer for the group data */
+    size_t size;
+    struct mb_batch_group *next;
+} mb_batch_group;
+
 /* This holds all of the information to define a register set for a single unit id */
 typedef struct mb_node_def {
     char *hold_name;
@@ -242,7 +326,8 @@ typedef struct mb_port {
     unsigned char socket;     /* either UDP_SOCK or TCP_SOCK */
 
     int delay;       /* Intercommand delay */
-    int frame;       /* Interbyte timeout */
+    int frame;       /* Interbyte timeout in mSec.  Zero uses the silent interval */
+    unsigned int silence; /* 3.5 character times in uSec, figured from the serial settings */
     int retries;     /* Number of retries to try */
     int scanrate;    /* Scanrate in mSeconds */
     int timeout;     /* Response timeout */
@@ -250,11 +335,17 @@ typedef struct mb_port {
 
     mb_node_def **nodes; /* Individual node units */
 
-    fd_set fdset;
+    fd_set fdset;             /* Only used by the TCP Server when we don't have epoll */
     int maxfd;
-    client_buffer *buff_head; /* Head of a linked list of client connection buffers */
+    client_buffer **clients;  /* TCP Server connection buffers indexed by file descriptor */
+    int clients_size;
+    int server_fd;            /* epoll instance for the TCP Server */
 
     struct mb_cmd *commands;  /* Linked list of Modbus commands */
+    struct mb_cmd *scan;      /* The commands that are actually sent each scan, linked by snext */
+    struct mb_cmd *merged;    /* Commands created by mb_merge_commands() */
+    uint8_t coalesce;         /* If true adjacent read commands are merged */
+    int gap;                  /* Number of unused registers allowed between merged commands */
     int fd;                   /* File descriptor to the port */
     int ctrl_flags;
     int dienow;
@@ -269,6 +360,33 @@ typedef struct mb_port {
     int connection_count;
     uint8_t persist;              /* If true the port(s) stay open */
     uint8_t scanning;             /* A flag to tell us if we are currently scanning the port */
+    uint8_t concurrent;           /* If true TCP client commands to different servers are sent concurrently */
+    uint8_t window;               /* Number of requests that can be in flight on each connection */
+    uint16_t tid;                 /* Last transaction ID sent by the sequential TCP client */
+    int client_fd;                /* epoll instance for the concurrent client engine */
+    mb_cmd **heap;                /* Continuous commands ordered by deadline for the scheduler */
+    int heap_count;
+    uint64_t stats_time;          /* Time (nSec monotonic) that the stats tags are written next */
+    tag_handle jitter_h;          /* Handle to the command jitter tag */
+    tag_handle overrun_h;         /* Handle to the command overrun tag */
+    uint8_t cache;                /* If true slave/server requests are answered from register images */
+    mb_batch_group *groups;       /* Tag groups that the write command data is read with */
+    tag_handle *batch_h;          /* Read command data waiting to be written to the tag server */
+    void **batch_data;
+    int batch_count;
+    int batch_size;               /* Bytes that the waiting data will take in the message */
+
+    struct mb_port **routes;      /* Master port to forward each unit ID to.  NULL if not a gateway */
+    int ttl;                      /* mSec that a gateway server keeps read responses */
+    mb_gw_cache *gw_cache;        /* Read responses kept by a gateway server */
+    int gw_pipe[2];               /* Wakes up a gateway server when responses are ready */
+    unsigned int serial;          /* Last serial number given to a server connection */
+    uint8_t gateway;              /* Set on master ports that a gateway server forwards to */
+    mb_gw_request *gw_head;       /* Requests waiting on a master port or responses */
+    mb_gw_request *gw_tail;       /*   waiting on a server port */
+    int gw_count;                 /* Number of requests waiting on a master port */
+    pthread_mutex_t gw_lock;
+    pthread_cond_t gw_cond;
 
     pthread_mutex_t send_lock;
     tag_handle command_h;         /* Handle to command tag */
@@ -305,6 +423,7 @@ int mb_set_maxfailures(mb_port *port, int maxfailures, int inhibit);
 int mb_open_port(mb_port *port);
 int mb_close_port(mb_port *port);
 int mb_get_connection(mb_port *mp, struct in_addr address, uint16_t port);
+int mb_find_connection(mb_port *mp, struct in_addr address, uint16_t port);
 /* Set callback functions that are called any time data is read or written over the port */
 void mb_set_msgout_callback(mb_port *, void (*outfunc)(mb_port *,uint8_t *,unsigned int));
 void mb_set_msgin_callback(mb_port *, void (*infunc)(mb_port *,uint8_t *,unsigned int));
@@ -319,27 +438,70 @@ void mb_set_mode(mb_cmd *cmd, unsigned char mode);
 
 int mb_is_write_cmd(mb_cmd *cmd);
 int mb_is_read_cmd(mb_cmd *cmd);
+int mb_merge_commands(mb_port *port);
+void mb_update_merged(mb_port *port);
 
 /* End New Interface */
 int mb_run_port(mb_port *);
 int mb_send_command(mb_port *, mb_cmd *);
+int mb_scan_command(mb_port *, mb_cmd *);
 
 void mb_print_portconfig(FILE *fd, mb_port *mp);
 
 /* Port Functions - defined in modports.c */
 int add_cmd(mb_port *p, mb_cmd *mc);
 
+/* Concurrent TCP Client Functions - defined in mbclient.c */
+int mb_client_init(mb_port *port);
+int mb_client_scan(mb_port *port);
+
 /* TCP Server Functions - defined in mbserver.c */
 int server_loop(mb_port *port);
 
+/* Gateway Functions - defined in mbgateway.c */
+int mb_gateway_init(mb_port *port);
+void mb_gateway_request(mb_port *port, client_buffer *cc, uint8_t *frame, int length);
+void mb_gateway_deliver(mb_port *port);
+void mb_gateway_service(mb_port *mp);
+void mb_gateway_wait(mb_port *mp, struct timespec *deadline);
+
+/* Command Scheduler Functions - defined in mbsched.c */
+uint64_t mb_sched_now(void);
+int mb_sched_init(mb_port *mp);
+int mb_sched_collect(mb_port *mp);
+void mb_sched_start(mb_cmd *mc);
+uint64_t mb_sched_next(mb_port *mp);
+void mb_sched_sleep(mb_port *mp);
+void mb_sched_stats(mb_port *mp);
+
+/* Tag Server Batching Functions - defined in mbbatch.c */
+int mb_batch_init(mb_port *mp);
+void mb_batch_prefetch(mb_port *mp);
+int mb_batch_queue(mb_port *mp, mb_cmd *mc);
+void mb_batch_flush(mb_port *mp);
+void mb_batch_free(mb_port *mp);
+
 /* Serial Slave loop function */
 int slave_loop(mb_port *port);
 
 /* Protocol Functions - defined in modbus.c */
 int create_response(mb_port * port, unsigned char *buff, int size);
+int mb_build_tcp_request(mb_cmd *cmd, uint8_t *buff, uint16_t tid);
+int mb_handle_response(uint8_t *buff, mb_cmd *cmd);
+int mb_data_handle(mb_cmd *mc);
+int mb_get_write_data(mb_port *batch, mb_cmd *mc);
+int mb_send_read_data(mb_port *batch, mb_cmd *mc);
 
 /* Utility Functions - defined in modutil.c */
+/* Number of bytes that crc16() handles in each step.  Set by the build to 1, 4 or 8 */
+#ifndef MB_CRC_SLICE
+#  define MB_CRC_SLICE 8
+#endif
 uint16_t crc16(unsigned char *msg, unsigned short length);
 int crc16check(uint8_t *buff, int length);
+int mb_rtu_read(mb_port *mp, uint8_t *buff, int size, int timeout, int (*length)(uint8_t *, int));
+void mb_rtu_drain(mb_port *mp);
+int mb_rtu_request_length(uint8_t *buff, int count);
+int mb_rtu_response_length(uint8_t *buff, int count);
 
 #endif
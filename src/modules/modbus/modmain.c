@@ -30,6 +30,7 @@
 #include <pthread.h>
 #include <modopt.h>
 #include <modbus.h>
+#include <database.h>
 
 extern struct Config config;
 /* For now we'll keep ds as a global to simplify the code.  At some
@@ -92,6 +93,7 @@ _enable_callback(dax_state *_ds, void *ud) {
         n++;
         mc = mc->next;
     }
+    mb_update_merged(enable->port);
 }
 
 #define MOD_DATA_REG_COUNT 120
@@ -207,6 +209,7 @@ _setup_port(mb_port *port)
                         node->hold_size = 0;
                     } else {
                         node->hold_idx = h.index;
+                        if(port->cache) slave_cache_tag(h);
                     }
                 }
                 if(node->input_name != NULL) {
@@ -218,6 +221,7 @@ _setup_port(mb_port *port)
                         node->input_size = 0;
                     } else {
                         node->input_idx = h.index;
+                        if(port->cache) slave_cache_tag(h);
                     }
                 }
                 if(node->coil_name != NULL) {
@@ -229,6 +233,7 @@ _setup_port(mb_port *port)
                         node->coil_size = 0;
                     } else {
                         node->coil_idx = h.index;
+                        if(port->cache) slave_cache_tag(h);
                     }
                 }
                 if(node->disc_name != NULL) {
@@ -240,6 +245,7 @@ _setup_port(mb_port *port)
                         node->disc_size = 0;
                     } else {
                         node->disc_idx = h.index;
+                        if(port->cache) slave_cache_tag(h);
                     }
                 }
             }
@@ -276,6 +282,20 @@ _setup_port(mb_port *port)
             ud->port = port;
             dax_event_add(ds, &ud->h, EVENT_CHANGE, bits, NULL, _enable_callback, ud, _free_ud);
         }
+        /* The scheduler writes how late each command is and how many times
+         * it missed its period to these */
+        snprintf(ctag, 256, "%s_cmd_jitter", port->name);
+        result = dax_tag_add(ds, &port->jitter_h, ctag, DAX_DINT, size, 0x00);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to add command jitter tag for port %s", port->name);
+            bzero(&port->jitter_h, sizeof(tag_handle));
+        }
+        snprintf(ctag, 256, "%s_cmd_overrun", port->name);
+        result = dax_tag_add(ds, &port->overrun_h, ctag, DAX_UDINT, size, 0x00);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to add command overrun tag for port %s", port->name);
+            bzero(&port->overrun_h, sizeof(tag_handle));
+        }
         result = _add_async_command_tag(port);
         if(result) {
             dax_log(DAX_LOG_ERROR, "Unable to add Asynchronous Command Tag");
@@ -453,6 +473,15 @@ main (int argc, const char * argv[]) {
         dax_log(DAX_LOG_FATAL, "Fatal error in configuration");
         exit(result);
     }
+    /* Merge the read commands on the ports that asked for it */
+    for(n = 0; n < config.portcount; n++) {
+        if(config.ports[n]->type == MB_MASTER && config.ports[n]->coalesce) {
+            result = mb_merge_commands(config.ports[n]);
+            if(result < 0) {
+                dax_log(DAX_LOG_ERROR, "Unable to merge commands on port %s", config.ports[n]->name);
+            }
+        }
+    }
 
     if( dax_connect(ds) ) {
         dax_log(DAX_LOG_FATAL, "Unable to connect to OpenDAX server!");
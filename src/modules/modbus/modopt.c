@@ -307,6 +307,51 @@ _add_port(lua_State *L)
     }
     lua_pop(L, 1);
 
+    lua_getfield(L, -1, "coalesce");
+    p->coalesce = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "gap");
+    tmp = (int)lua_tointeger(L, -1);
+    if(tmp > 0) p->gap = tmp;
+    lua_pop(L, 1);
+
+    /* Only TCP clients can talk to more than one server at a time */
+    lua_getfield(L, -1, "concurrent");
+    if(lua_toboolean(L, -1)) {
+        if(p->protocol == MB_TCP && p->type == MB_MASTER) {
+            p->concurrent = 1;
+        } else {
+            dax_log(DAX_LOG_WARN, "Concurrent scanning only applies to TCP client ports");
+        }
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "window");
+    tmp = (int)lua_tointeger(L, -1);
+    if(tmp > 1) {
+        if(tmp > MB_MAX_WINDOW) {
+            dax_log(DAX_LOG_WARN, "Window of %d is too large, using %d", tmp, MB_MAX_WINDOW);
+            tmp = MB_MAX_WINDOW;
+        }
+        if(!p->concurrent) {
+            dax_log(DAX_LOG_WARN, "A transaction window only applies to concurrent TCP client ports");
+        } else {
+            p->window = tmp;
+        }
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "cache");
+    if(!lua_isnil(L, -1)) p->cache = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    /* How long a gateway server keeps read responses */
+    lua_getfield(L, -1, "ttl");
+    tmp = (int)lua_tointeger(L, -1);
+    if(tmp > 0) p->ttl = tmp;
+    lua_pop(L, 1);
+
     if(p->type == MB_SLAVE) {
         p->nodes = malloc(sizeof(mb_node_def) * MB_MAX_SLAVE_NODES);
         if(p->nodes == NULL) {
@@ -468,6 +513,12 @@ _add_command(lua_State *L)
     lua_getfield(L, -1, "interval");
     mb_set_interval(c, (int)lua_tonumber(L, -1));
     lua_pop(L,1);
+
+    /* If the period is given it is used instead of the interval */
+    lua_getfield(L, -1, "period");
+    result = (int)lua_tointeger(L, -1);
+    if(result > 0) c->period = result;
+    lua_pop(L,1);
     return 0;
 }
 
@@ -669,6 +720,65 @@ _add_write_callback(lua_State *L)
     return 0;
 }
 
+/* Lua interface function for forwarding requests from a TCP server port to
+   an RTU master port.  Requests for the given unit IDs are sent out on the
+   master port instead of being answered from the server's registers.
+   Arguments:
+      server port id
+      master port id
+      unit id
+      last unit id (optional) for a range of units
+*/
+static int
+_add_gateway(lua_State *L)
+{
+    int s, m, first, last;
+    mb_port *server, *master;
+
+    s = lua_tointeger(L, 1);
+    m = lua_tointeger(L, 2);
+    s--; m--; /* Lua has indexes that are 1+ our actual array indexes */
+    if(s < 0 || s >= config.portcount) {
+        luaL_error(L, "Unknown Port ID : %d", s+1);
+    }
+    if(m < 0 || m >= config.portcount) {
+        luaL_error(L, "Unknown Port ID : %d", m+1);
+    }
+    server = config.ports[s];
+    master = config.ports[m];
+    if(server->type != MB_SLAVE || server->protocol != MB_TCP) {
+        luaL_error(L, "Gateway port %s must be a TCP server", server->name);
+    }
+    if(master->type != MB_MASTER || master->protocol != MB_RTU) {
+        luaL_error(L, "Port %s must be an RTU master to forward gateway requests", master->name);
+    }
+
+    first = lua_tointeger(L, 3);
+    if(lua_isnoneornil(L, 4)) {
+        last = first;
+    } else {
+        last = lua_tointeger(L, 4);
+    }
+    /* Unit ID 0 is a broadcast and there would be no response to send back */
+    if(first < 1 || last >= MB_MAX_SLAVE_NODES || first > last) {
+        luaL_error(L, "Invalid unit id given for gateway on Port %s", server->name);
+    }
+
+    if(server->routes == NULL) {
+        /* This is indexed by the unit ID byte from the request */
+        server->routes = calloc(256, sizeof(mb_port *));
+        if(server->routes == NULL) {
+            luaL_error(L, "Unable to allocate memory for gateway on port %s", server->name);
+        }
+    }
+    dax_log(DAX_LOG_DEBUG, "Forwarding units %d-%d on port %s to port %s", first, last, server->name, master->name);
+    for(int n = first; n <= last; n++) {
+        server->routes[n] = master;
+    }
+    master->gateway = 1;
+    return 0;
+}
+
 
 /* This function should be called from main() to configure the program.
  * First the defaults are set then the configuration file is parsed then
@@ -700,6 +810,7 @@ modbus_configure(int argc, const char *argv[])
     dax_set_luafunction(ds, (void *)_add_register, "add_register");
     dax_set_luafunction(ds, (void *)_add_read_callback, "add_read_callback");
     dax_set_luafunction(ds, (void *)_add_write_callback, "add_write_callback");
+    dax_set_luafunction(ds, (void *)_add_gateway, "add_gateway");
 
     result = dax_configure(ds, argc, (char **)argv, CFG_CMDLINE | CFG_MODCONF);
 
@@ -708,6 +819,7 @@ modbus_configure(int argc, const char *argv[])
     dax_clear_luafunction(ds, "add_register");
     dax_clear_luafunction(ds, "add_read_callback");
     dax_clear_luafunction(ds, "add_write_callback");
+    dax_clear_luafunction(ds, "add_gateway");
 
     /* Add functions that make sense for any callbacks that might be configured.
        The callback functions will live in the configuration Lua state */
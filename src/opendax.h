@@ -151,10 +151,14 @@ typedef struct lua_State lua_State;
 #define TAG_ATTR_OVR_SET    0x0008 /* Tag override is set */
 #define TAG_ATTR_SPECIAL    0x0010 /* Special tags have a read/write hook function */
 #define TAG_ATTR_OWNED      0x0020 /* Module owned tags will be deleted and can be read only */
+#define TAG_ATTR_TIMESTAMP  0x0040 /* Server keeps the time and writer of the last write */
 #define TAG_ATTR_MAPPING    0x1000 /* Tag is the source of at least one map */
 #define TAG_ATTR_EVENT      0x2000 /* Tag has at least one event */
 #define TAG_ATTR_OVERRIDE   0x4000 /* Tag has override installed */
 
+/* Next index returned by dax_tag_list() when there are no more tags */
+#define TAG_LIST_DONE       -1
+
 
 /* Event Types */
 #define EVENT_READ     0x01 /* Called before a tag is read - Not implemented */
@@ -167,9 +171,12 @@ typedef struct lua_State lua_State;
 #define EVENT_LESS     0x08 /* Less Than */
 #define EVENT_DEADBAND 0x09 /* Changed by X amount since last event */
 #define EVENT_DELETED  0x0A /* Tag gets deleted */
+#define EVENT_GROUP    0x0B /* Pushed data for a subscribed tag group */
 
 /* Event Options */
 #define EVENT_OPT_SEND_DATA  0x01 /* Send the affected data with the event */
+#define EVENT_OPT_COALESCE   0x02 /* Hold events inside the interval and send one with the latest data */
+#define EVENT_OPT_SEND_TIME  0x04 /* Send the time and writer of the last write with the event */
 
 /* Atomic Operations */
 #define ATOMIC_OP_INC  0x0001  /* Increment */
@@ -181,6 +188,10 @@ typedef struct lua_State lua_State;
 #define ATOMIC_OP_NAND 0x0007  /* Bitwise NAND */
 #define ATOMIC_OP_XOR  0x0008  /* Bitwise XOR */
 #define ATOMIC_OP_XNOR 0x0009  /* Bitwise XNOR */
+#define ATOMIC_OP_CAS  0x000A  /* Compare and swap */
+/* This flag can be OR'd with any of the above operations to have the
+ * server return the data as it was before the operation was applied */
+#define ATOMIC_OP_FETCH 0x8000
 
 
 /* Defines the maximum length of a tagname */
@@ -277,6 +288,49 @@ typedef struct dax_id {
     dax_dint id;         /* The ID of the event */
 } dax_id;
 
+/*!
+ * The time and writer of the last write to a tag.  These are sent with
+ * events that have the EVENT_OPT_SEND_TIME option set and can be
+ * retrieved in the callback with dax_event_get_stamp()
+ */
+typedef struct dax_stamp {
+    dax_time time;       /* Wall clock time of the write in mSec since the epoch */
+    uint64_t mono;       /* Server's monotonic clock at the write in uSec */
+    tag_index writer;    /* Index of the _module tag of the writer, -1 for the server */
+} dax_stamp;
+
+/*!
+ * A range of a tag that has been written.  These are returned by
+ * dax_changes_since()
+ */
+typedef struct dax_change {
+    tag_index idx;       /* Index of the tag that was written */
+    uint32_t byte;       /* Byte offset of the start of the change */
+    uint32_t size;       /* Number of bytes that were changed */
+} dax_change;
+
+/*!
+ * One piece of raw data in a list that is passed to dax_multi_write()
+ */
+typedef struct dax_write_item {
+    tag_index idx;       /* Index of the tag to write */
+    uint32_t offset;     /* Byte offset within the tag's data */
+    uint32_t size;       /* Size of the data in bytes */
+    void *data;          /* Data that will be written */
+    void *mask;          /* Mask for the data, NULL for a plain write */
+} dax_write_item;
+
+/*!
+ * One operation in a list that is passed to dax_atomic_batch()
+ */
+typedef struct dax_atomic {
+    tag_handle h;        /* Handle to the data to operate on */
+    uint16_t operation;  /* ATOMIC_OP_* optionally OR'd with ATOMIC_OP_FETCH */
+    void *data;          /* Operand data.  Expected then new data for CAS */
+    void *old;           /* Receives the old data for CAS and FETCH, can be NULL */
+    int result;          /* Result of this operation */
+} dax_atomic;
+
 /*! Opaque pointer for storing a dax_state object in the library */
 typedef struct dax_state dax_state;
 /*! Opaque pointer for tag group */
@@ -332,6 +386,8 @@ void dax_set_disconnect_callback(dax_state *ds, void (*f)(int result));
 
 /* Adds a tag to the opendax server database. */
 int dax_tag_add(dax_state *ds, tag_handle *h, char *name, tag_type type, int count, uint32_t attr);
+/* Adds a list of tags in as few messages as possible */
+int dax_tag_add_bulk(dax_state *ds, tag_handle *h, dax_tag *tags, int count);
 
 /* Delete the tag give by index */
 int dax_tag_del(dax_state *ds, tag_index index);
@@ -340,6 +396,14 @@ int dax_tag_del(dax_state *ds, tag_index index);
 int dax_tag_byname(dax_state *ds, dax_tag *tag, char *name);
 /* Get tag by index */
 int dax_tag_byindex(dax_state *ds, dax_tag *tag, tag_index index);
+/* Get a list of tags by name in as few messages as possible */
+int dax_tag_get_bulk(dax_state *ds, dax_tag *tags, char **names, int count);
+/* Get a page of the tag list, optionally filtered by a wildcard pattern */
+int dax_tag_list(dax_state *ds, tag_index *start, char *filter, dax_tag *tags, int *count);
+/* Call the callback function for every tag that matches the filter */
+int dax_tag_iter(dax_state *ds, char *filter, void *udata, void (*callback)(dax_tag *tag, void *udata));
+/* Get the list of tag changes since the given journal sequence number */
+int dax_changes_since(dax_state *ds, uint64_t *seq, dax_change *changes, int *count);
 
 /* The handle is a complete description of where in the tagbase the
  * data that we wish to retrieve is located.  This can be used in place
@@ -368,6 +432,11 @@ int dax_write(dax_state *ds, tag_index idx, uint32_t offset, void *data, size_t
 /* simple untyped masked tag write */
 int dax_mask(dax_state *ds, tag_index idx, uint32_t offset, void *data,
              void *mask, size_t size);
+/* untyped write of several pieces of data as a single operation */
+int dax_multi_write(dax_state *ds, dax_write_item *items, int count);
+/* add or remove several items from a queue tag at once */
+int dax_queue_write(dax_state *ds, tag_handle h, void *data, int count);
+int dax_queue_read(dax_state *ds, tag_handle h, void *data, int *count);
 
 /* These are the bread and butter tag handling functions.  The functions
  * understand the type of tag being written and take care of all the
@@ -384,6 +453,7 @@ int dax_mask(dax_state *ds, tag_index idx, uint32_t offset, void *data,
 int dax_tag_read(dax_state *ds, tag_handle handle, void *data);
 int dax_tag_write(dax_state *ds, tag_handle handle, void *data);
 int dax_tag_mask(dax_state *ds, tag_handle handle, void *data, void *mask);
+int dax_tag_multi_write(dax_state *ds, tag_handle *handles, void **data, int count);
 #define dax_read_tag dax_tag_read
 #define dax_write_tag dax_tag_write
 #define dax_mask_tag dax_tag_mask
@@ -397,6 +467,9 @@ int dax_tag_set_override(dax_state *ds, tag_handle handle);
 int dax_tag_clr_override(dax_state *ds, tag_handle handle);
 
 int dax_atomic_op(dax_state *ds, tag_handle handle, void *data, uint16_t operation);
+int dax_atomic_fetch_op(dax_state *ds, tag_handle handle, void *data, uint16_t operation, void *old);
+int dax_atomic_cas(dax_state *ds, tag_handle handle, void *expected, void *newdata, void *old);
+int dax_atomic_batch(dax_state *ds, dax_atomic *ops, int count);
 
 /* Event handling functions */
 int dax_event_add(dax_state *ds, tag_handle *handle, int event_type, void *data,
@@ -405,9 +478,11 @@ int dax_event_add(dax_state *ds, tag_handle *handle, int event_type, void *data,
 int dax_event_del(dax_state *ds, dax_id id);
 int dax_event_get(dax_state *ds, dax_id id);
 int dax_event_options(dax_state *ds, dax_id id, uint32_t options);
+int dax_event_interval(dax_state *ds, dax_id id, uint32_t interval);
 int dax_event_wait(dax_state *ds, int timeout, dax_id *id);
 int dax_event_poll(dax_state *ds, dax_id *id);
 int dax_event_get_data(dax_state *ds, void* buff, int len);
+int dax_event_get_stamp(dax_state *ds, dax_stamp *stamp);
 
 /* Event Utility Functions */
 int dax_event_string_to_type(char *string);
@@ -456,6 +531,11 @@ int dax_group_get_size(tag_group_id *id);
 int dax_group_read(dax_state *ds, tag_group_id *id, void *buff, size_t size);
 int dax_group_write(dax_state *ds, tag_group_id *id, void *buff);
 int dax_group_del(dax_state *ds, tag_group_id *id);
+int dax_group_subscribe(dax_state *ds, tag_group_id *id, uint32_t interval,
+                        void (*callback)(dax_state *ds, void *udata),
+                        void *udata, void (*free_callback)(void *udata));
+int dax_group_unsubscribe(dax_state *ds, tag_group_id *id);
+int dax_group_get_data(dax_state *ds, tag_group_id *id, void *buff, size_t size);
 
 /* Convenience functions for converting strings to basic DAX values and back */
 int dax_val_to_string(char *buff, int size, tag_type type, void *val, int index);
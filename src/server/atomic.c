@@ -21,6 +21,7 @@
 #include <common.h>
 #include "tagbase.h"
 #include "retain.h"
+#include "journal.h"
 #include "func.h"
 #include <ctype.h>
 #include <assert.h>
@@ -353,9 +354,77 @@ _atomic_xnor(tag_handle h, void *data) {
 }
 
 
+/* Compare and swap.  'data' holds the expected data followed by the new
+ * data, each h.size bytes long.  BOOL data starts at bit zero of the first
+ * byte just like the other operations.  Returns 1 if the current data did
+ * not match and nothing was written. */
+static int
+_atomic_cas(tag_handle h, void *data) {
+    uint8_t *db, *expect, *new, mask;
+    int n, b;
+
+    db = (uint8_t *)&_db[h.index].data[h.byte];
+    expect = (uint8_t *)data;
+    new = (uint8_t *)data + h.size;
+    if(h.type == DAX_BOOL) {
+        for(n = 0; n < h.count; n++) {
+            b = h.bit + n;
+            if(((db[b/8] >> (b%8)) & 0x01) != ((expect[n/8] >> (n%8)) & 0x01)) return 1;
+        }
+        for(n = 0; n < h.count; n++) {
+            b = h.bit + n;
+            mask = 0x01 << (b%8);
+            if(new[n/8] & (0x01 << (n%8))) db[b/8] |= mask;
+            else                           db[b/8] &= ~mask;
+        }
+    } else {
+        if(memcmp(db, expect, h.size)) return 1;
+        memcpy(db, new, h.size);
+    }
+    return 0;
+}
+
+/* Returns the number of bytes that _atomic_fetch() will write.  The handle
+ * should have been through atomic_check() first */
 int
-atomic_op(tag_handle h, void *data, uint16_t op) {
-    int result;
+atomic_fetch_size(tag_handle h) {
+    if(h.type == DAX_BOOL) return (h.count - 1)/8 + 1;
+    return h.size;
+}
+
+/* Copies the data that the handle points to into 'old'.  BOOLs are shifted
+ * down so that the first bit of the handle is bit zero of the first byte */
+static void
+_atomic_fetch(tag_handle h, uint8_t *old) {
+    uint8_t *db;
+    int n, b;
+
+    db = (uint8_t *)&_db[h.index].data[h.byte];
+    if(h.type == DAX_BOOL) {
+        bzero(old, atomic_fetch_size(h));
+        for(n = 0; n < h.count; n++) {
+            b = h.bit + n;
+            if(db[b/8] & (0x01 << (b%8))) old[n/8] |= (0x01 << (n%8));
+        }
+    } else {
+        memcpy(old, db, h.size);
+    }
+}
+
+/* Applies the atomic operation 'op' to the data pointed to by the handle.  If
+ * 'old' is not NULL the data as it was before the operation is written there.
+ * It should be at least atomic_fetch_size() bytes.  Returns 1 if a compare
+ * and swap did not match, zero if the operation was applied or an error code
+ * otherwise.  Map checks are left up to the caller. */
+/* Checks the handle for an atomic operation against the tag.  The handle
+ * comes straight from the module so everything that the operations use to
+ * find their way around the data is checked here.  For BOOLs the data has
+ * to carry a bit for each item and for everything else the size has to
+ * match the count.  Returns zero if the handle is good or an error code. */
+int
+atomic_check(tag_handle h) {
+    uint32_t tag_size;
+
     /* We don't do these on custom data types */
     if(IS_CUSTOM(h.type)) {
         return ERR_BADTYPE;
@@ -364,22 +433,50 @@ atomic_op(tag_handle h, void *data, uint16_t op) {
     if(h.index < 0 || h.index >= get_tagindex()) {
         return ERR_ARG;
     }
-    /* Bounds Check Size - we can use the TYPESIZE macro here because we have
-       already excluded CDTs */
-    if((h.byte + h.size) > (_db[h.index].count * TYPESIZE(_db[h.index].type))) {
+    /* If the index is within range but the data area is a NULL pointer then the
+       tag has been deleted */
+    if(_db[h.index].data == NULL) {
+        return ERR_DELETED;
+    }
+    if(h.count == 0) {
+        return ERR_ARG;
+    }
+    tag_size = tag_get_size(h.index);
+    if(h.byte > tag_size) {
         return ERR_2BIG;
     }
+    if(h.type == DAX_BOOL) {
+        if(h.bit > 7) return ERR_ARG;
+        if(h.count > (tag_size - h.byte) * 8) return ERR_2BIG;
+        if(h.size < (h.count - 1)/8 + 1) return ERR_ARG;
+        if((h.bit + h.count - 1)/8 + 1 > tag_size - h.byte) return ERR_2BIG;
+    } else {
+        if(h.count > tag_size - h.byte) return ERR_2BIG;
+        if(h.size != h.count * TYPESIZE(h.type)) return ERR_ARG;
+        if(h.size > tag_size - h.byte) return ERR_2BIG;
+    }
     /* Since we directly manipulate the _db here we can't deal with virtual tags or
        special tags.*/
     if(_db[h.index].attr & (TAG_ATTR_VIRTUAL | TAG_ATTR_SPECIAL)) {
         return ERR_READONLY;
     }
-    /* If the index is within range but the data area is a NULL pointer then the
-       tag has been deleted */
-    if(_db[h.index].data == NULL) {
-        return ERR_DELETED;
+    return 0;
+}
+
+int
+atomic_op(int fd, tag_handle h, void *data, uint16_t op, void *old) {
+    int result;
+
+    result = atomic_check(h);
+    if(result) return result;
+    if(old != NULL) {
+        _atomic_fetch(h, old);
     }
-    switch(op) {
+    switch(op & ~ATOMIC_OP_FETCH) {
+        case ATOMIC_OP_CAS:
+            result = _atomic_cas(h, data);
+            if(result) return result; /* No match, nothing to check */
+            break;
         case ATOMIC_OP_INC:
             if(h.type == DAX_BOOL) return ERR_BADTYPE;
             result = _atomic_inc(h, data);
@@ -413,6 +510,8 @@ atomic_op(tag_handle h, void *data, uint16_t op) {
             return ERR_NOTIMPLEMENTED;
     }
     if(result) return result;
+    tag_stamp_write(fd, h.index);
+    journal_add(h.index, h.byte, h.size);
     event_check(h.index, h.byte, h.size);
     if(_db[h.index].attr & TAG_ATTR_RETAIN) {
         ret_tag_write(h.index);
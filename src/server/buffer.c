@@ -24,6 +24,7 @@
 #include "module.h"
 #include "tagbase.h"
 #include "options.h"
+#include "stats.h"
 
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -31,16 +32,13 @@
 #include <string.h>
 
 /* Notes:
- Okay here is how all this works.  To keep from having to have a buffer for
- each module and to keep from having some arbitrary amount of buffers for
- new modules we are going to share some buffers.  Each buffer has a file
- descriptor associated with it.  When the socket code decides that it needs
- to read information from a socket it will use these functions to find a buffer
- that is associated with the file descriptor.  If there isn't one associated
- with the file descriptor then it tries to find a free one.  If it can't
- find a free one then it'll create a new one.  There is a minimum number
- of buffers that will be kept allocated all the time to keep from calling
- malloc() and free() too much.
+ Each connection owns a single receive buffer that is kept in an array
+ indexed by the file descriptor.  The buffer is allocated the first time
+ that data is read from the socket and it is freed when the connection is
+ closed.  Partial messages stay in the buffer until the rest of the message
+ arrives so a slow sender never loses data, and every complete message in
+ the buffer is dispatched before returning so that pipelined messages are
+ not dropped.  The min_buffers option sets the starting size of the array.
 
  There will be quite a few denial of service attacks that can be done here
  and I'll have to figure out a way to keep things limping along if some
@@ -49,178 +47,170 @@
 
 
 typedef struct dax_BuffNode {
-    int fd;
     int index; /* Index of the next available char in the buffer */
-    unsigned char buffer[DAX_MSGMAX];
-    struct dax_BuffNode *next;
+    /* The raw bytes are read right into the message structure so that the
+     * message can be handled in place without being copied again */
+    dax_message msg;
 } dax_buffnode;
 
-/* This is the head of the data buffer list */
-static dax_buffnode *_buffer;
+/* Array of buffers indexed by file descriptor */
+static dax_buffnode **_buffers;
+static int _buffsize;
 
-/* Allocate and initialize a buffer node */
-static dax_buffnode *
-_new_buffnode(void)
-{
-    dax_buffnode *node;
-
-    node = malloc(sizeof(dax_buffnode));
-    if(node == NULL) return NULL;
-    node->fd = 0;
-    node->index = 0;
-    node->next = NULL;
-
-    return node;
-}
-
-/* Create the initial linked list of buffer nodes */
+/* Allocate the initial array of buffer pointers */
 int
 buff_initialize(void)
 {
-    int n, count;
-    dax_buffnode *node, *last;
-
-    count = opt_min_buffers();
-    last = NULL;
-
-    for(n = 0; n < count; n++) {
-        node = _new_buffnode();
-        if(node == NULL) {
-            dax_log(DAX_LOG_FATAL, "Unable to allocate all of the communication buffers");
-            kill(getpid(), SIGQUIT);
-        }
-        if(n == 0) {
-            _buffer = node;
-        } else {
-            last->next = node;
-        }
-        last = node;
+    _buffsize = opt_min_buffers();
+    if(_buffsize < 16) _buffsize = 16;
+    _buffers = xcalloc(_buffsize, sizeof(dax_buffnode *));
+    if(_buffers == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to allocate the communication buffers");
+        kill(getpid(), SIGQUIT);
     }
     return 0;
 }
 
-/* Return the index of the buffer node that is either presently
-   assigned to the fd or if there isn't one a free one */
+/* Return the buffer that belongs to the fd allocating it if need be */
 static dax_buffnode *
-find_buff_slot(int fd)
+_get_buffer(int fd)
 {
-    dax_buffnode *node, *firstfree, *result;
+    dax_buffnode **new;
+    int size;
+
+    if(fd >= _buffsize) {
+        size = _buffsize;
+        while(size <= fd) size *= 2;
+        new = xrealloc(_buffers, size * sizeof(dax_buffnode *));
+        if(new == NULL) return NULL;
+        memset(&new[_buffsize], 0, (size - _buffsize) * sizeof(dax_buffnode *));
+        _buffers = new;
+        _buffsize = size;
+    }
+    if(_buffers[fd] == NULL) {
+        _buffers[fd] = xmalloc(sizeof(dax_buffnode));
+        if(_buffers[fd] == NULL) return NULL;
+        _buffers[fd]->index = 0;
+    }
+    return _buffers[fd];
+}
 
-    node = _buffer;
-    firstfree = NULL;
+/* Dispatch every complete message that is in the buffer.  Anything left
+ * over is moved to the front of the buffer to wait for the rest of the
+ * message. */
+static int
+_buff_dispatch(int fd, dax_buffnode *node)
+{
+    unsigned char *buffer;
+    uint32_t size;
+    int result, retval = 0;
 
-    while(node != NULL) {
-        if(node->fd == fd) /* found it */
-            return node;
-        else if(node->fd == 0 && firstfree == NULL)
-            firstfree = node;  /* store a free one for later */
-        node = node->next;
-    }
-    /* couldn't find one that matched the fd so
-     * if we have one that was free return it */
-    if(firstfree != NULL) {
-        result = firstfree;
-    } else {
-        result = _new_buffnode();
-        if(result != NULL) {
-            node = _buffer;
-            /* double linked list would eliminate this ??? */
-            while(node->next != NULL) node = node->next;
-            node->next = result;
+    buffer = (unsigned char *)&node->msg;
+    /* First four bytes of a message should always be the size of
+       the message and it should be in network byte order */
+    while(node->index >= sizeof(uint32_t)) {
+        size = ntohl(node->msg.size);
+        if(size < MSG_HDR_SIZE || size > DAX_MSGMAX) {
+            /* We've lost our place in the stream and there is no way
+             * to find the start of the next message.  The caller closes
+             * the connection when it gets this error. */
+            dax_log(DAX_LOG_ERROR, "Bad message size %u on socket %d", size, fd);
+            node->index = 0;
+            return ERR_MSG_BAD;
+        }
+        if(node->index < size) break; /* Wait for the rest of it */
+        result = msg_dispatcher(fd, &node->msg);
+        if(result < 0) retval = result;
+        /* The handler may have closed the connection */
+        if(fd >= _buffsize || _buffers[fd] != node) return retval;
+        node->index -= size;
+        if(node->index > 0) {
+            memmove(buffer, &buffer[size], node->index);
         }
     }
-    if(result) result->fd = fd;
-    return result;
+    return retval;
 }
 
+/* Read whatever is waiting on the socket and dispatch every complete
+ * message that is in the buffer. */
 int
 buff_read(int fd)
 {
     dax_buffnode *node;
-    size_t result;
-    uint32_t size;
-
-    node = find_buff_slot(fd);
+    unsigned char *buffer;
+    ssize_t result;
 
+    node = _get_buffer(fd);
     /* If we can't get a buffer then return error */
     if(node == NULL) return ERR_ALLOC;
+    buffer = (unsigned char *)&node->msg;
 
     /* We don't want to read too much now do we */
-    size = DAX_MSGMAX - node->index;
-    result = read(fd, &node->buffer[node->index], size);
+    result = read(fd, &buffer[node->index], DAX_MSGMAX - node->index);
     //--Problem with xread() see func.c
     //--result = xread(fd, &node->buffer[node->index], size);
 
     if(result < 0) {
+        if(errno == EINTR || errno == EAGAIN) return 0;
         dax_log(DAX_LOG_ERROR, "Unable to read data from socket %d", fd);
         return ERR_MSG_RECV;
     } if(result == 0) { /* EOF means the other guy is closed */
         dax_log(DAX_LOG_COMM, "Received EOF on socket %d", fd);
         return ERR_NO_SOCKET;
     }
-
     node->index += result;
+    stats_bytes_in(result);
+    return _buff_dispatch(fd, node);
+}
 
-    /* Check the size and let the caller know how it turns out. */
-    /* First four bytes of a message should always be the size of
-       the message and it should be in network byte order */
-    size = ntohl(*(uint32_t *)node->buffer);
-    if(node->index < (size - 1)) {
-        return ERR_MSG_BAD;
-    } else if(node->index >= (size - 1)) {
-        return msg_dispatcher(fd, node->buffer);
-    }else if(size > DAX_MSGMAX) {
-        return ERR_2BIG;
+/* This is buff_read() for data that has already been received by somebody
+ * else, like the io_uring engine.  The data is copied into the connection's
+ * buffer a piece at a time so it can be more than one buffer's worth. */
+int
+buff_feed(int fd, const unsigned char *data, size_t len)
+{
+    dax_buffnode *node;
+    unsigned char *buffer;
+    size_t n;
+    int result, retval = 0;
+
+    while(len > 0) {
+        node = _get_buffer(fd);
+        if(node == NULL) return ERR_ALLOC;
+        buffer = (unsigned char *)&node->msg;
+        n = DAX_MSGMAX - node->index;
+        if(n > len) n = len;
+        memcpy(&buffer[node->index], data, n);
+        node->index += n;
+        data += n;
+        len -= n;
+        stats_bytes_in(n);
+        result = _buff_dispatch(fd, node);
+        if(result == ERR_MSG_BAD) return result;
+        if(result < 0) retval = result;
+        /* The handler may have closed the connection */
+        if(fd >= _buffsize || _buffers[fd] != node) return retval;
     }
-    return 0;
+    return retval;
 }
 
-/* TODO: Check boundary conditions where min_buffers = 0 or 1.  Shouldn't
-   be able to equal 0 but try to break it. */
-
 /* This frees the message buffer associated with 'fd' */
 void
 buff_free(int fd)
 {
-    dax_buffnode *node;
-    node = _buffer;
-
-    while(node != NULL) {
-        if(node->fd == fd) {
-            node->fd = 0;
-            node->index = 0;
-            return;
-        }
-        node = node->next;
+    if(fd >= 0 && fd < _buffsize && _buffers[fd] != NULL) {
+        xfree(_buffers[fd]);
+        _buffers[fd] = NULL;
     }
 }
 
-/* This function essentially marks all of the buffers as free.  If there are
- * more than min_buffers it'll free() the last one.  Kindof a poor boy
- * garbage collection. */
+/* This function frees all of the connection buffers */
 void
 buff_freeall(void)
 {
     int n;
-    dax_buffnode *node, *last;
-
-    n = 0;
-    node = _buffer;
-    last = NULL;
-
-    while(node != NULL) {
-        node->fd = 0;
-        node->index = 0;
-        n++;
-        /* If we are the last node, there are more than min_buffers nodes in the list
-           and last is not NULL then free the last node */
-        if(node->next == NULL && n > opt_min_buffers() && last != NULL) {
-            free(node);
-            node = NULL;
-            last->next = NULL;
-        } else {
-            last = node;
-            node = node->next;
-        }
+
+    for(n = 0; n < _buffsize; n++) {
+        buff_free(n);
     }
 }
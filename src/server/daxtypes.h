@@ -28,6 +28,8 @@
 
 /* Flag bits for the tag data groups */
 #define GRP_FLAG_NOT_EMPTY  0x01
+#define GRP_FLAG_SUBSCRIBED 0x02 /* Group data is pushed to the module on change */
+#define GRP_FLAG_PENDING    0x04 /* A push is being held back by the interval */
 
 /* Tag groups are an array of handles in each module */
 typedef struct tag_group_t {
@@ -35,6 +37,8 @@ typedef struct tag_group_t {
     unsigned int size; /* amount of memory needed to transfer this group */
     uint8_t count;    /* number of members in this group */
     tag_handle *members;
+    uint32_t interval; /* minimum time between subscription pushes in mSec */
+    time_t lastsent;   /* time of the last subscription push in mSec from xmonotime() */
 } tag_group;
 
 /* Modules are implemented as a circular doubly linked list */
@@ -47,6 +51,7 @@ typedef struct dax_Module {
     uint32_t timeout;  /* Module communication timeout. */
     time_t starttime;
     int event_count;
+    uint32_t queue;     /* Number of events waiting on rate limit timers */
     tag_group *tag_groups; /* Array of tag group packet definitions */
     uint32_t groups_size;  /* Current size of the group array */
     struct dax_Module *next, *prev;
@@ -21,6 +21,9 @@
 #include <common.h>
 #include "tagbase.h"
 #include "func.h"
+#include "groups.h"
+#include "stats.h"
+#include "module.h"
 #include <ctype.h>
 #include <assert.h>
 
@@ -33,31 +36,62 @@ extern _dax_tag_db *_db;
 static int
 _send_event(tag_index idx, _dax_event *event)
 {
-    int result;
-    char buff[DAX_MSGMAX];
-    uint32_t msgsize;
-
-    if(event->options & EVENT_OPT_SEND_DATA) {
-        msgsize = event->size + 16; /* Calculate the total size of this message */
-        *(uint32_t *)(&buff[0])  = htonl(event->size + 8); /* The size that we send */
-    } else {
-        msgsize = 16; /* Calculate the total size of this message */
-        *(uint32_t *)(&buff[0])  = htonl(8); /* The size that we send */
+    int result, count;
+    uint32_t header[4];
+    uint8_t stamp[EVENT_STAMP_SIZE];
+    _dax_tag_stamp *ts;
+    dax_module *writer;
+    struct iovec iov[3];
+    uint32_t msgsize, type;
+
+    type = MSG_EVENT | event->eventtype;
+    msgsize = 16;
+    count = 1;
+    iov[0].iov_base = header;
+    iov[0].iov_len = 16;
+    /* The write stamp goes between the header and the data */
+    if(event->options & EVENT_OPT_SEND_TIME) {
+        memset(stamp, 0, sizeof(stamp));
+        *((int32_t *)&stamp[16]) = -1;
+        ts = tag_get_stamp(idx);
+        if(ts != NULL) {
+            *((dax_time *)&stamp[0]) = ts->time;
+            *((uint64_t *)&stamp[8]) = ts->mono;
+            if(ts->fd >= 0 && (writer = module_find_fd(ts->fd)) != NULL && writer->tagindex > 0) {
+                *((int32_t *)&stamp[16]) = writer->tagindex;
+            }
+        }
+        type |= MSG_EVENT_STAMP;
+        iov[count].iov_base = stamp;
+        iov[count].iov_len = EVENT_STAMP_SIZE;
+        msgsize += EVENT_STAMP_SIZE;
+        count++;
     }
-    if(msgsize > DAX_MSGMAX) return ERR_2BIG;
-    *(uint32_t *)(&buff[4])  = htonl(MSG_EVENT | event->eventtype);
-    *(uint32_t *)(&buff[8])  = htonl(idx);
-    *(uint32_t *)(&buff[12])  = htonl(event->id);
     if(event->options & EVENT_OPT_SEND_DATA) {
-        memcpy(&buff[16], &_db[idx].data[event->byte], event->size);
+        /* The tag data is written straight out of the database */
+        iov[count].iov_base = &_db[idx].data[event->byte];
+        iov[count].iov_len = event->size;
+        msgsize += event->size;
+        count++;
+    }
+    if(msgsize > DAX_MSGMAX) {
+        stats_event_dropped();
+        return ERR_2BIG;
     }
+    header[0] = htonl(msgsize - 8); /* The size that we send */
+    header[1] = htonl(type);
+    header[2] = htonl(idx);
+    header[3] = htonl(event->id);
     dax_log(DAX_LOG_MSG, "Sending %d event to module %d",
          event->eventtype, event->notify->fd);
-    result = xwrite(event->notify->fd, buff, msgsize);
+    result = xwritev(event->notify->fd, iov, count);
     if(result < 0) {
         dax_log(DAX_LOG_ERROR, "_send_event: %s", strerror(errno));
+        stats_event_dropped();
         return ERR_MSG_SEND;
     }
+    stats_event_sent();
+    stats_bytes_out(result);
     return 0;
 }
 
@@ -391,6 +425,44 @@ _event_hit(_dax_event *event, tag_index idx, int offset, int size) {
     return 0;
 }
 
+/* This is the timer callback for events that have been coalesced.  The
+ * event is sent with whatever data is in the tag now. */
+static void
+_event_timeout(void *udata) {
+    _dax_event *event = (_dax_event *)udata;
+
+    event->pending = 0;
+    event->notify->queue--;
+    event->lastsent = xmonotime();
+    _send_event(event->index, event);
+}
+
+/* Called when an event that has a minimum interval hits.  If the interval
+ * has expired the event is sent right away.  Otherwise it is either dropped
+ * or, if the EVENT_OPT_COALESCE option is set, the timer is started so that
+ * one event with the latest data is sent at the end of the interval. */
+static void
+_event_limit(tag_index idx, _dax_event *event) {
+    time_t now;
+
+    if(event->pending) { /* Already waiting on the timer */
+        stats_event_coalesced();
+        return;
+    }
+    now = xmonotime();
+    if((now - event->lastsent) >= event->interval) {
+        event->lastsent = now;
+        _send_event(idx, event);
+    } else if(event->options & EVENT_OPT_COALESCE) {
+        event->pending = 1;
+        event->notify->queue++;
+        stats_event_coalesced();
+        timer_start(&event->timer, event->lastsent + event->interval);
+    } else {
+        stats_event_dropped();
+    }
+}
+
 /* This function checks to see if an event has occurred.  It should be
  * called from the tag_write() function or the tag_mask_write() function.
  * If it decides that there is an event match to the data area given then
@@ -413,11 +485,18 @@ event_check(tag_index idx, int offset, int size) {
          * this event. */
         if(offset <= (this->byte + this->size - 1) && (offset + size -1 ) >= this->byte) {
             if(_event_hit(this, idx, offset, size)) {
-                _send_event(idx, this);
+                if(this->interval) {
+                    _event_limit(idx, this);
+                } else {
+                    _send_event(idx, this);
+                }
             }
         }
         this = this->next;
     }
+    /* Tag group subscriptions are checked here too so that everything
+     * that fires events also pushes subscribed groups */
+    group_check(idx, offset, size);
     return;
 }
 
@@ -623,6 +702,11 @@ event_add(tag_handle h, int event_type, void *data, dax_module *module)
     new->datatype = h.type;
     new->eventtype = event_type;
     new->notify = module;
+    new->index = h.index;
+    new->interval = 0;
+    new->lastsent = 0;
+    new->pending = 0;
+    timer_init(&new->timer, _event_timeout, new);
     result = _set_event_data(new, h.index, data);
     if(result) {
         free(new);
@@ -651,6 +735,12 @@ event_add(tag_handle h, int event_type, void *data, dax_module *module)
  * and bad things will happen. */
 static void
 _free_event(_dax_event *event) {
+    timer_stop(&event->timer);
+    /* Let go of our reference to the tag's write stamp */
+    if(event->options & EVENT_OPT_SEND_TIME) {
+        tag_clr_attribute(event->index, TAG_ATTR_TIMESTAMP);
+    }
+    if(event->pending) event->notify->queue--;
     if(event->data != NULL) free(event->data);
     if(event->test != NULL) free(event->test);
     free(event);
@@ -689,9 +779,12 @@ event_del(int index, int id, dax_module *module)
         }
         _db[index].events = this->next;
         _free_event(this);
+        this = NULL; /* Don't look at the rest of the list */
+        result = 0;
+    } else {
+        last = this;
+        this = this->next;
     }
-    last = this;
-    this = this->next;
     while(this != NULL) {
         if(this->id == id) {
             if(this->notify != module) {
@@ -748,10 +841,54 @@ event_opt(int index, int id, uint32_t options, dax_module *module) {
         return ERR_AUTH;
     }
 
+    /* The tag has to keep the write stamps if we are going to send them.
+     * Each event holds one reference to the attribute while it has the option */
+    if((options & EVENT_OPT_SEND_TIME) && !(event->options & EVENT_OPT_SEND_TIME)) {
+        result = tag_set_attribute(index, TAG_ATTR_TIMESTAMP);
+        if(result) return result;
+    } else if(!(options & EVENT_OPT_SEND_TIME) && (event->options & EVENT_OPT_SEND_TIME)) {
+        tag_clr_attribute(index, TAG_ATTR_TIMESTAMP);
+    }
     event->options = options;
     return 0;
 }
 
+/* Sets the minimum time in mSec between events.  Setting the interval to
+ * zero removes the limit.  This only makes sense for WRITE and CHANGE
+ * events.  Edge triggered events like SET and RESET would lose
+ * information if they were dropped or coalesced. */
+int
+event_interval(int index, int id, uint32_t interval, dax_module *module) {
+    _dax_event *event;
+    int result;
+
+    if(index >= get_tagindex() || index < 0) {
+        dax_log(DAX_LOG_ERROR, "event_interval() - index %d is out of range", index);
+        return ERR_2BIG;
+    }
+
+    result = _find_event(&event, index, id);
+    if(result) {
+        dax_log(DAX_LOG_ERROR, "event_interval() - event not found");
+        return result;
+    }
+    if(event->notify != module) {
+        dax_log(DAX_LOG_ERROR, "Module cannot modify another module's event");
+        return ERR_AUTH;
+    }
+    if(interval && event->eventtype != EVENT_WRITE && event->eventtype != EVENT_CHANGE) {
+        dax_log(DAX_LOG_ERROR, "event_interval() - Only WRITE and CHANGE events can have an interval");
+        return ERR_ILLEGAL;
+    }
+    event->interval = interval;
+    /* If we are removing the limit then send anything that is waiting */
+    if(event->pending && interval == 0) {
+        timer_stop(&event->timer);
+        _event_timeout(event);
+    }
+    return 0;
+}
+
 
 /* Removes all of the events that are owned by the given module */
 int
@@ -28,6 +28,7 @@
 #include <syslog.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <time.h>
 
 /* Wrapper functions - Mostly system calls that need special handling */
 
@@ -61,6 +62,36 @@ xwrite(int fd, const void *buff, size_t nbyte)
     return nbyte;
 }
 
+/* Same as xwrite() but for writev().  The iovec array is modified as the
+ * data is written so the caller should not count on it afterwards. */
+ssize_t
+xwritev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t result;
+
+    while(iovcnt > 0) {
+        result = writev(fd, iov, iovcnt);
+        if(result <= 0) {
+            /* If we get interrupted by a signal go again */
+            if(result < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        total += result;
+        /* Skip past the buffers that were completely written */
+        while(iovcnt > 0 && (size_t)result >= iov->iov_len) {
+            result -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + result;
+            iov->iov_len -= result;
+        }
+    }
+    return total;
+}
+
 /* Memory management functions.  These are just to override the
  * standard memory management functions in case I decide to do
  * something creative with them later. */
@@ -116,4 +147,16 @@ xtime(void) {
     gettimeofday(&gettime, NULL);
     return gettime.tv_sec * 1000 + gettime.tv_usec / 1000;
 }
+
+/* Returns mSec on the monotonic clock.  This is what the timers and the
+ * event intervals run on so that setting the system clock doesn't hold
+ * them up or fire them all at once.  It has nothing to do with the time
+ * of day so don't store it in tags. */
+time_t
+xmonotime(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
     
@@ -19,12 +19,14 @@
 #include <opendax.h>
 #include <sys/time.h>
 #include <signal.h>
+#include <sys/uio.h>
 
 #ifndef __FUNC_H
 #define __FUNC_H
 
 /* Wrappers for system calls */
 ssize_t xwrite(int fd, const void *buff, size_t nbyte);
+ssize_t xwritev(int fd, struct iovec *iov, int iovcnt);
 
 /* Memory management functions.  These are just to override the
  * standard memory management functions in case I decide to do
@@ -41,5 +43,6 @@ char *xstrcpy(const char *);
 char *xstrdup(char *);
 
 time_t xtime(void);
+time_t xmonotime(void);
 
 #endif /* !__FUNC_H */
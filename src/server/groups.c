@@ -25,12 +25,29 @@
 #include "libcommon.h"
 #include "groups.h"
 #include "tagbase.h"
+#include "func.h"
+#include "stats.h"
+
+/* Subscribed groups are kept in a list so that the tag write path only
+ * has to look at the groups that actually want data pushed to them. We
+ * store the module and the group index instead of a pointer to the group
+ * because the tag_groups array can be moved by realloc() */
+typedef struct group_sub_t {
+    dax_module *mod;
+    uint32_t index;
+    struct group_sub_t *next;
+} group_sub;
+
+static group_sub *_subs = NULL;
+static int _hold = 0;
 
 static void
 _init_group(tag_group *grp) {
     grp->size = 0;
     grp->flags = 0x00;
     grp->members = NULL;
+    grp->interval = 0;
+    grp->lastsent = 0;
 }
 
 
@@ -107,16 +124,39 @@ group_add(dax_module *mod, uint8_t *handles, uint8_t count) {
 
     mod->tag_groups[index].flags |= GRP_FLAG_NOT_EMPTY;
     mod->tag_groups[index].count = count;
+    mod->tag_groups[index].size = datasize;
     dax_log(DAX_LOG_MSG, "Group Add message from %s", mod->name);
     return index;
 }
 
 
+/* Removes the group from the subscription list if it is there */
+static void
+_sub_remove(dax_module *mod, uint32_t index) {
+    group_sub *this, *last = NULL;
+
+    this = _subs;
+    while(this != NULL) {
+        if(this->mod == mod && (index == this->index || index == (uint32_t)-1)) {
+            if(last == NULL) _subs = this->next;
+            else last->next = this->next;
+            free(this);
+            this = (last == NULL) ? _subs : last->next;
+        } else {
+            last = this;
+            this = this->next;
+        }
+    }
+}
+
 /* Deletes a single tag group from the given module */
 int
 group_del(dax_module *mod, int index) {
     if((mod->tag_groups[index].flags & GRP_FLAG_NOT_EMPTY) == 0) return ERR_NOTFOUND;
 
+    if(mod->tag_groups[index].flags & GRP_FLAG_SUBSCRIBED) {
+        _sub_remove(mod, index);
+    }
     free(mod->tag_groups[index].members);
     mod->tag_groups[index].flags = 0x00;
     mod->tag_groups[index].count = 0;
@@ -143,23 +183,165 @@ group_read(dax_module *mod, uint32_t index, uint8_t *buff, int size) {
     return offset;
 }
 
-/* loop through the array of members and populate buff with
- * the data.*/
+/* loop through the array of members and write the data in buff to
+ * them.  fd is the connection that sent the data so that the writes
+ * are checked and recorded the same as any other write from it. */
 int
-group_write(dax_module *mod, uint32_t index, uint8_t *buff) {
+group_write(int fd, dax_module *mod, uint32_t index, uint8_t *buff) {
     int n, offset=0, result;
     tag_group *group;
 
     group = &mod->tag_groups[index];
     if((group->flags & GRP_FLAG_NOT_EMPTY) == 0) return ERR_NOTFOUND;
+    /* Hold the subscription pushes until all the members are written so
+     * that subscribers don't get a half written group */
+    group_sub_hold();
     for(n = 0;n<group->count;n++) {
-        result = tag_write(-1, group->members[n].index, group->members[n].byte, &buff[offset], group->members[n].size);
-        if(result) return result;
+        result = tag_write(fd, group->members[n].index, group->members[n].byte, &buff[offset], group->members[n].size);
+        if(result) {
+            group_sub_release();
+            return result;
+        }
         offset += group->members[n].size;
     }
+    group_sub_release();
     return offset;
 }
 
+/* Starts or stops pushing the group data to the module whenever any
+ * member of the group is written.  'interval' is the minimum number of
+ * milliseconds between pushes.  Writes that happen inside the interval
+ * are coalesced into a single push of the latest data when it expires. */
+int
+group_subscribe(dax_module *mod, uint32_t index, uint8_t flags, uint32_t interval) {
+    tag_group *group;
+    group_sub *new;
+
+    if(index >= mod->groups_size) return ERR_ARG;
+    group = &mod->tag_groups[index];
+    if((group->flags & GRP_FLAG_NOT_EMPTY) == 0) return ERR_NOTFOUND;
+
+    if(flags & GRP_SUB_ENABLE) {
+        /* The whole group has to fit in one push */
+        if(group->size > MSG_GROUP_EVENT_DATA_SIZE) return ERR_2BIG;
+        group->interval = interval;
+        if(group->flags & GRP_FLAG_SUBSCRIBED) return 0; /* Just changing the interval */
+        new = malloc(sizeof(group_sub));
+        if(new == NULL) return ERR_ALLOC;
+        new->mod = mod;
+        new->index = index;
+        new->next = _subs;
+        _subs = new;
+        group->lastsent = 0;
+        group->flags |= GRP_FLAG_SUBSCRIBED;
+    } else {
+        if((group->flags & GRP_FLAG_SUBSCRIBED) == 0) return ERR_NOTFOUND;
+        _sub_remove(mod, index);
+        group->flags &= ~(GRP_FLAG_SUBSCRIBED | GRP_FLAG_PENDING);
+    }
+    return 0;
+}
+
+/* Sends the entire group data to the module as an EVENT_GROUP event */
+static int
+_send_group(dax_module *mod, uint32_t index, time_t now) {
+    int result;
+    uint8_t buff[DAX_MSGMAX];
+    tag_group *group;
+
+    group = &mod->tag_groups[index];
+    group->flags &= ~GRP_FLAG_PENDING;
+    group->lastsent = now;
+    result = group_read(mod, index, &buff[16], MSG_GROUP_EVENT_DATA_SIZE);
+    if(result < 0) return result;
+    *(uint32_t *)(&buff[0])  = htonl(result + 8);
+    *(uint32_t *)(&buff[4])  = htonl(MSG_EVENT | EVENT_GROUP);
+    *(uint32_t *)(&buff[8])  = htonl(index);
+    *(uint32_t *)(&buff[12]) = htonl(GROUP_EVENT_ID);
+    result = xwrite(mod->fd, buff, result + 16);
+    if(result < 0) {
+        dax_log(DAX_LOG_ERROR, "_send_group: %s", strerror(errno));
+        return ERR_MSG_SEND;
+    }
+    stats_bytes_out(result);
+    return 0;
+}
+
+/* This is called from event_check() whenever tag data is written.  If the
+ * written area overlaps any member of a subscribed group the group is
+ * either pushed immediately or marked as pending if the interval has not
+ * expired yet. */
+void
+group_check(tag_index idx, int offset, int size) {
+    group_sub *this;
+    tag_group *group;
+    tag_handle *h;
+    time_t now = 0;
+    int n;
+
+    for(this = _subs; this != NULL; this = this->next) {
+        group = &this->mod->tag_groups[this->index];
+        if(group->flags & GRP_FLAG_PENDING) continue; /* Already going out */
+        for(n = 0; n < group->count; n++) {
+            h = &group->members[n];
+            if(h->index == idx && offset <= (h->byte + h->size - 1) && (offset + size - 1) >= h->byte) {
+                break;
+            }
+        }
+        if(n == group->count) continue; /* Not one of ours */
+        if(_hold) {
+            group->flags |= GRP_FLAG_PENDING;
+            continue;
+        }
+        if(now == 0) now = xmonotime();
+        if((now - group->lastsent) >= group->interval) {
+            _send_group(this->mod, this->index, now);
+        } else {
+            group->flags |= GRP_FLAG_PENDING;
+        }
+    }
+}
+
+/* Sends all of the pending group pushes whose interval has expired.
+ * Returns the number of milliseconds until the next pending push is due
+ * or -1 if there is nothing pending. */
+int
+group_sub_flush(void) {
+    group_sub *this;
+    tag_group *group;
+    time_t now, elapsed;
+    int wait, next = -1;
+
+    if(_subs == NULL || _hold) return -1;
+    now = xmonotime();
+    for(this = _subs; this != NULL; this = this->next) {
+        group = &this->mod->tag_groups[this->index];
+        if((group->flags & GRP_FLAG_PENDING) == 0) continue;
+        elapsed = now - group->lastsent;
+        if(elapsed >= group->interval) {
+            _send_group(this->mod, this->index, now);
+        } else {
+            wait = group->interval - elapsed;
+            if(next < 0 || wait < next) next = wait;
+        }
+    }
+    return next;
+}
+
+/* group_sub_hold() and group_sub_release() bracket operations that write
+ * more than one piece of tag data so that subscribed groups are only
+ * pushed once, after all the data is in place.  These nest. */
+void
+group_sub_hold(void) {
+    _hold++;
+}
+
+void
+group_sub_release(void) {
+    if(_hold > 0) _hold--;
+    if(_hold == 0) group_sub_flush();
+}
+
 
 /* Deletes all of the groups and free's the tag_groups array
  * This is called when we are removing the module */
@@ -167,6 +349,7 @@ int
 groups_cleanup(dax_module *mod) {
     uint32_t n;
 
+    _sub_remove(mod, (uint32_t)-1);
     for(n=0;n<mod->groups_size;n++) {
         group_del(mod, n);
     }
@@ -38,7 +38,12 @@
 int group_add(dax_module *mod, uint8_t *handles, uint8_t count);
 int group_del(dax_module *mod, int index);
 int group_read(dax_module *mod, uint32_t index, uint8_t *buff, int size);
-int group_write(dax_module *mod, uint32_t index, uint8_t *buff);
+int group_write(int fd, dax_module *mod, uint32_t index, uint8_t *buff);
+int group_subscribe(dax_module *mod, uint32_t index, uint8_t flags, uint32_t interval);
+void group_check(tag_index idx, int offset, int size);
+int group_sub_flush(void);
+void group_sub_hold(void);
+void group_sub_release(void);
 int groups_cleanup(dax_module *mod);
 
 #endif /* !__DAX_GROUPS_H */
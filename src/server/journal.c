@@ -0,0 +1,133 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the tag change journal.  This is a fixed size ring
+ * of the tag ranges that have been written, in the order that they were
+ * written.  Clients that lose their connection can ask for the changes
+ * since the last sequence number that they saw instead of reading every
+ * tag again.
+ */
+
+#include "journal.h"
+#include "func.h"
+#include <time.h>
+
+static journal_entry *_ring;
+static uint32_t _size;   /* Number of slots in the ring */
+static uint32_t _head;   /* Slot where the next entry will go */
+static uint32_t _count;  /* Number of slots that are in use */
+static uint64_t _seq;    /* Last sequence number that was handed out */
+static uint64_t _lost;   /* Highest sequence number that has been overwritten */
+
+int
+journal_init(uint32_t size)
+{
+    _ring = xmalloc(sizeof(journal_entry) * size);
+    if(_ring == NULL) {
+        dax_log(DAX_LOG_ERROR, "Unable to allocate the change journal");
+        return ERR_ALLOC;
+    }
+    _size = size;
+    _head = _count = 0;
+    /* The sequence starts with the time in the upper 32 bits so that a
+     * sequence number from before a server restart will always be older
+     * than anything we have and the client will be told to resync. */
+    _seq = _lost = (uint64_t)time(NULL) << 32;
+    dax_log(DAX_LOG_MINOR, "Change journal created with %d entries", size);
+    return 0;
+}
+
+/* Called every time that data is written to a tag.  If the last entry is a
+ * write to the same tag and the ranges touch then we just grow that entry
+ * and give it a new sequence number.  This keeps a tag that is being
+ * written over and over from pushing everything else out of the ring. */
+void
+journal_add(tag_index idx, uint32_t byte, uint32_t size)
+{
+    journal_entry *last;
+    uint32_t end;
+
+    if(_ring == NULL) return;
+    if(_count) {
+        last = &_ring[(_head + _size - 1) % _size];
+        if(last->idx == idx && byte <= last->byte + last->size && byte + size >= last->byte) {
+            end = MAX(last->byte + last->size, byte + size);
+            last->byte = MIN(last->byte, byte);
+            last->size = end - last->byte;
+            last->seq = ++_seq;
+            return;
+        }
+    }
+    if(_count == _size) {
+        _lost = _ring[_head].seq;
+    } else {
+        _count++;
+    }
+    _ring[_head].seq = ++_seq;
+    _ring[_head].idx = idx;
+    _ring[_head].byte = byte;
+    _ring[_head].size = size;
+    _head = (_head + 1) % _size;
+}
+
+/* Called when a tag is added, grown or deleted.  The entries only say which
+ * data was written so they can't tell a client about that.  Everybody that
+ * is behind the new sequence number will be told to resync. */
+void
+journal_resync(void)
+{
+    if(_ring == NULL) return;
+    _head = _count = 0;
+    _lost = ++_seq;
+}
+
+/* Copies up to 'max' of the entries that came after the sequence number
+ * 'seq' into 'entries' and updates 'seq' to the last entry that was copied.
+ * Returns the number of entries copied or ERR_OVERFLOW if the journal no
+ * longer has all of the changes since 'seq' or the tags have been added or
+ * deleted since then.  In that case 'seq' is set to
+ * the current sequence number and the client has to read everything. */
+int
+journal_since(uint64_t *seq, journal_entry *entries, int max)
+{
+    uint32_t first, lo, hi, mid;
+    int n;
+
+    if(_ring == NULL || *seq > _seq || *seq < _lost) {
+        *seq = _seq;
+        return ERR_OVERFLOW;
+    }
+    /* Binary search for the oldest entry that is newer than seq */
+    first = (_head + _size - _count) % _size;
+    lo = 0;
+    hi = _count;
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(_ring[(first + mid) % _size].seq <= *seq) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for(n = 0; n < max && lo + n < _count; n++) {
+        entries[n] = _ring[(first + lo + n) % _size];
+    }
+    if(n) {
+        *seq = entries[n - 1].seq;
+    }
+    return n;
+}
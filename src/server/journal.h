@@ -0,0 +1,42 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the definitions for the tag change journal
+ */
+
+#ifndef __DAX_JOURNAL_H
+#define __DAX_JOURNAL_H 1
+
+#include <common.h>
+#include <opendax.h>
+
+/* Each entry is a range of a tag that was changed.  Every change gets the
+ * next number in a global sequence, so the entries in the ring are always
+ * sorted by seq. */
+typedef struct {
+    uint64_t seq;
+    tag_index idx;
+    uint32_t byte;
+    uint32_t size;
+} journal_entry;
+
+int journal_init(uint32_t size);
+void journal_add(tag_index idx, uint32_t byte, uint32_t size);
+void journal_resync(void);
+int journal_since(uint64_t *seq, journal_entry *entries, int max);
+
+#endif /* !__DAX_JOURNAL_H */
@@ -22,6 +22,7 @@
 #include <common.h>
 #include "tagbase.h"
 #include "func.h"
+#include "stats.h"
 
 extern _dax_tag_db *_db;
 
@@ -226,6 +227,7 @@ map_check(tag_index idx, int offset, int size) {
         if(offset <= (this->source.byte + this->source.size - 1) && (offset + size -1 ) >= this->source.byte) {
             srcdb = &_db[this->source.index].data[this->source.byte];
             /* Mapping Hit */
+            stats_map_hop();
             if(this->mask != NULL) {
                 /* Move the bits from their position in the source to
                  * where they should go in the destination */
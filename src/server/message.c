@@ -30,12 +30,19 @@
 #include "options.h"
 #include "groups.h"
 #include "virtualtag.h"
+#include "stats.h"
+#include "journal.h"
+#include "uring.h"
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
 #include <string.h>
+#include <fnmatch.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #define ASYNC 0
 #define RESPONSE 1
@@ -52,6 +59,16 @@ static fd_set _listenfdset;
  * it is used in the select() call in msg_receive() */
 static fd_set _fdset;
 static int _maxfd;
+/* When the epoll engine is used this is the epoll instance, otherwise
+ * it is -1 and select() is used. */
+static int _epollfd = -1;
+#ifdef HAVE_IO_URING
+/* Set when the io_uring engine is being used */
+static int _uring;
+/* Size of the io_uring queues and number of receive buffers */
+# define URING_ENTRIES 256
+# define URING_BUFFERS 256
+#endif
 
 /* This array holds the functions for each message command */
 /* Index 0 is not used. */
@@ -87,6 +104,14 @@ int msg_add_override(dax_message *msg);
 int msg_del_override(dax_message *msg);
 int msg_get_override(dax_message *msg);
 int msg_set_override(dax_message *msg);
+int msg_group_subscribe(dax_message *msg);
+int msg_atomic_batch(dax_message *msg);
+int msg_tag_multi_write(dax_message *msg);
+int msg_tag_add_bulk(dax_message *msg);
+int msg_tag_get_bulk(dax_message *msg);
+int msg_changes_since(dax_message *msg);
+int msg_queue_write(dax_message *msg);
+int msg_queue_read(dax_message *msg);
 
 
 /* Generic message sending function.  If response is MSG_ERROR then it is assumed that
@@ -96,27 +121,34 @@ static int
 _message_send(int fd, int command, void *payload, size_t size, int response)
 {
     int result;
-    char buff[DAX_MSGMAX];
+    uint32_t header[2];
+    struct iovec iov[2];
 
-    ((uint32_t *)buff)[0] = htonl(size);
+    header[0] = htonl(size);
     if(response == RESPONSE) {
-        ((uint32_t *)buff)[1] = htonl(command | MSG_RESPONSE);
+        header[1] = htonl(command | MSG_RESPONSE);
     } else if(response == ERROR) {
         dax_log(DAX_LOG_MSGERR, "Returning Error '%s' to Module", dax_errstr(*(int *)payload));
-        ((uint32_t *)buff)[1] = htonl(command | MSG_ERROR);
+        header[1] = htonl(command | MSG_ERROR);
     } else {
-        ((uint32_t *)buff)[1] = htonl(command);
+        header[1] = htonl(command);
     }
     /* Bounds check so we don't seg fault */
     if(size > (DAX_MSGMAX - MSG_HDR_SIZE)) {
         return ERR_2BIG;
     }
-    memcpy(&buff[MSG_HDR_SIZE], payload, size);
-    result = xwrite(fd, buff, size + MSG_HDR_SIZE);
+    /* The header and the payload are written together straight from where
+     * they are instead of being copied into a single buffer first */
+    iov[0].iov_base = header;
+    iov[0].iov_len = MSG_HDR_SIZE;
+    iov[1].iov_base = payload;
+    iov[1].iov_len = size;
+    result = xwritev(fd, iov, size ? 2 : 1);
     if(result < 0) {
         dax_log(DAX_LOG_ERROR, "_message_send: %s", strerror(errno));
         return ERR_MSG_SEND;
     }
+    stats_bytes_out(result);
     return 0;
 }
 
@@ -201,8 +233,31 @@ msg_setup(void)
 {
     _maxfd = 0;
     struct in_addr s;
+    int engine;
     FD_ZERO(&_fdset);
     FD_ZERO(&_listenfdset);
+    engine = opt_io_engine();
+#ifdef HAVE_IO_URING
+    if(engine == IO_ENGINE_URING) {
+        if(uring_init(URING_ENTRIES, URING_BUFFERS, DAX_MSGMAX)) {
+            dax_log(DAX_LOG_ERROR, "Unable to start the io_uring engine, using epoll");
+            engine = IO_ENGINE_EPOLL;
+        } else {
+            _uring = 1;
+            dax_log(DAX_LOG_COMM, "Using the io_uring I/O engine");
+        }
+    }
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+    if(engine == IO_ENGINE_EPOLL) {
+        _epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if(_epollfd < 0) {
+            dax_log(DAX_LOG_ERROR, "Unable to create epoll instance, using select - %s", strerror(errno));
+        } else {
+            dax_log(DAX_LOG_COMM, "Using the epoll I/O engine");
+        }
+    }
+#endif
 
     dax_log(DAX_LOG_DEBUG, "Opening Local Connection - %s", opt_socketname());
     _msg_setup_local_socket();
@@ -242,6 +297,14 @@ msg_setup(void)
     cmd_arr[MSG_DEL_OVRD]   = &msg_del_override;
     cmd_arr[MSG_GET_OVRD]   = &msg_get_override;
     cmd_arr[MSG_SET_OVRD]   = &msg_set_override;
+    cmd_arr[MSG_GRP_SUB]    = &msg_group_subscribe;
+    cmd_arr[MSG_ATOMIC_BATCH] = &msg_atomic_batch;
+    cmd_arr[MSG_TAG_MULTI_WRITE] = &msg_tag_multi_write;
+    cmd_arr[MSG_TAG_ADD_BULK] = &msg_tag_add_bulk;
+    cmd_arr[MSG_TAG_GET_BULK] = &msg_tag_get_bulk;
+    cmd_arr[MSG_CHANGES_SINCE] = &msg_changes_since;
+    cmd_arr[MSG_QUEUE_WRITE] = &msg_queue_write;
+    cmd_arr[MSG_QUEUE_READ]  = &msg_queue_read;
 
     return 0;
 }
@@ -252,6 +315,11 @@ msg_destroy(void)
 {
     unlink(opt_socketname());
     dax_log(DAX_LOG_COMM, "Removed local socket file %s", opt_socketname());
+    buff_freeall();
+#ifdef HAVE_IO_URING
+    if(_uring) uring_free();
+    _uring = 0;
+#endif
 }
 
 /* These two functions are wrappers to deal with adding and deleting
@@ -259,6 +327,32 @@ msg_destroy(void)
 void
 msg_add_fd(int fd)
 {
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev;
+#endif
+
+#ifdef HAVE_IO_URING
+    if(_uring) {
+        if(fd < FD_SETSIZE && FD_ISSET(fd, &_listenfdset)) {
+            uring_accept(fd);
+        } else {
+            uring_recv(fd);
+        }
+        if(fd > _maxfd) _maxfd = fd;
+        return;
+    }
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+    if(_epollfd >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if(epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &ev)) {
+            dax_log(DAX_LOG_ERROR, "Unable to add fd %d to epoll - %s", fd, strerror(errno));
+        }
+        if(fd > _maxfd) _maxfd = fd;
+        return;
+    }
+#endif
     FD_SET(fd, &_fdset);
     if(fd > _maxfd) _maxfd = fd;
 }
@@ -268,6 +362,22 @@ msg_del_fd(int fd)
 {
     int n, tmpfd = 0;
 
+#ifdef HAVE_IO_URING
+    if(_uring) {
+        uring_cancel(fd);
+        close(fd);
+        buff_free(fd);
+        return;
+    }
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+    if(_epollfd >= 0) {
+        epoll_ctl(_epollfd, EPOLL_CTL_DEL, fd, NULL);
+        close(fd);
+        buff_free(fd);
+        return;
+    }
+#endif
     FD_CLR(fd, &_fdset);
 
     /* If it's the largest one then we need to re-figure _maxfd */
@@ -283,6 +393,126 @@ msg_del_fd(int fd)
     buff_free(fd);
 }
 
+/* Deal with the result of reading data from fd n.  The connection is
+ * closed if the other end hung up or if we lost our place in the stream */
+static int
+_msg_read_result(int n, int result)
+{
+    if(result == ERR_NO_SOCKET) { /* This is the end of file */
+        dax_log(DAX_LOG_COMM, "Connection Closed for fd %d", n);
+        module_unregister(n);
+        msg_del_fd(n);
+    } else if(result == ERR_MSG_BAD) {
+        /* We can't find the start of the next message so we have to
+         * hang up on them */
+        dax_log(DAX_LOG_ERROR, "Closing fd %d after a bad message", n);
+        module_unregister(n);
+        msg_del_fd(n);
+    } else if(result < 0) {
+        return result; /* Pass the error up */
+    }
+    return 0;
+}
+
+/* Handle a file descriptor that is ready to be read.  If it is one of the
+ * listening sockets then we accept the new connection otherwise we read
+ * the data and dispatch the messages */
+static int
+_msg_handle_fd(int n)
+{
+    struct sockaddr_un addr;
+    socklen_t len = 0;
+    int fd, result;
+
+    if(n < FD_SETSIZE && FD_ISSET(n, &_listenfdset)) { /* This is a listening socket */
+        fd = accept(n, (struct sockaddr *)&addr, &len);
+        if(fd < 0) {
+            /* TODO: Need to handle these errors */
+            dax_log(DAX_LOG_ERROR, "Error Accepting socket: %s", strerror(errno));
+        } else {
+            dax_log(DAX_LOG_COMM, "Accepted socket on fd %d", n);
+            msg_add_fd(fd);
+        }
+    } else {
+        result = buff_read(n);
+        return _msg_read_result(n, result);
+    }
+    return 0;
+}
+
+#ifdef HAVE_IO_URING
+/* This is the msg_receive() for the io_uring engine.  The accepts and
+ * receives are already armed so we just handle whatever has completed. */
+static int
+_msg_receive_uring(int wait)
+{
+    uring_event ev;
+    int result;
+
+    result = uring_wait(wait);
+    if(result) return result;
+    while(uring_next(&ev)) {
+        if(ev.op == URING_ACCEPT) {
+            if(ev.res < 0) {
+                dax_log(DAX_LOG_ERROR, "Error Accepting socket: %s", strerror(-ev.res));
+            } else {
+                dax_log(DAX_LOG_COMM, "Accepted socket on fd %d", ev.fd);
+                msg_add_fd(ev.res);
+            }
+            /* Running out of file descriptors stops the accept */
+            if(!ev.more && ev.res != -EINVAL && ev.res != -EBADF) {
+                uring_rearm(&ev);
+            }
+        } else if(ev.op == URING_RECV) {
+            if(ev.res > 0) {
+                result = buff_feed(ev.fd, ev.data, ev.res);
+            } else if(ev.res == 0) {
+                dax_log(DAX_LOG_COMM, "Received EOF on socket %d", ev.fd);
+                result = ERR_NO_SOCKET;
+            } else if(ev.res == -ENOBUFS) {
+                /* All of the buffers are in use.  It'll be armed again below */
+                result = 0;
+            } else {
+                dax_log(DAX_LOG_ERROR, "Unable to read data from socket %d - %s", ev.fd, strerror(-ev.res));
+                result = ERR_NO_SOCKET;
+            }
+            uring_buffer_done(&ev);
+            result = _msg_read_result(ev.fd, result);
+            /* This won't do anything if the connection was closed */
+            if(!ev.more) uring_rearm(&ev);
+            if(result < 0) return result;
+        }
+    }
+    return 0;
+}
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+/* This is the msg_receive() for the epoll engine.  We only get back the
+ * file descriptors that are ready instead of having to scan them all. */
+static int
+_msg_receive_epoll(int wait)
+{
+    struct epoll_event events[64];
+    int result, count, n;
+
+    count = epoll_wait(_epollfd, events, 64, wait);
+    if(count < 0) {
+        /* Ignore interruption by signal */
+        if(errno != EINTR) {
+            dax_log(DAX_LOG_ERROR, "msg_receive epoll error: %s", strerror(errno));
+            return ERR_MSG_RECV;
+        }
+        return 0;
+    }
+    for(n = 0; n < count; n++) {
+        result = _msg_handle_fd(events[n].data.fd);
+        if(result < 0) return result;
+    }
+    return 0;
+}
+#endif
+
 /* This function blocks waiting for a message to be received.  Once a message
  * is retrieved from the system the proper handling function is called */
 int
@@ -290,14 +520,25 @@ msg_receive(void)
 {
     fd_set tmpset;
     struct timeval tm;
-    struct sockaddr_un addr;
-    int result, fd, n;
-    socklen_t len = 0;
+    int result, n, wait;
+
+    /* Send any tag group subscriptions that are due and make sure that
+     * we wake up in time for the next one. */
+    wait = group_sub_flush();
+    n = timer_run(xmonotime());
+    if(n >= 0 && (wait < 0 || n < wait)) wait = n;
+    if(wait < 0 || wait > 1000) wait = 1000; /* TODO: this should be configuration */
+#ifdef HAVE_IO_URING
+    if(_uring) return _msg_receive_uring(wait);
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+    if(_epollfd >= 0) return _msg_receive_epoll(wait);
+#endif
 
     FD_ZERO(&tmpset);
     FD_COPY(&_fdset, &tmpset);
-    tm.tv_sec = 1; /* TODO: this should be configuration */
-    tm.tv_usec = 0;
+    tm.tv_sec = wait / 1000;
+    tm.tv_usec = (wait % 1000) * 1000;
 
     result = select(_maxfd + 1, &tmpset, NULL, NULL, &tm);
 
@@ -309,58 +550,53 @@ msg_receive(void)
             return ERR_MSG_RECV;
         }
     } else if(result == 0) { /* Timeout */
-        buff_freeall(); /* this erases all of the _buffer nodes */
         return 0;
     } else {
         for(n = 0; n <= _maxfd; n++) {
             if(FD_ISSET(n, &tmpset)) {
-                if(FD_ISSET(n, &_listenfdset)) { /* This is a listening socket */
-                    fd = accept(n, (struct sockaddr *)&addr, &len);
-                    if(fd < 0) {
-                        /* TODO: Need to handle these errors */
-                        dax_log(DAX_LOG_ERROR, "Error Accepting socket: %s", strerror(errno));
-                    } else {
-                        dax_log(DAX_LOG_COMM, "Accepted socket on fd %d", n);
-                        msg_add_fd(fd);
-                    }
-                } else {
-                    result = buff_read(n);
-                    if(result == ERR_NO_SOCKET) { /* This is the end of file */
-                        dax_log(DAX_LOG_COMM, "Connection Closed for fd %d", n);
-                        module_unregister(n);
-                        msg_del_fd(n);
-                    } else if(result < 0) {
-                        return result; /* Pass the error up */
-                    }
-                }
+                result = _msg_handle_fd(n);
+                if(result < 0) return result;
             }
         }
     }
     return 0;
 }
 
-/* This handles each message.  It extracts out the dax_message structure
- * and then calls the proper message handling function.  This message will
- * unmarshal the header but it is up to the individual wrapper function to
- * unmarshal the data portion of the message if need be. */
+/* This handles each message.  The message is handled in place in the
+ * receive buffer so the header is converted to host order right in the
+ * structure and the handling function is called with a pointer to it.  It
+ * is up to the individual wrapper function to unmarshal the data portion
+ * of the message if need be. */
 int
-msg_dispatcher(int fd, unsigned char *buff)
+msg_dispatcher(int fd, dax_message *msg)
 {
-    dax_message message;
+    struct timespec start, end;
+    int result, command;
 
     /* The first four bytes are the size and the size is always
      * sent in network order */
-    message.size = ntohl(*(uint32_t *)buff) - MSG_HDR_SIZE;
+    msg->size = ntohl(msg->size) - MSG_HDR_SIZE;
     /* The next four bytes are the DAX command also sent in network
      * byte order. */
-    message.msg_type = ntohl(*(uint32_t *)&buff[4]);
-
-    if(CHECK_COMMAND(message.msg_type)) return ERR_MSG_BAD;
-    message.fd = fd;
-    memcpy(message.data, &buff[8], message.size);
-    buff_free(fd);
+    msg->msg_type = ntohl(msg->msg_type);
+
+    /* _buff_dispatch() has already checked the size so the frame is good
+     * even if we don't know the command.  We tell the module and keep the
+     * connection since we know where the next message starts. */
+    if(CHECK_COMMAND(msg->msg_type)) {
+        dax_log(DAX_LOG_MSGERR, "Unknown command 0x%X from fd %d", msg->msg_type, fd);
+        result = ERR_NOTIMPLEMENTED;
+        _message_send(fd, msg->msg_type, &result, sizeof(int), ERROR);
+        return 0;
+    }
+    msg->fd = fd;
+    command = msg->msg_type;
     /* Now call the function to deal with it */
-    return (*cmd_arr[message.msg_type])(&message);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result = (*cmd_arr[command])(msg);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats_message(fd, command, stats_elapsed(&start, &end));
+    return result;
 }
 
 
@@ -516,11 +752,199 @@ msg_tag_get(dax_message *msg)
     return 0;
 }
 
-/* TODO: Make this do something */
+/* Checks that the count is in range and that each of the count items in the
+ * bulk message is a 'header' byte header followed by a NULL terminated name
+ * that is all inside the message.  Returns 0 if they are or an error code. */
+static int
+_bulk_check(dax_message *msg, int count, int header)
+{
+    int n, offset = 2;
+
+    if(count > TAG_BULK_MAX) return ERR_2BIG;
+    for(n = 0; n < count; n++) {
+        if(offset + header >= msg->size) return ERR_MSG_BAD;
+        offset += header;
+        offset += strnlen(&msg->data[offset], msg->size - offset);
+        if(offset >= msg->size) return ERR_MSG_BAD;
+        offset++;
+    }
+    return 0;
+}
+
+/* The bulk add message is a two byte count followed by that many tag
+ * definitions.  Each one is the type, count and attributes followed by the
+ * NULL terminated name, the same as MSG_TAG_ADD.  Each tag is added on it's
+ * own so the response is an array of the tag indexes or the error code for
+ * each tag that could not be added.  The whole message is checked first so
+ * if an error is returned none of the tags were added. */
+int
+msg_tag_add_bulk(dax_message *msg)
+{
+    int32_t results[TAG_BULK_MAX];
+    uint16_t count;
+    uint32_t type, tcount, attr;
+    char *name;
+    int n, offset, result;
+
+    count = *((uint16_t *)&msg->data[0]);
+    dax_log(DAX_LOG_MSG, "Tag Bulk Add Message from module %d, count %d", msg->fd, count);
+    result = _bulk_check(msg, count, 12);
+    offset = 2;
+    for(n = 0; n < count && result == 0; n++) {
+        type = *((uint32_t *)&msg->data[offset]);
+        tcount = *((uint32_t *)&msg->data[offset + 4]);
+        attr = *((uint32_t *)&msg->data[offset + 8]);
+        name = &msg->data[offset + 12];
+        offset += 13 + strlen(name);
+        if(name[0] == '_') {
+            results[n] = ERR_ILLEGAL;
+        } else {
+            results[n] = tag_add(msg->fd, name, type, tcount, attr);
+        }
+    }
+    if(result) {
+        _message_send(msg->fd, MSG_TAG_ADD_BULK, &result, sizeof(result), ERROR);
+        dax_log(DAX_LOG_MSGERR, "Bad MSG_TAG_ADD_BULK message from module %d", msg->fd);
+    } else {
+        _message_send(msg->fd, MSG_TAG_ADD_BULK, results, count * sizeof(int32_t), RESPONSE);
+    }
+    return 0;
+}
+
+/* The bulk get message is a two byte count followed by that many NULL
+ * terminated tag names.  The response is TAG_BULK_SIZE bytes for each tag
+ * containing the index, type, count and attributes.  If the tag is not found
+ * the index is the error code and the rest of the definition is zero. */
+int
+msg_tag_get_bulk(dax_message *msg)
+{
+    char buff[TAG_BULK_MAX * TAG_BULK_SIZE];
+    uint16_t count;
+    dax_tag tag;
+    char *name;
+    int n, offset, len, result;
+
+    count = *((uint16_t *)&msg->data[0]);
+    dax_log(DAX_LOG_MSG, "Tag Bulk Get Message from module %d, count %d", msg->fd, count);
+    result = _bulk_check(msg, count, 0);
+    offset = 2;
+    for(n = 0; n < count && result == 0; n++) {
+        name = &msg->data[offset];
+        len = strlen(name);
+        offset += len + 1;
+        memset(&buff[n * TAG_BULK_SIZE], 0, TAG_BULK_SIZE);
+        if(len > DAX_TAGNAME_SIZE || tag_get_name(name, &tag)) {
+            *((int32_t *)&buff[n * TAG_BULK_SIZE]) = ERR_NOTFOUND;
+        } else {
+            *((uint32_t *)&buff[n * TAG_BULK_SIZE]) = tag.idx;
+            *((uint32_t *)&buff[n * TAG_BULK_SIZE + 4]) = tag.type;
+            *((uint32_t *)&buff[n * TAG_BULK_SIZE + 8]) = tag.count;
+            *((uint16_t *)&buff[n * TAG_BULK_SIZE + 12]) = tag.attr;
+        }
+    }
+    if(result) {
+        _message_send(msg->fd, MSG_TAG_GET_BULK, &result, sizeof(result), ERROR);
+        dax_log(DAX_LOG_MSGERR, "Bad MSG_TAG_GET_BULK message from module %d", msg->fd);
+    } else {
+        _message_send(msg->fd, MSG_TAG_GET_BULK, buff, count * TAG_BULK_SIZE, RESPONSE);
+    }
+    return 0;
+}
+
+/* The tag list message is the index to start at, the largest number of tags
+ * to return and an optional NULL terminated filter.  The filter is a shell
+ * style wildcard pattern that is matched against the tag names.  The response
+ * is the index to start the next page at, the number of tags in this page
+ * and then the tag definitions packed one after the other.  Each definition
+ * is the index, type, count and attributes followed by the NULL terminated
+ * name.  The next index is TAG_LIST_DONE after the last tag has been sent. */
 int
 msg_tag_list(dax_message *msg)
 {
-    dax_log(DAX_LOG_MSG, "Tag List Message from %d", msg->fd);
+    char buff[MSG_DATA_SIZE];
+    tag_index idx, last;
+    uint16_t max, count = 0;
+    char *filter = NULL;
+    dax_tag tag;
+    int size, len;
+
+    idx = *((tag_index *)&msg->data[0]);
+    max = *((uint16_t *)&msg->data[4]);
+    if(msg->size > 6 && msg->data[6] != '\0') {
+        msg->data[msg->size - 1] = '\0'; /* Just to be safe */
+        filter = &msg->data[6];
+    }
+    dax_log(DAX_LOG_MSG, "Tag List Message from %d starting at %d, filter '%s'", msg->fd, idx, filter ? filter : "");
+    if(idx < 0) {
+        idx = ERR_ARG;
+        _message_send(msg->fd, MSG_TAG_LIST, &idx, sizeof(idx), ERROR);
+        return 0;
+    }
+    last = get_tagindex();
+    size = 6;
+    for( ; idx < last && count < max; idx++) {
+        if(tag_get_index(idx, &tag)) continue; /* deleted */
+        if(filter != NULL && fnmatch(filter, tag.name, 0)) continue;
+        len = strlen(tag.name) + 1;
+        if(size + 14 + len > MSG_DATA_SIZE) break;
+        *((uint32_t *)&buff[size]) = tag.idx;
+        *((uint32_t *)&buff[size + 4]) = tag.type;
+        *((uint32_t *)&buff[size + 8]) = tag.count;
+        *((uint16_t *)&buff[size + 12]) = tag.attr;
+        memcpy(&buff[size + 14], tag.name, len);
+        size += 14 + len;
+        count++;
+    }
+    if(idx >= last) idx = TAG_LIST_DONE;
+    *((tag_index *)&buff[0]) = idx;
+    *((uint16_t *)&buff[4]) = count;
+    _message_send(msg->fd, MSG_TAG_LIST, buff, size, RESPONSE);
+    return 0;
+}
+
+/* Returns the tag ranges that have changed since the journal sequence
+ * number that is given.  The request is the sequence number (8) and the
+ * maximum number of changes to return (2).  The response is a result (4),
+ * the new sequence number (8), the count (2) and then the index, byte
+ * offset and size of each change.  If the journal no longer has all of
+ * the changes the result is ERR_OVERFLOW and the sequence number is the
+ * current one.  The module has to read everything it cares about and
+ * then it can use that sequence number to keep up from there. */
+int
+msg_changes_since(dax_message *msg)
+{
+    char buff[MSG_DATA_SIZE];
+    journal_entry entries[CHANGES_MAX];
+    uint64_t seq;
+    int max, count, n, offset;
+    int32_t result = 0;
+
+    if(msg->size < 10) {
+        result = ERR_MSG_BAD;
+        _message_send(msg->fd, MSG_CHANGES_SINCE, &result, sizeof(result), ERROR);
+        return 0;
+    }
+    seq = *((uint64_t *)&msg->data[0]);
+    max = *((uint16_t *)&msg->data[8]);
+    if(max > CHANGES_MAX) max = CHANGES_MAX;
+    dax_log(DAX_LOG_MSG, "Changes Since Message from %d, sequence %llu", msg->fd, (unsigned long long)seq);
+
+    count = journal_since(&seq, entries, max);
+    if(count < 0) {
+        result = count;
+        count = 0;
+    }
+    offset = CHANGES_HEADER_SIZE;
+    for(n = 0; n < count; n++) {
+        *((tag_index *)&buff[offset]) = entries[n].idx;
+        *((uint32_t *)&buff[offset + 4]) = entries[n].byte;
+        *((uint32_t *)&buff[offset + 8]) = entries[n].size;
+        offset += CHANGES_ENTRY_SIZE;
+    }
+    *((int32_t *)&buff[0]) = result;
+    *((uint64_t *)&buff[4]) = seq;
+    *((uint16_t *)&buff[12]) = count;
+    _message_send(msg->fd, MSG_CHANGES_SINCE, buff, offset, RESPONSE);
     return 0;
 }
 
@@ -542,7 +966,12 @@ msg_tag_read(dax_message *msg)
 
     dax_log(DAX_LOG_MSG, "Tag Read Message from module %d, index %d, offset %d, size %d", msg->fd, index, offset, size);
 
-    result = tag_read(msg->fd, index, offset, &data, size);
+    /* The data is copied once out of the database and written from here */
+    if(size < 0 || size > MSG_DATA_SIZE) {
+        result = ERR_2BIG;
+    } else {
+        result = tag_read(msg->fd, index, offset, &data, size);
+    }
     if(result) {
         _message_send(msg->fd, MSG_TAG_READ, &result, sizeof(result), ERROR);
     } else {
@@ -582,6 +1011,68 @@ msg_tag_write(dax_message *msg)
     return 0;
 }
 
+/* Adds a list of items to a queue tag.  The message is the tag index (4),
+ * the number of items (2) and then the data for each of the items. */
+int
+msg_queue_write(dax_message *msg)
+{
+    tag_index idx;
+    int result, count, size;
+
+    idx = *((tag_index *)&msg->data[0]);
+    count = *((uint16_t *)&msg->data[4]);
+    dax_log(DAX_LOG_MSG, "Queue Write Message from module %d, index %d, count %d", msg->fd, idx, count);
+
+    size = queue_item_size(idx);
+    if(size < 0) {
+        result = size;
+    } else if(msg->size < 6 || count == 0 || msg->size - 6 != count * size) {
+        result = ERR_ARG;
+    } else if(is_tag_readonly(idx) && ! is_tag_owned(msg->fd, idx)) {
+        result = ERR_READONLY;
+    } else {
+        result = queue_write_bulk(idx, &msg->data[6], count);
+    }
+    if(result) {
+        _message_send(msg->fd, MSG_QUEUE_WRITE, &result, sizeof(result), ERROR);
+    } else {
+        _message_send(msg->fd, MSG_QUEUE_WRITE, NULL, 0, RESPONSE);
+    }
+    return 0;
+}
+
+/* Removes up to the given number of items from a queue tag.  The message
+ * is the tag index (4) and the maximum number of items (2).  The response
+ * is the number of items (2) followed by the data. */
+int
+msg_queue_read(dax_message *msg)
+{
+    char buff[MSG_DATA_SIZE];
+    tag_index idx;
+    int result, max, size;
+
+    idx = *((tag_index *)&msg->data[0]);
+    max = *((uint16_t *)&msg->data[4]);
+    dax_log(DAX_LOG_MSG, "Queue Read Message from module %d, index %d, max %d", msg->fd, idx, max);
+
+    size = queue_item_size(idx);
+    if(size < 0) {
+        result = size;
+    } else if(size == 0 || size > MSG_DATA_SIZE - 2) {
+        result = ERR_2BIG;
+    } else {
+        max = MIN(max, (MSG_DATA_SIZE - 2) / size);
+        result = queue_read_bulk(idx, &buff[2], max);
+    }
+    if(result < 0) {
+        _message_send(msg->fd, MSG_QUEUE_READ, &result, sizeof(result), ERROR);
+    } else {
+        *((uint16_t *)&buff[0]) = result;
+        _message_send(msg->fd, MSG_QUEUE_READ, buff, 2 + result * size, RESPONSE);
+    }
+    return 0;
+}
+
 /* Generic write with bit mask */
 int
 msg_tag_mask_write(dax_message *msg)
@@ -614,6 +1105,66 @@ msg_tag_mask_write(dax_message *msg)
 }
 
 
+/* The multi write message is a two byte count followed by that many items.
+ * Each item is the tag index, byte offset and data size followed by a flags
+ * byte, the data and the mask if the MULTI_WRITE_MASK flag is set. */
+int
+msg_tag_multi_write(dax_message *msg)
+{
+    tag_write_item items[MSG_DATA_SIZE / 13];
+    int result, n, offset;
+    uint16_t count;
+    uint8_t flags;
+
+    count = *((uint16_t *)&msg->data[0]);
+    dax_log(DAX_LOG_MSG, "Tag Multi Write Message from module %d, count %d", msg->fd, count);
+    offset = 2;
+    result = 0;
+    if(count > MSG_DATA_SIZE / 13) result = ERR_2BIG;
+    for(n = 0; n < count && result == 0; n++) {
+        if(offset + 13 > msg->size) {
+            result = ERR_MSG_BAD;
+            break;
+        }
+        items[n].idx = *((tag_index *)&msg->data[offset]);
+        items[n].offset = *((uint32_t *)&msg->data[offset + 4]);
+        items[n].size = *((uint32_t *)&msg->data[offset + 8]);
+        flags = msg->data[offset + 12];
+        offset += 13;
+        /* The sizes are checked against what is left before they are added
+         * so that a huge size can't wrap the offset around */
+        if(items[n].size < 0 || items[n].size > (int)msg->size - offset) {
+            result = ERR_MSG_BAD;
+            break;
+        }
+        items[n].data = &msg->data[offset];
+        offset += items[n].size;
+        if(flags & MULTI_WRITE_MASK) {
+            if(items[n].size > (int)msg->size - offset) {
+                result = ERR_MSG_BAD;
+                break;
+            }
+            items[n].mask = &msg->data[offset];
+            offset += items[n].size;
+        } else {
+            items[n].mask = NULL;
+        }
+    }
+    if(result == 0) {
+        result = tag_multi_write(msg->fd, items, count);
+    }
+    if(result) {
+        _message_send(msg->fd, MSG_TAG_MULTI_WRITE, &result, sizeof(result), ERROR);
+        dax_log(DAX_LOG_ERROR, "Unable to do multi write from module %d: result %d", msg->fd, result);
+    } else {
+        for(n = 0; n < count; n++) {
+            if(! items[n].merged) map_check(items[n].idx, items[n].offset, items[n].size);
+        }
+        _message_send(msg->fd, MSG_TAG_MULTI_WRITE, NULL, 0, RESPONSE);
+    }
+    return 0;
+}
+
 int
 msg_evnt_add(dax_message *msg)
 {
@@ -691,8 +1242,12 @@ msg_evnt_opt(dax_message *msg)
     dax_log(DAX_LOG_MSG, "Event Set Option Message from %d", msg->fd);
 
     result = event_opt(idx, id, options, module);
+    /* The minimum interval is optional at the end of the message */
+    if(result == 0 && msg->size >= 16) {
+        result = event_interval(idx, id, *((uint32_t *)&msg->data[12]), module);
+    }
 
-    if(idx >= 0) {
+    if(result == 0) {
         _message_send(msg->fd, MSG_EVNT_OPT, &idx, 8, RESPONSE);
     } else {
         _message_send(msg->fd, MSG_EVNT_OPT, &result, sizeof(result), ERROR);
@@ -923,7 +1478,7 @@ msg_group_write(dax_message *msg) {
     mod = module_find_fd(msg->fd);
     memcpy(&index, &msg->data[0], 4);
 
-    result = group_write(mod, index, (uint8_t *)&msg->data[4]);
+    result = group_write(msg->fd, mod, index, (uint8_t *)&msg->data[4]);
     if(result < 0) { /* Send Error */
         _message_send(msg->fd, MSG_GRP_WRITE, &result, sizeof(int), ERROR);
         dax_log(DAX_LOG_MSGERR, "Group Write Message for %s Returning Error %d",mod->name, result);
@@ -934,6 +1489,29 @@ msg_group_write(dax_message *msg) {
     return 0;
 }
 
+int
+msg_group_subscribe(dax_message *msg) {
+    dax_module *mod;
+    int result;
+    uint32_t index, interval;
+    uint8_t flags;
+
+    mod = module_find_fd(msg->fd);
+    memcpy(&index, &msg->data[0], 4);
+    flags = msg->data[4];
+    memcpy(&interval, &msg->data[5], 4);
+
+    result = group_subscribe(mod, index, flags, interval);
+    if(result < 0) { /* Send Error */
+        _message_send(msg->fd, MSG_GRP_SUB, &result, sizeof(int), ERROR);
+        dax_log(DAX_LOG_MSGERR, "Group Subscribe Message for %s Returning Error %d",mod->name, result);
+    } else {
+        _message_send(msg->fd, MSG_GRP_SUB, NULL, 0, RESPONSE);
+        dax_log(DAX_LOG_MSG, "Group Subscribe Message for %s", mod->name);
+    }
+    return 0;
+}
+
 int
 msg_group_mask_write(dax_message *msg) {
     int result;
@@ -949,11 +1527,15 @@ msg_group_mask_write(dax_message *msg) {
     return 0;
 }
 
+/* Compare and swap and the fetch variants return the old data */
+#define ATOMIC_FETCH(op) (((op) & ATOMIC_OP_FETCH) || ((op) & ~ATOMIC_OP_FETCH) == ATOMIC_OP_CAS)
+
 int
 msg_atomic_op(dax_message *msg) {
     int result;
     tag_handle h;
     uint16_t operation;
+    uint8_t buff[MSG_DATA_SIZE];
 
     h.index = *(dax_dint *)msg->data;          /* Index */
     h.byte = *(dax_dint *)&msg->data[4];       /* Byte offset */
@@ -962,19 +1544,112 @@ msg_atomic_op(dax_message *msg) {
     h.bit = msg->data[16];                     /* Bit offset */
     operation = *(dax_uint *)&msg->data[17];   /* Operation */
     h.size = msg->size - 21; /* Total message size minus the above data */
+    /* Compare and swap carries both the expected and the new data */
+    if((operation & ~ATOMIC_OP_FETCH) == ATOMIC_OP_CAS) h.size /= 2;
 
     dax_log(DAX_LOG_MSG, "Atomic Operation Message from module %d, index %d, offset %d, size %d", msg->fd, h.index, h.byte, h.size);
-    if(is_tag_readonly(h.index) && ! is_tag_owned(msg->fd, h.index)) {
+    /* The handle has to be good before we look at the tag or size the reply */
+    result = atomic_check(h);
+    if(result == 0 && is_tag_readonly(h.index) && ! is_tag_owned(msg->fd, h.index)) {
         result = ERR_READONLY;
-    } else {
-        result = atomic_op(h, &msg->data[21], operation);
+    }
+    if(result == 0) {
+        result = atomic_op(msg->fd, h, &msg->data[21], operation, ATOMIC_FETCH(operation) ? &buff[4] : NULL);
     }
     if(result < 0) { /* Send Error */
         _message_send(msg->fd, MSG_ATOMIC_OP, &result, sizeof(int), ERROR);
     } else {
-        map_check(h.index, h.byte, h.size);
-        _message_send(msg->fd, MSG_ATOMIC_OP, NULL, 0, RESPONSE);
+        if(result == 0) map_check(h.index, h.byte, h.size);
+        if(ATOMIC_FETCH(operation)) {
+            /* The result tells the module whether a CAS matched */
+            memcpy(buff, &result, 4);
+            _message_send(msg->fd, MSG_ATOMIC_OP, buff, atomic_fetch_size(h) + 4, RESPONSE);
+        } else {
+            _message_send(msg->fd, MSG_ATOMIC_OP, NULL, 0, RESPONSE);
+        }
+    }
+    return 0;
+}
+
+/* Reads the operation in the batch message at offset into h, operation and
+ * size.  Returns the offset of the operation's data or ERR_MSG_BAD if it
+ * runs past the end of the message */
+static int
+_atomic_batch_item(dax_message *msg, int offset, tag_handle *h, uint16_t *operation, int *size)
+{
+    if(offset + 25 > msg->size) return ERR_MSG_BAD;
+    h->index = *(dax_dint *)&msg->data[offset];
+    h->byte = *(dax_dint *)&msg->data[offset + 4];
+    h->count = *(dax_dint *)&msg->data[offset + 8];
+    h->type = *(dax_dint *)&msg->data[offset + 12];
+    h->bit = msg->data[offset + 16];
+    *operation = *(dax_uint *)&msg->data[offset + 17];
+    *size = *(dax_dint *)&msg->data[offset + 21];
+    offset += 25;
+    if(*size < 0 || offset + *size > msg->size) return ERR_MSG_BAD;
+    h->size = *size;
+    if((*operation & ~ATOMIC_OP_FETCH) == ATOMIC_OP_CAS) h->size /= 2;
+    return offset;
+}
+
+/* The batch message is a two byte count followed by that many operations.
+ * Each operation is the same as the MSG_ATOMIC_OP header with a four byte
+ * data size added before the data.  Every operation is applied in order in
+ * this one dispatch so no other module can get in between them.  The
+ * response has the result of each operation followed by the old data if it
+ * was asked for.  A failure in one operation does not stop the others.  If
+ * the message itself is bad or the response won't fit, the error is sent
+ * and none of the operations are applied. */
+int
+msg_atomic_batch(dax_message *msg) {
+    int result, n, offset, outsize, size;
+    uint16_t count, operation;
+    tag_handle h;
+    uint8_t buff[MSG_DATA_SIZE];
+
+    count = *(uint16_t *)msg->data;
+    dax_log(DAX_LOG_MSG, "Atomic Batch Message from module %d, count %d", msg->fd, count);
+    /* Check the whole message before we touch anything */
+    offset = 2;
+    outsize = 0;
+    for(n = 0; n < count; n++) {
+        offset = _atomic_batch_item(msg, offset, &h, &operation, &size);
+        if(offset < 0) {
+            _message_send(msg->fd, MSG_ATOMIC_BATCH, &offset, sizeof(int), ERROR);
+            return 0;
+        }
+        /* A bad handle only gets its error code in the response */
+        outsize += 4;
+        if(atomic_check(h) == 0 && ATOMIC_FETCH(operation)) outsize += atomic_fetch_size(h);
+        if(outsize > MSG_DATA_SIZE) {
+            result = ERR_2BIG;
+            _message_send(msg->fd, MSG_ATOMIC_BATCH, &result, sizeof(int), ERROR);
+            return 0;
+        }
+        offset += size;
+    }
+
+    offset = 2;
+    outsize = 0;
+    group_sub_hold();
+    for(n = 0; n < count; n++) {
+        offset = _atomic_batch_item(msg, offset, &h, &operation, &size);
+        result = atomic_check(h);
+        if(result == 0 && is_tag_readonly(h.index) && ! is_tag_owned(msg->fd, h.index)) {
+            result = ERR_READONLY;
+        }
+        if(result == 0) {
+            result = atomic_op(msg->fd, h, &msg->data[offset], operation,
+                               ATOMIC_FETCH(operation) ? &buff[outsize + 4] : NULL);
+        }
+        if(result == 0) map_check(h.index, h.byte, h.size);
+        memcpy(&buff[outsize], &result, 4);
+        outsize += 4;
+        if(result >= 0 && ATOMIC_FETCH(operation)) outsize += atomic_fetch_size(h);
+        offset += size;
     }
+    group_sub_release();
+    _message_send(msg->fd, MSG_ATOMIC_BATCH, buff, outsize, RESPONSE);
     return 0;
 }
 
@@ -33,12 +33,12 @@ void msg_destroy(void);
 int msg_receive(void);
 void msg_add_fd(int);
 void msg_del_fd(int);
-int msg_dispatcher(int, unsigned char *);
+int msg_dispatcher(int, dax_message *);
 
 /* buffer.c functions */
 int buff_initialize(void);
 int buff_read(int fd);
-void buff_wipe(void);
+int buff_feed(int fd, const unsigned char *data, size_t len);
 void buff_free(int);
 void buff_freeall(void);
 
@@ -22,6 +22,7 @@
 #include "func.h"
 #include "tagbase.h"
 #include "groups.h"
+#include "stats.h"
 
 #include <time.h>
 #include <sys/socket.h>
@@ -116,6 +117,7 @@ module_add(char *name, unsigned int flags)
 
         new->fd = 0;
         new->event_count = 0;
+        new->queue = 0;
         new->tag_groups = NULL;
         new->groups_size = 0;
 
@@ -330,3 +332,31 @@ module_find_fd(int fd)
     } while(_current_mod != last);
     return NULL;
 }
+
+/* Writes the request rate and the queue depth of each module into the
+ * module's tag.  elapsed is the time in seconds since the last update.
+ * The queue depth is the number of rate limited events and tag group
+ * pushes that are waiting to be sent to the module. */
+void
+module_stats_update(float elapsed)
+{
+    dax_module *this;
+    float rate;
+    uint32_t queue, n;
+
+    if(_current_mod == NULL) return;
+    this = _current_mod;
+    do {
+        rate = stats_fd_requests(this->fd) / elapsed;
+        if(this->tagindex > 0) {
+            queue = this->queue;
+            for(n = 0; n < this->groups_size; n++) {
+                if(this->tag_groups[n].flags & GRP_FLAG_PENDING) queue++;
+            }
+            /* The special tag hooks would stop us from writing these */
+            tag_server_write(this->tagindex, MOD_STAT_REQUESTS_OFFSET, &rate, sizeof(float));
+            tag_server_write(this->tagindex, MOD_STAT_QUEUE_OFFSET, &queue, sizeof(uint32_t));
+        }
+        this = this->next;
+    } while(this != _current_mod);
+}
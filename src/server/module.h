@@ -38,6 +38,8 @@ dax_module *module_register(char *name, uint32_t timeout, int fd);
 dax_module *event_register(uint32_t mid , int fd);
 void module_unregister(pid_t pid);
 dax_module *module_find_fd(int fd);
+/* Write the performance statistics to the module tags */
+void module_stats_update(float elapsed);
 
 
 #ifdef DEBUG
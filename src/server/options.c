@@ -37,12 +37,16 @@ static struct in_addr _serverip;
 static unsigned int _serverport;
 static char *_mod_tag_exclude;
 static int _min_buffers;
+static int _io_engine;
+static int _journal_size;
 
 
 /* Initialize the configuration to NULL or 0 for cleanliness */
 static void initconfig(void) {
 
     _min_buffers = 0;
+    _io_engine = IO_ENGINE_SELECT;
+    _journal_size = 0;
     _socketname = NULL;
     _serverip.s_addr = 0;
     _serverport = 0;
@@ -55,6 +59,7 @@ static void
 setdefaults(void)
 {
     if(!_min_buffers) _min_buffers = DEFAULT_MIN_BUFFERS;
+    if(_journal_size <= 0) _journal_size = DEFAULT_JOURNAL_SIZE;
     if(!_socketname) _socketname = strdup("/tmp/opendax");
     if(!_serverport) _serverport = DEFAULT_PORT;
     if(!_serverip.s_addr) inet_aton("0.0.0.0", &_serverip);
@@ -189,6 +194,27 @@ readconfigfile(void)
     }
     lua_pop(L, 1);
 
+    lua_getglobal(L, "io_engine");
+    c = (char *)lua_tostring(L, -1);
+    if(c) {
+        if(!strcasecmp(c, "epoll")) {
+            _io_engine = IO_ENGINE_EPOLL;
+        } else if(!strcasecmp(c, "io_uring")) {
+#ifdef HAVE_IO_URING
+            _io_engine = IO_ENGINE_URING;
+#else
+            dax_log(DAX_LOG_ERROR, "The io_uring engine is not available on this system, using select");
+#endif
+        } else if(strcasecmp(c, "select")) {
+            dax_log(DAX_LOG_ERROR, "Unknown io_engine '%s', using select", c);
+        }
+    }
+    lua_pop(L, 1);
+
+    lua_getglobal(L, "journal_size");
+    _journal_size = (int)lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
     lua_getglobal(L, "mod_tag_exclude");
     if(_mod_tag_exclude == NULL) { /* Make sure we didn't get anything on the commandline */
         c = (char *)lua_tostring(L, -1);
@@ -251,3 +277,18 @@ opt_min_buffers(void)
     return _min_buffers;
 }
 
+int
+opt_io_engine(void)
+{
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_IO_URING)
+    return _io_engine;
+#else
+    return IO_ENGINE_SELECT;
+#endif
+}
+
+int
+opt_journal_size(void)
+{
+    return _journal_size;
+}
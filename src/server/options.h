@@ -34,6 +34,16 @@
 #  define DEFAULT_MIN_BUFFERS 5
 #endif
 
+/* This is the default number of entries in the tag change journal */
+#ifndef DEFAULT_JOURNAL_SIZE
+#  define DEFAULT_JOURNAL_SIZE 4096
+#endif
+
+/* I/O engines that the server can use to wait on the sockets */
+#define IO_ENGINE_SELECT 0
+#define IO_ENGINE_EPOLL  1
+#define IO_ENGINE_URING  2
+
 int opt_configure(int argc, const char *argv[]);
 
 /* These functions return the configuration parameters */
@@ -43,6 +53,9 @@ unsigned int opt_serverport(void);
 char *opt_mod_tag_exclude(void);
 /* Minimum number of communication buffers to allocate */
 int opt_min_buffers(void);
+/* Which I/O engine to use for the module sockets */
+int opt_io_engine(void);
+int opt_journal_size(void);
 int opt_start_timeout(void);
 
 #endif /* !__OPTIONS_H */
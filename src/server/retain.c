@@ -22,6 +22,7 @@
 #include "retain.h"
 #include "func.h"
 #include "tagbase.h"
+#include "stats.h"
 #include <sys/stat.h>
 #include <fcntl.h>
 #ifdef HAVE_SQLITE
@@ -266,7 +267,9 @@ ret_del_tag(int index) {
 int
 ret_tag_write(int index) {
     int result;
+    struct timespec start, end;
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
     result = sqlite3_bind_blob(update_stmt, 1, _db[index].data, type_size(_db[index].type) * _db[index].count, NULL);
     if(result) {
         DF("Problem with bind_blob %d", result);
@@ -277,6 +280,8 @@ ret_tag_write(int index) {
     }
     result = sqlite3_step(update_stmt);
     result = sqlite3_reset(update_stmt);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats_retain_time(stats_elapsed(&start, &end));
     return 0;
 }
 
@@ -23,6 +23,8 @@
 #include "tagbase.h"
 #include "retain.h"
 #include "func.h"
+#include "stats.h"
+#include "journal.h"
 #include <pthread.h>
 #include <syslog.h>
 #include <signal.h>
@@ -59,8 +61,10 @@ main(int argc, const char *argv[])
     result = msg_setup();    /* This creates and sets up the message sockets */
     if(result) dax_log(DAX_LOG_ERROR, "msg_setup() returned %d", result);
     initialize_tagbase(); /* initialize the tag name database */
+    stats_init(); /* create the _stats tag */
     /* TODO: Add retention filename from configuration */
     ret_init(NULL);
+    journal_init(opt_journal_size()); /* start keeping track of tag changes */
     /* Start the message handling thread */
     if(pthread_create(&message_thread, NULL, (void *)&messagethread, NULL)) {
         dax_log(DAX_LOG_FATAL, "Unable to create message thread");
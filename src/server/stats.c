@@ -0,0 +1,247 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the code that keeps the server performance
+ * statistics and publishes them in the _stats system tag.
+ */
+
+#include "stats.h"
+#include "tagbase.h"
+#include "module.h"
+#include "func.h"
+#include <libcommon.h>
+#include <stddef.h>
+
+/* The dispatch latency for each command is kept in a small HDR style
+ * histogram.  Values below HIST_SUB get their own bucket and above that
+ * each power of two is split into HIST_SUB linear sub buckets, so any
+ * value is recorded to within 1/HIST_SUB (12.5%) with only 240 buckets
+ * for the whole range of a uint32_t. */
+#define HIST_SUB_BITS 3
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((32 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+#define STATS_CMDS (NUM_COMMANDS + 1)
+
+/* This is the layout of the _stats tag.  It has to match the CDT that is
+ * created in stats_init().  Each array is indexed by the message command. */
+typedef struct {
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint32_t events_sent;
+    uint32_t events_dropped;
+    uint32_t events_coalesced;
+    uint32_t map_hops;
+    uint32_t retain_time;
+    float msg_rate[STATS_CMDS];
+    uint32_t latency_p50[STATS_CMDS];
+    uint32_t latency_p99[STATS_CMDS];
+} stats_tag;
+
+/* The tag data is byte packed so the size of the tag doesn't include any
+ * padding that the compiler may add to the end of the structure */
+#define STATS_SIZE (offsetof(stats_tag, latency_p99) + sizeof(uint32_t) * STATS_CMDS)
+
+static stats_tag _stats;
+static tag_index _stats_index = -1;
+static dax_timer _stats_timer;
+static time_t _lastpublish;
+
+/* Counters for the current interval */
+static uint32_t _msgcount[STATS_CMDS];
+static uint32_t _hist[STATS_CMDS][HIST_BUCKETS];
+static uint32_t _retain_time;
+static uint32_t *_fdcount;
+static int _fdsize;
+
+static inline int
+_hist_bucket(uint32_t value)
+{
+    int msb;
+
+    if(value < HIST_SUB) return value;
+    msb = 31 - __builtin_clz(value);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + ((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Returns the lowest value that would be recorded in the bucket */
+static uint32_t
+_hist_value(int bucket)
+{
+    int msb;
+
+    if(bucket < HIST_SUB) return bucket;
+    msb = bucket / HIST_SUB + HIST_SUB_BITS - 1;
+    return (uint32_t)(HIST_SUB + bucket % HIST_SUB) << (msb - HIST_SUB_BITS);
+}
+
+/* Returns the value at the given percentile of the histogram */
+static uint32_t
+_hist_percentile(uint32_t *hist, uint32_t count, int percent)
+{
+    uint32_t target, total = 0;
+    int n;
+
+    target = ((uint64_t)count * percent + 99) / 100;
+    for(n = 0; n < HIST_BUCKETS; n++) {
+        total += hist[n];
+        if(total >= target) return _hist_value(n);
+    }
+    return 0;
+}
+
+/* Timer callback that copies the counters for the last interval into the
+ * _stats tag and the module tags */
+static void
+_stats_publish(void *udata)
+{
+    time_t now;
+    float elapsed;
+    int n;
+
+    now = xmonotime();
+    elapsed = (now - _lastpublish) / 1000.0;
+    if(elapsed <= 0) elapsed = STATS_INTERVAL / 1000.0;
+    for(n = 0; n < STATS_CMDS; n++) {
+        _stats.msg_rate[n] = _msgcount[n] / elapsed;
+        if(_msgcount[n]) {
+            _stats.latency_p50[n] = _hist_percentile(_hist[n], _msgcount[n], 50);
+            _stats.latency_p99[n] = _hist_percentile(_hist[n], _msgcount[n], 99);
+            memset(_hist[n], 0, sizeof(_hist[n]));
+        } else {
+            _stats.latency_p50[n] = _stats.latency_p99[n] = 0;
+        }
+        _msgcount[n] = 0;
+    }
+    _stats.retain_time = _retain_time;
+    _retain_time = 0;
+    tag_server_write(_stats_index, 0, &_stats, STATS_SIZE);
+    module_stats_update(elapsed);
+    _lastpublish = now;
+    timer_start(&_stats_timer, now + STATS_INTERVAL);
+}
+
+/* Create the _stats datatype and tag and start the timer that publishes it */
+void
+stats_init(void)
+{
+    char cdt[512];
+    tag_type type;
+
+    snprintf(cdt, sizeof(cdt), "_stats:bytes_in,ULINT,1:bytes_out,ULINT,1:"
+             "events_sent,UDINT,1:events_dropped,UDINT,1:events_coalesced,UDINT,1:"
+             "map_hops,UDINT,1:retain_time,UDINT,1:msg_rate,REAL,%d:"
+             "latency_p50,UDINT,%d:latency_p99,UDINT,%d", STATS_CMDS, STATS_CMDS, STATS_CMDS);
+    type = cdt_create(cdt, NULL);
+    if(type == 0 || type_size(type) != STATS_SIZE) {
+        dax_log(DAX_LOG_ERROR, "Unable to create the _stats datatype");
+        return;
+    }
+    _stats_index = tag_add(-1, "_stats", type, 1, 0);
+    if(_stats_index < 0) {
+        dax_log(DAX_LOG_ERROR, "Unable to create the _stats tag");
+        return;
+    }
+    tag_set_attribute(_stats_index, TAG_ATTR_READONLY);
+    _lastpublish = xmonotime();
+    timer_init(&_stats_timer, _stats_publish, NULL);
+    timer_start(&_stats_timer, _lastpublish + STATS_INTERVAL);
+}
+
+/* Record one message from the module at fd that took usec microseconds
+ * to handle */
+void
+stats_message(int fd, int command, uint32_t usec)
+{
+    uint32_t *new;
+    int size;
+
+    if(command > 0 && command < STATS_CMDS) {
+        _msgcount[command]++;
+        _hist[command][_hist_bucket(usec)]++;
+    }
+    if(fd < 0) return;
+    if(fd >= _fdsize) {
+        size = _fdsize ? _fdsize : 16;
+        while(size <= fd) size *= 2;
+        new = xrealloc(_fdcount, size * sizeof(uint32_t));
+        if(new == NULL) return;
+        memset(&new[_fdsize], 0, (size - _fdsize) * sizeof(uint32_t));
+        _fdcount = new;
+        _fdsize = size;
+    }
+    _fdcount[fd]++;
+}
+
+uint32_t
+stats_fd_requests(int fd)
+{
+    uint32_t count;
+
+    if(fd < 0 || fd >= _fdsize) return 0;
+    count = _fdcount[fd];
+    _fdcount[fd] = 0;
+    return count;
+}
+
+uint32_t
+stats_elapsed(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000 + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+void
+stats_bytes_in(size_t size)
+{
+    _stats.bytes_in += size;
+}
+
+void
+stats_bytes_out(size_t size)
+{
+    _stats.bytes_out += size;
+}
+
+void
+stats_event_sent(void)
+{
+    _stats.events_sent++;
+}
+
+void
+stats_event_dropped(void)
+{
+    _stats.events_dropped++;
+}
+
+void
+stats_event_coalesced(void)
+{
+    _stats.events_coalesced++;
+}
+
+void
+stats_map_hop(void)
+{
+    _stats.map_hops++;
+}
+
+void
+stats_retain_time(uint32_t usec)
+{
+    _retain_time += usec;
+}
@@ -0,0 +1,51 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the definitions for the server performance statistics
+ */
+
+#ifndef __DAX_STATS_H
+#define __DAX_STATS_H 1
+
+#include <common.h>
+#include <opendax.h>
+#include <time.h>
+
+/* The counters are kept in memory and the _stats tag is only written once
+ * every STATS_INTERVAL mSec so that keeping track of them is cheap. */
+#define STATS_INTERVAL 1000
+
+void stats_init(void);
+
+/* These are called from the hot path to update the counters */
+void stats_message(int fd, int command, uint32_t usec);
+void stats_bytes_in(size_t size);
+void stats_bytes_out(size_t size);
+void stats_event_sent(void);
+void stats_event_dropped(void);
+void stats_event_coalesced(void);
+void stats_map_hop(void);
+void stats_retain_time(uint32_t usec);
+
+/* Returns the number of messages received on the fd since the last time
+ * this function was called for that fd */
+uint32_t stats_fd_requests(int fd);
+
+/* Returns the number of microseconds between the two times */
+uint32_t stats_elapsed(struct timespec *start, struct timespec *end);
+
+#endif /* !__DAX_STATS_H */
@@ -20,9 +20,12 @@
 
 #include <ctype.h>
 #include <assert.h>
+#include <time.h>
 #include <common.h>
 #include "tagbase.h"
+#include "groups.h"
 #include "retain.h"
+#include "journal.h"
 #include "func.h"
 
 /* Notes:
@@ -302,21 +305,20 @@ _queue_add(int idx, tag_type type, unsigned int count) {
     q->type = type;
     q->qcount = 0;
     q->qread = 0;
-    q->queue = malloc(START_QUEUE_SIZE * sizeof(void *));
+    /* The items are kept in one contiguous ring */
+    q->queue = malloc(START_QUEUE_SIZE * size);
     if(q->queue == NULL) {
         free(q);
         return ERR_ALLOC;
     }
-    /* Set the pointers to zero so we know that they are not allocated */
-    bzero(q->queue, START_QUEUE_SIZE * sizeof(void *));
     q->qsize = START_QUEUE_SIZE;
     vf.rf = read_queue;
     vf.wf = write_queue;
     vf.userdata = (uint8_t *)q;
     _db[idx].data = malloc(sizeof(virt_functions));
     if(_db[idx].data == NULL) {
-        free(q);
         free(q->queue);
+        free(q);
         return ERR_ALLOC;
     }
     memcpy(_db[idx].data, &vf, sizeof(virt_functions));
@@ -385,7 +387,7 @@ initialize_tagbase(void)
     _datatype_size = DAX_DATATYPE_SIZE;
 
     /*  Create the default datatypes */
-    char *_mod_cdt = "_module:starttime,TIME,1:id,DINT,1:running,BOOL,1:faulted,BOOL,1:status,CHAR,64:stop,BOOL,1:run,BOOL,1:reload,BOOL,1:kill,BOOL,1";
+    char *_mod_cdt = "_module:starttime,TIME,1:id,DINT,1:running,BOOL,1:faulted,BOOL,1:status,CHAR,64:stop,BOOL,1:run,BOOL,1:reload,BOOL,1:kill,BOOL,1:requests,REAL,1:queue,UDINT,1";
     type = cdt_create(_mod_cdt, NULL);
     if(type == 0) {
         dax_log(DAX_LOG_FATAL, "Unable to create default datatypes");
@@ -428,8 +430,50 @@ initialize_tagbase(void)
     set_dbsize(_dbsize);
 }
 
+/* Allocates the stamp that keeps the time and writer of the last write */
+static int
+_stamp_enable(tag_index idx)
+{
+    if(_db[idx].stamp == NULL) {
+        _db[idx].stamp = xmalloc(sizeof(_dax_tag_stamp));
+        if(_db[idx].stamp == NULL) {
+            dax_log(DAX_LOG_ERROR, "Unable to allocate the write stamp for tag %s", _db[idx].name);
+            return ERR_ALLOC;
+        }
+        _db[idx].stamp->fd = -1;
+    }
+    _db[idx].attr |= TAG_ATTR_TIMESTAMP;
+    return 0;
+}
+
+/* Record the time and writer for tags that keep them */
+static inline void
+_stamp_write(int fd, tag_index idx)
+{
+    struct timespec ts;
+    _dax_tag_stamp *stamp = _db[idx].stamp;
+
+    if(stamp == NULL) return;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    stamp->time = (dax_time)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    stamp->mono = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    stamp->fd = fd;
+}
+
+/* For writes that are done outside of this file, like the atomic operations */
+void
+tag_stamp_write(int fd, tag_index idx)
+{
+    _stamp_write(fd, idx);
+}
+
 static void
 _set_attribute(tag_index idx, uint32_t attr) {
+    /* A tag that is created with the attribute keeps the stamp for good */
+    if(attr & TAG_ATTR_TIMESTAMP) {
+        if(_stamp_enable(idx) == 0) _db[idx].stamp_keep = 1;
+    }
     /* We only let the Tag Retention attribute to be set at this point */
     if(attr & TAG_ATTR_RETAIN) {
         /* TODO: add tag retention */;
@@ -506,6 +550,7 @@ tag_add(int fd, char *name, tag_type type, uint32_t count, uint32_t attr)
                 _set_attribute(n, attr);
                 /* Since it changed we update this tag so the write event will trigger */
                 tag_write(-1, INDEX_ADDED_TAG, 0, &n, sizeof(tag_index));
+                journal_resync();
                 return n;
             } else {
                 dax_log(DAX_LOG_ERROR, "Unable to allocate memory to grow the size of tag %s", name);
@@ -542,6 +587,9 @@ tag_add(int fd, char *name, tag_type type, uint32_t count, uint32_t attr)
     _db[n].events = NULL;
     _db[n].omask = NULL;
     _db[n].odata = NULL;
+    _db[n].stamp = NULL;
+    _db[n].stamp_refs = 0;
+    _db[n].stamp_keep = 0;
 
     if(_add_index(name, n)) {
         /* free up our previous allocation if we can't put this in the __index */
@@ -571,24 +619,50 @@ tag_add(int fd, char *name, tag_type type, uint32_t count, uint32_t attr)
     *((uint16_t *)&tag_desc[12]) = attr;
     memcpy(&tag_desc[14], name, DAX_TAGNAME_SIZE + 1);
     tag_write(-1, INDEX_ADDED_TAG, 0, tag_desc, 47);
+    journal_resync();
 
     dax_log(DAX_LOG_DEBUG, "Tag added with name = %s, type = 0x%X, count = %d", name, type, count);
 
     return n;
 }
 
+/* The TAG_ATTR_TIMESTAMP attribute is reference counted.  Every set has to
+ * be matched by a clear and the stamp is only freed on the last one unless
+ * the tag was created with the attribute. */
 int
 tag_set_attribute(tag_index index, uint32_t attr) {
+    if(attr & TAG_ATTR_TIMESTAMP) {
+        if(_stamp_enable(index)) return ERR_ALLOC;
+        _db[index].stamp_refs++;
+    }
     _db[index].attr |= attr;
     return 0;
 }
 
 int
 tag_clr_attribute(tag_index index, uint32_t attr) {
+    if(attr & TAG_ATTR_TIMESTAMP) {
+        if(_db[index].stamp_refs > 0) _db[index].stamp_refs--;
+        if(_db[index].stamp_refs == 0 && !_db[index].stamp_keep) {
+            xfree(_db[index].stamp);
+            _db[index].stamp = NULL;
+        } else {
+            attr &= ~TAG_ATTR_TIMESTAMP;
+        }
+    }
     _db[index].attr &= ~attr;
     return 0;
 }
 
+/* Returns the stamp for the last write to the tag or NULL if the tag
+ * doesn't keep them */
+_dax_tag_stamp *
+tag_get_stamp(tag_index idx)
+{
+    if(idx < 0 || idx >= _tagnextindex) return NULL;
+    return _db[idx].stamp;
+}
+
 
 /* Deletes the tag given my index.  The tags position in the _db array is not
  * moved.  The name and data fields are freed and set to NULL.  The events
@@ -634,11 +708,16 @@ tag_del(tag_index idx)
     *((uint16_t *)&tag_desc[12]) = _db[idx].attr;
     memcpy(&tag_desc[14], _db[idx].name, DAX_TAGNAME_SIZE + 1);
     tag_write(-1, INDEX_DELETED_TAG, 0, tag_desc, 47);
+    journal_resync();
 
     xfree(_db[idx].name);
     xfree(_db[idx].data);
+    xfree(_db[idx].stamp);
     _db[idx].name = NULL;
     _db[idx].data = NULL;
+    _db[idx].stamp = NULL;
+    _db[idx].stamp_refs = 0;
+    _db[idx].stamp_keep = 0;
     _db[idx].attr = 0;
     _tagcount--;
     if(_db[INDEX_TAGCOUNT].data != NULL) {
@@ -811,6 +890,8 @@ tag_write(int fd, tag_index idx, int offset, void *data, int size)
         }
         /* Copy the data into the right place. */
         memcpy(&(_db[idx].data[offset]), data, size);
+        _stamp_write(fd, idx);
+        journal_add(idx, offset, size);
         event_check(idx, offset, size);
     }
 
@@ -821,6 +902,35 @@ tag_write(int fd, tag_index idx, int offset, void *data, int size)
     return 0;
 }
 
+/* This is for the server to write its own data into system tags.  It skips
+ * the special tag hooks, which would stop anybody but the owning module from
+ * writing to a module tag, so it should never be used for data that came
+ * from a module.  These are statistics that change every time they are
+ * published so they are left out of the change journal.  Otherwise they
+ * would push the real changes out of the ring. */
+int
+tag_server_write(tag_index idx, int offset, void *data, int size)
+{
+    if(idx < 0 || idx >= _tagnextindex) {
+        return ERR_ARG;
+    }
+    if(_db[idx].attr & TAG_ATTR_VIRTUAL) return ERR_ILLEGAL;
+    if( (offset + size) > tag_get_size(idx)) {
+        return ERR_2BIG;
+    }
+    if(_db[idx].data == NULL) {
+        return ERR_DELETED;
+    }
+    memcpy(&(_db[idx].data[offset]), data, size);
+    _stamp_write(-1, idx);
+    event_check(idx, offset, size);
+
+    if(_db[idx].attr & TAG_ATTR_RETAIN) {
+        ret_tag_write(idx);
+    }
+    return 0;
+}
+
 /* Writes the data to the tagbase but only if the corresponding mask bit is set */
 int
 tag_mask_write(int fd, tag_index idx, int offset, void *data, void *mask, int size)
@@ -854,6 +964,8 @@ tag_mask_write(int fd, tag_index idx, int offset, void *data, void *mask, int si
     for(n = 0; n < size; n++) {
         db[n] = (newdata[n] & newmask[n]) | (db[n] & ~newmask[n]);
     }
+    _stamp_write(fd, idx);
+    journal_add(idx, offset, size);
     event_check(idx, offset, size);
 
     if(_db[idx].attr & TAG_ATTR_RETAIN) {
@@ -863,6 +975,77 @@ tag_mask_write(int fd, tag_index idx, int offset, void *data, void *mask, int si
     return 0;
 }
 
+/* Writes a list of data to the tagbase as a single operation.  Everything
+ * is checked before anything is written so either all of the data is written
+ * or none of it is.  The event checks are done after all of the data is in
+ * place so that nobody sees an intermediate state.  Writes to the same tag
+ * that touch each other are combined into a single event check.  Virtual and
+ * special tags are not allowed because they have side effects of their own.
+ * Map checks are left up to the caller. */
+int
+tag_multi_write(int fd, tag_write_item *items, int count)
+{
+    uint8_t *db, *newdata, *newmask;
+    int n, i, j, lo, hi, more;
+
+    for(n = 0; n < count; n++) {
+        if(items[n].idx < 0 || items[n].idx >= _tagnextindex) return ERR_ARG;
+        if(_db[items[n].idx].attr & (TAG_ATTR_VIRTUAL | TAG_ATTR_SPECIAL)) return ERR_ILLEGAL;
+        if(_db[items[n].idx].data == NULL) return ERR_DELETED;
+        if(items[n].offset < 0 || items[n].size < 0 ||
+           items[n].offset > tag_get_size(items[n].idx) ||
+           items[n].size > tag_get_size(items[n].idx) - items[n].offset) {
+            return ERR_2BIG;
+        }
+        if(is_tag_readonly(items[n].idx) && ! is_tag_owned(fd, items[n].idx)) return ERR_READONLY;
+    }
+
+    for(n = 0; n < count; n++) {
+        db = &_db[items[n].idx].data[items[n].offset];
+        if(items[n].mask == NULL) {
+            memcpy(db, items[n].data, items[n].size);
+        } else {
+            newdata = (uint8_t *)items[n].data;
+            newmask = (uint8_t *)items[n].mask;
+            for(i = 0; i < items[n].size; i++) {
+                db[i] = (newdata[i] & newmask[i]) | (db[i] & ~newmask[i]);
+            }
+        }
+        items[n].merged = 0;
+    }
+
+    group_sub_hold();
+    for(n = 0; n < count; n++) {
+        if(items[n].merged) continue;
+        lo = items[n].offset;
+        hi = lo + items[n].size;
+        /* Keep sweeping until the range stops growing */
+        do {
+            more = 0;
+            for(j = n + 1; j < count; j++) {
+                if(items[j].merged || items[j].idx != items[n].idx) continue;
+                if(items[j].offset <= hi && (items[j].offset + items[j].size) >= lo) {
+                    lo = MIN(lo, items[j].offset);
+                    hi = MAX(hi, items[j].offset + items[j].size);
+                    items[j].merged = 1;
+                    more = 1;
+                }
+            }
+        } while(more);
+        _stamp_write(fd, items[n].idx);
+        journal_add(items[n].idx, lo, hi - lo);
+        event_check(items[n].idx, lo, hi - lo);
+        if(_db[items[n].idx].attr & TAG_ATTR_RETAIN) {
+            ret_tag_write(items[n].idx);
+        }
+        /* Leave the combined range so the caller can do the map checks */
+        items[n].offset = lo;
+        items[n].size = hi - lo;
+    }
+    group_sub_release();
+    return 0;
+}
+
 /* These two static functions destroy the cdt that is
  * passed as *cdt to _cdt_destroy.  _cdt_member_destroy
  * is a static function to free the member list */
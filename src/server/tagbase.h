@@ -22,6 +22,7 @@
 #include <opendax.h>
 #include "daxtypes.h"
 #include "virtualtag.h"
+#include "timer.h"
 
 
 #ifndef __TAGBASE_H
@@ -69,6 +70,8 @@
 /* Offset for the Module tag */
 #define MOD_ID_OFFSET 8
 #define MOD_STAT_COMMAND_OFFSET 77  /* _module.xxx where xxx are the commands */
+#define MOD_STAT_REQUESTS_OFFSET 78 /* _module.requests */
+#define MOD_STAT_QUEUE_OFFSET   82  /* _module.queue */
 
 #define CDT_FLAGS_RETAINED 0x80;
 
@@ -85,6 +88,11 @@ typedef struct dax_event_t {
     void *data;          /* Data given by module */
     void *test;          /* Internal data, depends on event type */
     dax_module *notify;  /* Module to be notified of this event */
+    tag_index index;     /* Tag index that this event belongs to */
+    uint32_t interval;   /* Minimum time between events in mSec */
+    time_t lastsent;     /* Time that the last event was sent in mSec from xmonotime() */
+    uint8_t pending;     /* A coalesced event is waiting on the timer */
+    dax_timer timer;     /* Timer used to send coalesced events */
     struct dax_event_t *next;
 } _dax_event;
 
@@ -96,6 +104,14 @@ typedef struct dax_datamap_t {
     struct dax_datamap_t *next;
 } _dax_datamap;
 
+/* Time and writer of the last write to a tag.  This is only allocated for
+ * tags that have the TAG_ATTR_TIMESTAMP attribute */
+typedef struct {
+    dax_time time;  /* Wall clock in mSec */
+    uint64_t mono;  /* Monotonic clock in uSec */
+    int fd;         /* fd of the module that wrote it, -1 = tagserver */
+} _dax_tag_stamp;
+
 /* This is the internal structure for the tag array. */
 typedef struct {
     tag_type type;
@@ -111,6 +127,9 @@ typedef struct {
     uint8_t *omask;        /* Override mask pointer */
     uint8_t *odata;        /* Override data pointer */
     uint32_t ret_file_pointer; /* Pointer to the data area of the tag retention file */
+    _dax_tag_stamp *stamp;     /* Time and writer of the last write, NULL if not kept */
+    unsigned int stamp_refs;   /* Number of events that need the stamp */
+    uint8_t stamp_keep;        /* Set if the tag was created with TAG_ATTR_TIMESTAMP */
 } _dax_tag_db;
 
 typedef struct {
@@ -120,11 +139,22 @@ typedef struct {
     int tag_idx;
 } _dax_tag_index;
 
+/* One piece of data for tag_multi_write() */
+typedef struct {
+    tag_index idx;
+    int offset;
+    int size;
+    void *data;
+    void *mask;   /* NULL for a plain write */
+    int merged;   /* Used internally to combine the event checks */
+} tag_write_item;
+
 /* Tag Database Handling Functions */
 void initialize_tagbase(void);
 tag_index tag_add(int fd, char *name, tag_type type, uint32_t count, uint32_t attr);
 int tag_set_attribute(tag_index index, uint32_t attr);
 int tag_clr_attribute(tag_index index, uint32_t attr);
+_dax_tag_stamp *tag_get_stamp(tag_index idx);
 
 tag_index virtual_tag_add(char *name, tag_type type, unsigned int count, vfunction *rf, vfunction *wf);
 int tag_del(tag_index idx);
@@ -140,10 +170,15 @@ int tag_get_size(tag_index idx);
 /* Database reading and writing functions */
 int tag_read(int fd, tag_index handle, int offset, void *data, int size);
 int tag_write(int fd, tag_index handle, int offset, void *data, int size);
+int tag_server_write(tag_index handle, int offset, void *data, int size);
+void tag_stamp_write(int fd, tag_index idx);
 int tag_mask_write(int fd, tag_index handle, int offset, void *data, void *mask, int size);
+int tag_multi_write(int fd, tag_write_item *items, int count);
 
 /* Perform an atomic operation on the data */
-int atomic_op(tag_handle h, void *data, uint16_t op);
+int atomic_op(int fd, tag_handle h, void *data, uint16_t op, void *old);
+int atomic_check(tag_handle h);
+int atomic_fetch_size(tag_handle h);
 
 /* Custom DataType functions */
 tag_type cdt_create(char *str, int *error);
@@ -160,6 +195,7 @@ int event_add(tag_handle h, int event_type, void *data, dax_module *module);
 int event_del(int index, int id, dax_module *module);
 int events_del_all(_dax_event *head);
 int event_opt(int index, int id, uint32_t options, dax_module *module);
+int event_interval(int index, int id, uint32_t interval, dax_module *module);
 int events_cleanup(dax_module *module);
 
 int map_add(tag_handle src, tag_handle dest);
@@ -0,0 +1,124 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the timer wheel that the server uses to schedule
+ * things that have to happen later, like rate limited events.
+ */
+
+#include "timer.h"
+
+static dax_timer *_wheel[TIMER_WHEEL_SLOTS];
+static time_t _lasttick = 0; /* The last tick that was processed */
+static int _count = 0;       /* Number of armed timers */
+
+#define TICK(x) ((x) / TIMER_TICK)
+#define SLOT(x) ((x) & (TIMER_WHEEL_SLOTS - 1))
+
+void
+timer_init(dax_timer *timer, void (*callback)(void *udata), void *udata) {
+    timer->expire = 0;
+    timer->callback = callback;
+    timer->udata = udata;
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->slot = -1;
+}
+
+/* Arms the timer to expire at 'expire' mSec.  If the timer is already
+ * armed it is moved. */
+void
+timer_start(dax_timer *timer, time_t expire) {
+    time_t tick;
+    int slot;
+
+    if(timer->slot >= 0) timer_stop(timer);
+    /* Timers that are already due go in the next slot to be processed */
+    tick = TICK(expire);
+    if(tick <= _lasttick) tick = _lasttick + 1;
+    slot = SLOT(tick);
+    timer->expire = expire;
+    timer->prev = NULL;
+    timer->next = _wheel[slot];
+    if(_wheel[slot] != NULL) _wheel[slot]->prev = timer;
+    _wheel[slot] = timer;
+    timer->slot = slot;
+    _count++;
+}
+
+void
+timer_stop(dax_timer *timer) {
+    if(timer->slot < 0) return;
+    if(timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        _wheel[timer->slot] = timer->next;
+    }
+    if(timer->next != NULL) timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+    timer->slot = -1;
+    _count--;
+}
+
+/* Fires all of the timers in the given slot that are due */
+static void
+_run_slot(int slot, time_t now) {
+    dax_timer *this, *next;
+
+    this = _wheel[slot];
+    while(this != NULL) {
+        next = this->next;
+        if(TICK(this->expire) <= TICK(now)) {
+            timer_stop(this);
+            /* The callback is free to restart the timer */
+            this->callback(this->udata);
+        }
+        this = next;
+    }
+}
+
+/* This should be called from the main message loop.  It fires all of the
+ * timers that have expired and returns the number of mSec until the next
+ * timer is due or -1 if there are no timers armed.  The return value is
+ * only a hint, it may be early but it should never be late. */
+int
+timer_run(time_t now) {
+    time_t tick, n, last;
+    int slot;
+
+    tick = TICK(now);
+    if(_count == 0) {
+        _lasttick = tick;
+        return -1;
+    }
+    /* If we have been away for longer than one trip around the wheel then
+     * we only need to look at each slot once */
+    last = _lasttick;
+    if(tick - last > TIMER_WHEEL_SLOTS) last = tick - TIMER_WHEEL_SLOTS;
+    for(n = last + 1; n <= tick; n++) {
+        _run_slot(SLOT(n), now);
+    }
+    _lasttick = tick;
+    if(_count == 0) return -1;
+    /* Find the next slot that has something in it */
+    for(n = 1; n <= TIMER_WHEEL_SLOTS; n++) {
+        slot = SLOT(tick + n);
+        if(_wheel[slot] != NULL) {
+            return MAX(0, (tick + n) * TIMER_TICK - now);
+        }
+    }
+    return -1; /* Should never get here */
+}
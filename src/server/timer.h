@@ -0,0 +1,50 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the definitions for the server timer wheel.
+ */
+
+#ifndef __DAX_TIMER_H
+#define __DAX_TIMER_H 1
+
+#include <common.h>
+
+/* The timer wheel is an array of slots that each represent one tick of
+ * time.  A timer is placed in the slot that corresponds to its expiration
+ * tick modulo the number of slots.  Timers that are further out than one
+ * trip around the wheel simply stay in their slot until their time comes.
+ * This makes starting and stopping a timer O(1) which matters because
+ * rate limited events may be rescheduled on every tag write. */
+#define TIMER_WHEEL_SLOTS 256 /* Must be a power of two */
+#define TIMER_TICK        10  /* Length of a single tick in mSec */
+
+/* Timers are meant to be embedded in the object that uses them so that
+ * the wheel never has to allocate any memory. */
+typedef struct dax_timer_t {
+    time_t expire;                 /* Expiration time in mSec from xmonotime() */
+    void (*callback)(void *udata); /* Called when the timer expires */
+    void *udata;
+    struct dax_timer_t *next, *prev;
+    int slot;                      /* Slot that we are in, -1 if not armed */
+} dax_timer;
+
+void timer_init(dax_timer *timer, void (*callback)(void *udata), void *udata);
+void timer_start(dax_timer *timer, time_t expire);
+void timer_stop(dax_timer *timer);
+int timer_run(time_t now);
+
+#endif /* !__DAX_TIMER_H */
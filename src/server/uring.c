@@ -0,0 +1,461 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the io_uring I/O engine.  We talk to the kernel with
+ * the raw system calls so that we don't need liburing.
+ *
+ * Each listening socket gets a single multishot accept and each connection
+ * gets a single multishot receive, so once they are armed the kernel keeps
+ * handing us connections and data without us asking again.  The received
+ * data goes into buffers from a ring that we give the kernel up front and
+ * each buffer goes back on the ring once the data has been copied into the
+ * connection's message buffer.
+ *
+ * The fd numbers get reused as soon as a connection is closed but there may
+ * still be completions for the old connection on the way.  Each fd has a
+ * generation number that is changed when the receive is cancelled and it
+ * goes in the user data of every request, so anything left over from the
+ * old connection can be thrown away.
+ */
+
+#include "uring.h"
+#include "func.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <string.h>
+
+/* The user data of each request is the operation in the top byte, the
+ * generation of the fd in the next three and the fd in the bottom four */
+#define URING_UDATA(op, gen, fd) (((uint64_t)(op) << 56) | \
+                                  ((uint64_t)((gen) & 0xFFFFFF) << 32) | \
+                                  (uint32_t)(fd))
+/* The provided buffer group that the receives use */
+#define URING_BGID 0
+
+static int _ringfd = -1;
+/* Submission queue */
+static void *_sq_ptr;
+static size_t _sq_len;
+static unsigned int *_sq_head;
+static unsigned int *_sq_tail;
+static unsigned int _sq_mask;
+static unsigned int _sq_entries;
+static struct io_uring_sqe *_sqes;
+static size_t _sqes_len;
+/* Completion queue.  This might be the same mapping as the submission queue */
+static void *_cq_ptr;
+static size_t _cq_len;
+static unsigned int *_cq_head;
+static unsigned int *_cq_tail;
+static unsigned int _cq_mask;
+static struct io_uring_cqe *_cqes;
+/* Provided buffers */
+static struct io_uring_buf_ring *_br;
+static size_t _br_len;
+static unsigned int _br_entries;
+static unsigned char *_bufs;
+static unsigned int _buf_size;
+/* Generation of each fd */
+static uint32_t *_gens;
+static int _gens_size;
+
+static int
+_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+_uring_enter(unsigned int to_submit, unsigned int min_complete,
+             unsigned int flags, void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, _ringfd, to_submit, min_complete,
+                        flags, arg, argsz);
+}
+
+static int
+_uring_register(unsigned int opcode, void *arg, unsigned int nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, _ringfd, opcode, arg, nr_args);
+}
+
+/* Returns the current generation of fd */
+static uint32_t
+_gen_get(int fd)
+{
+    if(fd < 0 || fd >= _gens_size) return 0;
+    return _gens[fd] & 0xFFFFFF;
+}
+
+/* Changes the generation of fd so that anything that is still on the way
+ * for it is ignored.  Returns the generation that it had before. */
+static uint32_t
+_gen_bump(int fd)
+{
+    uint32_t *new;
+    uint32_t gen;
+    int size;
+
+    if(fd < 0) return 0;
+    if(fd >= _gens_size) {
+        size = _gens_size ? _gens_size : 64;
+        while(size <= fd) size *= 2;
+        new = xrealloc(_gens, size * sizeof(uint32_t));
+        if(new == NULL) return 0;
+        memset(&new[_gens_size], 0, (size - _gens_size) * sizeof(uint32_t));
+        _gens = new;
+        _gens_size = size;
+    }
+    gen = _gens[fd] & 0xFFFFFF;
+    _gens[fd]++;
+    return gen;
+}
+
+/* Puts the buffer back on the ring so that the kernel can use it again */
+static void
+_buffer_add(unsigned int bid)
+{
+    struct io_uring_buf *buf;
+    unsigned short tail;
+
+    /* We are the only one that moves the tail */
+    tail = _br->tail;
+    buf = &_br->bufs[tail & (_br_entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)&_bufs[bid * _buf_size];
+    buf->len = _buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&_br->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/* Hands whatever is in the submission queue to the kernel */
+static int
+_submit(void)
+{
+    unsigned int pending;
+
+    pending = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if(pending == 0) return 0;
+    if(_uring_enter(pending, 0, 0, NULL, 0) < 0 && errno != EINTR) {
+        dax_log(DAX_LOG_ERROR, "Unable to submit io_uring requests - %s", strerror(errno));
+        return ERR_GENERIC;
+    }
+    return 0;
+}
+
+/* Returns the next free submission queue entry or NULL if the queue is full
+ * and we can't empty it.  The entry isn't seen by the kernel until
+ * _push_sqe() is called. */
+static struct io_uring_sqe *
+_get_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail;
+
+    tail = *_sq_tail;
+    if(tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries) {
+        _submit();
+        if(tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries) {
+            dax_log(DAX_LOG_ERROR, "The io_uring submission queue is full");
+            return NULL;
+        }
+    }
+    sqe = &_sqes[tail & _sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+static void
+_push_sqe(void)
+{
+    __atomic_store_n(_sq_tail, *_sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Sets up the ring with room for 'entries' requests at a time and 'buffers'
+ * receive buffers that are 'size' bytes each.  Returns 0 on success or an
+ * error if the kernel doesn't have what we need. */
+int
+uring_init(unsigned int entries, unsigned int buffers, unsigned int size)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    unsigned int n;
+
+    memset(&p, 0, sizeof(p));
+    /* Only the main thread ever touches the ring */
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    _ringfd = _uring_setup(entries, &p);
+    if(_ringfd < 0 && errno == EINVAL) {
+        /* Older kernels don't know about those flags */
+        memset(&p, 0, sizeof(p));
+        _ringfd = _uring_setup(entries, &p);
+    }
+    if(_ringfd < 0) {
+        dax_log(DAX_LOG_ERROR, "Unable to create io_uring instance - %s", strerror(errno));
+        return ERR_GENERIC;
+    }
+    /* We need the timeout on io_uring_enter() and we don't want to lose
+     * completions if the queue overflows */
+    if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        dax_log(DAX_LOG_ERROR, "The kernel's io_uring is too old");
+        uring_free();
+        return ERR_NOTIMPLEMENTED;
+    }
+
+    _sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    _cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(_cq_len > _sq_len) _sq_len = _cq_len;
+        _cq_len = _sq_len;
+    }
+    _sq_ptr = mmap(NULL, _sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   _ringfd, IORING_OFF_SQ_RING);
+    if(_sq_ptr == MAP_FAILED) {
+        _sq_ptr = NULL;
+        goto error;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        _cq_ptr = _sq_ptr;
+    } else {
+        _cq_ptr = mmap(NULL, _cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       _ringfd, IORING_OFF_CQ_RING);
+        if(_cq_ptr == MAP_FAILED) {
+            _cq_ptr = NULL;
+            goto error;
+        }
+    }
+    _sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = mmap(NULL, _sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 _ringfd, IORING_OFF_SQES);
+    if(_sqes == MAP_FAILED) {
+        _sqes = NULL;
+        goto error;
+    }
+    _sq_head = (unsigned int *)((char *)_sq_ptr + p.sq_off.head);
+    _sq_tail = (unsigned int *)((char *)_sq_ptr + p.sq_off.tail);
+    _sq_mask = *(unsigned int *)((char *)_sq_ptr + p.sq_off.ring_mask);
+    _sq_entries = p.sq_entries;
+    _cq_head = (unsigned int *)((char *)_cq_ptr + p.cq_off.head);
+    _cq_tail = (unsigned int *)((char *)_cq_ptr + p.cq_off.tail);
+    _cq_mask = *(unsigned int *)((char *)_cq_ptr + p.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *)((char *)_cq_ptr + p.cq_off.cqes);
+    /* The entries always go in the array in order so we only set it once */
+    for(n = 0; n < _sq_entries; n++) {
+        ((unsigned int *)((char *)_sq_ptr + p.sq_off.array))[n] = n;
+    }
+
+    /* The buffer ring has to be a power of two */
+    _br_entries = 1;
+    while(_br_entries < buffers && _br_entries < 32768) _br_entries *= 2;
+    _buf_size = size;
+    _br_len = _br_entries * sizeof(struct io_uring_buf);
+    _br = mmap(NULL, _br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(_br == MAP_FAILED) {
+        _br = NULL;
+        goto error;
+    }
+    _bufs = xmalloc(_br_entries * _buf_size);
+    if(_bufs == NULL) goto error;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)_br;
+    reg.ring_entries = _br_entries;
+    reg.bgid = URING_BGID;
+    if(_uring_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        dax_log(DAX_LOG_ERROR, "Unable to register io_uring buffers - %s", strerror(errno));
+        uring_free();
+        return ERR_NOTIMPLEMENTED;
+    }
+    _br->tail = 0;
+    for(n = 0; n < _br_entries; n++) {
+        _buffer_add(n);
+    }
+    return 0;
+
+error:
+    dax_log(DAX_LOG_ERROR, "Unable to map the io_uring queues - %s", strerror(errno));
+    uring_free();
+    return ERR_ALLOC;
+}
+
+void
+uring_free(void)
+{
+    if(_sqes != NULL) munmap(_sqes, _sqes_len);
+    if(_cq_ptr != NULL && _cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_len);
+    if(_sq_ptr != NULL) munmap(_sq_ptr, _sq_len);
+    /* Closing the ring unregisters the buffers */
+    if(_ringfd >= 0) close(_ringfd);
+    if(_br != NULL) munmap(_br, _br_len);
+    if(_bufs != NULL) xfree(_bufs);
+    if(_gens != NULL) xfree(_gens);
+    _sqes = NULL;
+    _cq_ptr = NULL;
+    _sq_ptr = NULL;
+    _ringfd = -1;
+    _br = NULL;
+    _bufs = NULL;
+    _gens = NULL;
+    _gens_size = 0;
+}
+
+static int
+_accept(int fd, uint32_t gen)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = _get_sqe();
+    if(sqe == NULL) return ERR_ALLOC;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = URING_UDATA(URING_ACCEPT, gen, fd);
+    _push_sqe();
+    return 0;
+}
+
+static int
+_recv(int fd, uint32_t gen)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = _get_sqe();
+    if(sqe == NULL) return ERR_ALLOC;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = URING_UDATA(URING_RECV, gen, fd);
+    _push_sqe();
+    return 0;
+}
+
+/* Start accepting connections on the listening socket fd */
+int
+uring_accept(int fd)
+{
+    return _accept(fd, _gen_get(fd));
+}
+
+/* Start receiving data on the connected socket fd */
+int
+uring_recv(int fd)
+{
+    return _recv(fd, _gen_get(fd));
+}
+
+/* Stop receiving on fd.  This has to be called before the fd is closed
+ * because the request holds its own reference to the socket. */
+int
+uring_cancel(int fd)
+{
+    struct io_uring_sqe *sqe;
+    uint32_t gen;
+
+    gen = _gen_bump(fd);
+    sqe = _get_sqe();
+    if(sqe == NULL) return ERR_ALLOC;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = URING_UDATA(URING_RECV, gen, fd);
+    sqe->user_data = URING_UDATA(URING_CANCEL, 0, fd);
+    _push_sqe();
+    /* Send it now so that the socket really gets closed */
+    return _submit();
+}
+
+/* The kernel stops a multishot request when it runs into trouble, like
+ * running out of buffers.  This starts it again if the fd is still the
+ * same connection. */
+int
+uring_rearm(uring_event *ev)
+{
+    if(ev->gen != _gen_get(ev->fd)) return 0;
+    if(ev->op == URING_ACCEPT) return _accept(ev->fd, ev->gen);
+    if(ev->op == URING_RECV) return _recv(ev->fd, ev->gen);
+    return 0;
+}
+
+/* Submits everything that is queued and waits up to msec milliseconds for
+ * something to complete */
+int
+uring_wait(int msec)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int pending;
+
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    pending = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if(_uring_enter(pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                    &arg, sizeof(arg)) < 0) {
+        /* Timing out or being interrupted by a signal is fine */
+        if(errno != ETIME && errno != EINTR) {
+            dax_log(DAX_LOG_ERROR, "io_uring_enter error: %s", strerror(errno));
+            return ERR_MSG_RECV;
+        }
+    }
+    return 0;
+}
+
+/* Gets the next completion from the ring.  Returns 1 if ev was filled in
+ * and 0 if there is nothing left. */
+int
+uring_next(uring_event *ev)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+
+    while(1) {
+        head = *_cq_head;
+        if(head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) return 0;
+        cqe = &_cqes[head & _cq_mask];
+        ev->op = (int)(cqe->user_data >> 56);
+        ev->gen = (uint32_t)(cqe->user_data >> 32) & 0xFFFFFF;
+        ev->fd = (int)(uint32_t)cqe->user_data;
+        ev->res = cqe->res;
+        ev->more = (cqe->flags & IORING_CQE_F_MORE) ? 1 : 0;
+        ev->bid = -1;
+        ev->data = NULL;
+        if(cqe->flags & IORING_CQE_F_BUFFER) {
+            ev->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            ev->data = &_bufs[ev->bid * _buf_size];
+        }
+        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+        if(ev->op != URING_CANCEL && ev->gen == _gen_get(ev->fd)) return 1;
+        /* Left over from a connection that has been closed */
+        uring_buffer_done(ev);
+    }
+}
+
+void
+uring_buffer_done(uring_event *ev)
+{
+    if(ev->bid >= 0) {
+        _buffer_add(ev->bid);
+        ev->bid = -1;
+        ev->data = NULL;
+    }
+}
+
+#endif /* HAVE_IO_URING */
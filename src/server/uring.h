@@ -0,0 +1,59 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+ * This file contains the definitions for the io_uring I/O engine
+ */
+
+#ifndef __DAX_URING_H
+#define __DAX_URING_H 1
+
+#include <common.h>
+#include <stdint.h>
+
+#ifdef HAVE_IO_URING
+
+/* What the completion was for */
+#define URING_ACCEPT 1
+#define URING_RECV   2
+#define URING_CANCEL 3
+
+/* One completion from the ring.  If bid is not -1 then the received data
+ * is in one of the provided buffers and it has to be given back with
+ * uring_buffer_done() once we are finished with it. */
+typedef struct {
+    int op;
+    int fd;
+    uint32_t gen;   /* Generation of the fd when the request was made */
+    int32_t res;    /* Result of the request or -errno */
+    int more;       /* Set if the multishot request is still armed */
+    int bid;
+    unsigned char *data;
+} uring_event;
+
+int uring_init(unsigned int entries, unsigned int buffers, unsigned int size);
+void uring_free(void);
+int uring_accept(int fd);
+int uring_recv(int fd);
+int uring_cancel(int fd);
+int uring_rearm(uring_event *ev);
+int uring_wait(int msec);
+int uring_next(uring_event *ev);
+void uring_buffer_done(uring_event *ev);
+
+#endif /* HAVE_IO_URING */
+
+#endif /* !__DAX_URING_H */
@@ -75,37 +75,71 @@ get_module_tag_name(int fd, tag_index idx, int offset, void *data, int size, voi
 
 
 /* These functions deal with tag based queues */
+
+/* Make sure that there is room for 'count' more items in the queue.  When
+ * the ring has to grow the items are copied to the start of the new ring
+ * in order so that nothing is wrapped anymore. */
+static int
+_queue_reserve(tag_queue *q, int count)
+{
+    uint8_t *new_queue;
+    int newqsize, first;
+
+    if(q->qcount + count <= q->qsize) return 0;
+    newqsize = q->qsize;
+    while(newqsize < q->qcount + count) newqsize *= 2;
+    new_queue = malloc((size_t)newqsize * q->size);
+    if(new_queue == NULL) return ERR_ALLOC;
+    /* The part from qread to the end of the ring and then the wrapped part */
+    first = MIN(q->qcount, q->qsize - q->qread);
+    memcpy(new_queue, &q->queue[q->qread * q->size], first * q->size);
+    memcpy(&new_queue[first * q->size], q->queue, (q->qcount - first) * q->size);
+    free(q->queue);
+    q->queue = new_queue;
+    q->qsize = newqsize;
+    q->qread = 0;
+    return 0;
+}
+
+/* Copy 'count' items into the ring.  At most two copies are needed, one
+ * up to the end of the ring and one for the part that wraps around. */
+static void
+_queue_put(tag_queue *q, uint8_t *data, int count)
+{
+    int next, first;
+
+    next = (q->qread + q->qcount) % q->qsize;
+    first = MIN(count, q->qsize - next);
+    memcpy(&q->queue[next * q->size], data, first * q->size);
+    memcpy(q->queue, &data[first * q->size], (count - first) * q->size);
+    q->qcount += count;
+}
+
+/* Take up to 'max' items out of the ring and return the number taken */
+static int
+_queue_get(tag_queue *q, uint8_t *data, int max)
+{
+    int count, first;
+
+    count = MIN(max, q->qcount);
+    first = MIN(count, q->qsize - q->qread);
+    memcpy(data, &q->queue[q->qread * q->size], first * q->size);
+    memcpy(&data[first * q->size], q->queue, (count - first) * q->size);
+    q->qread = (q->qread + count) % q->qsize;
+    q->qcount -= count;
+    return count;
+}
+
 int
 write_queue(int fd, tag_index idx, int offset, void *data, int size, void *userdata) {
     tag_queue *q;
 
-    int next, newqsize;
-    uint8_t *new_queue;
-
     /* We only allow writing the entire tag.  Doing otherwise
      * would be ambiguous */
     q = (tag_queue *)userdata;
     if(offset != 0 || size != q->size) return ERR_ILLEGAL;
-    /* We need to grow the queue */
-    if(q->qcount == q->qsize) {
-        newqsize = q->qsize* 2;
-        new_queue = realloc(q->queue, sizeof(void *) * newqsize);
-        if(new_queue == NULL) return ERR_ALLOC;
-        q->queue = (void **)new_queue;
-        /* After the queue size is increased we need to move the fragment that is now
-         * at the beginning of the queue to the start of the new area */
-        if(q->qread > 0) {
-            memcpy(&q->queue[q->qsize], &q->queue[0], q->qread*sizeof(void *));
-        }
-        q->qsize = newqsize;
-    }
-    next = (q->qread + q->qcount) % q->qsize;
-    if(q->queue[next] == NULL) {
-        q->queue[next] = malloc(q->size);
-        if(q->queue[next] == NULL) return ERR_ALLOC;
-    }
-    memcpy(q->queue[next], data, q->size);
-    q->qcount++;
+    if(_queue_reserve(q, 1)) return ERR_ALLOC;
+    _queue_put(q, data, 1);
     /* This will break if we have any event other than "WRITE" */
     event_check(idx, offset, size);
 
@@ -120,15 +154,60 @@ read_queue(int fd, tag_index idx, int offset, void *data, int size, void *userda
     if(q->qcount == 0) {
         return ERR_EMPTY;
     }
-    memcpy(data, q->queue[q->qread], q->size);
-    q->qread++;
-    if(q->qread == q->qsize)  {
-        q->qread = 0;
-    }
-    q->qcount--;
+    _queue_get(q, data, 1);
     return 0;
 }
 
+/* Returns the queue for the tag or NULL if the tag is not a queue */
+static tag_queue *
+_get_queue(tag_index idx)
+{
+    if(idx < 0 || idx >= get_tagindex() || !is_tag_queue(idx)) return NULL;
+    if(_db[idx].data == NULL) return NULL;
+    return (tag_queue *)((virt_functions *)_db[idx].data)->userdata;
+}
+
+/* Add 'count' items to the queue as a single operation.  The write
+ * event is only checked once for the whole batch so the module that
+ * gets the event should read until the queue is empty. */
+int
+queue_write_bulk(tag_index idx, void *data, int count)
+{
+    tag_queue *q;
+
+    q = _get_queue(idx);
+    if(q == NULL) return ERR_ARG;
+    if(count <= 0) return ERR_ARG;
+    if(_queue_reserve(q, count)) return ERR_ALLOC;
+    _queue_put(q, data, count);
+    event_check(idx, 0, q->size);
+    return 0;
+}
+
+/* Remove up to 'max' items from the queue and return the number of items
+ * that were copied into data or ERR_EMPTY if there was nothing there */
+int
+queue_read_bulk(tag_index idx, void *data, int max)
+{
+    tag_queue *q;
+
+    q = _get_queue(idx);
+    if(q == NULL) return ERR_ARG;
+    if(q->qcount == 0) return ERR_EMPTY;
+    return _queue_get(q, data, max);
+}
+
+/* Returns the size of one item in the queue or an error if the tag is not a queue */
+int
+queue_item_size(tag_index idx)
+{
+    tag_queue *q;
+
+    q = _get_queue(idx);
+    if(q == NULL) return ERR_ARG;
+    return q->size;
+}
+
 /* Special tag handling functions.  The idea behind "special" tags is that
    they have a hook that is called right before the actual data is read
    or written.  This hook can interrupt the process by returning an error,
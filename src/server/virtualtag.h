@@ -47,7 +47,8 @@ typedef struct virt_functions {
 
 /* This structure represents a single tag queue.  A copy of
  * this would be placed in the *userdata pointer of the virt_function
- * structure in the data area of the tag.
+ * structure in the data area of the tag.  The items are stored in one
+ * contiguous ring of qsize slots that are each 'size' bytes long.
  */
 typedef struct tag_queue {
     tag_type type;   /* Type of the tag items */
@@ -56,7 +57,7 @@ typedef struct tag_queue {
     int qsize;       /* Total size of the queue in number of tag items */
     int qcount;      /* Current number of items in the queue */
     int qread;       /* Nest item that needs to be read */
-    void **queue;    /* Pointer to the actual queue */
+    uint8_t *queue;  /* Pointer to the ring of qsize * size bytes */
 } tag_queue;
 
 /* Set virtual/special function execution environment variables */
@@ -72,6 +73,9 @@ int get_module_tag_name(int fd, tag_index idx, int offset, void *data, int size,
 /* queue handling functions */
 int write_queue(int fd, tag_index idx, int offset, void *data, int size, void *userdata);
 int read_queue(int fd, tag_index idx, int offset, void *data, int size, void *userdata);
+int queue_write_bulk(tag_index idx, void *data, int count);
+int queue_read_bulk(tag_index idx, void *data, int max);
+int queue_item_size(tag_index idx);
 
 /* Special tag hook functions */
 int special_tag_read(int fd, tag_index index, int offset, void *data, int size);
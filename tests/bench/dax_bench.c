@@ -0,0 +1,581 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  dax_bench - Performance benchmark for the tag server
+ *
+ *  This program starts a local tag server (unless told to use one that is
+ *  already running) and drives a set of workloads against it through the
+ *  library.  Each workload reports its throughput and latency percentiles
+ *  and the whole report is written as JSON so that the numbers can be
+ *  compared between commits.
+ *
+ *  The workloads are...
+ *    readwrite - N clients each doing a mix of reads, writes and masked
+ *                writes on M tags
+ *    events    - one writer and N subscribers that all have an event on
+ *                the same tag
+ *    mapping   - writes to the head of a chain of mapped tags
+ *    group     - reads and writes of a tag group
+ *    retain    - writes to a retained tag
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <libcommon.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#ifndef BUILD_DIR
+# define BUILD_DIR "../.."
+#endif
+
+#define TAGNAME "bench_%d"
+
+static struct {
+    int clients;    /* Number of client connections for readwrite */
+    int tags;       /* Number of tags for readwrite */
+    int ops;        /* Number of operations per client / workload */
+    int read, write, mask; /* Percentage mix of the readwrite operations */
+    int fanout;     /* Number of event subscribers */
+    int chain;      /* Length of the mapping chain */
+    int group;      /* Number of tags in the group */
+    char *server;   /* Path to the tagserver executable */
+    int noserver;   /* Use a server that is already running */
+    char *outfile;  /* Where to write the JSON report */
+} _opt = {4, 100, 10000, 50, 40, 10, 4, 8, 16, NULL, 0, NULL};
+
+typedef struct {
+    const char *name;
+    int ops;          /* Number of operations that were completed */
+    int errors;       /* Number of operations that failed */
+    double seconds;   /* Wall clock time for the whole workload */
+    uint32_t *lat;    /* Latency of each operation in uSec */
+    long events;      /* Number of events received (events workload) */
+} bench_result;
+
+static bench_result _results[8];
+static int _result_count;
+
+static inline uint64_t
+_now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static dax_state *
+_connect(const char *name)
+{
+    dax_state *ds;
+    char *argv[] = {(char *)name, NULL};
+
+    ds = dax_init(name);
+    if(ds == NULL) return NULL;
+    dax_configure(ds, 1, argv, 0);
+    if(dax_connect(ds)) {
+        dax_free(ds);
+        return NULL;
+    }
+    return ds;
+}
+
+static bench_result *
+_new_result(const char *name, int ops)
+{
+    bench_result *r;
+
+    r = &_results[_result_count++];
+    r->name = name;
+    r->ops = 0;
+    r->errors = 0;
+    r->events = 0;
+    r->lat = malloc(sizeof(uint32_t) * (ops > 0 ? ops : 1));
+    if(r->lat == NULL) {
+        fprintf(stderr, "Unable to allocate latency buffer\n");
+        exit(-1);
+    }
+    return r;
+}
+
+static void
+_record(bench_result *r, uint64_t start, int result)
+{
+    if(result) {
+        r->errors++;
+    } else {
+        r->lat[r->ops++] = _now_usec() - start;
+    }
+}
+
+/* readwrite workload */
+
+typedef struct {
+    int id;
+    bench_result r;
+} rw_client;
+
+static void *
+_rw_thread(void *arg)
+{
+    rw_client *c = (rw_client *)arg;
+    dax_state *ds;
+    tag_handle *h;
+    char name[DAX_TAGNAME_SIZE + 1];
+    dax_dint value, mask = 0x0000FFFF;
+    unsigned int seed;
+    uint64_t start;
+    int n, op, result;
+
+    snprintf(name, sizeof(name), "bench_rw%d", c->id);
+    ds = _connect(name);
+    if(ds == NULL) {
+        c->r.errors = _opt.ops;
+        return NULL;
+    }
+    h = malloc(sizeof(tag_handle) * _opt.tags);
+    for(n = 0; n < _opt.tags; n++) {
+        snprintf(name, sizeof(name), TAGNAME, n);
+        if(dax_tag_handle(ds, &h[n], name, 1)) c->r.errors++;
+    }
+    seed = c->id;
+    for(n = 0; n < _opt.ops && c->r.errors == 0; n++) {
+        op = rand_r(&seed) % 100;
+        value = n;
+        start = _now_usec();
+        if(op < _opt.read) {
+            result = dax_tag_read(ds, h[n % _opt.tags], &value);
+        } else if(op < _opt.read + _opt.write) {
+            result = dax_tag_write(ds, h[n % _opt.tags], &value);
+        } else {
+            result = dax_tag_mask(ds, h[n % _opt.tags], &value, &mask);
+        }
+        _record(&c->r, start, result);
+    }
+    free(h);
+    dax_disconnect(ds);
+    dax_free(ds);
+    return NULL;
+}
+
+static int
+_bench_readwrite(dax_state *ds)
+{
+    rw_client *clients;
+    pthread_t *threads;
+    bench_result *r;
+    tag_handle h;
+    char name[DAX_TAGNAME_SIZE + 1];
+    uint64_t start;
+    int n;
+
+    for(n = 0; n < _opt.tags; n++) {
+        snprintf(name, sizeof(name), TAGNAME, n);
+        if(dax_tag_add(ds, &h, name, DAX_DINT, 1, 0)) return -1;
+    }
+    clients = calloc(_opt.clients, sizeof(rw_client));
+    threads = calloc(_opt.clients, sizeof(pthread_t));
+    r = _new_result("readwrite", _opt.ops * _opt.clients);
+    start = _now_usec();
+    for(n = 0; n < _opt.clients; n++) {
+        clients[n].id = n;
+        clients[n].r.lat = malloc(sizeof(uint32_t) * _opt.ops);
+        pthread_create(&threads[n], NULL, _rw_thread, &clients[n]);
+    }
+    for(n = 0; n < _opt.clients; n++) {
+        pthread_join(threads[n], NULL);
+        memcpy(&r->lat[r->ops], clients[n].r.lat, clients[n].r.ops * sizeof(uint32_t));
+        r->ops += clients[n].r.ops;
+        r->errors += clients[n].r.errors;
+        free(clients[n].r.lat);
+    }
+    r->seconds = (_now_usec() - start) / 1e6;
+    free(clients);
+    free(threads);
+    return 0;
+}
+
+/* events workload */
+
+static pthread_barrier_t _event_barrier;
+static volatile int _writer_done;
+
+static void
+_event_callback(dax_state *ds, void *udata)
+{
+    (*(long *)udata)++;
+}
+
+static void *
+_event_thread(void *arg)
+{
+    long *count = (long *)arg;
+    dax_state *ds;
+    tag_handle h;
+    dax_id id;
+    int idle = 0;
+
+    ds = _connect("bench_event");
+    if(ds == NULL || dax_tag_handle(ds, &h, "bench_event", 1) ||
+       dax_event_add(ds, &h, EVENT_WRITE, NULL, &id, _event_callback, count, NULL)) {
+        *count = -1;
+        pthread_barrier_wait(&_event_barrier);
+        return NULL;
+    }
+    pthread_barrier_wait(&_event_barrier);
+    /* Keep going until the writer is done and we stop getting events */
+    while(*count < _opt.ops && idle < 10) {
+        if(dax_event_wait(ds, 100, NULL) == ERR_TIMEOUT) {
+            if(_writer_done) idle++;
+        }
+    }
+    dax_disconnect(ds);
+    dax_free(ds);
+    return NULL;
+}
+
+static int
+_bench_events(dax_state *ds)
+{
+    pthread_t *threads;
+    long *counts;
+    bench_result *r;
+    tag_handle h;
+    dax_dint value;
+    uint64_t start;
+    int n;
+
+    if(dax_tag_add(ds, &h, "bench_event", DAX_DINT, 1, 0)) return -1;
+    threads = calloc(_opt.fanout, sizeof(pthread_t));
+    counts = calloc(_opt.fanout, sizeof(long));
+    pthread_barrier_init(&_event_barrier, NULL, _opt.fanout + 1);
+    _writer_done = 0;
+    for(n = 0; n < _opt.fanout; n++) {
+        pthread_create(&threads[n], NULL, _event_thread, &counts[n]);
+    }
+    pthread_barrier_wait(&_event_barrier);
+    r = _new_result("events", _opt.ops);
+    start = _now_usec();
+    for(n = 0; n < _opt.ops; n++) {
+        uint64_t s = _now_usec();
+        value = n;
+        _record(r, s, dax_tag_write(ds, h, &value));
+    }
+    _writer_done = 1;
+    for(n = 0; n < _opt.fanout; n++) {
+        pthread_join(threads[n], NULL);
+        if(counts[n] < 0) {
+            r->errors++;
+        } else {
+            r->events += counts[n];
+        }
+    }
+    r->seconds = (_now_usec() - start) / 1e6;
+    pthread_barrier_destroy(&_event_barrier);
+    free(threads);
+    free(counts);
+    return 0;
+}
+
+/* mapping workload */
+
+static int
+_bench_mapping(dax_state *ds)
+{
+    tag_handle *h;
+    bench_result *r;
+    char name[DAX_TAGNAME_SIZE + 1];
+    dax_id id;
+    dax_dint value;
+    uint64_t start;
+    int n;
+
+    h = malloc(sizeof(tag_handle) * (_opt.chain + 1));
+    for(n = 0; n <= _opt.chain; n++) {
+        snprintf(name, sizeof(name), "bench_map%d", n);
+        if(dax_tag_add(ds, &h[n], name, DAX_DINT, 1, 0)) return -1;
+        if(n > 0 && dax_map_add(ds, &h[n - 1], &h[n], &id)) return -1;
+    }
+    r = _new_result("mapping", _opt.ops);
+    start = _now_usec();
+    for(n = 0; n < _opt.ops; n++) {
+        uint64_t s = _now_usec();
+        value = n;
+        _record(r, s, dax_tag_write(ds, h[0], &value));
+    }
+    r->seconds = (_now_usec() - start) / 1e6;
+    /* Make sure that the data made it all the way down the chain */
+    if(dax_tag_read(ds, h[_opt.chain], &value) || value != _opt.ops - 1) r->errors++;
+    free(h);
+    return 0;
+}
+
+/* group workload */
+
+static int
+_bench_group(dax_state *ds)
+{
+    tag_handle *h;
+    tag_group_id *id;
+    bench_result *r;
+    char name[DAX_TAGNAME_SIZE + 1];
+    uint8_t *buff;
+    uint64_t start;
+    int n, result, size;
+
+    h = malloc(sizeof(tag_handle) * _opt.group);
+    for(n = 0; n < _opt.group; n++) {
+        snprintf(name, sizeof(name), "bench_grp%d", n);
+        if(dax_tag_add(ds, &h[n], name, DAX_DINT, 1, 0)) return -1;
+    }
+    id = dax_group_add(ds, &result, h, _opt.group, 0);
+    if(id == NULL) return result;
+    size = dax_group_get_size(id);
+    buff = calloc(1, size);
+    r = _new_result("group", _opt.ops);
+    start = _now_usec();
+    for(n = 0; n < _opt.ops; n++) {
+        uint64_t s = _now_usec();
+        if(n % 2) {
+            result = dax_group_read(ds, id, buff, size);
+        } else {
+            buff[0] = n;
+            result = dax_group_write(ds, id, buff);
+        }
+        _record(r, s, result);
+    }
+    r->seconds = (_now_usec() - start) / 1e6;
+    dax_group_del(ds, id);
+    free(buff);
+    free(h);
+    return 0;
+}
+
+/* retain workload */
+
+static int
+_bench_retain(dax_state *ds)
+{
+    tag_handle h;
+    bench_result *r;
+    dax_dint value;
+    uint64_t start;
+    int n;
+
+    if(dax_tag_add(ds, &h, "bench_retain", DAX_DINT, 1, TAG_ATTR_RETAIN)) return -1;
+    r = _new_result("retain", _opt.ops);
+    start = _now_usec();
+    for(n = 0; n < _opt.ops; n++) {
+        uint64_t s = _now_usec();
+        value = n;
+        _record(r, s, dax_tag_write(ds, h, &value));
+    }
+    r->seconds = (_now_usec() - start) / 1e6;
+    return 0;
+}
+
+/* Reporting */
+
+static int
+_compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t
+_percentile(bench_result *r, int percent)
+{
+    int n;
+
+    if(r->ops == 0) return 0;
+    n = ((long)r->ops * percent + 99) / 100 - 1;
+    if(n < 0) n = 0;
+    return r->lat[n];
+}
+
+static void
+_report(FILE *fd)
+{
+    bench_result *r;
+    int n;
+
+    fprintf(fd, "{\n  \"version\": \"%s\",\n", VERSION);
+    fprintf(fd, "  \"config\": {\"clients\": %d, \"tags\": %d, \"ops\": %d, "
+                "\"read\": %d, \"write\": %d, \"mask\": %d, \"fanout\": %d, "
+                "\"chain\": %d, \"group\": %d},\n",
+            _opt.clients, _opt.tags, _opt.ops, _opt.read, _opt.write, _opt.mask,
+            _opt.fanout, _opt.chain, _opt.group);
+    fprintf(fd, "  \"results\": [\n");
+    for(n = 0; n < _result_count; n++) {
+        r = &_results[n];
+        qsort(r->lat, r->ops, sizeof(uint32_t), _compare);
+        fprintf(fd, "    {\"name\": \"%s\", \"ops\": %d, \"errors\": %d, \"seconds\": %.6f, "
+                    "\"ops_per_sec\": %.1f, ",
+                r->name, r->ops, r->errors, r->seconds,
+                r->seconds > 0 ? r->ops / r->seconds : 0.0);
+        if(strcmp(r->name, "events") == 0) {
+            fprintf(fd, "\"events\": %ld, \"events_per_sec\": %.1f, ", r->events,
+                    r->seconds > 0 ? r->events / r->seconds : 0.0);
+        }
+        fprintf(fd, "\"latency_us\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}}%s\n",
+                _percentile(r, 50), _percentile(r, 90), _percentile(r, 99),
+                _percentile(r, 100), n < _result_count - 1 ? "," : "");
+    }
+    fprintf(fd, "  ]\n}\n");
+}
+
+static void
+_usage(const char *name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  -c, --clients N     Number of readwrite clients (%d)\n", _opt.clients);
+    printf("  -t, --tags N        Number of readwrite tags (%d)\n", _opt.tags);
+    printf("  -n, --ops N         Operations per client and workload (%d)\n", _opt.ops);
+    printf("  -m, --mix R:W:M     Read, write and mask percentages (%d:%d:%d)\n", _opt.read, _opt.write, _opt.mask);
+    printf("  -f, --fanout N      Number of event subscribers (%d)\n", _opt.fanout);
+    printf("  -l, --chain N       Length of the mapping chain (%d)\n", _opt.chain);
+    printf("  -g, --group N       Number of tags in the group (%d)\n", _opt.group);
+    printf("  -s, --server PATH   Path to the tagserver executable\n");
+    printf("  -x, --no-server     Use a tag server that is already running\n");
+    printf("  -o, --output FILE   Write the JSON report to FILE instead of stdout\n");
+    printf("  -q, --quick         Small workload that is used as a smoke test\n");
+}
+
+static void
+_parse_args(int argc, char *argv[])
+{
+    int c;
+    static struct option options[] = {
+        {"clients", required_argument, 0, 'c'},
+        {"tags", required_argument, 0, 't'},
+        {"ops", required_argument, 0, 'n'},
+        {"mix", required_argument, 0, 'm'},
+        {"fanout", required_argument, 0, 'f'},
+        {"chain", required_argument, 0, 'l'},
+        {"group", required_argument, 0, 'g'},
+        {"server", required_argument, 0, 's'},
+        {"no-server", no_argument, 0, 'x'},
+        {"output", required_argument, 0, 'o'},
+        {"quick", no_argument, 0, 'q'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    while((c = getopt_long(argc, argv, "c:t:n:m:f:l:g:s:xo:qh", options, NULL)) != -1) {
+        switch(c) {
+            case 'c': _opt.clients = atoi(optarg); break;
+            case 't': _opt.tags = atoi(optarg); break;
+            case 'n': _opt.ops = atoi(optarg); break;
+            case 'm':
+                if(sscanf(optarg, "%d:%d:%d", &_opt.read, &_opt.write, &_opt.mask) != 3 ||
+                   _opt.read + _opt.write + _opt.mask != 100) {
+                    fprintf(stderr, "The mix must be three percentages that add up to 100\n");
+                    exit(-1);
+                }
+                break;
+            case 'f': _opt.fanout = atoi(optarg); break;
+            case 'l': _opt.chain = atoi(optarg); break;
+            case 'g': _opt.group = atoi(optarg); break;
+            case 's': _opt.server = optarg; break;
+            case 'x': _opt.noserver = 1; break;
+            case 'o': _opt.outfile = optarg; break;
+            case 'q':
+                _opt.clients = 2;
+                _opt.tags = 10;
+                _opt.ops = 200;
+                _opt.fanout = 2;
+                _opt.chain = 4;
+                _opt.group = 4;
+                break;
+            case 'h':
+                _usage(argv[0]);
+                exit(0);
+            default:
+                _usage(argv[0]);
+                exit(-1);
+        }
+    }
+    if(_opt.clients < 1 || _opt.tags < 1 || _opt.ops < 1 || _opt.fanout < 1 ||
+       _opt.chain < 1 || _opt.group < 1 || _opt.group > TAG_GROUP_MAX_MEMBERS) {
+        fprintf(stderr, "Bad arguments\n");
+        exit(-1);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    dax_state *ds = NULL;
+    pid_t pid = 0;
+    FILE *out = stdout;
+    int n, status, errors = 0;
+
+    _parse_args(argc, argv);
+    if(!_opt.noserver) {
+        if(_opt.server == NULL) _opt.server = BUILD_DIR "/src/server/tagserver";
+        pid = fork();
+        if(pid == 0) {
+            execl(_opt.server, _opt.server, NULL);
+            fprintf(stderr, "Failed to launch tagserver %s\n", _opt.server);
+            exit(-1);
+        } else if(pid < 0) {
+            exit(-1);
+        }
+    }
+    /* Give the server a chance to start */
+    for(n = 0; n < 50 && ds == NULL; n++) {
+        ds = _connect("dax_bench");
+        if(ds == NULL) usleep(20000);
+    }
+    if(ds == NULL) {
+        fprintf(stderr, "Unable to connect to the tag server\n");
+        errors++;
+    } else {
+        if(_bench_readwrite(ds)) errors++;
+        if(_bench_events(ds)) errors++;
+        if(_bench_mapping(ds)) errors++;
+        if(_bench_group(ds)) errors++;
+        if(_bench_retain(ds)) errors++;
+        dax_disconnect(ds);
+    }
+    if(pid > 0) {
+        kill(pid, SIGINT);
+        waitpid(pid, &status, 0);
+        unlink("retentive.db");
+    }
+    if(_opt.outfile) {
+        out = fopen(_opt.outfile, "w");
+        if(out == NULL) {
+            fprintf(stderr, "Unable to open %s\n", _opt.outfile);
+            return -1;
+        }
+    }
+    _report(out);
+    if(out != stdout) fclose(out);
+    for(n = 0; n < _result_count; n++) {
+        if(_results[n].errors) errors++;
+        free(_results[n].lat);
+    }
+    return errors ? -1 : 0;
+}
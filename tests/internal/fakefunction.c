@@ -25,3 +25,8 @@ dax_module *
 module_find_fd(int fd) {
     return NULL;
 }
+
+void
+module_stats_update(float elapsed) {
+    return;
+}
@@ -25,6 +25,8 @@
 #include "daxtypes.h"
 #include "groups.h"
 #include "libcommon.h"
+#include "tagbase.h"
+#include <sys/socket.h>
 
 
 
@@ -97,10 +99,68 @@ _test_group_size(void) {
     groups_cleanup(&mod);
 }
 
+/* Packs a handle for one group member the way the message does */
+static void
+_pack_member(uint8_t *buff, tag_index idx, uint32_t size) {
+    uint32_t zero = 0, type = DAX_BYTE;
+
+    memcpy(&buff[0], &idx, 4);
+    memcpy(&buff[4], &zero, 4);
+    buff[8] = 0;
+    memcpy(&buff[9], &size, 4);
+    memcpy(&buff[13], &size, 4);
+    memcpy(&buff[17], &type, 4);
+}
+
+/* A group that fills a whole group read message is too big to be pushed
+ * with the index and the event id in front of it.  The biggest group that
+ * can be pushed should come out as a single full size message. */
+static void
+_test_group_subscribe_max(void) {
+    dax_module mod;
+    uint8_t handle[21];
+    uint8_t buff[DAX_MSGMAX + 16];
+    uint8_t data[MSG_GROUP_EVENT_DATA_SIZE];
+    tag_index idx;
+    int index, sv[2];
+    ssize_t len;
+    uint32_t size;
+
+    memset(&mod, 0, sizeof(mod));
+    mod.name = "test";
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    mod.fd = sv[0];
+    initialize_tagbase();
+    idx = tag_add(-1, "group_big", DAX_BYTE, MSG_TAG_GROUP_DATA_SIZE, 0);
+    assert(idx > 0);
+
+    _pack_member(handle, idx, MSG_TAG_GROUP_DATA_SIZE);
+    index = group_add(&mod, handle, 1);
+    assert(index >= 0);
+    assert(group_subscribe(&mod, index, GRP_SUB_ENABLE, 0) == ERR_2BIG);
+
+    _pack_member(handle, idx, MSG_GROUP_EVENT_DATA_SIZE);
+    index = group_add(&mod, handle, 1);
+    assert(index >= 0);
+    assert(group_subscribe(&mod, index, GRP_SUB_ENABLE, 0) == 0);
+    memset(data, 0x5A, sizeof(data));
+    assert(tag_write(-1, idx, 0, data, sizeof(data)) == 0);
+    len = recv(sv[1], buff, sizeof(buff), MSG_DONTWAIT);
+    assert(len == DAX_MSGMAX);
+    memcpy(&size, buff, 4);
+    assert(ntohl(size) + MSG_HDR_SIZE == DAX_MSGMAX);
+    assert(memcmp(&buff[16], data, sizeof(data)) == 0);
+
+    groups_cleanup(&mod);
+    close(sv[0]);
+    close(sv[1]);
+}
+
 int
 main(int argc, char *argv[]) {
     _test_simple();
     _test_group_array_growth();
     _test_group_size();
+    _test_group_subscribe_max();
     exit(0);
 }
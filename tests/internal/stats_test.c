@@ -0,0 +1,99 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Test for the server performance statistics
+ */
+/* This test records some messages and makes sure that the rates and the
+ * latency percentiles show up in the _stats tag when it is published.
+ * It also checks that the server can write the statistics into a module
+ * tag without opening the module tag up to everybody else.
+ */
+
+#include <common.h>
+#include <assert.h>
+#include "tagbase.h"
+#include "stats.h"
+#include "libcommon.h"
+
+/* Offsets of the members in the _stats tag */
+#define OFF_BYTES_IN  0
+#define OFF_SENT      16
+#define OFF_RATE      36
+#define OFF_P50       (OFF_RATE + (NUM_COMMANDS + 1) * 4)
+#define OFF_P99       (OFF_P50 + (NUM_COMMANDS + 1) * 4)
+
+int
+main(int argc, char *argv[]) {
+    dax_tag tag;
+    uint8_t buff[1024];
+    uint64_t bytes;
+    uint32_t p50, p99, count;
+    float rate;
+    int n;
+
+    initialize_tagbase();
+    stats_init();
+    assert(tag_get_name("_stats", &tag) == 0);
+    assert(type_size(tag.type) <= sizeof(buff));
+
+    for(n = 1; n <= 1000; n++) {
+        stats_message(5, MSG_TAG_READ, n);
+    }
+    stats_message(5, MSG_TAG_WRITE, 70000);
+    stats_bytes_in(100);
+    stats_bytes_in(28);
+    stats_event_sent();
+    assert(stats_fd_requests(5) == 1001);
+    assert(stats_fd_requests(5) == 0);
+
+    /* Nothing is written until the timer fires */
+    assert(tag_read(-1, tag.idx, 0, buff, type_size(tag.type)) == 0);
+    memcpy(&bytes, &buff[OFF_BYTES_IN], 8);
+    assert(bytes == 0);
+
+    timer_run(xmonotime() + STATS_INTERVAL + TIMER_TICK * 2);
+    assert(tag_read(-1, tag.idx, 0, buff, type_size(tag.type)) == 0);
+    memcpy(&bytes, &buff[OFF_BYTES_IN], 8);
+    assert(bytes == 128);
+    memcpy(&count, &buff[OFF_SENT], 4);
+    assert(count == 1);
+    memcpy(&rate, &buff[OFF_RATE + MSG_TAG_READ * 4], 4);
+    assert(rate > 0.0);
+    /* The histogram is accurate to 12.5% */
+    memcpy(&p50, &buff[OFF_P50 + MSG_TAG_READ * 4], 4);
+    memcpy(&p99, &buff[OFF_P99 + MSG_TAG_READ * 4], 4);
+    assert(p50 >= 500 * 7 / 8 && p50 <= 500);
+    assert(p99 >= 990 * 7 / 8 && p99 <= 990);
+    memcpy(&p99, &buff[OFF_P99 + MSG_TAG_WRITE * 4], 4);
+    assert(p99 >= 70000 * 7 / 8 && p99 <= 70000);
+    memcpy(&p50, &buff[OFF_P50 + MSG_TAG_GET * 4], 4);
+    assert(p50 == 0);
+
+    /* Writes that don't come from a module, like mappings, can't get past
+     * the module tag protection but the server's own statistics can */
+    n = tag_add(-1, "_mtest", cdt_get_type("_module"), 1, 0);
+    assert(n > 0);
+    tag_set_attribute(n, TAG_ATTR_SPECIAL);
+    rate = 12.5;
+    assert(tag_write(-1, n, MOD_STAT_REQUESTS_OFFSET, &rate, sizeof(float)) != 0);
+    assert(tag_server_write(n, MOD_STAT_REQUESTS_OFFSET, &rate, sizeof(float)) == 0);
+    rate = 0.0;
+    assert(tag_read(-1, n, MOD_STAT_REQUESTS_OFFSET, &rate, sizeof(float)) == 0);
+    assert(rate == 12.5);
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Microbenchmarks for the tagbase primitives.  This links directly to the
+ * server sources so that the cost of the algorithms can be measured
+ * without any of the socket overhead.  Each benchmark prints the number
+ * of operations and the average time per operation in nanoseconds.
+ *
+ * Run with -q to use small sizes.  That is what the test suite does
+ * just to make sure this still builds and runs.
+ */
+
+#include <tagbase.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <opendax.h>
+
+static int _quick;
+static dax_module _mod;
+
+static inline uint64_t
+_now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+_report(const char *name, long ops, uint64_t start)
+{
+    uint64_t elapsed = _now_nsec() - start;
+
+    printf("%-32s %10ld ops %12.1f ns/op\n", name, ops, (double)elapsed / ops);
+}
+
+/* Build a handle for the whole tag or a single bit of a BOOL tag */
+static tag_handle
+_handle(tag_index idx, tag_type type, int count, int bit)
+{
+    tag_handle h;
+
+    h.index = idx;
+    h.type = type;
+    if(type == DAX_BOOL && bit >= 0) {
+        h.byte = bit / 8;
+        h.bit = bit % 8;
+        h.count = 1;
+        h.size = 1;
+    } else {
+        h.byte = 0;
+        h.bit = 0;
+        h.count = count;
+        h.size = type_size(type) * count;
+    }
+    return h;
+}
+
+/* Adds 'count' tags and then looks every one of them up by name */
+static void
+_bench_add_and_find(long count)
+{
+    char tagname[DAX_TAGNAME_SIZE + 1];
+    char label[64];
+    dax_tag tag;
+    uint64_t start;
+    long n;
+
+    start = _now_nsec();
+    for(n = 0; n < count; n++) {
+        sprintf(tagname, "Add%ld_%ld", count, n);
+        assert(tag_add(-1, tagname, DAX_DINT, 1, 0) > 0);
+    }
+    snprintf(label, sizeof(label), "tag_add (%ld tags)", count);
+    _report(label, count, start);
+
+    start = _now_nsec();
+    for(n = 0; n < count; n++) {
+        /* Visit the tags out of order so that the cache doesn't help too much */
+        sprintf(tagname, "Add%ld_%ld", count, (n * 7919) % count);
+        assert(tag_get_name(tagname, &tag) == 0);
+    }
+    snprintf(label, sizeof(label), "tag_get_name (%ld tags)", count);
+    _report(label, count, start);
+}
+
+/* Writes to a tag that has 'events' write events attached */
+static void
+_bench_write_events(int events, long ops)
+{
+    char tagname[DAX_TAGNAME_SIZE + 1];
+    char label[64];
+    tag_index idx;
+    dax_dint value;
+    uint64_t start;
+    long n;
+
+    sprintf(tagname, "Events%d", events);
+    idx = tag_add(-1, tagname, DAX_DINT, 1, 0);
+    assert(idx > 0);
+    for(n = 0; n < events; n++) {
+        assert(event_add(_handle(idx, DAX_DINT, 1, -1), EVENT_WRITE, NULL, &_mod) >= 0);
+    }
+    start = _now_nsec();
+    for(n = 0; n < ops; n++) {
+        value = n;
+        tag_write(-1, idx, 0, &value, sizeof(value));
+    }
+    snprintf(label, sizeof(label), "tag_write (%d events)", events);
+    _report(label, ops, start);
+}
+
+/* A BOOL array with a change event on every bit.  Each write toggles a
+ * single bit so only one of the events should fire. */
+static void
+_bench_bool_change(int bits, long ops)
+{
+    char label[64];
+    tag_index idx;
+    uint8_t *data;
+    uint64_t start;
+    long n;
+    int size = (bits + 7) / 8;
+
+    idx = tag_add(-1, "BoolChange", DAX_BOOL, bits, 0);
+    assert(idx > 0);
+    for(n = 0; n < bits; n++) {
+        assert(event_add(_handle(idx, DAX_BOOL, 1, n), EVENT_CHANGE, NULL, &_mod) >= 0);
+    }
+    data = calloc(1, size);
+    start = _now_nsec();
+    for(n = 0; n < ops; n++) {
+        data[(n % bits) / 8] ^= 0x01 << (n % 8);
+        tag_write(-1, idx, 0, data, size);
+    }
+    snprintf(label, sizeof(label), "BOOL change (%d bits)", bits);
+    _report(label, ops, start);
+    free(data);
+}
+
+/* One source tag mapped to 'fanout' destination tags */
+static void
+_bench_map_fanout(int fanout, long ops)
+{
+    char tagname[DAX_TAGNAME_SIZE + 1];
+    char label[64];
+    tag_index src, dest;
+    dax_dint value;
+    uint64_t start;
+    long n;
+
+    sprintf(tagname, "MapSrc%d", fanout);
+    src = tag_add(-1, tagname, DAX_DINT, 1, 0);
+    assert(src > 0);
+    for(n = 0; n < fanout; n++) {
+        sprintf(tagname, "MapDest%d_%ld", fanout, n);
+        dest = tag_add(-1, tagname, DAX_DINT, 1, 0);
+        assert(dest > 0);
+        assert(map_add(_handle(src, DAX_DINT, 1, -1), _handle(dest, DAX_DINT, 1, -1)) >= 0);
+    }
+    start = _now_nsec();
+    for(n = 0; n < ops; n++) {
+        value = n;
+        tag_write(-1, src, 0, &value, sizeof(value));
+        map_check(src, 0, sizeof(value));
+    }
+    snprintf(label, sizeof(label), "map_check (fanout %d)", fanout);
+    _report(label, ops, start);
+    /* The last one should have gotten the last value */
+    tag_read(-1, dest, 0, &value, sizeof(value));
+    assert(value == ops - 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    long ops;
+
+    if(argc > 1 && strcmp(argv[1], "-q") == 0) _quick = 1;
+    ops = _quick ? 1000 : 100000;
+
+    /* Only errors, logging every new tag would swamp the results */
+    dax_init_logger("tagbase_bench", DAX_LOG_ERROR);
+    initialize_tagbase();
+    /* Events are written to this module.  We send them to /dev/null so that
+     * the write() is still counted but nobody has to read them. */
+    memset(&_mod, 0, sizeof(_mod));
+    _mod.name = "bench";
+    _mod.fd = open("/dev/null", O_WRONLY);
+    assert(_mod.fd >= 0);
+
+    _bench_add_and_find(1000);
+    if(! _quick) {
+        _bench_add_and_find(100000);
+        _bench_add_and_find(1000000);
+    }
+    _bench_write_events(0, ops);
+    _bench_write_events(10, ops);
+    _bench_write_events(1000, _quick ? 100 : ops / 10);
+    _bench_bool_change(_quick ? 64 : 1024, ops);
+    _bench_map_fanout(1, ops);
+    _bench_map_fanout(10, ops);
+    _bench_map_fanout(100, _quick ? 100 : ops / 10);
+
+    close(_mod.fd);
+    return 0;
+}
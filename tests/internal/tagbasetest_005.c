@@ -0,0 +1,72 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Main source code file for the OpenDAX Bad Module
+ */
+/* Range checks of tag_multi_write().  An offset and size that add up to
+ * more than will fit in an int must not get past the check.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <opendax.h>
+#include <tagbase.h>
+
+int
+main(int argc, char *argv[])
+{
+    tag_write_item items[2];
+    dax_dint data[4] = {1, 2, 3, 4};
+    dax_dint temp[4];
+    int idx;
+
+    initialize_tagbase();
+    dax_log_set_default_mask(DAX_LOG_ALL);
+    idx = tag_add(-1, "multi_test", DAX_DINT, 4, 0);
+    if(idx < 0) exit(-1);
+
+    items[0].idx = idx;
+    items[0].offset = 0;
+    items[0].size = sizeof(data);
+    items[0].data = data;
+    items[0].mask = NULL;
+    assert(tag_multi_write(-1, items, 1) == 0);
+
+    /* The sum of these wraps around to a negative number */
+    items[1].idx = idx;
+    items[1].offset = 8;
+    items[1].size = INT_MAX;
+    items[1].data = data;
+    items[1].mask = NULL;
+    assert(tag_multi_write(-1, items, 2) == ERR_2BIG);
+    items[1].offset = INT_MAX;
+    items[1].size = 8;
+    assert(tag_multi_write(-1, items, 2) == ERR_2BIG);
+    /* One byte past the end */
+    items[1].offset = 8;
+    items[1].size = 9;
+    assert(tag_multi_write(-1, items, 2) == ERR_2BIG);
+    /* Right up to the end is fine */
+    items[1].size = 8;
+    assert(tag_multi_write(-1, items, 2) == 0);
+
+    assert(tag_read(-1, idx, 0, temp, sizeof(temp)) == 0);
+    assert(temp[0] == 1 && temp[1] == 2 && temp[2] == 1 && temp[3] == 2);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/* The EVENT_OPT_SEND_TIME option turns on the TAG_ATTR_TIMESTAMP attribute
+ * for the tag.  It should be turned back off when the last event that
+ * needs it goes away but not if the tag was created with it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <opendax.h>
+#include <tagbase.h>
+
+static int
+_has_stamp(int idx)
+{
+    dax_tag tag;
+
+    assert(tag_get_index(idx, &tag) == 0);
+    if(tag.attr & TAG_ATTR_TIMESTAMP) {
+        assert(tag_get_stamp(idx) != NULL);
+        return 1;
+    }
+    assert(tag_get_stamp(idx) == NULL);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    dax_module module;
+    tag_handle h;
+    int idx, id1, id2;
+
+    initialize_tagbase();
+    dax_log_set_default_mask(DAX_LOG_ALL);
+    memset(&module, 0, sizeof(module));
+
+    idx = tag_add(-1, "stamp_test", DAX_DINT, 1, 0);
+    if(idx < 0) exit(-1);
+    h.index = idx;
+    h.byte = 0;
+    h.bit = 0;
+    h.count = 1;
+    h.size = sizeof(dax_dint);
+    h.type = DAX_DINT;
+
+    id1 = event_add(h, EVENT_WRITE, NULL, &module);
+    id2 = event_add(h, EVENT_WRITE, NULL, &module);
+    assert(id1 >= 0 && id2 >= 0);
+    assert(_has_stamp(idx) == 0);
+
+    /* Setting the option twice on the same event only counts once */
+    assert(event_opt(idx, id1, EVENT_OPT_SEND_TIME, &module) == 0);
+    assert(event_opt(idx, id1, EVENT_OPT_SEND_TIME | EVENT_OPT_SEND_DATA, &module) == 0);
+    assert(event_opt(idx, id2, EVENT_OPT_SEND_TIME, &module) == 0);
+    assert(_has_stamp(idx) == 1);
+    assert(event_del(idx, id1, &module) == 0);
+    assert(_has_stamp(idx) == 1);
+    /* Clearing the option lets go of it too */
+    assert(event_opt(idx, id2, 0, &module) == 0);
+    assert(_has_stamp(idx) == 0);
+    assert(event_opt(idx, id2, EVENT_OPT_SEND_TIME, &module) == 0);
+    assert(_has_stamp(idx) == 1);
+    assert(event_del(idx, id2, &module) == 0);
+    assert(_has_stamp(idx) == 0);
+
+    /* A tag that asked for the stamps itself keeps them */
+    idx = tag_add(-1, "stamp_keep", DAX_DINT, 1, TAG_ATTR_TIMESTAMP);
+    if(idx < 0) exit(-1);
+    h.index = idx;
+    id1 = event_add(h, EVENT_WRITE, NULL, &module);
+    assert(id1 >= 0);
+    assert(event_opt(idx, id1, EVENT_OPT_SEND_TIME, &module) == 0);
+    assert(event_del(idx, id1, &module) == 0);
+    assert(_has_stamp(idx) == 1);
+
+    return 0;
+}
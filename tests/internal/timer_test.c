@@ -0,0 +1,96 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  Test for the server timer wheel
+ */
+/* This test makes sure that the timer wheel fires timers in order, at
+ * the right time and handles timers that are more than one trip around
+ * the wheel away.
+ */
+
+#include <common.h>
+#include <assert.h>
+#include "timer.h"
+
+static int fired[4];
+
+static void
+_callback(void *udata) {
+    fired[(long)udata]++;
+}
+
+int
+main(int argc, char *argv[]) {
+    dax_timer t[4];
+    time_t now = 100000;
+    int n, result;
+
+    for(n = 0; n < 4; n++) {
+        timer_init(&t[n], _callback, (void *)(long)n);
+    }
+    /* Nothing armed */
+    assert(timer_run(now) == -1);
+
+    timer_start(&t[0], now + 50);
+    timer_start(&t[1], now + 20);
+    /* Further out than one trip around the wheel */
+    timer_start(&t[2], now + TIMER_TICK * TIMER_WHEEL_SLOTS * 3 + 5);
+    timer_start(&t[3], now + 30);
+    timer_stop(&t[3]);
+
+    result = timer_run(now);
+    assert(result >= 0 && result <= 20);
+    assert(fired[0] == 0 && fired[1] == 0);
+
+    now += 25;
+    timer_run(now);
+    assert(fired[1] == 1 && fired[0] == 0);
+
+    now += 30;
+    timer_run(now);
+    assert(fired[0] == 1 && fired[1] == 1);
+    assert(fired[3] == 0); /* This one was stopped */
+
+    /* Go around the wheel a couple of times */
+    for(n = 0; n < TIMER_WHEEL_SLOTS * 2; n++) {
+        now += TIMER_TICK;
+        timer_run(now);
+    }
+    assert(fired[2] == 0);
+    now += TIMER_TICK * TIMER_WHEEL_SLOTS;
+    timer_run(now);
+    assert(fired[2] == 1);
+
+    /* Restarting moves the timer */
+    timer_start(&t[0], now + 500);
+    timer_start(&t[0], now + 10);
+    now += 20;
+    timer_run(now);
+    assert(fired[0] == 2);
+    now += 1000;
+    assert(timer_run(now) == -1);
+    assert(fired[0] == 2);
+
+    /* A long sleep should still fire everything that is due */
+    timer_start(&t[1], now + 100);
+    timer_start(&t[3], now + 200);
+    now += TIMER_TICK * TIMER_WHEEL_SLOTS * 10;
+    assert(timer_run(now) == -1);
+    assert(fired[1] == 2 && fired[3] == 1);
+
+    exit(0);
+}
@@ -0,0 +1,103 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test sends atomic operations with handles that don't fit the tag
+ *  and makes sure the server refuses them without touching the data.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result = 0;
+    tag_handle h, bad;
+    dax_byte data[2], old[2];
+    dax_atomic ops[2];
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) {
+        return -1;
+    }
+    result = dax_tag_add(ds, &h, "Bits", DAX_BOOL, 10, 0);
+    if(result) return -1;
+    data[0] = 0xFF; data[1] = 0xFF;
+
+    /* Far more bits than the tag or the message has */
+    bad = h;
+    bad.count = 0x7FFFFFFF;
+    result = dax_atomic_op(ds, bad, data, ATOMIC_OP_OR);
+    if(result == 0) return -1;
+    /* No items at all */
+    bad.count = 0;
+    result = dax_atomic_op(ds, bad, data, ATOMIC_OP_OR);
+    if(result == 0) return -1;
+    /* The bit offset has to be inside the first byte */
+    bad = h;
+    bad.count = 1;
+    bad.bit = 12;
+    result = dax_atomic_op(ds, bad, data, ATOMIC_OP_OR);
+    if(result == 0) return -1;
+    /* Runs off the end of the tag */
+    bad = h;
+    bad.byte = 1;
+    bad.bit = 4;
+    result = dax_atomic_op(ds, bad, data, ATOMIC_OP_OR);
+    if(result == 0) return -1;
+
+    /* A bad handle in a batch fails on its own */
+    bad = h;
+    bad.count = 0x7FFFFFFF;
+    ops[0].h = bad; ops[0].operation = ATOMIC_OP_OR;
+    ops[0].data = data; ops[0].old = NULL;
+    ops[1].h = h; ops[1].operation = ATOMIC_OP_OR | ATOMIC_OP_FETCH;
+    ops[1].data = data; ops[1].old = old;
+    result = dax_atomic_batch(ds, ops, 2);
+    if(result) return result;
+    if(ops[0].result == 0) return -1;
+    if(ops[1].result != 0 || old[0] != 0 || old[1] != 0) return -1;
+
+    result = dax_read_tag(ds, h, data);
+    if(result || data[0] != 0xFF || (data[1] & 0x03) != 0x03) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
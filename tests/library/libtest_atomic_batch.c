@@ -0,0 +1,93 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test sends a list of atomic operations in a single batch message
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result = 0;
+    tag_handle h1, h2;
+    dax_dint temp, inc, cas[2], old[3];
+    dax_atomic ops[4];
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) {
+        return -1;
+    }
+    result = dax_tag_add(ds, &h1, "Counter", DAX_DINT, 1, 0);
+    if(result) return -1;
+    result = dax_tag_add(ds, &h2, "Lock", DAX_DINT, 1, 0);
+    if(result) return -1;
+    temp = 10;
+    result = dax_write_tag(ds, h1, &temp);
+    if(result) return -1;
+
+    inc = 5;
+    cas[0] = 0; cas[1] = 1; /* Take the lock if it's free */
+    ops[0].h = h1; ops[0].operation = ATOMIC_OP_INC | ATOMIC_OP_FETCH;
+    ops[0].data = &inc; ops[0].old = &old[0];
+    ops[1].h = h2; ops[1].operation = ATOMIC_OP_CAS;
+    ops[1].data = cas; ops[1].old = &old[1];
+    /* The lock is taken now so this one should fail */
+    ops[2].h = h2; ops[2].operation = ATOMIC_OP_CAS;
+    ops[2].data = cas; ops[2].old = &old[2];
+    ops[3].h = h1; ops[3].operation = ATOMIC_OP_DEC;
+    ops[3].data = &inc; ops[3].old = NULL;
+
+    result = dax_atomic_batch(ds, ops, 4);
+    if(result) return result;
+    if(ops[0].result != 0 || old[0] != 10) return -1;
+    if(ops[1].result != 0 || old[1] != 0) return -1;
+    if(ops[2].result != ERR_INUSE || old[2] != 1) return -1;
+    if(ops[3].result != 0) return -1;
+
+    result = dax_read_tag(ds, h1, &temp);
+    if(result || temp != 10) return -1;
+    result = dax_read_tag(ds, h2, &temp);
+    if(result || temp != 1) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
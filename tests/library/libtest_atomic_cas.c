@@ -0,0 +1,115 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test checks the compare and swap and the fetch variants of the
+ *  atomic operations
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result = 0;
+    tag_handle h, hb;
+    dax_dint temp, expect, new, old;
+    dax_byte bexpect[2], bnew[2], bold[2], bits[2];
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) {
+        return -1;
+    }
+    result = dax_tag_add(ds, &h, "Test1", DAX_DINT, 1, 0);
+    if(result) return -1;
+    temp = 12;
+    result = dax_write_tag(ds, h, &temp);
+    if(result) return -1;
+
+    /* Fetch and increment should give us the value before the increment */
+    temp = 2;
+    result = dax_atomic_fetch_op(ds, h, &temp, ATOMIC_OP_INC, &old);
+    if(result) return -1;
+    if(old != 12) return -1;
+    result = dax_read_tag(ds, h, &temp);
+    if(result) return -1;
+    if(temp != 14) return -1;
+
+    /* Compare and swap that matches */
+    expect = 14;
+    new = 100;
+    result = dax_atomic_cas(ds, h, &expect, &new, &old);
+    if(result) return -1;
+    if(old != 14) return -1;
+    result = dax_read_tag(ds, h, &temp);
+    if(temp != 100) return -1;
+
+    /* Compare and swap that doesn't match should leave the tag alone */
+    expect = 14;
+    new = 200;
+    result = dax_atomic_cas(ds, h, &expect, &new, &old);
+    if(result != ERR_INUSE) return -1;
+    if(old != 100) return -1;
+    result = dax_read_tag(ds, h, &temp);
+    if(temp != 100) return -1;
+
+    /* BOOL compare and swap on bits that straddle a byte boundary */
+    result = dax_tag_add(ds, &hb, "TestBool", DAX_BOOL, 16, 0);
+    if(result) return -1;
+    bits[0] = 0x40; bits[1] = 0x01; /* Bits 6 and 8 */
+    result = dax_write_tag(ds, hb, bits);
+    if(result) return -1;
+    result = dax_tag_handle(ds, &hb, "TestBool[6]", 3);
+    if(result) return -1;
+    /* The handle spans two bytes so the buffers have to as well */
+    bexpect[0] = 0x05; bexpect[1] = 0x00; /* bits 6,7,8 = 1,0,1 */
+    bnew[0] = 0x02; bnew[1] = 0x00;       /* bits 6,7,8 = 0,1,0 */
+    result = dax_atomic_cas(ds, hb, bexpect, bnew, bold);
+    if(result) return -1;
+    if(bold[0] != 0x05) return -1;
+    result = dax_tag_handle(ds, &hb, "TestBool", 0);
+    if(result) return -1;
+    result = dax_read_tag(ds, hb, bits);
+    if(result) return -1;
+    if(bits[0] != 0x80 || bits[1] != 0x00) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
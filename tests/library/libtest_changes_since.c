@@ -0,0 +1,168 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test writes some tags and then makes sure that the change journal
+ *  returns the right ranges.  Adding and deleting a tag and writing enough
+ *  to overflow the journal should both tell us to resync.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+#define CHANGE_COUNT 64
+
+/* Returns the number of changes that are for the given tag and sets
+ * *last to the last one that was found.  The server writes its own
+ * system tags so there may be other changes in the list. */
+static int
+_find_changes(dax_change *changes, int count, tag_index idx, dax_change **last)
+{
+    int n, found = 0;
+
+    for(n = 0; n < count; n++) {
+        if(changes[n].idx == idx) {
+            *last = &changes[n];
+            found++;
+        }
+    }
+    return found;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result, n, count;
+    tag_handle h_a, h_b, h_c, h_d;
+    dax_change changes[CHANGE_COUNT], *c;
+    dax_dint data[10], mask[10];
+    uint64_t seq, first;
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return -1;
+
+    result = dax_tag_add(ds, &h_a, "ChangeA", DAX_DINT, 10, 0);
+    result += dax_tag_add(ds, &h_b, "ChangeB", DAX_DINT, 10, 0);
+    result += dax_tag_add(ds, &h_c, "ChangeC", DAX_DINT, 10, 0);
+    if(result) return -1;
+
+    /* A new module doesn't know anything so it should be told to resync
+     * and given the current sequence number */
+    seq = 0;
+    count = 0;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result != ERR_OVERFLOW || seq == 0) return -1;
+    first = seq;
+
+    memset(data, 0, sizeof(data));
+    memset(mask, 0xFF, sizeof(mask));
+    /* Two writes to the same range of A should only be one change */
+    result = dax_write(ds, h_a.index, 0, data, 8);
+    result += dax_write(ds, h_a.index, 4, data, 8);
+    result += dax_write(ds, h_b.index, 8, data, 12);
+    result += dax_mask(ds, h_c.index, 20, data, mask, 4);
+    if(result) return -1;
+
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result) return result;
+    if(seq <= first) return -1;
+    if(_find_changes(changes, count, h_a.index, &c) != 1) return -1;
+    if(c->byte != 0 || c->size != 12) return -1;
+    if(_find_changes(changes, count, h_b.index, &c) != 1) return -1;
+    if(c->byte != 8 || c->size != 12) return -1;
+    if(_find_changes(changes, count, h_c.index, &c) != 1) return -1;
+    if(c->byte != 20 || c->size != 4) return -1;
+
+    /* Asking again should give us nothing of ours */
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result) return result;
+    if(_find_changes(changes, count, h_a.index, &c) ||
+       _find_changes(changes, count, h_b.index, &c) ||
+       _find_changes(changes, count, h_c.index, &c)) return -1;
+
+    /* Atomic operations are changes too */
+    h_c.byte = 8;
+    h_c.count = 1;
+    h_c.size = 4;
+    data[0] = 1;
+    result = dax_atomic_op(ds, h_c, data, ATOMIC_OP_INC);
+    if(result) return result;
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result) return result;
+    if(_find_changes(changes, count, h_c.index, &c) != 1) return -1;
+    if(c->byte != 8 || c->size != 4) return -1;
+
+    /* Adding or deleting a tag isn't in the journal so it should tell us
+     * to resync each time */
+    result = dax_tag_add(ds, &h_d, "ChangeD", DAX_DINT, 1, 0);
+    if(result) return result;
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result != ERR_OVERFLOW || count != 0) return -1;
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result) return result;
+    result = dax_tag_del(ds, h_d.index);
+    if(result) return result;
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result != ERR_OVERFLOW || count != 0) return -1;
+    /* After the resync we should get changes again */
+    result = dax_write(ds, h_a.index, 0, data, 4);
+    if(result) return result;
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &seq, changes, &count);
+    if(result) return result;
+    if(_find_changes(changes, count, h_a.index, &c) != 1) return -1;
+
+    /* Alternate between two tags so that nothing is combined and the
+     * journal wraps around past where we started */
+    for(n = 0; n < 5000; n++) {
+        data[0] = n;
+        result = dax_write(ds, n % 2 ? h_a.index : h_b.index, 0, data, 4);
+        if(result) return result;
+    }
+    count = CHANGE_COUNT;
+    result = dax_changes_since(ds, &first, changes, &count);
+    if(result != ERR_OVERFLOW || count != 0) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
@@ -0,0 +1,102 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test sets a minimum interval on a write event with the coalesce
+ *  option and makes sure that a burst of writes only produces one event
+ *  per interval and that the last event carries the latest data.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+static dax_dint validation = 0;
+static int callcount = 0;
+
+void
+test_callback(dax_state *ds, void *udata) {
+    dax_event_get_data(ds, &validation, sizeof(dax_dint));
+    callcount++;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    tag_handle tag;
+    int result = 0;
+    dax_dint x;
+    dax_id id;
+    dax_state *ds;
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) {
+        return -1;
+    }
+    dax_tag_add(ds, &tag, "Dummy", DAX_DINT, 1, 0);
+    result = dax_event_add(ds, &tag, EVENT_WRITE, NULL, &id, test_callback, NULL, NULL);
+    if(result) return result;
+    result = dax_event_options(ds, id, EVENT_OPT_SEND_DATA | EVENT_OPT_COALESCE);
+    if(result) return result;
+    result = dax_event_interval(ds, id, 500);
+    if(result) return result;
+
+    for(x = 1; x <= 100; x++) {
+        result = dax_write_tag(ds, tag, &x);
+        if(result) return result;
+    }
+    /* The first write goes right through */
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(callcount != 1 || validation != 1) return -1;
+    /* The rest should show up as one event at the end of the interval */
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(callcount != 2 || validation != 100) return -1;
+    if(dax_event_poll(ds, NULL) != ERR_NOTFOUND) return -1;
+
+    /* Without the coalesce option the extra events are just dropped */
+    result = dax_event_options(ds, id, EVENT_OPT_SEND_DATA);
+    if(result) return result;
+    for(x = 1; x <= 100; x++) {
+        result = dax_write_tag(ds, tag, &x);
+        if(result) return result;
+    }
+    if(dax_event_wait(ds, 700, NULL) != ERR_TIMEOUT) return -1;
+    if(callcount != 2) return -1;
+
+    dax_disconnect(ds);
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
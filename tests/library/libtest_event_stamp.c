@@ -0,0 +1,153 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test sets the EVENT_OPT_SEND_TIME option on an event and makes sure
+ *  that the time and writer of the write come along with the data.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include "libtest_common.h"
+
+static dax_dint validation = 0;
+static dax_stamp stamp;
+static int stamp_result;
+
+void
+test_callback(dax_state *ds, void *udata) {
+    dax_event_get_data(ds, &validation, sizeof(dax_dint));
+    stamp_result = dax_event_get_stamp(ds, &stamp);
+}
+
+static dax_time
+_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (dax_time)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    tag_handle tag;
+    int result = 0;
+    dax_dint x;
+    dax_id id;
+    tag_group_id *gid;
+    dax_state *ds;
+    dax_tag modtag;
+    char modname[DAX_TAGNAME_SIZE + 1];
+    dax_time before, after;
+    uint64_t lastmono;
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return -1;
+
+    /* Find the index of our own module tag so we can check the writer */
+    result = dax_tag_handle(ds, &tag, "_my_tagname", 0);
+    if(result) return result;
+    result = dax_read_tag(ds, tag, modname);
+    if(result) return result;
+    modname[DAX_TAGNAME_SIZE] = '\0';
+    result = dax_tag_byname(ds, &modtag, modname);
+    if(result) return result;
+
+    result = dax_tag_add(ds, &tag, "StampTag", DAX_DINT, 1, 0);
+    if(result) return result;
+    result = dax_event_add(ds, &tag, EVENT_WRITE, NULL, &id, test_callback, NULL, NULL);
+    if(result) return result;
+
+    /* Without the option we should get the data but no stamp */
+    result = dax_event_options(ds, id, EVENT_OPT_SEND_DATA);
+    if(result) return result;
+    x = 12;
+    result = dax_write_tag(ds, tag, &x);
+    if(result) return result;
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(validation != x || stamp_result != ERR_EMPTY) return -1;
+
+    result = dax_event_options(ds, id, EVENT_OPT_SEND_DATA | EVENT_OPT_SEND_TIME);
+    if(result) return result;
+    before = _now();
+    x = 34;
+    result = dax_write_tag(ds, tag, &x);
+    if(result) return result;
+    after = _now();
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(validation != x || stamp_result != 0) return -1;
+    if(stamp.time < before || stamp.time > after) return -1;
+    if(stamp.writer != modtag.idx) return -1;
+    lastmono = stamp.mono;
+
+    /* The monotonic time should move forward on the next write */
+    x = 56;
+    result = dax_write_tag(ds, tag, &x);
+    if(result) return result;
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(validation != x || stamp_result != 0) return -1;
+    if(stamp.mono <= lastmono) return -1;
+
+    /* Atomic operations and group writes are stamped with the writer too */
+    x = 1;
+    result = dax_atomic_op(ds, tag, &x, ATOMIC_OP_INC);
+    if(result) return result;
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(validation != 57 || stamp_result != 0) return -1;
+    if(stamp.writer != modtag.idx) return -1;
+
+    gid = dax_group_add(ds, &result, &tag, 1, 0);
+    if(gid == NULL) return result;
+    x = 78;
+    result = dax_group_write(ds, gid, &x);
+    if(result) return result;
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(validation != x || stamp_result != 0) return -1;
+    if(stamp.writer != modtag.idx) return -1;
+
+    /* Outside of the callback there is nothing to get */
+    if(dax_event_get_stamp(ds, &stamp) != ERR_DELETED) return -1;
+
+    dax_disconnect(ds);
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
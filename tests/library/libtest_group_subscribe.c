@@ -0,0 +1,118 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test subscribes to a tag group and makes sure that the server
+ *  pushes the whole group when a member changes and that writes inside
+ *  the interval are coalesced into a single push of the latest data.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+static dax_dint validation[3];
+static int callcount = 0;
+
+void
+test_callback(dax_state *ds, void *udata) {
+    tag_group_id *id = (tag_group_id *)udata;
+
+    dax_group_get_data(ds, id, validation, sizeof(validation));
+    callcount++;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result = 0;
+    tag_group_id *idx;
+    tag_handle h[3];
+    dax_dint temp;
+    dax_dint temp_array[3];
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) {
+        return -1;
+    }
+    result = 0;
+    result += dax_tag_add(ds, &h[0], "TEST1", DAX_DINT, 1, 0);
+    result += dax_tag_add(ds, &h[1], "TEST2", DAX_DINT, 1, 0);
+    result += dax_tag_add(ds, &h[2], "TEST3", DAX_DINT, 1, 0);
+    if(result) return -1;
+    idx = dax_group_add(ds, &result, h, 3, 0);
+    if(result) return result;
+
+    result = dax_group_subscribe(ds, idx, 0, test_callback, idx, NULL);
+    if(result) return result;
+
+    /* A group write should only generate a single push */
+    temp_array[0] = 0x1122;
+    temp_array[1] = 0x3344;
+    temp_array[2] = 0x5566;
+    result = dax_group_write(ds, idx, temp_array);
+    if(result) return result;
+    result = dax_event_wait(ds, 1000, NULL);
+    if(result) return result;
+    if(dax_event_poll(ds, NULL) != ERR_NOTFOUND) return -1;
+    if(callcount != 1) return -1;
+    if(validation[0] != 0x1122 || validation[1] != 0x3344 || validation[2] != 0x5566) return -1;
+
+    /* These should all be coalesced into one push with the latest data */
+    result = dax_group_subscribe(ds, idx, 1000, test_callback, idx, NULL);
+    if(result) return result;
+    for(temp = 1; temp <= 10; temp++) {
+        result = dax_write_tag(ds, h[1], &temp);
+        if(result) return result;
+    }
+    result = dax_event_wait(ds, 2000, NULL);
+    if(result) return result;
+    if(dax_event_poll(ds, NULL) != ERR_NOTFOUND) return -1;
+    if(callcount != 2) return -1;
+    if(validation[1] != 10) return -1;
+
+    /* After unsubscribing we shouldn't get anything */
+    result = dax_group_unsubscribe(ds, idx);
+    if(result) return result;
+    result = dax_write_tag(ds, h[2], &temp);
+    if(result) return result;
+    if(dax_event_wait(ds, 200, NULL) != ERR_TIMEOUT) return -1;
+
+    result = dax_group_del(ds, idx);
+    dax_disconnect(ds);
+
+    return result;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
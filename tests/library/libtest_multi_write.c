@@ -0,0 +1,118 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test writes several tags with a single multi write message and
+ *  checks that adjacent writes to the same tag only fire one event and
+ *  that nothing is written if one of the items is bad.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+static int callcount = 0;
+
+void
+test_callback(dax_state *ds, void *udata) {
+    callcount++;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result = 0;
+    tag_handle h[4], hbool;
+    void *data[4];
+    dax_dint a[2], b[2], readback[4];
+    dax_real r, rr;
+    dax_byte bits[2], bitsback[2];
+    dax_id id;
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) {
+        return -1;
+    }
+    result += dax_tag_add(ds, &hbool, "Bools", DAX_BOOL, 16, 0);
+    result += dax_tag_add(ds, &h[2], "Real", DAX_REAL, 1, 0);
+    result += dax_tag_add(ds, &h[0], "Dints", DAX_DINT, 4, 0);
+    if(result) return -1;
+    result = dax_event_add(ds, &h[0], EVENT_WRITE, NULL, &id, test_callback, NULL, NULL);
+    if(result) return result;
+
+    result += dax_tag_handle(ds, &h[0], "Dints[0]", 2);
+    result += dax_tag_handle(ds, &h[1], "Dints[2]", 2);
+    result += dax_tag_handle(ds, &h[3], "Bools[3]", 4);
+    if(result) return -1;
+
+    a[0] = 1; a[1] = 2; b[0] = 3; b[1] = 4;
+    r = 3.5;
+    bits[0] = 0x0F;
+    data[0] = a; data[1] = b; data[2] = &r; data[3] = bits;
+    result = dax_tag_multi_write(ds, h, data, 4);
+    if(result) return result;
+
+    result += dax_tag_handle(ds, &h[0], "Dints", 0);
+    result += dax_read_tag(ds, h[0], readback);
+    result += dax_read_tag(ds, h[2], &rr);
+    result += dax_read_tag(ds, hbool, bitsback);
+    if(result) return -1;
+    if(readback[0] != 1 || readback[1] != 2 || readback[2] != 3 || readback[3] != 4) return -1;
+    if(rr != r) return -1;
+    if(bitsback[0] != 0x78 || bitsback[1] != 0x00) return -1;
+
+    /* Both halves of the array were written together so only one event */
+    result = dax_event_poll(ds, NULL);
+    if(result) return result;
+    if(dax_event_poll(ds, NULL) != ERR_NOTFOUND) return -1;
+    if(callcount != 1) return -1;
+
+    /* One bad item should keep everything from being written */
+    a[0] = 100;
+    h[1].index = 100000;
+    result = dax_tag_handle(ds, &h[0], "Dints[0]", 2);
+    if(result) return -1;
+    result = dax_tag_multi_write(ds, h, data, 2);
+    if(result == 0) return -1;
+    result = dax_tag_handle(ds, &h[0], "Dints", 0);
+    result += dax_read_tag(ds, h[0], readback);
+    if(result) return -1;
+    if(readback[0] != 1) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
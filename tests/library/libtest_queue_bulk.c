@@ -0,0 +1,113 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test adds and removes items from a queue in batches.  It mixes in
+ *  single reads and writes and makes the queue grow while it is wrapped
+ *  around to make sure that the order is always kept.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+#define BULK_COUNT 3000
+
+static dax_dint data[BULK_COUNT];
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result, n, count;
+    tag_handle h;
+    dax_dint temp, next_write = 0, next_read = 0;
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return -1;
+
+    result = dax_tag_add(ds, &h, "BulkQueue", DAX_DINT | DAX_QUEUE, 1, 0);
+    if(result) return -1;
+
+    /* Get the read pointer away from the start of the ring */
+    for(n = 0; n < 10; n++) {
+        temp = next_write++;
+        result = dax_write_tag(ds, h, &temp);
+        if(result) return result;
+    }
+    count = 5;
+    result = dax_queue_read(ds, h, data, &count);
+    if(result) return result;
+    if(count != 5) return -1;
+    for(n = 0; n < count; n++) {
+        if(data[n] != next_read++) return -1;
+    }
+    /* This wraps around and then has to grow more than once.  It also
+     * takes more than one message. */
+    for(n = 0; n < BULK_COUNT; n++) {
+        data[n] = next_write++;
+    }
+    result = dax_queue_write(ds, h, data, BULK_COUNT);
+    if(result) return result;
+    /* A single read should get the next one in line */
+    result = dax_read_tag(ds, h, &temp);
+    if(result) return result;
+    if(temp != next_read++) return -1;
+
+    /* Drain it in odd sized chunks */
+    while(1) {
+        count = 97;
+        result = dax_queue_read(ds, h, data, &count);
+        if(result == ERR_EMPTY) break;
+        if(result) return result;
+        if(count < 1 || count > 97) return -1;
+        for(n = 0; n < count; n++) {
+            if(data[n] != next_read++) return -1;
+        }
+    }
+    if(next_read != next_write) return -1;
+
+    /* Single reads should see the empty queue too */
+    if(dax_read_tag(ds, h, &temp) != ERR_EMPTY) return -1;
+
+    /* Bulk operations on a tag that isn't a queue should fail */
+    result = dax_tag_add(ds, &h, "NotAQueue", DAX_DINT, 1, 0);
+    if(result) return result;
+    if(dax_queue_write(ds, h, data, 1) == 0) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
@@ -0,0 +1,114 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test adds more tags than will fit in a single bulk add message
+ *  and then retrieves them again with a second module so that none of
+ *  them are in the tag cache.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+#define TAG_COUNT 600
+
+static dax_tag tags[TAG_COUNT];
+static dax_tag found[TAG_COUNT];
+static tag_handle handles[TAG_COUNT];
+static char *names[TAG_COUNT];
+
+static dax_state *
+_connect(int argc, char *argv[], char *name)
+{
+    dax_state *ds;
+
+    ds = dax_init(name);
+    dax_init_config(ds, name);
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    if(dax_connect(ds)) return NULL;
+    return ds;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds, *ds2;
+    int result, n;
+
+    ds = _connect(argc, argv, "test");
+    if(ds == NULL) return -1;
+
+    for(n = 0; n < TAG_COUNT; n++) {
+        snprintf(tags[n].name, DAX_TAGNAME_SIZE, "BulkTag%d", n);
+        tags[n].type = (n % 3) ? DAX_DINT : DAX_BOOL;
+        tags[n].count = n % 20 + 1;
+        tags[n].attr = 0;
+        names[n] = tags[n].name;
+    }
+    /* One bad tag in the middle should not keep the others from being added */
+    tags[300].name[0] = '_';
+    result = dax_tag_add_bulk(ds, handles, tags, TAG_COUNT);
+    if(result != ERR_ILLEGAL) return -1;
+    for(n = 0; n < TAG_COUNT; n++) {
+        if(n == 300) {
+            if(tags[n].idx != ERR_ILLEGAL) return -1;
+        } else {
+            if(tags[n].idx < 0) return -1;
+            if(handles[n].index != tags[n].idx) return -1;
+            if(handles[n].size != ((n % 3) ? (n % 20 + 1) * 4 : (n % 20) / 8 + 1)) return -1;
+        }
+    }
+
+    ds2 = _connect(argc, argv, "test2");
+    if(ds2 == NULL) return -1;
+    result = dax_tag_get_bulk(ds2, found, names, TAG_COUNT);
+    if(result != ERR_NOTFOUND) return -1;
+    for(n = 0; n < TAG_COUNT; n++) {
+        if(n == 300) {
+            if(found[n].idx != ERR_NOTFOUND) return -1;
+            continue;
+        }
+        if(found[n].idx != tags[n].idx) return -1;
+        if(found[n].type != tags[n].type) return -1;
+        if(found[n].count != tags[n].count) return -1;
+        if(strcmp(found[n].name, tags[n].name)) return -1;
+    }
+    /* These should all come from the cache now */
+    result = dax_tag_get_bulk(ds2, &found[590], &names[590], 10);
+    if(result) return -1;
+    if(found[599].idx != tags[599].idx) return -1;
+
+    dax_disconnect(ds2);
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
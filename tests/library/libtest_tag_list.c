@@ -0,0 +1,106 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2021 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+/*
+ *  This test lists the tags in pages with and without a wildcard filter
+ *  and makes sure that deleted tags are skipped.
+ */
+
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libtest_common.h"
+
+static int itercount = 0;
+
+static void
+_iter_callback(dax_tag *tag, void *udata)
+{
+    if(strncmp(tag->name, "ListA", 5) == 0) itercount++;
+}
+
+int
+do_test(int argc, char *argv[])
+{
+    dax_state *ds;
+    int result, n, count, total;
+    char name[DAX_TAGNAME_SIZE + 1];
+    tag_handle h[60];
+    dax_tag tags[8];
+    tag_index start;
+
+    ds = dax_init("test");
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return -1;
+
+    for(n = 0; n < 60; n++) {
+        snprintf(name, DAX_TAGNAME_SIZE, "%s%d", n < 50 ? "ListA" : "ListB", n);
+        result = dax_tag_add(ds, &h[n], name, DAX_INT, n + 1, 0);
+        if(result) return -1;
+    }
+    result = dax_tag_del(ds, h[10].index);
+    result += dax_tag_del(ds, h[20].index);
+    if(result) return -1;
+
+    /* Page through the filtered list eight tags at a time */
+    start = 0;
+    total = 0;
+    while(start != TAG_LIST_DONE) {
+        count = 8;
+        result = dax_tag_list(ds, &start, "ListA*", tags, &count);
+        if(result) return result;
+        if(count > 8) return -1;
+        for(n = 0; n < count; n++) {
+            if(strncmp(tags[n].name, "ListA", 5)) return -1;
+            if(tags[n].type != DAX_INT) return -1;
+            if(tags[n].idx == h[10].index || tags[n].idx == h[20].index) return -1;
+            if(tags[n].count != atoi(&tags[n].name[5]) + 1) return -1;
+        }
+        total += count;
+    }
+    if(total != 48) return -1;
+
+    result = dax_tag_iter(ds, NULL, NULL, _iter_callback);
+    if(result) return result;
+    if(itercount != 48) return -1;
+
+    /* Nothing should match this one */
+    start = 0;
+    count = 8;
+    result = dax_tag_list(ds, &start, "NoTag?", tags, &count);
+    if(result) return result;
+    if(count != 0 || start != TAG_LIST_DONE) return -1;
+
+    dax_disconnect(ds);
+
+    return 0;
+}
+
+/* main inits and then calls run */
+int
+main(int argc, char *argv[])
+{
+    if(run_test(do_test, argc, argv, 0)) {
+        exit(-1);
+    } else {
+        exit(0);
+    }
+}
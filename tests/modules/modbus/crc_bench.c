@@ -0,0 +1,78 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Microbenchmark for the Modbus CRC16 function.  It prints the time per
+ *  frame and the throughput for a few typical RTU frame sizes with the
+ *  slice size that the module was built with and the original byte at a
+ *  time algorithm.
+ *
+ *  Run with -q to use a small number of iterations.  That is what the test
+ *  suite does just to make sure this still builds and runs.
+ */
+
+#include <modbus.h>
+#include "crc_ref.h"
+#include <time.h>
+
+static inline uint64_t
+_now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+_report(const char *name, int size, long ops, uint64_t start)
+{
+    uint64_t elapsed = _now_nsec() - start;
+
+    printf("%-16s %4d bytes %10ld ops %10.1f ns/op %8.1f MB/s\n", name, size, ops,
+           (double)elapsed / ops, (double)size * ops * 1000.0 / elapsed);
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint8_t buff[256];
+    int sizes[] = {8, 64, 256};
+    volatile uint16_t sink = 0;
+    uint64_t start;
+    long n, ops = 2000000;
+    char name[32];
+
+    if(argc > 1 && strcmp(argv[1], "-q") == 0) ops = 10000;
+    for(n = 0; n < sizeof(buff); n++) {
+        buff[n] = n * 7;
+    }
+    snprintf(name, sizeof(name), "slice-by-%d", MB_CRC_SLICE);
+    for(int s = 0; s < sizeof(sizes) / sizeof(int); s++) {
+        start = _now_nsec();
+        for(n = 0; n < ops; n++) {
+            sink ^= crc16(buff, sizes[s]);
+        }
+        _report(name, sizes[s], ops, start);
+        start = _now_nsec();
+        for(n = 0; n < ops; n++) {
+            sink ^= crc16_ref(buff, sizes[s]);
+        }
+        _report("original", sizes[s], ops, start);
+    }
+    return 0;
+}
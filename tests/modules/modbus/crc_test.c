@@ -0,0 +1,71 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test the Modbus CRC16 function against the original byte at a time
+ *  algorithm for every message length up to the largest RTU frame and
+ *  every starting alignment.
+ */
+
+#include <modbus.h>
+#include "crc_ref.h"
+
+int
+main(int argc, char *argv[])
+{
+    uint8_t buff[MB_FRAME_LEN + 8];
+    uint16_t crc, ref;
+    int n, len, offset, errors = 0;
+
+    srandom(1234);
+    for(n = 0; n < sizeof(buff); n++) {
+        buff[n] = random();
+    }
+    /* The check value for CRC-16/MODBUS is 0x4B37.  We return it swapped */
+    crc = crc16((unsigned char *)"123456789", 9);
+    if(crc != 0x374B) {
+        fprintf(stderr, "Check value is 0x%04X\n", crc);
+        errors++;
+    }
+    for(offset = 0; offset < 8; offset++) {
+        for(len = 0; len <= 256; len++) {
+            crc = crc16(&buff[offset], len);
+            ref = crc16_ref(&buff[offset], len);
+            if(crc != ref) {
+                fprintf(stderr, "Length %d offset %d: 0x%04X should be 0x%04X\n", len, offset, crc, ref);
+                errors++;
+            }
+        }
+    }
+    /* A message with its own CRC on the end has to pass the check */
+    crc = crc16(buff, 254);
+    COPYWORD(&buff[254], &crc);
+    if(!crc16check(buff, 256)) {
+        fprintf(stderr, "crc16check() failed on a good frame\n");
+        errors++;
+    }
+    buff[10] ^= 0x01;
+    if(crc16check(buff, 256)) {
+        fprintf(stderr, "crc16check() passed a bad frame\n");
+        errors++;
+    }
+    if(errors == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(errors ? 1 : 0);
+}
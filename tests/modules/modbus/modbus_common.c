@@ -19,7 +19,12 @@
  *  This file contains common modbus function */
 
 #define _XOPEN_SOURCE 500
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
 #include <unistd.h>
+#include <poll.h>
+#include <netinet/tcp.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "modbus_common.h"
 
 static int tid;
@@ -285,3 +290,241 @@ write_multiple_registers(int sock, uint16_t addr, uint16_t count, uint16_t *sbuf
     }
     return 0;
 }
+
+
+#define FAKE_MAX_FDS     64
+#define FAKE_MAX_PENDING 256
+#define FAKE_MAX_SEEN    64
+
+/* The different requests that the fake server has received and how many
+ * times it got each one.  It's in shared memory so that the test can see
+ * what the server process has been sent. */
+struct fake_seen {
+    int function;
+    int addr;
+    int count;
+    int hits;
+};
+
+static struct fake_seen *_seen;
+
+/* A request that the fake server has received but not answered yet */
+struct fake_pending {
+    int fd;
+    double due;
+    int length;
+    uint8_t buff[260];
+};
+
+static double
+_fake_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Builds the response to the request in p->buff in place.  Reads of holding
+ * or input registers return the register address plus the servers TCP port
+ * so that the test can tell which server the data came from.  Writes are
+ * simply acknowledged. */
+static void
+_fake_response(struct fake_pending *p, int port) {
+    uint16_t addr, count, value;
+    int n;
+
+    addr = (uint16_t)p->buff[8]<<8 | p->buff[9];
+    count = (uint16_t)p->buff[10]<<8 | p->buff[11];
+    switch(p->buff[7]) {
+        case 3:
+        case 4:
+            p->buff[8] = count * 2;
+            for(n = 0; n < count; n++) {
+                value = port + addr + n;
+                p->buff[9 + n*2] = value >> 8;
+                p->buff[10 + n*2] = value;
+            }
+            p->length = 9 + count * 2;
+            break;
+        case 5:
+        case 6:
+        case 15:
+        case 16:
+            p->length = 12;
+            break;
+        default:
+            p->buff[7] |= 0x80;
+            p->buff[8] = 1;
+            p->length = 9;
+            break;
+    }
+    p->buff[4] = (p->length - 6) >> 8;
+    p->buff[5] = (p->length - 6);
+}
+
+/* Counts the request in buff in the shared table */
+static void
+_fake_count(uint8_t *buff) {
+    int n, function, addr, count;
+
+    function = buff[7];
+    addr = (int)buff[8]<<8 | buff[9];
+    count = (int)buff[10]<<8 | buff[11];
+    for(n = 0; n < FAKE_MAX_SEEN; n++) {
+        if(_seen[n].hits == 0) {
+            _seen[n].function = function;
+            _seen[n].addr = addr;
+            _seen[n].count = count;
+        }
+        if(_seen[n].function == function && _seen[n].addr == addr && _seen[n].count == count) {
+            _seen[n].hits++;
+            return;
+        }
+    }
+}
+
+/* The fake server process.  Every request is answered 'delay' mSec after it
+ * is received and requests that arrive back to back on the same connection
+ * are all held at once so pipelined clients get pipelined answers. */
+static void
+_fake_server(int *ports, int count, int delay) {
+    struct pollfd fds[FAKE_MAX_FDS];
+    int fdport[FAKE_MAX_FDS];
+    struct fake_pending pending[FAKE_MAX_PENDING];
+    int nfds = 0, npending = 0, n, i, s, result, timeout;
+    struct sockaddr_in addr;
+    uint8_t buff[1024];
+    double now;
+    int on = 1;
+
+    for(n = 0; n < count; n++) {
+        s = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(ports[n]);
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        if(bind(s, (struct sockaddr *)&addr, sizeof(addr)) || listen(s, 5)) {
+            fprintf(stderr, "Fake server unable to listen on %d\n", ports[n]);
+            exit(-1);
+        }
+        fds[nfds].fd = s;
+        fds[nfds].events = POLLIN;
+        fdport[nfds++] = -ports[n]; /* Negative means it's a listening socket */
+    }
+    while(1) {
+        timeout = -1;
+        now = _fake_time();
+        for(n = 0; n < npending; n++) {
+            result = (int)((pending[n].due - now) * 1000) + 1;
+            if(result < 0) result = 0;
+            if(timeout < 0 || result < timeout) timeout = result;
+        }
+        poll(fds, nfds, timeout);
+        for(n = 0; n < nfds; n++) {
+            if(!(fds[n].revents & POLLIN)) continue;
+            if(fdport[n] < 0) {
+                s = accept(fds[n].fd, NULL, NULL);
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                if(s >= 0 && nfds < FAKE_MAX_FDS) {
+                    fds[nfds].fd = s;
+                    fds[nfds].events = POLLIN;
+                    fdport[nfds++] = -fdport[n];
+                }
+                continue;
+            }
+            result = read(fds[n].fd, buff, sizeof(buff));
+            if(result <= 0) {
+                close(fds[n].fd);
+                fds[n] = fds[--nfds];
+                fdport[n] = fdport[nfds];
+                n--;
+                continue;
+            }
+            /* We assume that requests don't get split up on the loopback */
+            for(i = 0; i + 6 <= result && npending < FAKE_MAX_PENDING; ) {
+                s = ((int)buff[i+4]<<8 | buff[i+5]) + 6;
+                if(i + s > result || s > 260) break;
+                pending[npending].fd = fds[n].fd;
+                pending[npending].due = _fake_time() + delay / 1000.0;
+                memcpy(pending[npending].buff, &buff[i], s);
+                _fake_count(pending[npending].buff);
+                _fake_response(&pending[npending], fdport[n]);
+                npending++;
+                i += s;
+            }
+        }
+        now = _fake_time();
+        for(n = 0; n < npending; n++) {
+            if(pending[n].due <= now) {
+                write(pending[n].fd, pending[n].buff, pending[n].length);
+                memmove(&pending[n], &pending[n+1], sizeof(struct fake_pending) * (npending - n - 1));
+                npending--;
+                n--;
+            }
+        }
+    }
+}
+
+/* Starts a process that acts like 'count' Modbus TCP servers listening
+ * on the loopback at the given ports.  Each one waits 'delay' mSec before
+ * it answers a request. */
+pid_t
+run_fake_server(int *ports, int count, int delay) {
+    pid_t pid;
+
+    _seen = mmap(NULL, sizeof(struct fake_seen) * FAKE_MAX_SEEN, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(_seen == MAP_FAILED) {
+        printf("Unable to map the request table");
+        exit(-1);
+    }
+    memset(_seen, 0, sizeof(struct fake_seen) * FAKE_MAX_SEEN);
+    pid = fork();
+    if(pid == 0) {
+        _fake_server(ports, count, delay);
+        exit(0);
+    } else if(pid < 0) {
+        printf("Forking problem");
+        exit(-1);
+    }
+    usleep(100000);
+    return pid;
+}
+
+/* Returns the number of requests that the fake server has received with the
+ * given function code, address and count.  -1 matches anything. */
+int
+fake_server_requests(int function, int addr, int count) {
+    int n, total = 0;
+
+    for(n = 0; n < FAKE_MAX_SEEN && _seen[n].hits; n++) {
+        if(function >= 0 && _seen[n].function != function) continue;
+        if(addr >= 0 && _seen[n].addr != addr) continue;
+        if(count >= 0 && _seen[n].count != count) continue;
+        total += _seen[n].hits;
+    }
+    return total;
+}
+
+/* Returns the monotonic clock in seconds for timing the tests */
+double
+test_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Waits up to 'timeout' seconds for the first 'count' registers in the tag
+ * to match 'expect'.  Returns the number of seconds that it took or a
+ * negative number if it timed out. */
+double
+wait_for_registers(dax_state *ds, tag_handle h, uint16_t *expect, int count, double timeout) {
+    uint16_t buff[count];
+    double start = test_now();
+
+    while(test_now() - start < timeout) {
+        dax_read_tag(ds, h, buff);
+        if(memcmp(buff, expect, count * sizeof(uint16_t)) == 0) return test_now() - start;
+        usleep(20000);
+    }
+    return -1.0;
+}
@@ -37,4 +37,8 @@ int write_single_coil(int sock, uint16_t addr, uint8_t val);
 int write_single_register(int sock, uint16_t addr, uint16_t val);
 int write_multiple_coils(int sock, uint16_t addr, uint16_t count, uint8_t *sbuff);
 int write_multiple_registers(int sock, uint16_t addr, uint16_t count, uint16_t *sbuff);
+pid_t run_fake_server(int *ports, int count, int delay);
+int fake_server_requests(int function, int addr, int count);
+double test_now(void);
+double wait_for_registers(dax_state *ds, tag_handle h, uint16_t *expect, int count, double timeout);
 
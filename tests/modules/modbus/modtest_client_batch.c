@@ -0,0 +1,93 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test the tag server batching of a client scan.  The client's write
+ *  commands send mb_batch_out to a server port in the same module and its
+ *  read commands read the registers back into mb_batch_in.  The write data
+ *  is read with a tag group at the start of each scan and the read data is
+ *  written all at once at the end, so this checks that both get to the
+ *  right tags, and that new data is picked up on the next scan.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "modbus_common.h"
+
+int
+main(int argc, char *argv[])
+{
+    int exit_status = 0;
+    dax_state *ds;
+    tag_handle h_out, h_in;
+    uint16_t out[32];
+    int status, result, n;
+    pid_t server_pid, mod_pid;
+
+    /* Run the tag server and the modbus module */
+    server_pid = run_server();
+    mod_pid = run_module("../../../src/modules/modbus/daxmodbus", "conf/mb_client_batch.conf");
+    /* Connect to the tag server */
+    ds = dax_init("test");
+    if(ds == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to Allocate DaxState Object\n");
+        kill(getpid(), SIGQUIT);
+    }
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return result;
+    usleep(200000); /* Give the module time to create the tags */
+    result =  dax_tag_handle(ds, &h_out, "mb_batch_out", 0);
+    if(result) return result;
+    result =  dax_tag_handle(ds, &h_in, "mb_batch_in", 0);
+    if(result) return result;
+
+    /* mb_batch_in should get mb_batch_out followed by zeros */
+    bzero(out, sizeof(out));
+    for(n = 0; n < 16; n++) out[n] = 1000 + n;
+    dax_write_tag(ds, h_out, out);
+    if(wait_for_registers(ds, h_in, out, 32, 3.0) < 0) {
+        fprintf(stderr, "First data never came back\n");
+        exit_status = 1;
+    }
+    for(n = 0; n < 16; n++) out[n] = 2000 + n * 3;
+    dax_write_tag(ds, h_out, out);
+    if(wait_for_registers(ds, h_in, out, 32, 3.0) < 0) {
+        fprintf(stderr, "Changed data never came back\n");
+        exit_status = 1;
+    }
+
+    dax_disconnect(ds);
+
+    kill(mod_pid, SIGINT);
+    kill(server_pid, SIGINT);
+    if( waitpid(mod_pid, &status, 0) != mod_pid )
+        fprintf(stderr, "Error killing modbus module\n");
+    if( waitpid(server_pid, &status, 0) != server_pid )
+        fprintf(stderr, "Error killing tag server\n");
+    if(exit_status == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(exit_status);
+}
@@ -0,0 +1,102 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test merging of adjacent read commands.  Three commands that read
+ *  registers 0-3, 4-7 and 10-13 are merged into one request and the
+ *  data has to be scattered back out to the right part of the tag.  The
+ *  fake server counts what it is sent so we know that only the merged
+ *  request went out.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "modbus_common.h"
+
+int
+main(int argc, char *argv[])
+{
+    int exit_status = 0;
+    dax_state *ds;
+    tag_handle h;
+    uint16_t buff[12], expect[12];
+    int ports[1] = {5511};
+    int status, result, n, total, merged;
+    pid_t server_pid, mod_pid, fake_pid;
+
+    fake_pid = run_fake_server(ports, 1, 0);
+    /* Run the tag server and the modbus module */
+    server_pid = run_server();
+    mod_pid = run_module("../../../src/modules/modbus/daxmodbus", "conf/mb_client_coalesce.conf");
+    /* Connect to the tag server */
+    ds = dax_init("test");
+    if(ds == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to Allocate DaxState Object\n");
+        kill(getpid(), SIGQUIT);
+    }
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return result;
+    usleep(200000); /* Give the module time to create the tag */
+    result =  dax_tag_handle(ds, &h, "mb_client_in", 0);
+    if(result) return result;
+
+    /* The fake server returns the register address plus its port number */
+    for(n = 0; n < 4; n++) {
+        expect[n] = 5511 + n;
+        expect[n + 4] = 5511 + 4 + n;
+        expect[n + 8] = 5511 + 10 + n;
+    }
+    for(n = 0; n < 50; n++) {
+        dax_read_tag(ds, h, buff);
+        if(memcmp(buff, expect, sizeof(buff)) == 0) break;
+        usleep(50000);
+    }
+    for(n = 0; n < 12; n++) {
+        printf("mb_client_in[%d] = %d, expected %d\n", n, buff[n], expect[n]);
+        if(buff[n] != expect[n]) exit_status = 1;
+    }
+    /* Let a few more scans go by.  Every request the server got should be
+     * the single merged read of registers 0-13, one for each scan. */
+    usleep(500000);
+    total = fake_server_requests(-1, -1, -1);
+    merged = fake_server_requests(3, 0, 14);
+    printf("Fake server got %d requests, %d of them merged\n", total, merged);
+    if(merged < 3 || total != merged) exit_status = 1;
+
+    dax_disconnect(ds);
+
+    kill(mod_pid, SIGINT);
+    kill(server_pid, SIGINT);
+    kill(fake_pid, SIGINT);
+    if( waitpid(mod_pid, &status, 0) != mod_pid )
+        fprintf(stderr, "Error killing modbus module\n");
+    if( waitpid(server_pid, &status, 0) != server_pid )
+        fprintf(stderr, "Error killing tag server\n");
+    waitpid(fake_pid, &status, 0);
+    if(exit_status == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(exit_status);
+}
@@ -0,0 +1,107 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test the concurrent TCP client engine.  Three fake servers each take
+ *  400mSec to answer and the client has two commands for each of them.
+ *  Sending them one at a time would take 2.4 seconds per scan.  Sent
+ *  concurrently a scan should only take about 0.8 seconds.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "modbus_common.h"
+
+#define REG_COUNT 24
+
+int
+main(int argc, char *argv[])
+{
+    int exit_status = 0;
+    dax_state *ds;
+    tag_handle h;
+    uint16_t buff[REG_COUNT], expect[REG_COUNT];
+    int ports[3] = {5511, 5512, 5513};
+    int status, result;
+    double elapsed;
+    pid_t server_pid, mod_pid, fake_pid;
+
+    fake_pid = run_fake_server(ports, 3, 400);
+    /* Run the tag server and the modbus module */
+    server_pid = run_server();
+    mod_pid = run_module("../../../src/modules/modbus/daxmodbus", "conf/mb_client_concurrent.conf");
+    /* Connect to the tag server */
+    ds = dax_init("test");
+    if(ds == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to Allocate DaxState Object\n");
+        kill(getpid(), SIGQUIT);
+    }
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return result;
+    usleep(200000); /* Give the module time to create the tag */
+    result =  dax_tag_handle(ds, &h, "mb_client_in", 0);
+    if(result) return result;
+    /* The fake servers return the register address plus their port number */
+    for(int s = 0; s < 3; s++) {
+        for(int n = 0; n < 8; n++) {
+            expect[s * 8 + n] = 5511 + s + n;
+        }
+    }
+
+    /* Wait for the first full scan.  This includes the connections */
+    elapsed = wait_for_registers(ds, h, expect, REG_COUNT, 5.0);
+    if(elapsed < 0) {
+        fprintf(stderr, "Never received the data from the servers\n");
+        exit_status = 1;
+    } else {
+        /* Now clear it and time how long it takes to get it all back.  Depending
+         * on where the scan is when we clear it the first time this could take
+         * two scans.  The data all shows up at the end of a scan so the second
+         * time we clear it right between scans and it should take just one. */
+        for(int n = 0; n < 2 && elapsed >= 0; n++) {
+            bzero(buff, sizeof(buff));
+            dax_write_tag(ds, h, buff);
+            elapsed = wait_for_registers(ds, h, expect, REG_COUNT, 6.0);
+        }
+        printf("Data refreshed in %f seconds\n", elapsed);
+        /* Halfway between one concurrent scan and one serial scan */
+        if(elapsed < 0 || elapsed > 1.6) exit_status = 1;
+    }
+
+    dax_disconnect(ds);
+
+    kill(mod_pid, SIGINT);
+    kill(server_pid, SIGINT);
+    kill(fake_pid, SIGINT);
+    if( waitpid(mod_pid, &status, 0) != mod_pid )
+        fprintf(stderr, "Error killing modbus module\n");
+    if( waitpid(server_pid, &status, 0) != server_pid )
+        fprintf(stderr, "Error killing tag server\n");
+    waitpid(fake_pid, &status, 0);
+    if(exit_status == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(exit_status);
+}
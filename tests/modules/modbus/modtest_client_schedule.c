@@ -0,0 +1,101 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test the command scheduler.  The fake server takes 120mSec to answer.
+ *  The first command has a period of 500mSec and should always be sent in
+ *  its period.  The second has a period of 50mSec, which it can never make,
+ *  so it should be counted as missing periods without holding up the first.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "modbus_common.h"
+
+#define REG_COUNT 8
+
+int
+main(int argc, char *argv[])
+{
+    int exit_status = 0;
+    dax_state *ds;
+    tag_handle h, hj, ho;
+    dax_dint jitter[2];
+    dax_udint overrun[2];
+    uint16_t expect[REG_COUNT];
+    int ports[1] = {5531};
+    int status, result;
+    pid_t server_pid, mod_pid, fake_pid;
+
+    fake_pid = run_fake_server(ports, 1, 120);
+    /* Run the tag server and the modbus module */
+    server_pid = run_server();
+    mod_pid = run_module("../../../src/modules/modbus/daxmodbus", "conf/mb_client_schedule.conf");
+    /* Connect to the tag server */
+    ds = dax_init("test");
+    if(ds == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to Allocate DaxState Object\n");
+        kill(getpid(), SIGQUIT);
+    }
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return result;
+    usleep(200000); /* Give the module time to create the tags */
+    result =  dax_tag_handle(ds, &h, "mb_client_in", 0);
+    if(result) return result;
+    result =  dax_tag_handle(ds, &hj, "TCPClient_cmd_jitter", 0);
+    if(result) return result;
+    result =  dax_tag_handle(ds, &ho, "TCPClient_cmd_overrun", 0);
+    if(result) return result;
+
+    for(int n = 0; n < REG_COUNT; n++) expect[n] = 5531 + n;
+    if(wait_for_registers(ds, h, expect, REG_COUNT, 5.0) < 0) {
+        fprintf(stderr, "Never received the data from the server\n");
+        exit_status = 1;
+    } else {
+        /* Let it run long enough for the tags to be written a couple of times */
+        sleep(3);
+        dax_read_tag(ds, hj, jitter);
+        dax_read_tag(ds, ho, overrun);
+        printf("Jitter %d, %d uSec  Overruns %u, %u\n", jitter[0], jitter[1], overrun[0], overrun[1]);
+        /* The slow command can only hold up the other one for one response */
+        if(overrun[0] != 0 || jitter[0] > 300000) exit_status = 1;
+        if(overrun[1] == 0) exit_status = 1;
+    }
+
+    dax_disconnect(ds);
+
+    kill(mod_pid, SIGINT);
+    kill(server_pid, SIGINT);
+    kill(fake_pid, SIGINT);
+    if( waitpid(mod_pid, &status, 0) != mod_pid )
+        fprintf(stderr, "Error killing modbus module\n");
+    if( waitpid(server_pid, &status, 0) != server_pid )
+        fprintf(stderr, "Error killing tag server\n");
+    waitpid(fake_pid, &status, 0);
+    if(exit_status == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(exit_status);
+}
@@ -0,0 +1,198 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test the Modbus TCP to RTU gateway.  The server forwards unit 1 over a
+ *  socat serial pair to an RTU slave in the same module.  We check that
+ *  the data gets through both ways, that reads are cached for the ttl,
+ *  that writes clear the cache, that a unit that doesn't answer gets a
+ *  gateway exception and that the server still answers for its own units.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "modbus_common.h"
+
+/* Reads count holding registers from the unit.  Returns 0 on success, the
+ * exception code if we get one or -1 on a communication error */
+static int
+_read_unit(int sock, uint8_t unit, uint16_t addr, uint16_t count, uint16_t *rbuff)
+{
+    static uint16_t tid;
+    uint8_t buff[256];
+    int result;
+
+    tid++;
+    buff[0] = tid>>8;
+    buff[1] = tid;
+    buff[2] = 0;
+    buff[3] = 0;
+    buff[4] = 0;
+    buff[5] = 6;
+    buff[6] = unit;
+    buff[7] = 3;
+    buff[8] = addr>>8;
+    buff[9] = addr;
+    buff[10] = count>>8;
+    buff[11] = count;
+    result = send(sock, buff, 12, 0);
+    if(result < 0) return -1;
+    result = recv(sock, buff, 256, 0);
+    if(result < 9) return -1;
+    if(((uint16_t)buff[0]<<8 | buff[1]) != tid) return -1;
+    if(buff[7] != 3) return buff[8];
+    swab(&buff[9], rbuff, buff[8]);
+    return 0;
+}
+
+static int
+_connect(void)
+{
+    struct sockaddr_in addr;
+    int s;
+
+    s = socket(PF_INET, SOCK_STREAM, 0);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5502);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(connect(s, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "%s\n", strerror(errno));
+        return -1;
+    }
+    return s;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int s, s2, exit_status = 0;
+    dax_state *ds;
+    tag_handle h, hl;
+    uint16_t buff[16], rbuff[16];
+    int status, n, result;
+    pid_t server_pid, mod_pid, socat_pid;
+
+    /* Run the tag server and the modbus module */
+    server_pid = run_server();
+    socat_pid = run_socat();
+    mod_pid = run_module("../../../src/modules/modbus/daxmodbus", "conf/mb_gateway.conf");
+    /* Connect to the tag server */
+    ds = dax_init("test");
+    if(ds == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to Allocate DaxState Object\n");
+        kill(getpid(), SIGQUIT);
+    }
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return result;
+    result = dax_tag_handle(ds, &h, "mb_gw_remote", 0);
+    if(result) return result;
+    result = dax_tag_handle(ds, &hl, "mb_gw_local", 0);
+    if(result) return result;
+
+    s = _connect();
+    s2 = _connect();
+    if(s < 0 || s2 < 0) return -1;
+
+    for(n = 0; n < 16; n++) buff[n] = 100 + n;
+    dax_write_tag(ds, h, buff);
+    usleep(100000);
+    /* This one goes out on the serial line */
+    result = _read_unit(s, 1, 0, 16, rbuff);
+    if(result || memcmp(buff, rbuff, sizeof(buff))) {
+        fprintf(stderr, "Gateway read failed %d\n", result);
+        exit_status = 1;
+    }
+
+    /* The tag changes but the second client should get the cached copy */
+    buff[0] = 555;
+    dax_write_tag(ds, h, buff);
+    usleep(100000);
+    result = _read_unit(s2, 1, 0, 16, rbuff);
+    if(result || rbuff[0] != 100) {
+        fprintf(stderr, "Cached read failed %d, %d\n", result, rbuff[0]);
+        exit_status = 1;
+    }
+    /* After the ttl we should see the new value */
+    usleep(500000);
+    result = _read_unit(s2, 1, 0, 16, rbuff);
+    if(result || rbuff[0] != 555) {
+        fprintf(stderr, "Read after ttl failed %d, %d\n", result, rbuff[0]);
+        exit_status = 1;
+    }
+
+    /* A write goes through to the tag and clears the cache */
+    result = write_single_register(s, 3, 777);
+    if(result) {
+        fprintf(stderr, "Gateway write failed %d\n", result);
+        exit_status = 1;
+    }
+    dax_read_tag(ds, h, buff);
+    if(buff[3] != 777) {
+        fprintf(stderr, "Gateway write didn't reach the tag, %d\n", buff[3]);
+        exit_status = 1;
+    }
+    result = _read_unit(s2, 1, 0, 16, rbuff);
+    if(result || rbuff[3] != 777) {
+        fprintf(stderr, "Read after write failed %d, %d\n", result, rbuff[3]);
+        exit_status = 1;
+    }
+
+    /* Nothing answers for unit 2 */
+    result = _read_unit(s, 2, 0, 1, rbuff);
+    if(result != 0x0B) {
+        fprintf(stderr, "Expected gateway target exception, got %d\n", result);
+        exit_status = 1;
+    }
+
+    /* Unit 3 is the server's own */
+    for(n = 0; n < 16; n++) buff[n] = 200 + n;
+    dax_write_tag(ds, hl, buff);
+    usleep(100000);
+    result = _read_unit(s, 3, 0, 16, rbuff);
+    if(result || memcmp(buff, rbuff, sizeof(buff))) {
+        fprintf(stderr, "Local read failed %d\n", result);
+        exit_status = 1;
+    }
+
+    close(s);
+    close(s2);
+    dax_disconnect(ds);
+
+    kill(mod_pid, SIGINT);
+    kill(server_pid, SIGINT);
+    kill(socat_pid, SIGINT);
+    if( waitpid(mod_pid, &status, 0) != mod_pid )
+        fprintf(stderr, "Error killing modbus module\n");
+    if( waitpid(server_pid, &status, 0) != server_pid )
+        fprintf(stderr, "Error killing tag server\n");
+    waitpid(socat_pid, &status, 0);
+    if(exit_status == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(exit_status);
+}
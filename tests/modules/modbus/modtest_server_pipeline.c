@@ -0,0 +1,182 @@
+/*  OpenDAX - An open source data acquisition and control system
+ *  Copyright (c) 2024 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Test that the TCP server answers every request when the client sends
+ *  more than one in a single write and when a request is split across
+ *  writes.  We also make sure that a bad header only costs the client
+ *  that sent it its own connection.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <common.h>
+#include <opendax.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "modbus_common.h"
+
+static int
+_connect(void) {
+    struct sockaddr_in addr;
+    int s;
+
+    s = socket(PF_INET, SOCK_STREAM, 0);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(5502);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if(connect(s, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "%s\n", strerror(errno));
+        return -1;
+    }
+    return s;
+}
+
+/* Builds a read holding register request in buff and returns the length */
+static int
+_request(uint8_t *buff, uint16_t tid, uint16_t addr, uint16_t count) {
+    buff[0] = tid >> 8;
+    buff[1] = tid;
+    buff[2] = 0;
+    buff[3] = 0;
+    buff[4] = 0;
+    buff[5] = 6;
+    buff[6] = 1;
+    buff[7] = 3;
+    buff[8] = addr >> 8;
+    buff[9] = addr;
+    buff[10] = count >> 8;
+    buff[11] = count;
+    return 12;
+}
+
+static int
+_recv_all(int sock, uint8_t *buff, int size) {
+    int result, got = 0;
+
+    while(got < size) {
+        result = recv(sock, &buff[got], size - got, 0);
+        if(result <= 0) return -1;
+        got += result;
+    }
+    return got;
+}
+
+/* Reads one response and compares it to what we expect */
+static int
+_check_response(int sock, uint16_t tid, uint16_t addr, uint16_t count) {
+    uint8_t buff[300];
+
+    if(_recv_all(sock, buff, 9) < 0) return 1;
+    if(((uint16_t)buff[0] << 8 | buff[1]) != tid) {
+        fprintf(stderr, "Expected transaction %d\n", tid);
+        return 1;
+    }
+    if(buff[7] != 3 || buff[8] != count * 2) return 1;
+    if(_recv_all(sock, &buff[9], count * 2) < 0) return 1;
+    for(int n = 0; n < count; n++) {
+        if(((uint16_t)buff[9 + n * 2] << 8 | buff[10 + n * 2]) != addr + n + 100) {
+            fprintf(stderr, "Bad value in transaction %d\n", tid);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int s, s2, exit_status = 0;
+    dax_state *ds;
+    tag_handle h;
+    uint8_t buff[256];
+    uint16_t regs[32];
+    int status, n, len;
+    int result;
+    pid_t server_pid, mod_pid;
+
+    /* Run the tag server and the modbus module */
+    server_pid = run_server();
+    mod_pid = run_module("../../../src/modules/modbus/daxmodbus", "conf/mb_server.conf");
+    /* Connect to the tag server */
+    ds = dax_init("test");
+    if(ds == NULL) {
+        dax_log(DAX_LOG_FATAL, "Unable to Allocate DaxState Object\n");
+        kill(getpid(), SIGQUIT);
+    }
+    dax_init_config(ds, "test");
+    dax_configure(ds, argc, argv, CFG_CMDLINE);
+    result = dax_connect(ds);
+    if(result) return result;
+    result =  dax_tag_handle(ds, &h, "mb_hreg", 0);
+    if(result) return result;
+    for(n = 0; n < 32; n++) regs[n] = n + 100;
+    dax_write_tag(ds, h, regs);
+
+    s = _connect();
+    s2 = _connect();
+    if(s < 0 || s2 < 0) exit(1);
+
+    /* Three requests in one write with the last one cut short */
+    len = _request(buff, 1, 0, 4);
+    len += _request(&buff[len], 2, 10, 20);
+    len += _request(&buff[len], 3, 30, 2);
+    send(s, buff, len - 5, 0);
+    usleep(50000);
+    /* The other connection shouldn't be held up by the partial frame */
+    _request(buff, 10, 5, 5);
+    send(s2, buff, 12, 0);
+    exit_status += _check_response(s2, 10, 5, 5);
+    /* Now finish the last request */
+    _request(buff, 3, 30, 2);
+    send(s, &buff[7], 5, 0);
+    exit_status += _check_response(s, 1, 0, 4);
+    exit_status += _check_response(s, 2, 10, 20);
+    exit_status += _check_response(s, 3, 30, 2);
+
+    /* A length that is too long should close only that connection */
+    _request(buff, 4, 0, 1);
+    buff[4] = 0x10;
+    send(s, buff, 6, 0);
+    if(recv(s, buff, sizeof(buff), 0) != 0) {
+        fprintf(stderr, "Connection was not closed after a bad header\n");
+        exit_status++;
+    }
+    _request(buff, 11, 0, 1);
+    send(s2, buff, 12, 0);
+    exit_status += _check_response(s2, 11, 0, 1);
+
+    close(s);
+    close(s2);
+    dax_disconnect(ds);
+
+    kill(mod_pid, SIGINT);
+    kill(server_pid, SIGINT);
+    if( waitpid(mod_pid, &status, 0) != mod_pid )
+        fprintf(stderr, "Error killing modbus module\n");
+    if( waitpid(server_pid, &status, 0) != server_pid )
+        fprintf(stderr, "Error killing tag server\n");
+    if(exit_status == 0)
+        fprintf(stderr, "TEST PASSED\n");
+    else
+        fprintf(stderr, "***TEST FAILED***\n");
+    exit(exit_status);
+}